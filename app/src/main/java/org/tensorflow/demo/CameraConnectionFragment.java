@@ -403,11 +403,18 @@ public class CameraConnectionFragment extends Fragment {
     @Override
     protected void onPreExecute() {
       List<Classifier.Recognition> results = TensorFlowImageListener.getResults();
+      if (results == null || results.isEmpty()) {
+        cancel(false);
+        return;
+      }
       title = results.get(0).getTitle();
     }
 
     @Override
     protected Void doInBackground(Void... voids) {
+      if (isCancelled()) {
+        return null;
+      }
       Retrofit retrofit = new Retrofit.Builder()
               .baseUrl("http://drishti.grubx.in/objects/")
               .addConverterFactory(GsonConverterFactory.create())
@@ -596,6 +603,7 @@ public class CameraConnectionFragment extends Fragment {
         previewReader.close();
         previewReader = null;
       }
+      tfPreviewListener.close();
     } catch (final InterruptedException e) {
       throw new RuntimeException("Interrupted while trying to lock camera closing.", e);
     } finally {
@@ -804,4 +812,4 @@ public class CameraConnectionFragment extends Fragment {
               .create();
     }
   }
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -27,9 +27,13 @@ import android.util.Log;
 
 import org.tensorflow.demo.env.Logger;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.FloatBuffer;
+import java.nio.IntBuffer;
 import java.util.ArrayList;
 import java.util.List;
-import java.util.StringTokenizer;
+import java.util.concurrent.locks.ReentrantReadWriteLock;
 
 /**
  * JNI wrapper class for the Tensorflow native code.
@@ -44,8 +48,91 @@ class TensorFlowClassifier implements Classifier {
           "cat", "chair", "cow", "diningtable", "dog", "horse", "motorbike", "person",
           "pottedplant", "sheep", "sofa", "train","Screen"};
 
+  // Handle of the native model, 0 when none is loaded. Calls into native code
+  // hold the read lock, so that initialize can swap in a new model while other
+  // threads keep detecting, and the old one is only freed once nobody uses it.
+  private final ReentrantReadWriteLock handleLock = new ReentrantReadWriteLock();
+  private long nativeHandle;
+
+  // Geometry of the YOLO output grid of the loaded model; must match the
+  // values passed to initializeTensorFlow.
+  private int numClasses;
+  private int inputSize;
+  private int numCandidates;
+  private int candidateStride;
+
+  // Decoded candidate boxes written by the native code. Each candidate is
+  // [center x, center y, width, height, score per class], normalized to [0, 1].
+  private float[] candidates;
+
+  // Detections that survive non-max suppression, written by detectObjects as
+  // [class, score, center x, center y, width, height], normalized to [0, 1].
+  private static final int DETECTION_STRIDE = 6;
+  private static final int MAX_DETECTIONS = 10;
+  private static final float SCORE_THRESHOLD = 0.2f;
+  private static final float IOU_THRESHOLD = 0.5f;
+  private final float[] detections = new float[MAX_DETECTIONS * DETECTION_STRIDE];
+
+  // Direct buffer the native code writes detections to in place when running on camera planes.
+  private final FloatBuffer detectionBuffer = allocateDetectionBuffer();
+
+  // Objects followed between detector runs, written by trackYuvFrameDirect as
+  // [track id, class, score, center x, center y, width, height], normalized to [0, 1].
+  private static final int TRACK_STRIDE = 7;
+  private static final int MAX_TRACKED_OBJECTS = 10;
+  private final FloatBuffer trackBuffer =
+      ByteBuffer.allocateDirect(MAX_TRACKED_OBJECTS * TRACK_STRIDE * 4)
+          .order(ByteOrder.nativeOrder())
+          .asFloatBuffer();
+  private final float[] trackedObjects = new float[MAX_TRACKED_OBJECTS * TRACK_STRIDE];
+
+  /** Receives the detections of the frames submitted with {@link #submitYuvImage}. */
+  public interface PipelineListener {
+    /**
+     * Called on the native pipeline thread for every submitted frame that was not dropped, in
+     * submission order. Boxes are in input-size coordinates.
+     */
+    void onRecognitions(long frameId, List<Recognition> recognitions);
+  }
+
+  // Output staging of the asynchronous pipeline, only used on its worker thread.
+  private final FloatBuffer pipelineBuffer = allocateDetectionBuffer();
+  private final float[] pipelineDetections = new float[MAX_DETECTIONS * DETECTION_STRIDE];
+  private PipelineListener pipelineListener;
+  // Queue depth of the running pipeline, 0 when it is stopped.
+  private int pipelineQueueDepth;
+
+  // Step stats profiling settings, applied to every model loaded. Guarded by handleLock.
+  private int profileSampleInterval;
+  private int profileRingCapacity;
+
+  // Tracker settings, applied to every model loaded once set. Guarded by handleLock.
+  private boolean trackerConfigured;
+  private float trackerMatchIou;
+  private int trackerMaxMissedDetections;
+  private boolean trackerOpticalFlow;
+
+  // Scene change gating settings, applied to every model loaded. Guarded by handleLock.
+  private boolean sceneChangeGating;
+  private float sceneChangeBlockThreshold;
+  private float sceneChangeBlockFraction;
+  private int sceneChangeRefreshInterval;
+
+  // Latency target camera frames are kept within by switching model variants, 0 if none.
+  private int latencyTargetMs;
+
+  // Debug frame recording, carried over to models loaded later. Null directory when not recording.
+  private String recorderDirectory;
+  private int recorderSampleInterval;
+  private int recorderQueueCapacity;
+  private int recorderJpegQuality;
+  private int recorderRecordsPerFile;
+  private int recorderMaxFiles;
+
   // jni native methods.
-  public native int initializeTensorFlow(
+  private static native boolean hasQuantizedKernels();
+
+  private native long initializeTensorFlow(
       AssetManager assetManager,
       String model,
       String labels,
@@ -54,159 +141,759 @@ class TensorFlowClassifier implements Classifier {
       int imageMean,
       float imageStd,
       String inputName,
-      String outputName);
+      String outputName,
+      int gridSize,
+      int boxesPerCell,
+      int intraOpThreads,
+      int interOpThreads,
+      boolean usePerSessionThreads,
+      long cpuAffinityMask);
+
+  private native void releaseTensorFlow(long handle);
 
-  private native String classifyImageBmp(Bitmap bitmap);
+  private native int classifyImageBmp(long handle, Bitmap bitmap, float[] output);
 
-  private native String classifyImageRgb(int[] output, int width, int height);
+  private native int classifyImageRgb(
+      long handle, int[] input, int width, int height, float[] output);
+
+  private native int detectObjects(
+      long handle,
+      Bitmap bitmap,
+      int maxDetections,
+      float scoreThreshold,
+      float iouThreshold,
+      float[] output);
+
+  private native int detectObjectsYuv(
+      long handle,
+      byte[] y,
+      byte[] u,
+      byte[] v,
+      int width,
+      int height,
+      int yRowStride,
+      int uvRowStride,
+      int uvPixelStride,
+      int rotation,
+      int maxDetections,
+      float scoreThreshold,
+      float iouThreshold,
+      float[] output);
+
+  // Same as above, but operating in place on direct buffers.
+  private native int classifyImageRgbDirect(
+      long handle, IntBuffer input, int width, int height, FloatBuffer output);
+
+  private native int detectObjectsYuvDirect(
+      long handle,
+      ByteBuffer y,
+      ByteBuffer u,
+      ByteBuffer v,
+      int width,
+      int height,
+      int yRowStride,
+      int uvRowStride,
+      int uvPixelStride,
+      int rotation,
+      int maxDetections,
+      float scoreThreshold,
+      float iouThreshold,
+      FloatBuffer output);
+
+  private native void startInferencePipeline(
+      long handle,
+      int queueDepth,
+      int maxDetections,
+      float scoreThreshold,
+      float iouThreshold,
+      FloatBuffer output);
+
+  private native void stopInferencePipeline(long handle);
+
+  private native long submitYuvFrameDirect(
+      long handle,
+      ByteBuffer y,
+      ByteBuffer u,
+      ByteBuffer v,
+      int width,
+      int height,
+      int yRowStride,
+      int uvRowStride,
+      int uvPixelStride,
+      int rotation);
+
+  private native int trackYuvFrameDirect(
+      long handle,
+      ByteBuffer y,
+      ByteBuffer u,
+      ByteBuffer v,
+      int width,
+      int height,
+      int yRowStride,
+      int uvRowStride,
+      int uvPixelStride,
+      int rotation,
+      int maxObjects,
+      FloatBuffer output);
+
+  private native void setTrackerConfig(
+      long handle, float matchIou, int maxMissedDetections, boolean opticalFlow);
+
+  private native void setProfiling(long handle, int sampleInterval, int ringCapacity);
+
+  private native int flushProfile(long handle, String directory);
+
+  private native String getProfileSummary(long handle);
+
+  private native void setSceneChangeGating(
+      long handle,
+      boolean enabled,
+      float blockThreshold,
+      float changedBlockFraction,
+      int refreshInterval);
+
+  private native long[] getSceneChangeStats(long handle);
+
+  private native boolean addModelVariant(
+      long handle,
+      AssetManager assetManager,
+      String model,
+      int inputSize,
+      int gridSize,
+      int boxesPerCell);
+
+  private native void setLatencyTarget(long handle, int targetMs);
+
+  private native int getActiveInputSize(long handle);
+
+  private native boolean startFrameRecorder(
+      long handle,
+      String directory,
+      int sampleInterval,
+      int queueCapacity,
+      int jpegQuality,
+      int recordsPerFile,
+      int maxFiles);
+
+  private native void stopFrameRecorder(long handle);
+
+  private native long[] getFrameRecorderStats(long handle);
 
   static {
     System.loadLibrary("tensorflow_demo");
   }
 
+  /** Returned by {@link #submitYuvImage} for frames skipped because the scene has not changed. */
+  public static final long FRAME_UNCHANGED = -2;
+
+  /** Value of {@code cpuAffinityMask} that selects the cores with the highest maximum frequency. */
+  public static final long AFFINITY_FASTEST_CORES = -1;
+
+  /** Loads a model with the default TensorFlow thread pools. */
+  public int initialize(
+      final AssetManager assetManager,
+      final String model,
+      final String labels,
+      final int numClasses,
+      final int inputSize,
+      final int imageMean,
+      final float imageStd,
+      final String inputName,
+      final String outputName,
+      final int gridSize,
+      final int boxesPerCell) {
+    return initialize(
+        assetManager, model, labels, numClasses, inputSize, imageMean, imageStd,
+        inputName, outputName, gridSize, boxesPerCell, 0, 0, false, 0);
+  }
+
+  /**
+   * Loads a model. Calling this again replaces the loaded model without interrupting other
+   * threads: the new model is loaded first, then swapped in, and the running pipeline, if any,
+   * moves over to it. If the new model cannot be loaded, the old one stays in use.
+   *
+   * <p>{@code intraOpThreads} threads parallelize a single op and {@code interOpThreads} threads
+   * run independent ops; 0 keeps the TensorFlow default. The intra-op pool is
+   * shared by the whole process and sized by the first model loaded. Bit i of
+   * {@code cpuAffinityMask} allows the session threads on CPU i; 0 leaves them unpinned.
+   *
+   * @return 0 on success, -1 if the model could not be loaded.
+   */
+  public int initialize(
+      final AssetManager assetManager,
+      final String model,
+      final String labels,
+      final int numClasses,
+      final int inputSize,
+      final int imageMean,
+      final float imageStd,
+      final String inputName,
+      final String outputName,
+      final int gridSize,
+      final int boxesPerCell,
+      final int intraOpThreads,
+      final int interOpThreads,
+      final boolean usePerSessionThreads,
+      final long cpuAffinityMask) {
+    // Loading takes a while, so it happens before the old model is locked out.
+    final long newHandle = initializeTensorFlow(
+        assetManager, model, labels, numClasses, inputSize, imageMean, imageStd,
+        inputName, outputName, gridSize, boxesPerCell, intraOpThreads, interOpThreads,
+        usePerSessionThreads, cpuAffinityMask);
+    if (newHandle == 0) {
+      Log.e(TAG, "Could not load " + model + ", keeping the current model.");
+      return -1;
+    }
+
+    final long oldHandle;
+    handleLock.writeLock().lock();
+    try {
+      oldHandle = nativeHandle;
+      // The pipeline shares its output staging with the old model, so that one is stopped first.
+      if (oldHandle != 0 && pipelineQueueDepth > 0) {
+        stopInferencePipeline(oldHandle);
+      }
+      nativeHandle = newHandle;
+      this.numClasses = numClasses;
+      this.inputSize = inputSize;
+      numCandidates = gridSize * gridSize * boxesPerCell;
+      candidateStride = 4 + numClasses;
+      candidates = new float[numCandidates * candidateStride];
+      if (profileSampleInterval > 0) {
+        setProfiling(nativeHandle, profileSampleInterval, profileRingCapacity);
+      }
+      if (trackerConfigured) {
+        setTrackerConfig(
+            nativeHandle, trackerMatchIou, trackerMaxMissedDetections, trackerOpticalFlow);
+      }
+      if (sceneChangeGating) {
+        setSceneChangeGating(
+            nativeHandle, true, sceneChangeBlockThreshold, sceneChangeBlockFraction,
+            sceneChangeRefreshInterval);
+      }
+      if (latencyTargetMs > 0) {
+        setLatencyTarget(nativeHandle, latencyTargetMs);
+      }
+      if (recorderDirectory != null) {
+        startFrameRecorder(
+            nativeHandle, recorderDirectory, recorderSampleInterval, recorderQueueCapacity,
+            recorderJpegQuality, recorderRecordsPerFile, recorderMaxFiles);
+      }
+      if (pipelineQueueDepth > 0) {
+        startInferencePipeline(
+            nativeHandle, pipelineQueueDepth, MAX_DETECTIONS, SCORE_THRESHOLD, IOU_THRESHOLD,
+            pipelineBuffer);
+      }
+    } finally {
+      handleLock.writeLock().unlock();
+    }
+
+    if (oldHandle != 0) {
+      releaseTensorFlow(oldHandle);
+    }
+    return 0;
+  }
+
+  // Returns the handle of the loaded model. Requires the read or write lock.
+  private long checkedHandle() {
+    if (nativeHandle == 0) {
+      throw new IllegalStateException("No model has been loaded.");
+    }
+    return nativeHandle;
+  }
+
   @Override
   public List<Recognition> recognizeImage(final Bitmap bitmap) {
     // Log this method so that it can be analyzed with systrace.
     Trace.beginSection("Recognize");
-    final ArrayList<Recognition> recognitions = new ArrayList<Recognition>();
-    ArrayList<Float> temp_array = new ArrayList<Float>();
-    float[][][] class_probs = new float[7][7][20];
-    float[][][] scales = new float[7][7][2];
-    float[][][][] boxes = new float[7][7][2][4];
+    handleLock.readLock().lock();
+    try {
+      synchronized (detections) {
+        final int count = detectObjects(
+            checkedHandle(), bitmap, MAX_DETECTIONS, SCORE_THRESHOLD, IOU_THRESHOLD, detections);
+        return toRecognitions(detections, count, bitmap.getWidth(), bitmap.getHeight());
+      }
+    } finally {
+      handleLock.readLock().unlock();
+      Trace.endSection();
+    }
+  }
 
-    final int w_bitmap = bitmap.getWidth();
-    final int h_bitmap = bitmap.getHeight();
+  /**
+   * Runs detection directly on a YUV 4:2:0 camera frame. The center square of the frame is
+   * rotated clockwise by {@code rotation} degrees and scaled to the model input size in native
+   * code, so the returned boxes are in input-size coordinates.
+   */
+  public List<Recognition> recognizeYuvImage(
+      final byte[] y,
+      final byte[] u,
+      final byte[] v,
+      final int width,
+      final int height,
+      final int yRowStride,
+      final int uvRowStride,
+      final int uvPixelStride,
+      final int rotation) {
+    Trace.beginSection("Recognize");
+    handleLock.readLock().lock();
+    try {
+      synchronized (detections) {
+        final int count = detectObjectsYuv(
+            checkedHandle(), y, u, v, width, height, yRowStride, uvRowStride, uvPixelStride,
+            rotation, MAX_DETECTIONS, SCORE_THRESHOLD, IOU_THRESHOLD, detections);
+        return toRecognitions(detections, count, inputSize, inputSize);
+      }
+    } finally {
+      handleLock.readLock().unlock();
+      Trace.endSection();
+    }
+  }
 
-    final float threshold = 0;
+  /**
+   * Same as {@link #recognizeYuvImage(byte[], byte[], byte[], int, int, int, int, int, int)},
+   * but reads the frame in place from the direct buffers of the planes of an
+   * {@link android.media.Image}, so the frame is never copied onto the Java heap. The image
+   * must stay open until this returns.
+   */
+  public List<Recognition> recognizeYuvImage(
+      final ByteBuffer y,
+      final ByteBuffer u,
+      final ByteBuffer v,
+      final int width,
+      final int height,
+      final int yRowStride,
+      final int uvRowStride,
+      final int uvPixelStride,
+      final int rotation) {
+    Trace.beginSection("Recognize");
+    handleLock.readLock().lock();
+    try {
+      synchronized (detections) {
+        final int count = detectObjectsYuvDirect(
+            checkedHandle(), y, u, v, width, height, yRowStride, uvRowStride, uvPixelStride,
+            rotation, MAX_DETECTIONS, SCORE_THRESHOLD, IOU_THRESHOLD, detectionBuffer);
+        detectionBuffer.rewind();
+        detectionBuffer.get(detections, 0, count * DETECTION_STRIDE);
+        return toRecognitions(detections, count, inputSize, inputSize);
+      }
+    } finally {
+      handleLock.readLock().unlock();
+      Trace.endSection();
+    }
+  }
 
-    Log.i(TAG, "Parsing");
-    final String result = classifyImageBmp(bitmap);
-    final StringTokenizer st = new StringTokenizer(result);
-    assert (!st.hasMoreTokens());
+  /**
+   * Starts detecting asynchronously on the frames passed to {@link #submitYuvImage}. Converting
+   * a frame then overlaps with running the model on the previous one. Up to {@code queueDepth}
+   * converted frames wait for the model; when a new frame arrives at a full queue, the oldest
+   * waiting frame is dropped so that results never lag far behind the camera. The pipeline keeps
+   * running across model swaps.
+   */
+  public void startPipeline(final int queueDepth, final PipelineListener listener) {
+    handleLock.writeLock().lock();
+    try {
+      pipelineListener = listener;
+      pipelineQueueDepth = queueDepth;
+      startInferencePipeline(
+          checkedHandle(), queueDepth, MAX_DETECTIONS, SCORE_THRESHOLD, IOU_THRESHOLD,
+          pipelineBuffer);
+    } finally {
+      handleLock.writeLock().unlock();
+    }
+  }
 
-    // Get all of the output and put it into an linear array.
-    for (int i = 0; i < 1470; i++) {
-      final float token = Float.parseFloat(st.nextToken());
-      temp_array.add(token);
+  /** Stops the pipeline, waiting for the frame currently being run. */
+  public void stopPipeline() {
+    handleLock.writeLock().lock();
+    try {
+      pipelineQueueDepth = 0;
+      if (nativeHandle != 0) {
+        stopInferencePipeline(nativeHandle);
+      }
+    } finally {
+      handleLock.writeLock().unlock();
+    }
+  }
 
+  /**
+   * Converts a YUV 4:2:0 camera frame, read in place from the direct buffers of its planes, and
+   * queues it for the pipeline. The image can be closed as soon as this returns.
+   *
+   * @return The id of the frame, as passed to {@link PipelineListener#onRecognitions}, -1 if the
+   *     pipeline is not running, or {@link #FRAME_UNCHANGED} if the frame was skipped by scene
+   *     change gating, in which case the last recognitions delivered still apply.
+   */
+  public long submitYuvImage(
+      final ByteBuffer y,
+      final ByteBuffer u,
+      final ByteBuffer v,
+      final int width,
+      final int height,
+      final int yRowStride,
+      final int uvRowStride,
+      final int uvPixelStride,
+      final int rotation) {
+    Trace.beginSection("SubmitFrame");
+    handleLock.readLock().lock();
+    try {
+      return submitYuvFrameDirect(
+          checkedHandle(), y, u, v, width, height, yRowStride, uvRowStride, uvPixelStride,
+          rotation);
+    } finally {
+      handleLock.readLock().unlock();
+      Trace.endSection();
     }
+  }
 
-    // Convert the linear array to the output tensor (7x7x30)
-    int counter = 0;
-    // Corresponds to class probs
-    for (int i = 0; i < 7; i++) {
-      for (int j = 0; j < 7; j++) {
-        for (int k = 0; k < 20; k++) {
-          class_probs[i][j][k] = temp_array.get(counter);
-          counter++;
+  /**
+   * Follows the objects found by {@link #recognizeYuvImage} and the pipeline to a camera frame,
+   * read in place from the direct buffers of its planes. This is much cheaper than running the
+   * model, so it can be called for every frame to keep boxes moving between detector runs. The
+   * id of each recognition stays the same for as long as the object is followed.
+   *
+   * @return The tracked objects in input-size coordinates, by decreasing score.
+   */
+  public List<Recognition> trackYuvImage(
+      final ByteBuffer y,
+      final ByteBuffer u,
+      final ByteBuffer v,
+      final int width,
+      final int height,
+      final int yRowStride,
+      final int uvRowStride,
+      final int uvPixelStride,
+      final int rotation) {
+    Trace.beginSection("Track");
+    handleLock.readLock().lock();
+    try {
+      synchronized (trackedObjects) {
+        final int count = trackYuvFrameDirect(
+            checkedHandle(), y, u, v, width, height, yRowStride, uvRowStride, uvPixelStride,
+            rotation, MAX_TRACKED_OBJECTS, trackBuffer);
+        trackBuffer.rewind();
+        trackBuffer.get(trackedObjects, 0, count * TRACK_STRIDE);
+        final ArrayList<Recognition> recognitions = new ArrayList<Recognition>();
+        for (int i = 0; i < count; i++) {
+          final int offset = i * TRACK_STRIDE;
+          // Same box convention as toRecognitions.
+          final RectF boundingBox = new RectF(
+              trackedObjects[offset + 3] * inputSize,
+              trackedObjects[offset + 4] * inputSize,
+              trackedObjects[offset + 5] * inputSize / 2,
+              trackedObjects[offset + 6] * inputSize / 2);
+          recognitions.add(new Recognition(
+              Integer.toString((int) trackedObjects[offset]),
+              class_labels[(int) trackedObjects[offset + 1]],
+              trackedObjects[offset + 2],
+              boundingBox));
         }
+        return recognitions;
       }
+    } finally {
+      handleLock.readLock().unlock();
+      Trace.endSection();
     }
-    // Corresponds to scales
-    for (int i = 0; i < 7; i++) {
-      for (int j = 0; j < 7; j++) {
-        for (int k = 0; k < 2; k++) {
-          scales[i][j][k] = temp_array.get(counter);
-          counter++;
-        }
+  }
+
+  /**
+   * Sets how detections are associated with tracks and whether frames refine the tracks by
+   * matching luma patches, and drops all tracks. A detection continues a track of the same class
+   * when their boxes overlap by more than {@code matchIou}; a track is dropped after
+   * {@code maxMissedDetections} detector runs in a row without a match. The setting carries over
+   * to models loaded later.
+   */
+  public void setTrackerConfig(
+      final float matchIou, final int maxMissedDetections, final boolean opticalFlow) {
+    handleLock.writeLock().lock();
+    try {
+      trackerConfigured = true;
+      trackerMatchIou = matchIou;
+      trackerMaxMissedDetections = maxMissedDetections;
+      trackerOpticalFlow = opticalFlow;
+      if (nativeHandle != 0) {
+        setTrackerConfig(nativeHandle, matchIou, maxMissedDetections, opticalFlow);
       }
+    } finally {
+      handleLock.writeLock().unlock();
     }
-    // Corresponds to boxes
-    for (int i = 0; i < 7; i++) {
-      for (int j = 0; j < 7; j++) {
-        for (int k = 0; k < 2; k++) {
-          for (int l = 0; l < 4; l++) {
-            boxes[i][j][k][l] = temp_array.get(counter);
-            counter++;
-          }
-        }
+  }
+
+  /**
+   * Traces one in every {@code sampleInterval} runs of the model, keeping the step stats of the
+   * last {@code ringCapacity} traced runs in memory until {@link #flushProfile}. A
+   * {@code sampleInterval} of 0 disables profiling, which is the default. The setting carries over
+   * to models loaded later.
+   */
+  public void setProfiling(final int sampleInterval, final int ringCapacity) {
+    handleLock.writeLock().lock();
+    try {
+      profileSampleInterval = sampleInterval;
+      profileRingCapacity = ringCapacity;
+      if (nativeHandle != 0) {
+        setProfiling(nativeHandle, sampleInterval, ringCapacity);
       }
+    } finally {
+      handleLock.writeLock().unlock();
     }
+  }
 
-    // Add offset.
-    for (int i = 0; i < 7; i++) {
-      for (int j = 0; j < 7; j++) {
-        for (int k = 0; k < 2; k++) {
-          boxes[i][j][k][0] += j;
-          boxes[i][j][k][0] = boxes[i][j][k][0] * w_bitmap / 7;
-        }
-      }
+  /**
+   * Writes the step stats collected so far to {@code directory} in the background, along with a
+   * summary.txt of per-node timings.
+   *
+   * @return The number of traced runs being written.
+   */
+  public int flushProfile(final String directory) {
+    handleLock.readLock().lock();
+    try {
+      return flushProfile(checkedHandle(), directory);
+    } finally {
+      handleLock.readLock().unlock();
     }
-    for (int i = 0; i < 7; i++) {
-      for (int j = 0; j < 7; j++) {
-        for (int k = 0; k < 2; k++) {
-          boxes[i][j][k][1] += i;
-          boxes[i][j][k][1] = boxes[i][j][k][1] * h_bitmap / 7;
-        }
+  }
+
+  /** Returns per-node timings aggregated over the traced runs of the current model. */
+  public String getProfileSummary() {
+    handleLock.readLock().lock();
+    try {
+      return getProfileSummary(checkedHandle());
+    } finally {
+      handleLock.readLock().unlock();
+    }
+  }
+
+  /**
+   * Skips running the model on YUV frames that hardly differ from the last frame it ran on. The
+   * center square of the luma plane is compared block by block; a block has changed when its mean
+   * absolute difference exceeds {@code blockThreshold} (out of 255), and the scene has changed
+   * when more than {@code changedBlockFraction} of the blocks have. The model still runs at least
+   * once every {@code refreshInterval} frames, unless that is 0. Skipped frames reuse the last
+   * detections in {@link #recognizeYuvImage}, and are not delivered by the pipeline at all. The
+   * setting carries over to models loaded later.
+   */
+  public void setSceneChangeGating(
+      final boolean enabled,
+      final float blockThreshold,
+      final float changedBlockFraction,
+      final int refreshInterval) {
+    handleLock.writeLock().lock();
+    try {
+      sceneChangeGating = enabled;
+      sceneChangeBlockThreshold = blockThreshold;
+      sceneChangeBlockFraction = changedBlockFraction;
+      sceneChangeRefreshInterval = refreshInterval;
+      if (nativeHandle != 0) {
+        setSceneChangeGating(
+            nativeHandle, enabled, blockThreshold, changedBlockFraction, refreshInterval);
       }
+    } finally {
+      handleLock.writeLock().unlock();
     }
-    for (int i = 0; i < 7; i++) {
-      for (int j = 0; j < 7; j++) {
-        for (int k = 0; k < 2; k++) {
-          boxes[i][j][k][2] = boxes[i][j][k][2] * boxes[i][j][k][2] * w_bitmap;
-          boxes[i][j][k][3] = boxes[i][j][k][3] * boxes[i][j][k][3] * h_bitmap;
-        }
+  }
+
+  /**
+   * Returns the number of frames checked for a scene change, the number of model runs saved by
+   * skipping them, and the number of runs forced by the refresh interval.
+   */
+  public long[] getSceneChangeStats() {
+    handleLock.readLock().lock();
+    try {
+      return getSceneChangeStats(checkedHandle());
+    } finally {
+      handleLock.readLock().unlock();
+    }
+  }
+
+  /**
+   * Loads a cheaper variant of the current model, e.g. the same detector exported for a smaller
+   * {@code inputSize}, which YUV frames are switched to when the model runs over the latency
+   * target. Variants must be added from the most accurate to the cheapest; they belong to the
+   * current model and are dropped when another one is loaded. Recognitions keep the coordinates
+   * of the model input size whichever variant produced them.
+   *
+   * @return Whether the variant could be loaded.
+   */
+  public boolean addModelVariant(
+      final AssetManager assetManager,
+      final String model,
+      final int inputSize,
+      final int gridSize,
+      final int boxesPerCell) {
+    handleLock.writeLock().lock();
+    try {
+      final long handle = checkedHandle();
+      // The pipeline allocates its buffers for the variants it starts with.
+      if (pipelineQueueDepth > 0) {
+        stopInferencePipeline(handle);
+      }
+      final boolean added =
+          addModelVariant(handle, assetManager, model, inputSize, gridSize, boxesPerCell);
+      if (pipelineQueueDepth > 0) {
+        startInferencePipeline(
+            handle, pipelineQueueDepth, MAX_DETECTIONS, SCORE_THRESHOLD, IOU_THRESHOLD,
+            pipelineBuffer);
       }
+      return added;
+    } finally {
+      handleLock.writeLock().unlock();
     }
+  }
 
-    float[][][][] probs = new float[7][7][2][20];
-    // Combine conditional class probabilities and objectness probability.
-    for (int i = 0; i < 2; i++) {
-      for (int j = 0; j < 20; j++) {
-        for (int l = 0; l < 7; l++) {
-          for (int m = 0; m < 7; m++) {
-            probs[l][m][i][j] = class_probs[l][m][j] * scales[l][m][i];
-          }
-        }
+  /**
+   * Switches YUV frames between the model and its variants so that running the model takes at
+   * most {@code targetMs} milliseconds, preferring the most accurate variant that fits. 0, the
+   * default, always runs the model itself. The setting carries over to models loaded later.
+   */
+  public void setLatencyTarget(final int targetMs) {
+    handleLock.writeLock().lock();
+    try {
+      latencyTargetMs = targetMs;
+      if (nativeHandle != 0) {
+        setLatencyTarget(nativeHandle, targetMs);
       }
+    } finally {
+      handleLock.writeLock().unlock();
     }
+  }
 
-    // I will try to output the best bounding box and class.
-    // First get best probability
-    float highest_prob = 0;
-    int hp_i = 0;
-    int hp_j = 0;
-    int hp_l = 0;
-    int hp_m = 0;
-    for (int i = 0; i < 2; i++) {
-      for (int j = 0; j < 20; j++) {
-        for (int l = 0; l < 7; l++) {
-          for (int m = 0; m < 7; m++) {
-            if (probs[l][m][i][j] >= highest_prob) {
-              highest_prob = probs[l][m][i][j];
-              hp_i = i;
-              hp_j = j;
-              hp_l = l;
-              hp_m = m;
-            }
-          }
-        }
+  /**
+   * Returns whether the native library was built with the eight bit kernels that models written by
+   * jni-build/quantize_model.sh need, i.e. with ENABLE_QUANTIZED_OPS set.
+   */
+  public static boolean supportsQuantizedModels() {
+    return hasQuantizedKernels();
+  }
+
+  /** Returns the input size of the variant YUV frames currently run on. */
+  public int getActiveInputSize() {
+    handleLock.readLock().lock();
+    try {
+      return getActiveInputSize(checkedHandle());
+    } finally {
+      handleLock.readLock().unlock();
+    }
+  }
+
+  /**
+   * Records one in every {@code sampleInterval} YUV frames the model runs on, as the model saw
+   * them, with their detections, for debugging in the field. Recording a frame only copies the
+   * model input; a native background thread encodes it as JPEG and appends it, as a tf.Example, to
+   * TFRecord files in {@code directory}. A new file is started every {@code recordsPerFile}
+   * records, and only the last {@code maxFiles} files are kept. Frames are dropped while
+   * {@code queueCapacity} are waiting to be encoded. The setting carries over to models loaded
+   * later.
+   *
+   * @return Whether recording started.
+   */
+  public boolean startFrameRecorder(
+      final String directory,
+      final int sampleInterval,
+      final int queueCapacity,
+      final int jpegQuality,
+      final int recordsPerFile,
+      final int maxFiles) {
+    handleLock.writeLock().lock();
+    try {
+      final boolean started =
+          startFrameRecorder(
+              checkedHandle(), directory, sampleInterval, queueCapacity, jpegQuality,
+              recordsPerFile, maxFiles);
+      recorderDirectory = started ? directory : null;
+      recorderSampleInterval = sampleInterval;
+      recorderQueueCapacity = queueCapacity;
+      recorderJpegQuality = jpegQuality;
+      recorderRecordsPerFile = recordsPerFile;
+      recorderMaxFiles = maxFiles;
+      return started;
+    } finally {
+      handleLock.writeLock().unlock();
+    }
+  }
+
+  /** Stops recording, waiting for the frames still being encoded. */
+  public void stopFrameRecorder() {
+    handleLock.writeLock().lock();
+    try {
+      recorderDirectory = null;
+      if (nativeHandle != 0) {
+        stopFrameRecorder(nativeHandle);
       }
+    } finally {
+      handleLock.writeLock().unlock();
     }
+  }
 
-    // Get x, y, width, height. These will be processed and drawn in BoundingBoxView.
-    float bounding_x = boxes[hp_l][hp_m][hp_i][0];
-    float bounding_y = boxes[hp_l][hp_m][hp_i][1];
-    float box_width = boxes[hp_l][hp_m][hp_i][2] / 2;
-    float box_height = boxes[hp_l][hp_m][hp_i][3] / 2;
+  /**
+   * Returns the number of frames recorded, the number dropped because the encoder was behind, and
+   * the number of bytes written since recording started.
+   */
+  public long[] getFrameRecorderStats() {
+    handleLock.readLock().lock();
+    try {
+      return getFrameRecorderStats(checkedHandle());
+    } finally {
+      handleLock.readLock().unlock();
+    }
+  }
 
-    // Now get the class number.
-    int predicted_class = hp_j;
+  // Called from native code on the pipeline thread once a frame has been run. This must not take
+  // handleLock: the pipeline is stopped under the write lock, which waits for this to return.
+  @SuppressWarnings("unused")
+  private void onPipelineResult(final long frameId, final int count) {
+    pipelineBuffer.rewind();
+    pipelineBuffer.get(pipelineDetections, 0, count * DETECTION_STRIDE);
+    pipelineListener.onRecognitions(
+        frameId, toRecognitions(pipelineDetections, count, inputSize, inputSize));
+  }
 
-    // Now log this prediction.
-    String prediction_string = Integer.toString(predicted_class) + " | x1: " + Float.toString(bounding_x) +
-            " y1: " + Float.toString(bounding_y) + " width: " + Float.toString(box_width) +
-            " height: " + Float.toString(box_height);
-    Log.i("Java prediction --- ", prediction_string);
+  private static FloatBuffer allocateDetectionBuffer() {
+    return ByteBuffer.allocateDirect(MAX_DETECTIONS * DETECTION_STRIDE * 4)
+        .order(ByteOrder.nativeOrder())
+        .asFloatBuffer();
+  }
 
-    // Add recognition to recognition list.
-    final RectF boundingBox = new RectF(bounding_x, bounding_y, box_width, box_height);
-    recognitions.add(new Recognition("Prediction ", class_labels[predicted_class], highest_prob, boundingBox));
-    Trace.endSection();
+  // Converts the first count rows of detections, ordered by decreasing score, to recognitions
+  // in the coordinates of a w_image x h_image input.
+  private List<Recognition> toRecognitions(
+      final float[] detections, final int count, final int w_image, final int h_image) {
+    final ArrayList<Recognition> recognitions = new ArrayList<Recognition>();
+    for (int i = 0; i < count; i++) {
+      final int offset = i * DETECTION_STRIDE;
+      final int predicted_class = (int) detections[offset];
+      final float score = detections[offset + 1];
+
+      // Get x, y, width, height. These will be processed and drawn in BoundingBoxView.
+      float bounding_x = detections[offset + 2] * w_image;
+      float bounding_y = detections[offset + 3] * h_image;
+      float box_width = detections[offset + 4] * w_image / 2;
+      float box_height = detections[offset + 5] * h_image / 2;
+
+      // Now log this prediction.
+      String prediction_string = Integer.toString(predicted_class) + " | x1: " + Float.toString(bounding_x) +
+              " y1: " + Float.toString(bounding_y) + " width: " + Float.toString(box_width) +
+              " height: " + Float.toString(box_height);
+      Log.i("Java prediction --- ", prediction_string);
+
+      // Add recognition to recognition list.
+      final RectF boundingBox = new RectF(bounding_x, bounding_y, box_width, box_height);
+      recognitions.add(new Recognition("Prediction ", class_labels[predicted_class], score, boundingBox));
+    }
     return recognitions;
   }
 
+  /** Stops the pipeline and frees the loaded model. */
   @Override
-  public void close() {}
+  public void close() {
+    handleLock.writeLock().lock();
+    try {
+      pipelineQueueDepth = 0;
+      if (nativeHandle != 0) {
+        releaseTensorFlow(nativeHandle);
+        nativeHandle = 0;
+      }
+    } finally {
+      handleLock.writeLock().unlock();
+    }
+  }
 
 }
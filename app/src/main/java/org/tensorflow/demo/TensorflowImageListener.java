@@ -22,15 +22,12 @@ package org.tensorflow.demo;
 import android.content.Context;
 import android.content.Intent;
 import android.content.res.AssetManager;
-import android.graphics.Bitmap;
-import android.graphics.Bitmap.Config;
-import android.graphics.Canvas;
-import android.graphics.Matrix;
 import android.media.Image;
 import android.media.Image.Plane;
 import android.media.ImageReader;
 import android.media.ImageReader.OnImageAvailableListener;
 import android.os.Build;
+import android.os.Environment;
 import android.os.Handler;
 import android.os.Looper;
 import android.os.Trace;
@@ -39,11 +36,16 @@ import android.speech.tts.TextToSpeech;
 
 import junit.framework.Assert;
 
-import org.tensorflow.demo.env.ImageUtils;
 import org.tensorflow.demo.env.Logger;
 
+import java.io.File;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.util.Arrays;
+import java.util.HashSet;
 import java.util.List;
 import java.util.Locale;
+import java.util.Set;
 
 /**
  * Class that takes in preview frames and converts the image to Bitmaps to process with Tensorflow.
@@ -52,7 +54,18 @@ class TensorFlowImageListener implements OnImageAvailableListener {
   private static final Logger LOGGER = new Logger();
 
   static Context context;
-  private static final boolean SAVE_PREVIEW_BITMAP = true;
+  // For examining the actual TF input in the field: one in every DEBUG_FRAME_SAMPLE_INTERVAL frames
+  // the model runs on is saved with its detections to TFRecord files under DEBUG_FRAME_DIRECTORY
+  // (relative to external storage). Frames are encoded natively on a background thread, so this
+  // costs the camera thread a copy of the model input per recorded frame. The native library must
+  // be built with ndk-build ENABLE_FRAME_RECORDER=1 for the JPEG encoder.
+  private static final boolean RECORD_DEBUG_FRAMES = false;
+  private static final String DEBUG_FRAME_DIRECTORY = "tensorflow/frames";
+  private static final int DEBUG_FRAME_SAMPLE_INTERVAL = 30;
+  private static final int DEBUG_FRAME_QUEUE_CAPACITY = 2;
+  private static final int DEBUG_FRAME_JPEG_QUALITY = 90;
+  private static final int DEBUG_FRAMES_PER_FILE = 100;
+  private static final int DEBUG_FRAME_MAX_FILES = 10;
 
   // These are the settings for the original v1 Inception model. If you want to
   // use a model that's been produced from the TensorFlow for Poets codelab,
@@ -60,29 +73,67 @@ class TensorFlowImageListener implements OnImageAvailableListener {
   // INPUT_NAME = "Mul:0", and OUTPUT_NAME = "final_result:0".
   // You'll also need to update the MODEL_FILE and LABEL_FILE paths to point to
   // the ones you produced.
-  private static final int NUM_CLASSES = 1470;
+  private static final int NUM_CLASSES = 20;
   private static final int INPUT_SIZE = 448;
   private static final int IMAGE_MEAN = 128;
   private static final float IMAGE_STD = 128;
   private static final String INPUT_NAME = "Placeholder";
   private static final String OUTPUT_NAME = "19_fc";
 
+  // Geometry of the YOLO v1 output layer: a GRID_SIZE x GRID_SIZE grid with
+  // BOXES_PER_CELL boxes predicted per cell.
+  private static final int GRID_SIZE = 7;
+  private static final int BOXES_PER_CELL = 2;
+
+  // Number of converted frames that may wait for the model. Converting a frame overlaps with
+  // running the model on the previous one; when frames arrive faster than the model runs, the
+  // oldest waiting frame is dropped, so results lag the camera by at most this many frames.
+  private static final int PIPELINE_QUEUE_DEPTH = 1;
+
+  // Whether boxes are moved on every camera frame by the native tracker, rather than only updated
+  // when the detector delivers a result. Tracking is cheap enough to run at the camera rate.
+  private static final boolean USE_TRACKER = true;
+
+  // While the camera looks at a static scene, the last detections are kept instead of running the
+  // model on every frame. A block of the luma plane has changed when its samples differ by more
+  // than SCENE_CHANGE_BLOCK_THRESHOLD on average; the model runs when more than
+  // SCENE_CHANGE_BLOCK_FRACTION of the blocks have changed, and at least every
+  // SCENE_CHANGE_REFRESH_INTERVAL frames.
+  private static final boolean SCENE_CHANGE_GATING = true;
+  private static final float SCENE_CHANGE_BLOCK_THRESHOLD = 10.0f;
+  private static final float SCENE_CHANGE_BLOCK_FRACTION = 0.02f;
+  private static final int SCENE_CHANGE_REFRESH_INTERVAL = 15;
+
   private static final String MODEL_FILE = "file:///android_asset/android_graph.pb";
+
+  // An eight bit copy of MODEL_FILE written by jni-build/quantize_model.sh. It is roughly a quarter
+  // of the size and runs on the quantized kernels, which are only built with
+  // ndk-build ENABLE_QUANTIZED_OPS=1; the float model is loaded if it is missing or the kernels
+  // were not built.
+  private static final boolean USE_QUANTIZED_MODEL = false;
+  private static final String QUANTIZED_MODEL_FILE =
+          "file:///android_asset/android_graph_quantized.pb";
   private static final String LABEL_FILE =
           "file:///android_asset/label_strings.txt";
 
+  // Exports of the model for smaller inputs, most accurate first, which camera frames are switched
+  // to while running the model takes longer than LATENCY_TARGET_MS. The fully connected head keeps
+  // the GRID_SIZE output grid at every input size. Only the variants found in the assets are
+  // loaded; without any, the latency target is not set and the model always runs at INPUT_SIZE.
+  private static final int LATENCY_TARGET_MS = 250;
+  private static final String ASSET_PREFIX = "file:///android_asset/";
+  private static final String[] VARIANT_MODEL_FILES = {
+          "file:///android_asset/android_graph_320.pb", "file:///android_asset/android_graph_224.pb"
+  };
+  private static final int[] VARIANT_INPUT_SIZES = {320, 224};
+
   private Integer sensorOrientation;
 
   private final TensorFlowClassifier tensorflow = new TensorFlowClassifier();
 
   private int previewWidth = 0;
   private int previewHeight = 0;
-  private byte[][] yuvBytes;
-  private int[] rgbBytes = null;
-  private Bitmap rgbFrameBitmap = null;
-  private Bitmap croppedBitmap = null;
 
-  private boolean computing = false;
   private boolean readyForNextImage = true;
   private Handler handler;
 
@@ -91,6 +142,16 @@ class TensorFlowImageListener implements OnImageAvailableListener {
 
   static List<Classifier.Recognition> results;
 
+  // Returns the names of the files at the root of the assets.
+  private static Set<String> listAssets(final AssetManager assetManager) {
+    try {
+      return new HashSet<String>(Arrays.asList(assetManager.list("")));
+    } catch (final IOException e) {
+      LOGGER.e(e, "Could not list the assets");
+      return new HashSet<String>();
+    }
+  }
+
   public void initialize(
           final AssetManager assetManager,
           final RecognitionScoreView scoreView,
@@ -98,42 +159,88 @@ class TensorFlowImageListener implements OnImageAvailableListener {
           final Handler handler,
           final Integer sensorOrientation) {
     Assert.assertNotNull(sensorOrientation);
-    tensorflow.initializeTensorFlow(
-            assetManager, MODEL_FILE, LABEL_FILE, NUM_CLASSES, INPUT_SIZE, IMAGE_MEAN, IMAGE_STD,
-            INPUT_NAME, OUTPUT_NAME);
+    final boolean quantizedLoaded =
+            USE_QUANTIZED_MODEL
+                && TensorFlowClassifier.supportsQuantizedModels()
+                && tensorflow.initialize(
+                        assetManager, QUANTIZED_MODEL_FILE, LABEL_FILE, NUM_CLASSES, INPUT_SIZE,
+                        IMAGE_MEAN, IMAGE_STD, INPUT_NAME, OUTPUT_NAME, GRID_SIZE, BOXES_PER_CELL)
+                    == 0;
+    if (!quantizedLoaded) {
+      tensorflow.initialize(
+              assetManager, MODEL_FILE, LABEL_FILE, NUM_CLASSES, INPUT_SIZE, IMAGE_MEAN, IMAGE_STD,
+              INPUT_NAME, OUTPUT_NAME, GRID_SIZE, BOXES_PER_CELL);
+    }
+    tensorflow.setSceneChangeGating(
+            SCENE_CHANGE_GATING,
+            SCENE_CHANGE_BLOCK_THRESHOLD,
+            SCENE_CHANGE_BLOCK_FRACTION,
+            SCENE_CHANGE_REFRESH_INTERVAL);
+    final Set<String> assets = listAssets(assetManager);
+    boolean variantAdded = false;
+    for (int i = 0; i < VARIANT_MODEL_FILES.length; ++i) {
+      if (assets.contains(VARIANT_MODEL_FILES[i].substring(ASSET_PREFIX.length()))) {
+        variantAdded |=
+            tensorflow.addModelVariant(
+                assetManager, VARIANT_MODEL_FILES[i], VARIANT_INPUT_SIZES[i], GRID_SIZE,
+                BOXES_PER_CELL);
+      }
+    }
+    if (variantAdded) {
+      tensorflow.setLatencyTarget(LATENCY_TARGET_MS);
+    } else {
+      LOGGER.i("No model variants in the assets, always running at %d", INPUT_SIZE);
+    }
+    if (RECORD_DEBUG_FRAMES) {
+      final File directory =
+          new File(Environment.getExternalStorageDirectory(), DEBUG_FRAME_DIRECTORY);
+      if (!directory.mkdirs() && !directory.isDirectory()) {
+        LOGGER.w("Could not create %s", directory);
+      }
+      if (!tensorflow.startFrameRecorder(
+              directory.getAbsolutePath(),
+              DEBUG_FRAME_SAMPLE_INTERVAL,
+              DEBUG_FRAME_QUEUE_CAPACITY,
+              DEBUG_FRAME_JPEG_QUALITY,
+              DEBUG_FRAMES_PER_FILE,
+              DEBUG_FRAME_MAX_FILES)) {
+        LOGGER.w("Could not start recording frames to %s", directory);
+      }
+    }
     this.scoreView = scoreView;
     this.boundingView = boundingView;
     this.handler = handler;
-    this.sensorOrientation = sensorOrientation;
-  }
-
-  private void drawResizedBitmap(final Bitmap src, final Bitmap dst) {
-    Assert.assertEquals(dst.getWidth(), dst.getHeight());
-    final float minDim = Math.min(src.getWidth(), src.getHeight());
-
-    final Matrix matrix = new Matrix();
-
-    // We only want the center square out of the original rectangle.
-    final float translateX = -Math.max(0, (src.getWidth() - minDim) / 2);
-    final float translateY = -Math.max(0, (src.getHeight() - minDim) / 2);
-    matrix.preTranslate(translateX, translateY);
-
-    final float scaleFactor = dst.getHeight() / minDim;
-    matrix.postScale(scaleFactor, scaleFactor);
-
-    // Rotate around the center if necessary.
     // Nataniel: added rotation because image is rotated on my device (Pixel C tablet)
     // TODO: Find out if this is happenning in every device.
-    sensorOrientation = 90;
-    if (sensorOrientation != 0) {
-      matrix.postTranslate(-dst.getWidth() / 2.0f, -dst.getHeight() / 2.0f);
-      matrix.postRotate(sensorOrientation);
-      matrix.postTranslate(dst.getWidth() / 2.0f, dst.getHeight() / 2.0f);
-    }
-    //LOGGER.i("sensorOrientationImageListener" + sensorOrientation.toString());
+    this.sensorOrientation = 90;
+
+    tensorflow.startPipeline(
+            PIPELINE_QUEUE_DEPTH,
+            new TensorFlowClassifier.PipelineListener() {
+              @Override
+              public void onRecognitions(
+                      final long frameId, final List<Classifier.Recognition> recognitions) {
+                // With the tracker, results are shown for every frame by onImageAvailable.
+                if (USE_TRACKER) {
+                  return;
+                }
+                handler.post(
+                        new Runnable() {
+                          @Override
+                          public void run() {
+                            showResults(recognitions);
+                          }
+                        });
+              }
+            });
+  }
 
-    final Canvas canvas = new Canvas(dst);
-    canvas.drawBitmap(src, matrix, null);
+  /**
+   * Stops the inference pipeline and frees the model. Frames that have not been run yet are
+   * dropped.
+   */
+  public void close() {
+    tensorflow.close();
   }
 
   @Override
@@ -147,52 +254,64 @@ class TensorFlowImageListener implements OnImageAvailableListener {
       }
 
       // No mutex needed as this method is not reentrant.
-      if (computing || !readyForNextImage) {
+      if (!readyForNextImage) {
         image.close();
         return;
       }
       readyForNextImage = true;
-      computing = true;
 
       Trace.beginSection("imageAvailable");
 
       final Plane[] planes = image.getPlanes();
 
-      // Initialize the storage bitmaps once when the resolution is known.
+      // Log the resolution once it is known.
       if (previewWidth != image.getWidth() || previewHeight != image.getHeight()) {
         previewWidth = image.getWidth();
         previewHeight = image.getHeight();
 
         LOGGER.i("Initializing at size %dx%d", previewWidth, previewHeight);
-        rgbBytes = new int[previewWidth * previewHeight];
-        rgbFrameBitmap = Bitmap.createBitmap(previewWidth, previewHeight, Config.ARGB_8888);
-        croppedBitmap = Bitmap.createBitmap(INPUT_SIZE, INPUT_SIZE, Config.ARGB_8888);
-
-        yuvBytes = new byte[planes.length][];
-        for (int i = 0; i < planes.length; ++i) {
-          yuvBytes[i] = new byte[planes[i].getBuffer().capacity()];
-        }
       }
 
-      for (int i = 0; i < planes.length; ++i) {
-        planes[i].getBuffer().get(yuvBytes[i]);
-      }
+      // The plane buffers are direct, so the native code reads them in place while converting
+      // the frame for the pipeline.
+      final ByteBuffer yBuffer = planes[0].getBuffer();
+      final ByteBuffer uBuffer = planes[1].getBuffer();
+      final ByteBuffer vBuffer = planes[2].getBuffer();
 
       final int yRowStride = planes[0].getRowStride();
       final int uvRowStride = planes[1].getRowStride();
       final int uvPixelStride = planes[1].getPixelStride();
-      ImageUtils.convertYUV420ToARGB8888(
-              yuvBytes[0],
-              yuvBytes[1],
-              yuvBytes[2],
-              rgbBytes,
+
+      tensorflow.submitYuvImage(
+              yBuffer,
+              uBuffer,
+              vBuffer,
               previewWidth,
               previewHeight,
               yRowStride,
               uvRowStride,
               uvPixelStride,
-              false);
-
+              sensorOrientation);
+      if (USE_TRACKER) {
+        final List<Classifier.Recognition> tracked =
+            tensorflow.trackYuvImage(
+                yBuffer,
+                uBuffer,
+                vBuffer,
+                previewWidth,
+                previewHeight,
+                yRowStride,
+                uvRowStride,
+                uvPixelStride,
+                sensorOrientation);
+        handler.post(
+            new Runnable() {
+              @Override
+              public void run() {
+                showResults(tracked);
+              }
+            });
+      }
       image.close();
     } catch (final Exception e) {
       if (image != null) {
@@ -203,39 +322,25 @@ class TensorFlowImageListener implements OnImageAvailableListener {
       return;
     }
 
-    rgbFrameBitmap.setPixels(rgbBytes, 0, previewWidth, 0, 0, previewWidth, previewHeight);
-    drawResizedBitmap(rgbFrameBitmap, croppedBitmap);
-
-    // For examining the actual TF input.
-    if (SAVE_PREVIEW_BITMAP) {
-      ImageUtils.saveBitmap(croppedBitmap);
-    }
-
-    handler.post(
-            new Runnable() {
-              @Override
-              public void run() {
-                results = tensorflow.recognizeImage(croppedBitmap);
-
-                System.out.println("Resul Sanjadgsajhdg*****  "+results);
+    Trace.endSection();
+  }
 
-                LOGGER.v("%d results", results.size());
-                for (final Classifier.Recognition result : results) {
-                  LOGGER.v("Result: " + result.getTitle());
-                }
-                scoreView.setResults(results);
-                boundingView.setResults(results);
+  private void showResults(final List<Classifier.Recognition> recognitions) {
+    results = recognitions;
 
-                System.out.println("Object to search is : "+CameraActivity.getObjectToSearch());
-                if (results.get(0).getTitle().equals(CameraActivity.getObjectToSearch())){
-                  CameraConnectionFragment.objectFound();
-                }
-                CameraConnectionFragment.prevObj = TensorFlowImageListener.getResults().get(0).getTitle();
-                computing = false;
-              }
-            });
+    LOGGER.v("%d results", results.size());
+    for (final Classifier.Recognition result : results) {
+      LOGGER.v("Result: " + result.getTitle());
+    }
+    scoreView.setResults(results);
+    boundingView.setResults(results);
 
-    Trace.endSection();
+    if (!results.isEmpty()) {
+      if (results.get(0).getTitle().equals(CameraActivity.getObjectToSearch())){
+        CameraConnectionFragment.objectFound();
+      }
+      CameraConnectionFragment.prevObj = results.get(0).getTitle();
+    }
   }
 
   public static List<Classifier.Recognition> getResults(){
@@ -251,4 +356,4 @@ class TensorFlowImageListener implements OnImageAvailableListener {
   public static int getInputSize() {
     return INPUT_SIZE;
   }
-}
\ No newline at end of file
+}
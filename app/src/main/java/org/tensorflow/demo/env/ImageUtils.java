@@ -20,6 +20,8 @@ import android.os.Environment;
 
 import java.io.File;
 import java.io.FileOutputStream;
+import java.nio.ByteBuffer;
+import java.nio.IntBuffer;
 
 /**
  * Utility class for manipulating images.
@@ -151,4 +153,91 @@ public class ImageUtils {
    */
   public static native void convertRGB565ToYUV420SP(
       byte[] input, byte[] output, int width, int height);
+
+  // The overloads below take direct buffers, such as the ByteBuffers of the
+  // planes of an android.media.Image, and are converted in place without
+  // copying the data onto or off the Java heap. ARGB data is passed as IntBuffers
+  // in native byte order; everything else is passed as ByteBuffers.
+
+  /**
+   * Same as {@link #convertYUV420SPToARGB8888(byte[], int[], int, int, boolean)}, but reads
+   * from and writes to direct buffers.
+   */
+  public static void convertYUV420SPToARGB8888(
+      final ByteBuffer input,
+      final IntBuffer output,
+      final int width,
+      final int height,
+      final boolean halfSize) {
+    convertYUV420SPToARGB8888Direct(input, output, width, height, halfSize);
+  }
+
+  /**
+   * Converts the planes of a YUV_420_888 {@link android.media.Image} to ARGB 8888 data. The
+   * planes are read in place from their direct buffers, and the output is written to a
+   * pre-allocated direct buffer holding at least width * height pixels.
+   */
+  public static void convertYUV420ToARGB8888(
+      final ByteBuffer y,
+      final ByteBuffer u,
+      final ByteBuffer v,
+      final IntBuffer output,
+      final int width,
+      final int height,
+      final int yRowStride,
+      final int uvRowStride,
+      final int uvPixelStride) {
+    convertYUV420ToARGB8888Direct(
+        y, u, v, output, width, height, yRowStride, uvRowStride, uvPixelStride);
+  }
+
+  /**
+   * Same as {@link #convertYUV420SPToRGB565(byte[], byte[], int, int)}, but reads from and
+   * writes to direct buffers.
+   */
+  public static void convertYUV420SPToRGB565(
+      final ByteBuffer input, final ByteBuffer output, final int width, final int height) {
+    convertYUV420SPToRGB565Direct(input, output, width, height);
+  }
+
+  /**
+   * Same as {@link #convertARGB8888ToYUV420SP(int[], byte[], int, int)}, but reads from and
+   * writes to direct buffers.
+   */
+  public static void convertARGB8888ToYUV420SP(
+      final IntBuffer input, final ByteBuffer output, final int width, final int height) {
+    convertARGB8888ToYUV420SPDirect(input, output, width, height);
+  }
+
+  /**
+   * Same as {@link #convertRGB565ToYUV420SP(byte[], byte[], int, int)}, but reads from and
+   * writes to direct buffers.
+   */
+  public static void convertRGB565ToYUV420SP(
+      final ByteBuffer input, final ByteBuffer output, final int width, final int height) {
+    convertRGB565ToYUV420SPDirect(input, output, width, height);
+  }
+
+  private static native void convertYUV420SPToARGB8888Direct(
+      ByteBuffer input, IntBuffer output, int width, int height, boolean halfSize);
+
+  private static native void convertYUV420ToARGB8888Direct(
+      ByteBuffer y,
+      ByteBuffer u,
+      ByteBuffer v,
+      IntBuffer output,
+      int width,
+      int height,
+      int yRowStride,
+      int uvRowStride,
+      int uvPixelStride);
+
+  private static native void convertYUV420SPToRGB565Direct(
+      ByteBuffer input, ByteBuffer output, int width, int height);
+
+  private static native void convertARGB8888ToYUV420SPDirect(
+      IntBuffer input, ByteBuffer output, int width, int height);
+
+  private static native void convertRGB565ToYUV420SPDirect(
+      ByteBuffer input, ByteBuffer output, int width, int height);
 }
@@ -33,15 +33,83 @@ TENSORFLOW_CFLAGS	  := \
 #-MF \
 
 TENSORFLOW_SRC_FILES := \
+	./adaptive_sharder.cc \
+	./allocation_counter.cc \
+	./conv_bias_leaky_relu_fusion.cc \
+	./detector_engine.cc \
+	./frame_recorder.cc \
 	./imageutils_jni.cc \
+	./inference_pipeline.cc \
 	./jni_utils.cc \
+	./kernel_rewrite_utils.cc \
+	./latency_controller.cc \
+	./memmapped_package.cc \
+	./non_max_suppression.cc \
+	./object_tracker.cc \
+	./packed_matmul.cc \
 	./rgb2yuv.cc \
+	./scene_change_detector.cc \
+	./session_threading.cc \
+	./static_executor.cc \
+	./static_memory_planner.cc \
+	./step_stats_profiler.cc \
 	./tensorflow_jni.cc \
+	./thread_caching_allocator.cc \
+	./winograd_conv.cc \
+	./yolo_decoder.cc \
 	./yuv2rgb.cc \
+	./yuv_preprocessor.cc \
+
+# Eight bit kernels for graphs rewritten by quantize_graph.py, which are not
+# part of libandroid_tensorflow_kernels. They need the gemmlowp headers from
+# the checkout TensorFlow was built with, so they are only built on request:
+#   ndk-build ENABLE_QUANTIZED_OPS=1 [GEMMLOWP_PATH=<gemmlowp checkout>]
+ifdef ENABLE_QUANTIZED_OPS
+GEMMLOWP_PATH ?= $(LOCAL_PATH)/../../../tensorflow/bazel-tensorflow/external/gemmlowp
+TENSORFLOW_CFLAGS += -DENABLE_QUANTIZED_OPS
+
+QUANTIZATION_SRC_FILES := \
+	./include/tensorflow/contrib/quantization/kernels/dequantize_op.cc \
+	./include/tensorflow/contrib/quantization/kernels/quantization_utils.cc \
+	./include/tensorflow/contrib/quantization/kernels/quantize_down_and_shrink_range.cc \
+	./include/tensorflow/contrib/quantization/kernels/quantize_op.cc \
+	./include/tensorflow/contrib/quantization/kernels/quantized_activation_ops.cc \
+	./include/tensorflow/contrib/quantization/kernels/quantized_batch_norm_op.cc \
+	./include/tensorflow/contrib/quantization/kernels/quantized_bias_add_op.cc \
+	./include/tensorflow/contrib/quantization/kernels/quantized_concat_op.cc \
+	./include/tensorflow/contrib/quantization/kernels/quantized_conv_ops.cc \
+	./include/tensorflow/contrib/quantization/kernels/quantized_matmul_op.cc \
+	./include/tensorflow/contrib/quantization/kernels/quantized_pooling_ops.cc \
+	./include/tensorflow/contrib/quantization/ops/array_ops.cc \
+	./include/tensorflow/contrib/quantization/ops/math_ops.cc \
+	./include/tensorflow/contrib/quantization/ops/nn_ops.cc \
+
+endif
+
+# JPEG encoding for the frame recorder. lib/jpeg is left out of the Android
+# TensorFlow libraries, so it is compiled here against the libjpeg TensorFlow
+# fetches. The recorder is only built on request, once libjpeg has been built
+# for the target ABI, e.g. with
+#   bazel build -c opt @jpeg_archive//:jpeg --cpu=armeabi-v7a \
+#     --crosstool_top=//external:android/crosstool \
+#     --host_crosstool_top=@bazel_tools//tools/cpp:toolchain
+#   ndk-build ENABLE_FRAME_RECORDER=1 [JPEG_PATH=... JPEG_LIB=...]
+# Otherwise starting it fails with Unimplemented.
+ifdef ENABLE_FRAME_RECORDER
+JPEG_PATH ?= $(LOCAL_PATH)/../../../tensorflow/bazel-tensorflow/external/jpeg_archive
+JPEG_GENFILES_PATH ?= $(LOCAL_PATH)/../../../tensorflow/bazel-genfiles/external/jpeg_archive
+JPEG_LIB ?= $(LOCAL_PATH)/../../../tensorflow/bazel-bin/external/jpeg_archive/libjpeg.a
+TENSORFLOW_CFLAGS += -DENABLE_FRAME_RECORDER
+
+JPEG_SRC_FILES := \
+	./include/tensorflow/core/lib/jpeg/jpeg_handle.cc \
+	./include/tensorflow/core/lib/jpeg/jpeg_mem.cc \
+
+endif
 
 LOCAL_MODULE    := tensorflow_demo
 LOCAL_ARM_MODE  := arm
-LOCAL_SRC_FILES := $(TENSORFLOW_SRC_FILES)
+LOCAL_SRC_FILES := $(TENSORFLOW_SRC_FILES) $(QUANTIZATION_SRC_FILES)
 LOCAL_CFLAGS    := $(TENSORFLOW_CFLAGS)
 
 LOCAL_LDLIBS    := \
@@ -53,6 +121,7 @@ LOCAL_LDLIBS    := \
 	$(LOCAL_PATH)/libs/$(TARGET_ARCH_ABI)/libprotobuf.a \
 	$(LOCAL_PATH)/libs/$(TARGET_ARCH_ABI)/libprotobuf_lite.a \
 	-Wl,-no-whole-archive \
+	$(JPEG_LIB) \
 	$(NDK_ROOT)/sources/cxx-stl/gnu-libstdc++/4.9/libs/$(TARGET_ARCH_ABI)/libgnustl_static.a \
 	$(NDK_ROOT)/sources/cxx-stl/gnu-libstdc++/4.9/libs/$(TARGET_ARCH_ABI)/libsupc++.a \
 	-landroid \
@@ -77,8 +146,33 @@ LOCAL_C_INCLUDES += $(LOCAL_PATH)/include \
 	$(LOCAL_PATH)/include/external/eigen_archive \
 	$(LOCAL_PATH)/include/external/protobuf/src \
 	$(LOCAL_PATH)/include/external/bazel_tools/tools/cpp/gcc3 \
+	$(GEMMLOWP_PATH) \
+
+LOCAL_STATIC_LIBRARIES := cpufeatures
+ifdef ENABLE_FRAME_RECORDER
+LOCAL_STATIC_LIBRARIES += tensorflow_jpeg
+endif
 
 NDK_MODULE_PATH := $(call my-dir)
 
 include $(BUILD_SHARED_LIBRARY)
 
+ifdef ENABLE_FRAME_RECORDER
+include $(CLEAR_VARS)
+
+# platform/jpeg.h only includes libjpeg for desktop POSIX builds, so lib/jpeg
+# is built as one. It uses nothing else that differs on Android.
+LOCAL_MODULE    := tensorflow_jpeg
+LOCAL_ARM_MODE  := arm
+LOCAL_SRC_FILES := $(JPEG_SRC_FILES)
+LOCAL_CFLAGS    := $(TENSORFLOW_CFLAGS) -DPLATFORM_POSIX
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/include \
+	$(LOCAL_PATH)/include/external/protobuf/src \
+	$(JPEG_PATH) \
+	$(JPEG_GENFILES_PATH)/jpeg-9a \
+
+include $(BUILD_STATIC_LIBRARY)
+endif
+
+$(call import-module,android/cpufeatures)
+
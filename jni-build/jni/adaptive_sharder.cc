@@ -0,0 +1,248 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/adaptive_sharder.h"
+
+#include <time.h>
+
+#include <algorithm>
+
+#include "tensorflow/core/lib/core/blocking_counter.h"
+#include "tensorflow/core/lib/strings/stringprintf.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// Work estimated under this runs on the calling thread alone, and larger
+// work gets one thread per this much, as Shard does with its guesses.
+const double kMinNsPerThread = 10000;
+// Chunks are at least this much work, so that taking one off the counter
+// costs a few percent at most.
+const double kMinChunkNs = 2000;
+// Each chunk is the remaining units over this many times the threads.
+const int64 kGuidedDivisor = 2;
+const int kNsPerCostScale = 1024;
+
+std::atomic<bool> adaptive_enabled(true);
+
+mutex sites_mu(LINKER_INITIALIZED);
+
+std::vector<ShardSite*>* Sites() EXCLUSIVE_LOCKS_REQUIRED(sites_mu) {
+  static std::vector<ShardSite*>* const sites = new std::vector<ShardSite*>;
+  return sites;
+}
+
+int64 NowNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// Hands out the units of a call in chunks, each a fraction of those left.
+class ChunkCounter {
+ public:
+  ChunkCounter(const int64 total, const int num_threads, const int64 min_chunk)
+      : total_(total),
+        divisor_(kGuidedDivisor * num_threads),
+        min_chunk_(min_chunk),
+        next_(0) {}
+
+  // Takes the next chunk. Returns false once none are left.
+  bool Next(int64* start, int64* limit) {
+    int64 begin = next_.load(std::memory_order_relaxed);
+    while (begin < total_) {
+      const int64 size = std::max(min_chunk_, (total_ - begin) / divisor_);
+      const int64 end = std::min(total_, begin + size);
+      if (next_.compare_exchange_weak(begin, end,
+                                      std::memory_order_relaxed)) {
+        *start = begin;
+        *limit = end;
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  const int64 total_;
+  const int64 divisor_;
+  const int64 min_chunk_;
+  std::atomic<int64> next_;
+};
+
+}  // namespace
+
+string ShardSiteStats::DebugString() const {
+  const double call_threads =
+      calls > 0 ? threads / static_cast<double>(calls) : 0.0;
+  const double unit_ns = units > 0 ? busy_ns / static_cast<double>(units) : 0.0;
+  const double busy_threads =
+      wall_ns > 0 ? busy_ns / static_cast<double>(wall_ns) : 0.0;
+  return strings::Printf(
+      "%s: %lld calls (%lld inline) on %.1f threads each, %lld units in %lld "
+      "chunks, %.3gns per unit, %.3gns per guessed ns, %.1f threads busy on "
+      "average",
+      name.c_str(), static_cast<long long>(calls),
+      static_cast<long long>(inline_calls), call_threads,
+      static_cast<long long>(units), static_cast<long long>(chunks), unit_ns,
+      ns_per_cost, busy_threads);
+}
+
+ShardSite::ShardSite(const string& name)
+    : name_(name),
+      scaled_ns_per_cost_(kNsPerCostScale),
+      calls_(0),
+      inline_calls_(0),
+      threads_(0),
+      units_(0),
+      chunks_(0),
+      busy_ns_(0),
+      wall_ns_(0) {
+  mutex_lock l(sites_mu);
+  Sites()->push_back(this);
+}
+
+double ShardSite::EstimateNs(const int64 total,
+                             const int64 cost_per_unit) const {
+  return static_cast<double>(total) * cost_per_unit *
+         scaled_ns_per_cost_.load(std::memory_order_relaxed) /
+         kNsPerCostScale;
+}
+
+void ShardSite::RecordCall(const int64 total, const int64 cost_per_unit,
+                           const int num_threads, const int64 num_chunks,
+                           const int64 busy_ns, const int64 wall_ns) {
+  const int64 measured = std::max<int64>(
+      1, static_cast<int64>(static_cast<double>(busy_ns) * kNsPerCostScale /
+                            (static_cast<double>(total) * cost_per_unit)));
+  // The first call replaces the guess; later ones move the estimate a
+  // quarter of the way, so that one preempted call does not undo it.
+  // Concurrent calls may lose an update, which the next one makes up for.
+  if (calls_.fetch_add(1, std::memory_order_relaxed) == 0) {
+    scaled_ns_per_cost_.store(measured, std::memory_order_relaxed);
+  } else {
+    const int64 estimate =
+        scaled_ns_per_cost_.load(std::memory_order_relaxed);
+    scaled_ns_per_cost_.store(estimate + (measured - estimate) / 4,
+                              std::memory_order_relaxed);
+  }
+  if (num_threads == 1) {
+    inline_calls_.fetch_add(1, std::memory_order_relaxed);
+  }
+  threads_.fetch_add(num_threads, std::memory_order_relaxed);
+  units_.fetch_add(total, std::memory_order_relaxed);
+  chunks_.fetch_add(num_chunks, std::memory_order_relaxed);
+  busy_ns_.fetch_add(busy_ns, std::memory_order_relaxed);
+  wall_ns_.fetch_add(wall_ns, std::memory_order_relaxed);
+}
+
+ShardSiteStats ShardSite::GetStats() const {
+  ShardSiteStats stats;
+  stats.name = name_;
+  stats.calls = calls_.load(std::memory_order_relaxed);
+  stats.inline_calls = inline_calls_.load(std::memory_order_relaxed);
+  stats.threads = threads_.load(std::memory_order_relaxed);
+  stats.units = units_.load(std::memory_order_relaxed);
+  stats.chunks = chunks_.load(std::memory_order_relaxed);
+  stats.busy_ns = busy_ns_.load(std::memory_order_relaxed);
+  stats.wall_ns = wall_ns_.load(std::memory_order_relaxed);
+  stats.ns_per_cost =
+      scaled_ns_per_cost_.load(std::memory_order_relaxed) /
+      static_cast<double>(kNsPerCostScale);
+  return stats;
+}
+
+void AdaptiveShard(ShardSite* site, int max_parallelism,
+                   thread::ThreadPool* workers, int64 total,
+                   int64 cost_per_unit,
+                   std::function<void(int64, int64)> work) {
+  CHECK_GE(total, 0);
+  if (total == 0) {
+    return;
+  }
+  if (!adaptive_enabled.load(std::memory_order_relaxed)) {
+    Shard(max_parallelism, workers, total, cost_per_unit, work);
+    return;
+  }
+  cost_per_unit = std::max<int64>(1, cost_per_unit);
+  const int64 start_ns = NowNanos();
+  const double estimate_ns = site->EstimateNs(total, cost_per_unit);
+  const int num_threads = static_cast<int>(
+      std::max<int64>(1, std::min<int64>(
+                             {static_cast<int64>(max_parallelism), total,
+                              static_cast<int64>(estimate_ns /
+                                                 kMinNsPerThread)})));
+  if (num_threads == 1) {
+    work(0, total);
+    const int64 elapsed_ns = NowNanos() - start_ns;
+    site->RecordCall(total, cost_per_unit, 1, 1, elapsed_ns, elapsed_ns);
+    return;
+  }
+
+  const int64 min_chunk = std::max<int64>(
+      1, static_cast<int64>(kMinChunkNs * total / estimate_ns));
+  ChunkCounter counter(total, num_threads, min_chunk);
+  std::atomic<int64> busy_ns(0);
+  std::atomic<int64> num_chunks(0);
+  // Timed from the first chunk a thread takes to the end of its last, so
+  // that waiting for a worker to wake up is not counted as work.
+  auto run_chunks = [&work, &counter, &busy_ns, &num_chunks]() {
+    int64 start;
+    int64 limit;
+    if (!counter.Next(&start, &limit)) {
+      return;
+    }
+    const int64 first_ns = NowNanos();
+    int64 chunks = 0;
+    do {
+      work(start, limit);
+      ++chunks;
+    } while (counter.Next(&start, &limit));
+    busy_ns.fetch_add(NowNanos() - first_ns, std::memory_order_relaxed);
+    num_chunks.fetch_add(chunks, std::memory_order_relaxed);
+  };
+  BlockingCounter done(num_threads - 1);
+  for (int i = 1; i < num_threads; ++i) {
+    workers->Schedule([&run_chunks, &done]() {
+      run_chunks();
+      done.DecrementCount();
+    });
+  }
+  run_chunks();
+  done.Wait();
+  site->RecordCall(total, cost_per_unit, num_threads, num_chunks.load(),
+                   busy_ns.load(), NowNanos() - start_ns);
+}
+
+std::vector<ShardSiteStats> GetShardSiteStats() {
+  mutex_lock l(sites_mu);
+  std::vector<ShardSiteStats> stats;
+  for (const ShardSite* site : *Sites()) {
+    stats.push_back(site->GetStats());
+  }
+  return stats;
+}
+
+void SetAdaptiveSharding(const bool enabled) {
+  adaptive_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+}  // namespace android
+}  // namespace tensorflow
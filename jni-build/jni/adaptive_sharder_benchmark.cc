@@ -0,0 +1,280 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Measures Shard against AdaptiveShard on the loops of three kinds of
+// kernel, each over a range of sizes and with the cost guess such a kernel
+// would pass: a cwise bias and ReLU over a vector, guessed at 1ns per
+// element; a reduction summing the rows of a matrix of 256 columns, at 1ns
+// per column; and a direct 3x3 convolution of 32 to 32 channels over rows of
+// a square image, at 1ns per multiply-add. Items processed are the units of
+// work, i.e. elements, rows and output rows. Every call site first runs a
+// few untimed calls, so that AdaptiveShard has measured it, and its stats
+// are logged at the end. Both are first checked to compute the same outputs
+// as running the loop on one thread.
+//
+// Usage:
+//   make -C jni-build kernel-benchmark
+//   jni-build/adaptive_sharder_benchmark [regex]
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/host_info.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/util/work_sharder.h"
+#include "tensorflow/examples/android/jni/adaptive_sharder.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+const int kReductionColumns = 256;
+const int kConvDepth = 32;
+
+thread::ThreadPool* Workers() {
+  static thread::ThreadPool* const workers = new thread::ThreadPool(
+      Env::Default(), "shard_benchmark", port::NumSchedulableCPUs());
+  return workers;
+}
+
+// The loop of a kernel over its units of work, and the buffers it reads and
+// writes.
+struct ShardedLoop {
+  int64 total = 0;
+  int64 cost_per_unit = 0;
+  std::vector<float> input;
+  std::vector<float> output;
+  std::function<void(int64, int64)> work;
+};
+
+// output = max(input * 0.5 + 0.25, 0) over size elements.
+void MakeCwise(const int64 size, ShardedLoop* loop) {
+  loop->total = size;
+  loop->cost_per_unit = 1;
+  loop->input.resize(size);
+  loop->output.resize(size);
+  for (int64 i = 0; i < size; ++i) {
+    loop->input[i] = (i % 17) - 8.0f;
+  }
+  const float* const input = loop->input.data();
+  float* const output = loop->output.data();
+  loop->work = [input, output](int64 start, int64 limit) {
+    for (int64 i = start; i < limit; ++i) {
+      output[i] = std::max(input[i] * 0.5f + 0.25f, 0.0f);
+    }
+  };
+}
+
+// output[row] = the sum of the kReductionColumns values of input[row].
+void MakeReduction(const int64 rows, ShardedLoop* loop) {
+  loop->total = rows;
+  loop->cost_per_unit = kReductionColumns;
+  loop->input.resize(rows * kReductionColumns);
+  loop->output.resize(rows);
+  for (int64 i = 0; i < loop->input.size(); ++i) {
+    loop->input[i] = (i % 13) * 0.125f;
+  }
+  const float* const input = loop->input.data();
+  float* const output = loop->output.data();
+  loop->work = [input, output](int64 start, int64 limit) {
+    for (int64 row = start; row < limit; ++row) {
+      const float* const values = input + row * kReductionColumns;
+      float sum = 0.0f;
+      for (int i = 0; i < kReductionColumns; ++i) {
+        sum += values[i];
+      }
+      output[row] = sum;
+    }
+  };
+}
+
+// A 3x3 convolution with SAME padding of a size x size x kConvDepth image
+// with kConvDepth filters of all ones scaled by 1/64, one output row per
+// unit.
+void MakeConv(const int64 size, ShardedLoop* loop) {
+  loop->total = size;
+  loop->cost_per_unit = size * 9 * kConvDepth * kConvDepth;
+  loop->input.resize(size * size * kConvDepth);
+  loop->output.resize(size * size * kConvDepth);
+  for (int64 i = 0; i < loop->input.size(); ++i) {
+    loop->input[i] = (i % 7) - 3.0f;
+  }
+  const float* const input = loop->input.data();
+  float* const output = loop->output.data();
+  loop->work = [input, output, size](int64 start, int64 limit) {
+    float sums[kConvDepth];
+    for (int64 row = start; row < limit; ++row) {
+      for (int64 col = 0; col < size; ++col) {
+        std::fill(sums, sums + kConvDepth, 0.0f);
+        for (int64 r = std::max<int64>(row - 1, 0);
+             r <= std::min(row + 1, size - 1); ++r) {
+          for (int64 c = std::max<int64>(col - 1, 0);
+               c <= std::min(col + 1, size - 1); ++c) {
+            const float* const pixel = input + (r * size + c) * kConvDepth;
+            for (int out = 0; out < kConvDepth; ++out) {
+              for (int in = 0; in < kConvDepth; ++in) {
+                sums[out] += pixel[in] * (1.0f / 64);
+              }
+            }
+          }
+        }
+        std::copy(sums, sums + kConvDepth,
+                  output + (row * size + col) * kConvDepth);
+      }
+    }
+  };
+}
+
+void RunLoop(ShardSite* site, const ShardedLoop& loop, const bool adaptive) {
+  thread::ThreadPool* const workers = Workers();
+  if (adaptive) {
+    AdaptiveShard(site, workers->NumThreads(), workers, loop.total,
+                  loop.cost_per_unit, loop.work);
+  } else {
+    Shard(workers->NumThreads(), workers, loop.total, loop.cost_per_unit,
+          loop.work);
+  }
+}
+
+void BenchmarkLoop(const int iters, ShardSite* site, const ShardedLoop& loop,
+                   const bool adaptive) {
+  testing::StopTiming();
+  for (int i = 0; i < 4; ++i) {
+    RunLoop(site, loop, adaptive);
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * loop.total);
+  testing::UseRealTime();
+  testing::StartTiming();
+  for (int i = 0; i < iters; ++i) {
+    RunLoop(site, loop, adaptive);
+  }
+  testing::StopTiming();
+}
+
+ShardSite* CwiseSite() {
+  static ShardSite* const site = new ShardSite("benchmark/cwise");
+  return site;
+}
+
+ShardSite* ReductionSite() {
+  static ShardSite* const site = new ShardSite("benchmark/reduction");
+  return site;
+}
+
+ShardSite* ConvSite() {
+  static ShardSite* const site = new ShardSite("benchmark/conv");
+  return site;
+}
+
+// Checks that AdaptiveShard covers every unit of loop exactly once, by
+// comparing with the output of the loop run on one thread.
+void VerifyLoop(const char* name, ShardedLoop* loop) {
+  loop->work(0, loop->total);
+  const std::vector<float> expected = loop->output;
+  static ShardSite* const site = new ShardSite("benchmark/verify");
+  for (int i = 0; i < 8; ++i) {
+    std::fill(loop->output.begin(), loop->output.end(), -1.0f);
+    RunLoop(site, *loop, true);
+    for (int64 j = 0; j < expected.size(); ++j) {
+      CHECK_EQ(expected[j], loop->output[j])
+          << name << " output " << j << " differs at call " << i;
+    }
+  }
+}
+
+void VerifyAdaptiveShard() {
+  for (const int64 size : {1, 100, 1 << 16}) {
+    ShardedLoop loop;
+    MakeCwise(size, &loop);
+    VerifyLoop("Cwise", &loop);
+  }
+  for (const int64 rows : {1, 7, 4096}) {
+    ShardedLoop loop;
+    MakeReduction(rows, &loop);
+    VerifyLoop("Reduction", &loop);
+  }
+  for (const int64 size : {3, 28}) {
+    ShardedLoop loop;
+    MakeConv(size, &loop);
+    VerifyLoop("Conv", &loop);
+  }
+}
+
+}  // namespace
+
+static void BM_CwiseShard(int iters, int size) {
+  ShardedLoop loop;
+  MakeCwise(size, &loop);
+  BenchmarkLoop(iters, CwiseSite(), loop, false);
+}
+static void BM_CwiseAdaptive(int iters, int size) {
+  ShardedLoop loop;
+  MakeCwise(size, &loop);
+  BenchmarkLoop(iters, CwiseSite(), loop, true);
+}
+static void BM_ReductionShard(int iters, int rows) {
+  ShardedLoop loop;
+  MakeReduction(rows, &loop);
+  BenchmarkLoop(iters, ReductionSite(), loop, false);
+}
+static void BM_ReductionAdaptive(int iters, int rows) {
+  ShardedLoop loop;
+  MakeReduction(rows, &loop);
+  BenchmarkLoop(iters, ReductionSite(), loop, true);
+}
+static void BM_ConvShard(int iters, int size) {
+  ShardedLoop loop;
+  MakeConv(size, &loop);
+  BenchmarkLoop(iters, ConvSite(), loop, false);
+}
+static void BM_ConvAdaptive(int iters, int size) {
+  ShardedLoop loop;
+  MakeConv(size, &loop);
+  BenchmarkLoop(iters, ConvSite(), loop, true);
+}
+BENCHMARK(BM_CwiseShard)
+    ->Arg(1 << 10)
+    ->Arg(1 << 14)
+    ->Arg(1 << 18)
+    ->Arg(1 << 22);
+BENCHMARK(BM_CwiseAdaptive)
+    ->Arg(1 << 10)
+    ->Arg(1 << 14)
+    ->Arg(1 << 18)
+    ->Arg(1 << 22);
+BENCHMARK(BM_ReductionShard)->Arg(16)->Arg(256)->Arg(4096)->Arg(65536);
+BENCHMARK(BM_ReductionAdaptive)->Arg(16)->Arg(256)->Arg(4096)->Arg(65536);
+BENCHMARK(BM_ConvShard)->Arg(7)->Arg(14)->Arg(28)->Arg(56);
+BENCHMARK(BM_ConvAdaptive)->Arg(7)->Arg(14)->Arg(28)->Arg(56);
+
+}  // namespace android
+}  // namespace tensorflow
+
+int main(int argc, char** argv) {
+  tensorflow::port::InitMain(argv[0], &argc, &argv);
+  tensorflow::android::VerifyAdaptiveShard();
+  tensorflow::testing::Benchmark::Run(argc > 1 ? argv[1] : "all");
+  for (const tensorflow::android::ShardSiteStats& stats :
+       tensorflow::android::GetShardSiteStats()) {
+    LOG(INFO) << stats.DebugString();
+  }
+  return 0;
+}
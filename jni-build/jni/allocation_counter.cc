@@ -0,0 +1,118 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/allocation_counter.h"
+
+#include <stdlib.h>
+
+#include <new>
+
+#ifndef MAX_NUM_RUNS
+#define MAX_NUM_RUNS 0
+#endif
+
+#if MAX_NUM_RUNS > 0 && !defined(COUNT_ALLOCATIONS)
+#define COUNT_ALLOCATIONS
+#endif
+
+#ifdef COUNT_ALLOCATIONS
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// Plain thread-local integers, so that counting never allocates itself.
+__thread int64 t_allocation_count = 0;
+__thread int t_pause_depth = 0;
+
+inline void* CountedAllocate(const size_t size) {
+  if (t_pause_depth == 0) {
+    ++t_allocation_count;
+  }
+  return malloc(size == 0 ? 1 : size);
+}
+
+inline void* CountedAllocateOrDie(const size_t size) {
+  void* const ptr = CountedAllocate(size);
+  if (ptr == nullptr) {
+#ifdef __EXCEPTIONS
+    throw std::bad_alloc();
+#else
+    // Built without exceptions, as the library is, so there is no bad_alloc.
+    abort();
+#endif
+  }
+  return ptr;
+}
+
+}  // namespace
+
+int64 GetThreadAllocationCount() { return t_allocation_count; }
+
+ScopedAllocationCountingPause::ScopedAllocationCountingPause() {
+  ++t_pause_depth;
+}
+
+ScopedAllocationCountingPause::~ScopedAllocationCountingPause() {
+  --t_pause_depth;
+}
+
+}  // namespace android
+}  // namespace tensorflow
+
+// Replacements for the global allocation functions of the library. They
+// behave like the default ones apart from the counting.
+void* operator new(size_t size) {
+  return tensorflow::android::CountedAllocateOrDie(size);
+}
+
+void* operator new[](size_t size) {
+  return tensorflow::android::CountedAllocateOrDie(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return tensorflow::android::CountedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return tensorflow::android::CountedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+
+void operator delete[](void* ptr) noexcept { free(ptr); }
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { free(ptr); }
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  free(ptr);
+}
+
+#else  // COUNT_ALLOCATIONS
+
+namespace tensorflow {
+namespace android {
+
+int64 GetThreadAllocationCount() { return 0; }
+
+ScopedAllocationCountingPause::ScopedAllocationCountingPause() {}
+
+ScopedAllocationCountingPause::~ScopedAllocationCountingPause() {}
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // COUNT_ALLOCATIONS
@@ -0,0 +1,201 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Compares YOLO layers run as Conv2D, Add, Mul and Maximum against the same
+// layers after FuseConvBiasLeakyRelu, with the kernel benchmark harness. Fused
+// layers are timed with the direct convolution and with the Winograd one,
+// which is first checked against Eigen's SpatialConvolution.
+//
+// Usage:
+//   make -C jni-build kernel-benchmark
+//   jni-build/conv_bias_leaky_relu_benchmark [regex]
+
+#define EIGEN_USE_THREADS
+
+#include <math.h>
+#include <algorithm>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/device_base.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/kernels/eigen_spatial_convolutions.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/host_info.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/examples/android/jni/conv_bias_leaky_relu_fusion.h"
+#include "tensorflow/examples/android/jni/winograd_conv.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// Slope of the leaky ReLU in YOLO_tensorflow.
+const float kAlpha = 0.1f;
+
+// Largest difference from the direct convolution allowed, relative to the
+// largest output. The Winograd transforms only reorder the sums.
+const float kWinogradTolerance = 1e-4f;
+
+Tensor RandomTensor(const TensorShape& shape) {
+  Tensor tensor(DT_FLOAT, shape);
+  tensor.flat<float>() = tensor.flat<float>().random() - 0.5f;
+  return tensor;
+}
+
+// One layer as the YOLO export builds it: Conv2D without padding on an input
+// that has already been padded, the bias added with Add and the leaky ReLU as
+// Maximum(Mul(alpha, x), x).
+Graph* YoloLayer(const int size, const int in_depth, const int out_depth,
+                 const int filter_size, const int stride, const bool fused) {
+  Graph* g = new Graph(OpRegistry::Global());
+  const Tensor input = RandomTensor({1, size, size, in_depth});
+  const Tensor filter =
+      RandomTensor({filter_size, filter_size, in_depth, out_depth});
+  const Tensor bias = RandomTensor({out_depth});
+  Tensor alpha(DT_FLOAT, TensorShape({}));
+  alpha.scalar<float>()() = kAlpha;
+
+  Node* conv;
+  TF_CHECK_OK(NodeBuilder(g->NewName("conv"), "Conv2D")
+                  .Input(test::graph::Constant(g, input))
+                  .Input(test::graph::Constant(g, filter))
+                  .Attr("T", DT_FLOAT)
+                  .Attr("strides", {1, stride, stride, 1})
+                  .Attr("padding", "VALID")
+                  .Finalize(g, &conv));
+  Node* biased = test::graph::Add(g, conv, test::graph::Constant(g, bias));
+  test::graph::Binary(
+      g, "Maximum",
+      test::graph::Binary(g, "Mul", test::graph::Constant(g, alpha), biased),
+      biased);
+
+  if (fused) {
+    CHECK_EQ(1, FuseConvBiasLeakyRelu(g));
+  }
+  return g;
+}
+
+// Checks the Winograd convolution of a 3x3 layer without padding against
+// SpatialConvolution, which Conv2D uses, followed by the bias and activation.
+void VerifyWinograd(const int size, const int in_depth, const int out_depth) {
+  const int out_size = size - 2;
+  const Tensor input = RandomTensor({1, size, size, in_depth});
+  const Tensor filter = RandomTensor({3, 3, in_depth, out_depth});
+  const Tensor bias = RandomTensor({out_depth});
+
+  Tensor expected(DT_FLOAT, TensorShape({1, out_size, out_size, out_depth}));
+  expected.tensor<float, 4>() =
+      Eigen::SpatialConvolution(input.tensor<float, 4>(),
+                                filter.tensor<float, 4>(), 1, 1,
+                                Eigen::PADDING_VALID);
+  auto expected_values = expected.flat_inner_dims<float>();
+  for (int64 p = 0; p < expected_values.dimension(0); ++p) {
+    for (int o = 0; o < out_depth; ++o) {
+      const float value = expected_values(p, o) + bias.flat<float>()(o);
+      expected_values(p, o) = std::max(kAlpha * value, value);
+    }
+  }
+
+  const int num_threads = port::NumSchedulableCPUs();
+  thread::ThreadPool pool(Env::Default(), "winograd", num_threads);
+  DeviceBase::CpuWorkerThreads workers;
+  workers.num_threads = num_threads;
+  workers.workers = &pool;
+  Tensor transformed(DT_FLOAT,
+                     TensorShape({kWinogradPoints, in_depth, out_depth}));
+  TransformWinogradFilter(filter.flat<float>().data(), in_depth, out_depth,
+                          workers, transformed.flat<float>().data());
+  Tensor actual(DT_FLOAT, expected.shape());
+  WinogradConv3x3BiasLeakyRelu(
+      input.flat<float>().data(), 1, size, size, in_depth,
+      transformed.flat<float>().data(), bias.flat<float>().data(), kAlpha,
+      out_depth, workers, actual.flat<float>().data());
+
+  float max_error = 0.0f;
+  float max_value = 0.0f;
+  for (int64 i = 0; i < expected.NumElements(); ++i) {
+    max_error = std::max(
+        max_error, fabsf(actual.flat<float>()(i) - expected.flat<float>()(i)));
+    max_value = std::max(max_value, fabsf(expected.flat<float>()(i)));
+  }
+  CHECK_LE(max_error, kWinogradTolerance * max_value)
+      << "Winograd convolution of " << size << "x" << size << "x" << in_depth
+      << " to " << out_depth << " differs from SpatialConvolution";
+  LOG(INFO) << "Winograd " << size << "x" << size << "x" << in_depth << " to "
+            << out_depth << ": max error " << max_error << " of " << max_value;
+}
+
+}  // namespace
+
+#define BM_ConvBiasLeakyRelu(SIZE, IN, OUT, FILTER, STRIDE, FUSED, WINOGRAD,   \
+                             LABEL)                                            \
+  static void BM_ConvBiasLeakyRelu_##SIZE##_##IN##_##OUT##_##FILTER##_##       \
+      STRIDE##_##LABEL(int iters) {                                            \
+    const int out_size = (SIZE - FILTER) / STRIDE + 1;                         \
+    testing::ItemsProcessed(static_cast<int64>(iters) * out_size * out_size *  \
+                            OUT);                                              \
+    SetWinogradConv3x3(WINOGRAD);                                              \
+    test::Benchmark("cpu", YoloLayer(SIZE, IN, OUT, FILTER, STRIDE, FUSED))    \
+        .Run(iters);                                                           \
+  }                                                                            \
+  BENCHMARK(BM_ConvBiasLeakyRelu_##SIZE##_##IN##_##OUT##_##FILTER##_##STRIDE   \
+                ##_##LABEL);
+
+#define BM_YoloLayer(SIZE, IN, OUT, FILTER, STRIDE)                            \
+  BM_ConvBiasLeakyRelu(SIZE, IN, OUT, FILTER, STRIDE, false, false, Unfused);  \
+  BM_ConvBiasLeakyRelu(SIZE, IN, OUT, FILTER, STRIDE, true, false, Direct);    \
+  BM_ConvBiasLeakyRelu(SIZE, IN, OUT, FILTER, STRIDE, true, true, Winograd);
+
+// The distinct layer shapes of YOLO small at 448x448, with the input of each
+// padded as the export does. Winograd only applies to the 3x3 layers with at
+// least 28x28 outputs, short of the deepest, and is otherwise the same as
+// Direct.
+BM_YoloLayer(454, 3, 64, 7, 2);
+BM_YoloLayer(114, 64, 192, 3, 1);
+BM_YoloLayer(56, 192, 128, 1, 1);
+BM_YoloLayer(58, 128, 256, 3, 1);
+BM_YoloLayer(56, 256, 256, 1, 1);
+BM_YoloLayer(58, 256, 512, 3, 1);
+BM_YoloLayer(28, 512, 256, 1, 1);
+BM_YoloLayer(30, 256, 512, 3, 1);
+BM_YoloLayer(28, 512, 512, 1, 1);
+BM_YoloLayer(30, 512, 1024, 3, 1);
+BM_YoloLayer(14, 1024, 512, 1, 1);
+BM_YoloLayer(16, 512, 1024, 3, 1);
+BM_YoloLayer(16, 1024, 1024, 3, 1);
+BM_YoloLayer(9, 1024, 1024, 3, 1);
+
+}  // namespace android
+}  // namespace tensorflow
+
+int main(int argc, char** argv) {
+  tensorflow::port::InitMain(argv[0], &argc, &argv);
+  // The 3x3 layers of YOLO small that take the Winograd path, and an odd
+  // size that leaves partial tiles at the edges.
+  tensorflow::android::VerifyWinograd(114, 64, 192);
+  tensorflow::android::VerifyWinograd(58, 128, 256);
+  tensorflow::android::VerifyWinograd(58, 256, 512);
+  tensorflow::android::VerifyWinograd(30, 256, 512);
+  tensorflow::android::VerifyWinograd(33, 32, 48);
+  tensorflow::testing::Benchmark::Run(argc > 1 ? argv[1] : "all");
+  return 0;
+}
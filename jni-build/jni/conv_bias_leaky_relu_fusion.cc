@@ -0,0 +1,599 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define EIGEN_USE_THREADS
+
+#include "tensorflow/examples/android/jni/conv_bias_leaky_relu_fusion.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/optimization_registry.h"
+#include "tensorflow/core/framework/common_shape_fns.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/shape_inference.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_types.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/eigen_spatial_convolutions.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/padding.h"
+#include "tensorflow/examples/android/jni/adaptive_sharder.h"
+#include "tensorflow/examples/android/jni/kernel_rewrite_utils.h"
+#include "tensorflow/examples/android/jni/winograd_conv.h"
+
+namespace tensorflow {
+
+using shape_inference::InferenceContext;
+using shape_inference::Shape;
+
+REGISTER_OP("FusedConv2DBiasLeakyRelu")
+    .Input("input: T")
+    .Input("filter: T")
+    .Input("bias: T")
+    .Output("output: T")
+    .Attr("T: {float}")
+    .Attr("strides: list(int)")
+    .Attr(GetPaddingAttrString())
+    .Attr("alpha: float")
+    .SetShapeFn([](InferenceContext* c) {
+      TF_RETURN_IF_ERROR(shape_inference::Conv2DShape(c));
+      const Shape* unused;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 1, &unused));
+      return Status::OK();
+    })
+    .Doc(R"doc(
+Computes max(alpha * x, x) with x = Conv2D(input, filter) + bias, in NHWC.
+
+Produced by the Conv2D, BiasAdd and leaky ReLU fusion pass rather than built
+directly; the result matches the unfused ops.
+
+filter: [filter_height, filter_width, in_channels, out_channels].
+bias: One value per output channel.
+strides: The stride of the sliding window for each dimension of the input.
+padding: The type of padding algorithm to use.
+alpha: Slope of the activation for negative values.
+)doc");
+
+namespace android {
+
+namespace {
+
+typedef Eigen::ThreadPoolDevice CPUDevice;
+
+// Output tiles are sized to stay within the L2 cache of a core between the
+// convolution writing them and the epilogue reading them back.
+const int64 kTileFloats = 32 * 1024;
+
+// Each tile packs the whole filter again, so tiles are kept large enough for
+// that to be a small fraction of their convolution.
+const int64 kMinTilePixels = 64;
+
+// Read when each kernel is constructed.
+std::atomic<bool> winograd_enabled(true);
+
+struct ConvGeometry {
+  int64 batch;
+  int64 in_rows;
+  int64 in_cols;
+  int64 in_depth;
+  int64 filter_rows;
+  int64 filter_cols;
+  int64 out_rows;
+  int64 out_cols;
+  int64 out_depth;
+  int stride_rows;
+  int stride_cols;
+
+  // Conv2D reduces these to a matrix multiplication.
+  bool IsPointwise() const {
+    return filter_rows == 1 && filter_cols == 1 && stride_rows == 1 &&
+           stride_cols == 1;
+  }
+};
+
+// Adds the bias to the pixels x depth values at output and applies the
+// activation in place.
+void ApplyBiasLeakyRelu(const float* const bias, const float alpha,
+                        const int64 depth, const int64 pixels, float* output) {
+  for (int64 p = 0; p < pixels; ++p) {
+    for (int64 c = 0; c < depth; ++c) {
+      const float value = output[c] + bias[c];
+      output[c] = std::max(alpha * value, value);
+    }
+    output += depth;
+  }
+}
+
+// Convolves output rows [row_begin, row_end) of one image on the calling
+// thread. Only valid without padding, or for pointwise filters, as the tile
+// reads just the input rows under it.
+void ConvolveTile(const ConvGeometry& g, const float* const input,
+                  const Tensor& filter, const int64 image,
+                  const int64 row_begin, const int64 row_end,
+                  float* const output) {
+  const int64 tile_rows = row_end - row_begin;
+  const float* const tile_input =
+      input +
+      ((image * g.in_rows + row_begin * g.stride_rows) * g.in_cols) *
+          g.in_depth;
+
+  if (g.IsPointwise()) {
+    const int64 pixels = tile_rows * g.out_cols;
+    Eigen::array<Eigen::IndexPair<Eigen::DenseIndex>, 1> dim_pair;
+    dim_pair[0] = Eigen::IndexPair<Eigen::DenseIndex>(1, 0);
+    TTypes<float, 2>::UnalignedTensor(output, pixels, g.out_depth) =
+        TTypes<float, 2>::UnalignedConstTensor(tile_input, pixels, g.in_depth)
+            .contract(filter.shaped<float, 2>({g.in_depth, g.out_depth}),
+                      dim_pair);
+    return;
+  }
+
+  const int64 tile_in_rows = (tile_rows - 1) * g.stride_rows + g.filter_rows;
+  // Need to swap row/col when calling Eigen.
+  TTypes<float, 4>::UnalignedTensor(output, 1, tile_rows, g.out_cols,
+                                    g.out_depth) =
+      Eigen::SpatialConvolution(
+          TTypes<float, 4>::UnalignedConstTensor(tile_input, 1, tile_in_rows,
+                                                 g.in_cols, g.in_depth),
+          filter.tensor<float, 4>(), g.stride_cols, g.stride_rows,
+          Eigen::PADDING_VALID);
+}
+
+class FusedConv2DBiasLeakyReluOp : public OpKernel {
+ public:
+  explicit FusedConv2DBiasLeakyReluOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("strides", &strides_));
+    OP_REQUIRES(context, strides_.size() == 4,
+                errors::InvalidArgument("Sliding window strides field must "
+                                        "specify 4 dimensions"));
+    OP_REQUIRES(
+        context, strides_[0] == 1 && strides_[3] == 1,
+        errors::InvalidArgument("Current implementation does not yet support "
+                                "strides in the batch and depth dimensions."));
+    OP_REQUIRES_OK(context, context->GetAttr("padding", &padding_));
+    OP_REQUIRES_OK(context, context->GetAttr("alpha", &alpha_));
+    use_winograd_ = winograd_enabled.load(std::memory_order_relaxed);
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& input = context->input(0);
+    const Tensor& filter = context->input(1);
+    const Tensor& bias = context->input(2);
+    OP_REQUIRES(context, input.dims() == 4,
+                errors::InvalidArgument("input must be 4-dimensional",
+                                        input.shape().DebugString()));
+    OP_REQUIRES(context, filter.dims() == 4,
+                errors::InvalidArgument("filter must be 4-dimensional: ",
+                                        filter.shape().DebugString()));
+    OP_REQUIRES(context, bias.dims() == 1,
+                errors::InvalidArgument("bias must be 1-dimensional: ",
+                                        bias.shape().DebugString()));
+
+    ConvGeometry g;
+    g.batch = input.dim_size(0);
+    g.in_rows = input.dim_size(1);
+    g.in_cols = input.dim_size(2);
+    g.in_depth = input.dim_size(3);
+    g.filter_rows = filter.dim_size(0);
+    g.filter_cols = filter.dim_size(1);
+    g.out_depth = filter.dim_size(3);
+    g.stride_rows = strides_[1];
+    g.stride_cols = strides_[2];
+    OP_REQUIRES(
+        context, g.in_depth == filter.dim_size(2),
+        errors::InvalidArgument("input and filter must have the same depth: ",
+                                g.in_depth, " vs ", filter.dim_size(2)));
+    OP_REQUIRES(
+        context, bias.dim_size(0) == g.out_depth,
+        errors::InvalidArgument("bias must have one value per filter: ",
+                                bias.dim_size(0), " vs ", g.out_depth));
+
+    int64 pad_rows = 0, pad_cols = 0;
+    OP_REQUIRES_OK(context, GetWindowedOutputSize(
+                                g.in_rows, g.filter_rows, g.stride_rows,
+                                padding_, &g.out_rows, &pad_rows));
+    OP_REQUIRES_OK(context, GetWindowedOutputSize(
+                                g.in_cols, g.filter_cols, g.stride_cols,
+                                padding_, &g.out_cols, &pad_cols));
+
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(
+                       0, TensorShape({g.batch, g.out_rows, g.out_cols,
+                                       g.out_depth}),
+                       &output));
+    if (output->NumElements() == 0) {
+      return;
+    }
+
+    const float* const input_data = input.flat<float>().data();
+    const float* const bias_data = bias.flat<float>().data();
+    float* const output_data = output->flat<float>().data();
+    const DeviceBase::CpuWorkerThreads& worker_threads =
+        *context->device()->tensorflow_cpu_worker_threads();
+
+    if (use_winograd_ && padding_ == VALID && g.filter_rows == 3 &&
+        g.filter_cols == 3 && g.stride_rows == 1 && g.stride_cols == 1 &&
+        UseWinogradConv3x3(g.out_rows, g.out_cols, g.in_depth,
+                           g.out_depth)) {
+      const std::shared_ptr<const Tensor> transformed =
+          TransformedFilter(filter, worker_threads);
+      WinogradConv3x3BiasLeakyRelu(
+          input_data, g.batch, g.in_rows, g.in_cols, g.in_depth,
+          transformed->flat<float>().data(), bias_data, alpha_, g.out_depth,
+          worker_threads, output_data);
+      return;
+    }
+
+    const int64 row_size = g.out_cols * g.out_depth;
+    const int64 tile_rows = std::min(
+        g.out_rows, std::max(kTileFloats / row_size,
+                             (kMinTilePixels + g.out_cols - 1) / g.out_cols));
+    const int64 tiles_per_image = (g.out_rows + tile_rows - 1) / tile_rows;
+    const int64 num_tiles = g.batch * tiles_per_image;
+    const int64 value_cost = g.filter_rows * g.filter_cols * g.in_depth;
+
+    if ((padding_ == VALID || g.IsPointwise()) &&
+        num_tiles >= worker_threads.num_threads) {
+      // Each thread convolves whole tiles on its own and finishes them while
+      // they are still in its cache.
+      auto work = [&](int64 begin, int64 end) {
+        for (int64 tile = begin; tile < end; ++tile) {
+          const int64 image = tile / tiles_per_image;
+          const int64 row_begin = (tile % tiles_per_image) * tile_rows;
+          const int64 row_end = std::min(row_begin + tile_rows, g.out_rows);
+          float* const tile_output =
+              output_data + (image * g.out_rows + row_begin) * row_size;
+          ConvolveTile(g, input_data, filter, image, row_begin, row_end,
+                       tile_output);
+          ApplyBiasLeakyRelu(bias_data, alpha_, g.out_depth,
+                             (row_end - row_begin) * g.out_cols, tile_output);
+        }
+      };
+      static ShardSite* const tile_site =
+          new ShardSite("conv_bias_leaky_relu/tiles");
+      AdaptiveShard(tile_site, worker_threads.num_threads,
+                    worker_threads.workers, num_tiles,
+                    tile_rows * row_size * value_cost, work);
+      return;
+    }
+
+    // Too few tiles to occupy every thread, or SAME padding, which the tiles
+    // cannot express: convolve with all threads as Conv2D does, then apply
+    // the epilogue in one parallel pass over the small or padded output.
+    const CPUDevice& device = context->eigen_device<CPUDevice>();
+    if (g.IsPointwise()) {
+      const int64 pixels = g.batch * g.out_rows * g.out_cols;
+      Eigen::array<Eigen::IndexPair<Eigen::DenseIndex>, 1> dim_pair;
+      dim_pair[0] = Eigen::IndexPair<Eigen::DenseIndex>(1, 0);
+      output->shaped<float, 2>({pixels, g.out_depth}).device(device) =
+          input.shaped<float, 2>({pixels, g.in_depth})
+              .contract(filter.shaped<float, 2>({g.in_depth, g.out_depth}),
+                        dim_pair);
+    } else {
+      output->tensor<float, 4>().device(device) = Eigen::SpatialConvolution(
+          input.tensor<float, 4>(), filter.tensor<float, 4>(), g.stride_cols,
+          g.stride_rows, BrainPadding2EigenPadding(padding_));
+    }
+    static ShardSite* const bias_site =
+        new ShardSite("conv_bias_leaky_relu/bias_leaky_relu");
+    AdaptiveShard(
+        bias_site, worker_threads.num_threads, worker_threads.workers,
+        g.batch * g.out_rows, row_size * 2, [&](int64 begin, int64 end) {
+          ApplyBiasLeakyRelu(bias_data, alpha_, g.out_depth,
+                             (end - begin) * g.out_cols,
+                             output_data + begin * row_size);
+        });
+  }
+
+ private:
+  // Returns the Winograd transform of filter, computed once per filter.
+  std::shared_ptr<const Tensor> TransformedFilter(
+      const Tensor& filter, const DeviceBase::CpuWorkerThreads& workers) {
+    return transformed_filter_.Get(
+        filter, [&workers](const Tensor& weights, Tensor* transformed) {
+          const int64 in_depth = weights.dim_size(2);
+          const int64 out_depth = weights.dim_size(3);
+          *transformed = Tensor(
+              DT_FLOAT, TensorShape({kWinogradPoints, in_depth, out_depth}));
+          TransformWinogradFilter(weights.flat<float>().data(), in_depth,
+                                  out_depth, workers,
+                                  transformed->flat<float>().data());
+        });
+  }
+
+  std::vector<int32> strides_;
+  Padding padding_;
+  float alpha_;
+  bool use_winograd_;
+
+  DerivedInputCache<Tensor> transformed_filter_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("FusedConv2DBiasLeakyRelu")
+                            .Device(DEVICE_CPU)
+                            .TypeConstraint<float>("T"),
+                        FusedConv2DBiasLeakyReluOp);
+
+// A matched layer. The fused node takes the convolution's data inputs and
+// the bias edge.
+struct LayerMatch {
+  Node* conv;
+  Node* biased;
+  Node* mul;
+  Node* maximum;
+  const Edge* bias;
+  float alpha;
+};
+
+// Whether node has exactly num_edges outgoing edges, all of them data inputs
+// of consumer_a or consumer_b.
+bool OnlyFeeds(const Node* node, const size_t num_edges,
+               const Node* consumer_a, const Node* consumer_b) {
+  if (node->out_edges().size() != num_edges) {
+    return false;
+  }
+  for (const Edge* edge : node->out_edges()) {
+    if (edge->IsControlEdge() ||
+        (edge->dst() != consumer_a && edge->dst() != consumer_b)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IsFloatOp(const Node* node, const char* type) {
+  DataType dtype;
+  return node->type_string() == type &&
+         GetNodeAttr(node->def(), "T", &dtype).ok() && dtype == DT_FLOAT;
+}
+
+// Op attrs added after a graph was exported may be absent; NHWC is their
+// default.
+bool IsNHWC(const Node* node) {
+  string data_format;
+  return !GetNodeAttr(node->def(), "data_format", &data_format).ok() ||
+         data_format == "NHWC";
+}
+
+bool GetConstValue(const Node* node, Tensor* value) {
+  const TensorProto* proto;
+  return node->type_string() == "Const" &&
+         GetNodeAttr(node->def(), "value", &proto).ok() &&
+         value->FromProto(*proto);
+}
+
+bool MatchConv(Node* conv, LayerMatch* match) {
+  if (!IsFloatOp(conv, "Conv2D") || !IsNHWC(conv)) {
+    return false;
+  }
+  match->conv = conv;
+  return true;
+}
+
+// Matches x = BiasAdd(conv, bias), or Add(conv, bias) in either order with a
+// constant bias of one value per filter, which Add would otherwise broadcast
+// differently.
+bool MatchBias(Node* biased, LayerMatch* match) {
+  const Edge* in0 = DataInput(biased, 0);
+  const Edge* in1 = DataInput(biased, 1);
+  if (in0 == nullptr || in1 == nullptr) {
+    return false;
+  }
+  if (IsFloatOp(biased, "BiasAdd")) {
+    match->bias = in1;
+    return IsNHWC(biased) && MatchConv(in0->src(), match);
+  }
+  if (!IsFloatOp(biased, "Add")) {
+    return false;
+  }
+  for (int i = 0; i < 2; ++i) {
+    const Edge* conv_edge = i == 0 ? in0 : in1;
+    const Edge* bias_edge = i == 0 ? in1 : in0;
+    Tensor bias;
+    if (!MatchConv(conv_edge->src(), match) ||
+        !GetConstValue(bias_edge->src(), &bias) || bias.dims() != 1) {
+      continue;
+    }
+    const Edge* filter_edge = DataInput(match->conv, 1);
+    Tensor filter;
+    if (filter_edge != nullptr && GetConstValue(filter_edge->src(), &filter) &&
+        filter.dims() == 4 && filter.dim_size(3) == bias.dim_size(0)) {
+      match->bias = bias_edge;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Matches Maximum(Mul(alpha, x), x) given which operand of maximum is the
+// Mul.
+bool MatchActivation(Node* maximum, const Edge* mul_edge, const Edge* x_edge,
+                     LayerMatch* match) {
+  Node* mul = mul_edge->src();
+  if (!IsFloatOp(mul, "Mul")) {
+    return false;
+  }
+  const Edge* in0 = DataInput(mul, 0);
+  const Edge* in1 = DataInput(mul, 1);
+  if (in0 == nullptr || in1 == nullptr) {
+    return false;
+  }
+  for (int i = 0; i < 2; ++i) {
+    const Edge* alpha_edge = i == 0 ? in0 : in1;
+    const Edge* mul_x_edge = i == 0 ? in1 : in0;
+    Tensor alpha;
+    if (mul_x_edge->src() != x_edge->src() ||
+        mul_x_edge->src_output() != x_edge->src_output() ||
+        !GetConstValue(alpha_edge->src(), &alpha) ||
+        alpha.dtype() != DT_FLOAT || alpha.NumElements() != 1) {
+      continue;
+    }
+    match->maximum = maximum;
+    match->mul = mul;
+    match->biased = x_edge->src();
+    match->alpha = alpha.flat<float>()(0);
+    return MatchBias(match->biased, match);
+  }
+  return false;
+}
+
+bool MatchLayer(Node* maximum, LayerMatch* match) {
+  if (!IsFloatOp(maximum, "Maximum")) {
+    return false;
+  }
+  const Edge* in0 = DataInput(maximum, 0);
+  const Edge* in1 = DataInput(maximum, 1);
+  if (in0 == nullptr || in1 == nullptr) {
+    return false;
+  }
+  if (!MatchActivation(maximum, in0, in1, match) &&
+      !MatchActivation(maximum, in1, in0, match)) {
+    return false;
+  }
+
+  // The intermediate values must not be needed anywhere else.
+  if (!OnlyFeeds(match->conv, 1, match->biased, nullptr) ||
+      !OnlyFeeds(match->biased, 2, match->mul, match->maximum) ||
+      !OnlyFeeds(match->mul, 1, match->maximum, nullptr)) {
+    return false;
+  }
+
+  // The fused kernel only exists for the CPU.
+  const string& device = match->conv->def().device();
+  for (const Node* node : {match->biased, match->mul, match->maximum}) {
+    if (node->def().device() != device) {
+      return false;
+    }
+  }
+  return IsCpuDevice(device);
+}
+
+Status ReplaceLayer(Graph* graph, const LayerMatch& match) {
+  const Edge* input = DataInput(match.conv, 0);
+  const Edge* filter = DataInput(match.conv, 1);
+  if (input == nullptr || filter == nullptr) {
+    return errors::InvalidArgument("Missing input of ", match.conv->name());
+  }
+  std::vector<int32> strides;
+  string padding;
+  TF_RETURN_IF_ERROR(GetNodeAttr(match.conv->def(), "strides", &strides));
+  TF_RETURN_IF_ERROR(GetNodeAttr(match.conv->def(), "padding", &padding));
+
+  const Node* const layer[] = {match.conv, match.biased, match.mul,
+                               match.maximum};
+  std::vector<Node*> control_inputs;
+  for (const Node* node : layer) {
+    for (const Edge* edge : node->in_edges()) {
+      if (edge->IsControlEdge() &&
+          std::find(control_inputs.begin(), control_inputs.end(),
+                    edge->src()) == control_inputs.end()) {
+        control_inputs.push_back(edge->src());
+      }
+    }
+  }
+
+  Node* fused;
+  TF_RETURN_IF_ERROR(NodeBuilder(match.maximum->name(),
+                                 "FusedConv2DBiasLeakyRelu",
+                                 graph->op_registry())
+                         .Input(input->src(), input->src_output())
+                         .Input(filter->src(), filter->src_output())
+                         .Input(match.bias->src(), match.bias->src_output())
+                         .Attr("T", DT_FLOAT)
+                         .Attr("strides", strides)
+                         .Attr("padding", padding)
+                         .Attr("alpha", match.alpha)
+                         .ControlInputs(control_inputs)
+                         .Device(match.conv->def().device())
+                         .Finalize(graph, &fused));
+
+  const std::vector<const Edge*> out_edges(match.maximum->out_edges().begin(),
+                                           match.maximum->out_edges().end());
+  for (const Edge* edge : out_edges) {
+    graph->AddEdge(fused, edge->src_output(), edge->dst(), edge->dst_input());
+  }
+  graph->RemoveNode(match.maximum);
+  graph->RemoveNode(match.mul);
+  graph->RemoveNode(match.biased);
+  graph->RemoveNode(match.conv);
+  return Status::OK();
+}
+
+std::atomic<bool> fusion_enabled(true);
+
+class ConvBiasLeakyReluFusionPass : public GraphOptimizationPass {
+ public:
+  Status Run(const GraphOptimizationPassOptions& options) override {
+    if (!fusion_enabled.load(std::memory_order_relaxed) ||
+        options.graph == nullptr) {
+      return Status::OK();
+    }
+    const int fused = FuseConvBiasLeakyRelu(options.graph->get());
+    if (fused > 0) {
+      VLOG(1) << "Fused " << fused << " convolution layers";
+    }
+    return Status::OK();
+  }
+};
+
+REGISTER_OPTIMIZATION(OptimizationPassRegistry::PRE_PLACEMENT, 0,
+                      ConvBiasLeakyReluFusionPass);
+
+}  // namespace
+
+int FuseConvBiasLeakyRelu(Graph* graph) {
+  // Collected first, as replacing a layer removes nodes from the graph.
+  std::vector<Node*> maximums;
+  for (Node* node : graph->nodes()) {
+    if (node->IsOp() && node->type_string() == "Maximum") {
+      maximums.push_back(node);
+    }
+  }
+
+  int fused = 0;
+  for (Node* maximum : maximums) {
+    LayerMatch match;
+    if (!MatchLayer(maximum, &match)) {
+      continue;
+    }
+    const Status s = ReplaceLayer(graph, match);
+    if (!s.ok()) {
+      LOG(WARNING) << "Could not fuse " << maximum->name() << ": " << s;
+      continue;
+    }
+    ++fused;
+  }
+  return fused;
+}
+
+void SetConvBiasLeakyReluFusion(const bool enabled) {
+  fusion_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void SetWinogradConv3x3(const bool enabled) {
+  winograd_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,700 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Replays recorded camera frames through the detector on a Linux host and
+// reports per-stage latency percentiles and throughput, so that regressions in
+// the native code can be caught on CI machines before a phone build. It drives
+// the same DetectorEngine as the JNI layer. It also reports the heap
+// allocations the detector makes per frame outside of Session::Run, which
+// should be 0 in the steady state.
+//
+// Frames are raw YUV 4:2:0 files, one frame per file, replayed in name order:
+// either I420 (full Y plane, then the U and V planes) or NV21 (full Y plane,
+// then interleaved V and U samples, as delivered by the old camera API).
+//
+// Usage:
+//   make -C jni-build benchmark
+//   jni-build/detector_benchmark --graph=android_graph.pb
+//       --frames=/path/to/frames --width=640 --height=480 --format=nv21
+//
+// With --reference_graph, every frame is also run through a second model,
+// typically the float original of an eight bit --graph, and the latency,
+// resident memory and detections of both are compared.
+//
+// With --profile_sample_interval=N, one in every N measured runs is traced and
+// the per-node summary logged; --profile_dir also writes the traces there.
+//
+// With --record_dir, one in every --record_sample_interval measured frames is
+// recorded there as the app records debug frames, so that the cost of
+// recording shows up in the percentiles and the files can be inspected.
+//
+// With --variant_graphs and --variant_input_sizes, comma separated and most
+// accurate first, cheaper exports of --graph are added to the engine and
+// --latency_target_ms switches frames between them; the number of frames run
+// at each input size is reported.
+//
+// --fuse_conv_bias_leaky_relu=false loads the graphs without fusing their
+// convolution layers, to measure what the fusion pass saves end to end, and
+// --winograd_conv3x3=false keeps the fused layers on the direct convolution.
+// --packed_matmul=false leaves the fully connected layers on MatMul, and
+// --matmul_weights=bfloat16|int8 packs their weights at reduced precision.
+// --static_executor runs the graphs from a static schedule instead of with
+// the local executor of DirectSession, and --static_memory_plan=false
+// leaves their intermediates to the CPU allocator. With --static_executor,
+// --critical_path_schedule runs independent nodes on the inter-op threads,
+// those with the longest measured path to the end of the graph first.
+// --thread_caching_allocator=false allocates the tensors of the CPU devices
+// straight from the CPU allocator instead of through per-thread bins; when
+// enabled, the share of small allocations served from the bins is logged.
+// --adaptive_sharding=false splits the loops of the fused convolution and
+// packed MatMul kernels by their static cost guesses, as Shard does; when
+// enabled, what each loop measured is logged.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/command_line_flags.h"
+#include "tensorflow/examples/android/jni/adaptive_sharder.h"
+#include "tensorflow/examples/android/jni/allocation_counter.h"
+#include "tensorflow/examples/android/jni/conv_bias_leaky_relu_fusion.h"
+#include "tensorflow/examples/android/jni/detector_engine.h"
+#include "tensorflow/examples/android/jni/frame_recorder.h"
+#include "tensorflow/examples/android/jni/memmapped_package.h"
+#include "tensorflow/examples/android/jni/non_max_suppression.h"
+#include "tensorflow/examples/android/jni/packed_matmul.h"
+#include "tensorflow/examples/android/jni/session_threading.h"
+#include "tensorflow/examples/android/jni/static_executor.h"
+#include "tensorflow/examples/android/jni/static_memory_planner.h"
+#include "tensorflow/examples/android/jni/thread_caching_allocator.h"
+#include "tensorflow/examples/android/jni/yuv2rgb.h"
+#include "tensorflow/examples/android/jni/yuv_preprocessor.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+inline int64 CurrentTimeUs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Latencies of one stage over all measured frames.
+class StageStats {
+ public:
+  explicit StageStats(const string& name) : name_(name) {}
+
+  void Add(const int64 us) { samples_.push_back(us); }
+
+  int64 total() const {
+    int64 total = 0;
+    for (const int64 us : samples_) {
+      total += us;
+    }
+    return total;
+  }
+
+  // Nearest-rank percentile.
+  int64 Percentile(const int percent) const {
+    if (samples_.empty()) {
+      return 0;
+    }
+    std::vector<int64> sorted(samples_);
+    std::sort(sorted.begin(), sorted.end());
+    const size_t rank = (sorted.size() * percent + 99) / 100;
+    return sorted[std::max<size_t>(rank, 1) - 1];
+  }
+
+  void Log() const {
+    const int64 count = std::max<int64>(samples_.size(), 1);
+    LOG(INFO) << name_ << ": p50 " << Percentile(50) << "us, p90 "
+              << Percentile(90) << "us, p99 " << Percentile(99) << "us, avg "
+              << total() / count << "us";
+  }
+
+ private:
+  const string name_;
+  std::vector<int64> samples_;
+};
+
+// Returns the resident set size of the process in kB, or 0 if unknown.
+int64 ReadResidentSetKb() {
+  FILE* const status = fopen("/proc/self/status", "r");
+  if (status == nullptr) {
+    return 0;
+  }
+  char line[128];
+  int64 resident_kb = 0;
+  while (fgets(line, sizeof(line), status) != nullptr) {
+    if (strncmp(line, "VmRSS:", 6) == 0) {
+      resident_kb = strtoll(line + 6, nullptr, 10);
+      break;
+    }
+  }
+  fclose(status);
+  return resident_kb;
+}
+
+// Intersection over union of two detections, as written by WriteDetections.
+float DetectionIOU(const float* const a, const float* const b) {
+  const float intersection_width = std::max(
+      0.0f, std::min(a[2] + a[4] / 2, b[2] + b[4] / 2) -
+                std::max(a[2] - a[4] / 2, b[2] - b[4] / 2));
+  const float intersection_height = std::max(
+      0.0f, std::min(a[3] + a[5] / 2, b[3] + b[5] / 2) -
+                std::max(a[3] - a[5] / 2, b[3] - b[5] / 2));
+  const float intersection = intersection_width * intersection_height;
+  const float union_area = a[4] * a[5] + b[4] * b[5] - intersection;
+  return union_area > 0 ? intersection / union_area : 0.0f;
+}
+
+// How well the detections of a model agree with those of a reference model
+// on the same frames. A detection agrees with a reference detection of the
+// same class if their boxes overlap by at least kMinIOU; each reference
+// detection is matched at most once, best score first.
+class DetectionAgreement {
+ public:
+  static constexpr float kMinIOU = 0.5f;
+
+  void Add(const float* const detections, const int count,
+           const float* const reference, const int reference_count) {
+    num_detections_ += count;
+    num_reference_ += reference_count;
+    matched_.assign(reference_count, false);
+    for (int i = 0; i < count; ++i) {
+      const float* const detection = detections + i * kDetectionStride;
+      for (int j = 0; j < reference_count; ++j) {
+        const float* const candidate = reference + j * kDetectionStride;
+        if (!matched_[j] && candidate[0] == detection[0] &&
+            DetectionIOU(detection, candidate) >= kMinIOU) {
+          matched_[j] = true;
+          ++num_matched_;
+          score_difference_ += fabs(detection[1] - candidate[1]);
+          break;
+        }
+      }
+    }
+  }
+
+  void Log() const {
+    LOG(INFO) << "Agreement with reference: " << num_matched_ << " of "
+              << num_reference_ << " reference detections found (recall "
+              << Ratio(num_matched_, num_reference_) << "), " << num_matched_
+              << " of " << num_detections_ << " detections confirmed "
+              << "(precision " << Ratio(num_matched_, num_detections_)
+              << "), mean score difference "
+              << (num_matched_ > 0 ? score_difference_ / num_matched_ : 0.0);
+  }
+
+ private:
+  static double Ratio(const int64 a, const int64 b) {
+    return b > 0 ? static_cast<double>(a) / b : 1.0;
+  }
+
+  int64 num_detections_ = 0;
+  int64 num_reference_ = 0;
+  int64 num_matched_ = 0;
+  double score_difference_ = 0.0;
+  std::vector<bool> matched_;
+};
+
+constexpr float DetectionAgreement::kMinIOU;
+
+// A recorded frame and the geometry of its planes.
+struct RecordedFrame {
+  string name;
+  string data;
+  YUV420Frame frame;
+};
+
+Status ReadFrames(const string& dir, const string& format, const int width,
+                  const int height, std::vector<RecordedFrame>* frames) {
+  const int uv_width = (width + 1) / 2;
+  const int uv_height = (height + 1) / 2;
+  const int64 y_size = static_cast<int64>(width) * height;
+  const int64 frame_size =
+      y_size + 2 * static_cast<int64>(uv_width) * uv_height;
+  if (format != "i420" && format != "nv21") {
+    return errors::InvalidArgument("Unknown frame format ", format);
+  }
+
+  Env* const env = Env::Default();
+  std::vector<string> names;
+  TF_RETURN_IF_ERROR(env->GetChildren(dir, &names));
+  std::sort(names.begin(), names.end());
+  for (const string& name : names) {
+    RecordedFrame recorded;
+    recorded.name = name;
+    TF_RETURN_IF_ERROR(
+        ReadFileToString(env, io::JoinPath(dir, name), &recorded.data));
+    if (recorded.data.size() != frame_size) {
+      LOG(WARNING) << "Skipping " << name << ": " << recorded.data.size()
+                   << " bytes, expected " << frame_size;
+      continue;
+    }
+    frames->push_back(std::move(recorded));
+  }
+  if (frames->empty()) {
+    return errors::NotFound("No ", width, "x", height, " ", format,
+                            " frames in ", dir);
+  }
+
+  // Point the frames at their planes only once the vector stops moving.
+  for (RecordedFrame& recorded : *frames) {
+    const uint8* const data =
+        reinterpret_cast<const uint8*>(recorded.data.data());
+    YUV420Frame& frame = recorded.frame;
+    frame.width = width;
+    frame.height = height;
+    frame.y = data;
+    frame.y_row_stride = width;
+    if (format == "i420") {
+      frame.u = data + y_size;
+      frame.v = frame.u + uv_width * uv_height;
+      frame.uv_row_stride = uv_width;
+      frame.uv_pixel_stride = 1;
+    } else {
+      frame.v = data + y_size;
+      frame.u = frame.v + 1;
+      frame.uv_row_stride = 2 * uv_width;
+      frame.uv_pixel_stride = 2;
+    }
+  }
+  return Status::OK();
+}
+
+// Reads graph_file as the JNI layer reads a model from the assets.
+Status ReadModel(const string& graph_file, GraphDef* const graph_def,
+                 std::unique_ptr<MemmappedPackage>* const package) {
+  if (MemmappedPackage::Map(nullptr, graph_file.c_str(), package).ok()) {
+    LOG(INFO) << "Mapped memmapped package " << graph_file;
+    return (*package)->ReadGraphDef(graph_def);
+  }
+  return ReadBinaryProto(Env::Default(), graph_file, graph_def);
+}
+
+// Loads graph_file as DetectorEngine is loaded by initializeTensorFlow.
+Status LoadEngine(const string& graph_file, const DetectorConfig& config,
+                  std::unique_ptr<DetectorEngine>* engine) {
+  GraphDef graph_def;
+  std::unique_ptr<MemmappedPackage> package;
+  TF_RETURN_IF_ERROR(ReadModel(graph_file, &graph_def, &package));
+  return DetectorEngine::Create(graph_def, config, std::move(package), engine);
+}
+
+// Adds the comma separated variant_graphs to engine, with the matching
+// entries of variant_input_sizes, as addModelVariant does.
+Status AddVariants(const string& variant_graphs,
+                   const string& variant_input_sizes,
+                   DetectorEngine* const engine) {
+  const std::vector<string> graphs =
+      str_util::Split(variant_graphs, ',', str_util::SkipEmpty());
+  const std::vector<string> sizes =
+      str_util::Split(variant_input_sizes, ',', str_util::SkipEmpty());
+  if (graphs.size() != sizes.size()) {
+    return errors::InvalidArgument(graphs.size(), " variant graphs but ",
+                                   sizes.size(), " input sizes");
+  }
+  for (int i = 0; i < graphs.size(); ++i) {
+    int32 input_size;
+    if (!strings::safe_strto32(sizes[i], &input_size)) {
+      return errors::InvalidArgument("Invalid input size ", sizes[i]);
+    }
+    GraphDef graph_def;
+    std::unique_ptr<MemmappedPackage> package;
+    TF_RETURN_IF_ERROR(ReadModel(graphs[i], &graph_def, &package));
+    TF_RETURN_IF_ERROR(engine->AddVariant(graph_def, input_size,
+                                          engine->config().grid,
+                                          std::move(package)));
+  }
+  return Status::OK();
+}
+
+int Main(int argc, char** argv) {
+  string graph = "android_graph.pb";
+  string reference_graph = "";
+  string frames_dir = "";
+  string format = "nv21";
+  int32 width = 640;
+  int32 height = 480;
+  int32 rotation = 90;
+  int32 input_size = 448;
+  int32 image_mean = 128;
+  string image_std = "128";
+  string input_name = "Placeholder";
+  string output_name = "19_fc";
+  int32 num_classes = 20;
+  int32 grid_size = 7;
+  int32 boxes_per_cell = 2;
+  int32 max_detections = 10;
+  string score_threshold = "0.2";
+  string iou_threshold = "0.5";
+  int32 warmup_frames = 5;
+  int32 passes = 1;
+  int32 intra_op_threads = 0;
+  int32 inter_op_threads = 0;
+  bool use_per_session_threads = false;
+  string cpu_affinity_mask = "0";
+  int32 profile_sample_interval = 0;
+  string profile_dir = "";
+  bool scene_change_gating = false;
+  string scene_change_block_threshold = "10";
+  string scene_change_block_fraction = "0.02";
+  int32 scene_change_refresh_interval = 15;
+  string record_dir = "";
+  int32 record_sample_interval = 30;
+  string variant_graphs = "";
+  string variant_input_sizes = "";
+  int32 latency_target_ms = 0;
+  bool fuse_conv_bias_leaky_relu = true;
+  bool winograd_conv3x3 = true;
+  bool packed_matmul = true;
+  string matmul_weights = "float";
+  bool static_executor = false;
+  bool static_memory_plan = true;
+  bool critical_path_schedule = false;
+  bool thread_caching_allocator = true;
+  bool adaptive_sharding = true;
+
+  const bool parse_ok = ParseFlags(
+      &argc, argv,
+      {Flag("graph", &graph), Flag("reference_graph", &reference_graph),
+       Flag("frames", &frames_dir),
+       Flag("format", &format), Flag("width", &width),
+       Flag("height", &height), Flag("rotation", &rotation),
+       Flag("input_size", &input_size), Flag("image_mean", &image_mean),
+       Flag("image_std", &image_std), Flag("input_name", &input_name),
+       Flag("output_name", &output_name), Flag("num_classes", &num_classes),
+       Flag("grid_size", &grid_size),
+       Flag("boxes_per_cell", &boxes_per_cell),
+       Flag("max_detections", &max_detections),
+       Flag("score_threshold", &score_threshold),
+       Flag("iou_threshold", &iou_threshold),
+       Flag("warmup_frames", &warmup_frames), Flag("passes", &passes),
+       Flag("intra_op_threads", &intra_op_threads),
+       Flag("inter_op_threads", &inter_op_threads),
+       Flag("use_per_session_threads", &use_per_session_threads),
+       Flag("cpu_affinity_mask", &cpu_affinity_mask),
+       Flag("profile_sample_interval", &profile_sample_interval),
+       Flag("profile_dir", &profile_dir),
+       Flag("scene_change_gating", &scene_change_gating),
+       Flag("scene_change_block_threshold", &scene_change_block_threshold),
+       Flag("scene_change_block_fraction", &scene_change_block_fraction),
+       Flag("scene_change_refresh_interval",
+            &scene_change_refresh_interval),
+       Flag("record_dir", &record_dir),
+       Flag("record_sample_interval", &record_sample_interval),
+       Flag("variant_graphs", &variant_graphs),
+       Flag("variant_input_sizes", &variant_input_sizes),
+       Flag("latency_target_ms", &latency_target_ms),
+       Flag("fuse_conv_bias_leaky_relu", &fuse_conv_bias_leaky_relu),
+       Flag("winograd_conv3x3", &winograd_conv3x3),
+       Flag("packed_matmul", &packed_matmul),
+       Flag("matmul_weights", &matmul_weights),
+       Flag("static_executor", &static_executor),
+       Flag("static_memory_plan", &static_memory_plan),
+       Flag("critical_path_schedule", &critical_path_schedule),
+       Flag("thread_caching_allocator", &thread_caching_allocator),
+       Flag("adaptive_sharding", &adaptive_sharding)});
+  if (!parse_ok || argc > 1 || frames_dir.empty()) {
+    LOG(ERROR) << "Usage: " << argv[0]
+               << " --graph=<graph.pb> --frames=<dir> [--width=640]"
+               << " [--height=480] [--format=nv21|i420] [--passes=1] ...";
+    return 1;
+  }
+
+  DetectorConfig config;
+  config.input_size = input_size;
+  config.image_mean = image_mean;
+  config.image_std = strtof(image_std.c_str(), nullptr);
+  config.input_name = input_name;
+  config.output_name = output_name;
+  config.grid.grid_size = grid_size;
+  config.grid.boxes_per_cell = boxes_per_cell;
+  config.grid.num_classes = num_classes;
+  config.threading.intra_op_threads = intra_op_threads;
+  config.threading.inter_op_threads = inter_op_threads;
+  config.threading.use_per_session_threads = use_per_session_threads;
+  config.threading.cpu_affinity_mask =
+      cpu_affinity_mask == "fastest"
+          ? kFastestCpus
+          : strtoull(cpu_affinity_mask.c_str(), nullptr, 16);
+  config.static_executor = static_executor;
+
+  std::vector<RecordedFrame> frames;
+  Status s = ReadFrames(frames_dir, format, width, height, &frames);
+  if (!s.ok()) {
+    LOG(ERROR) << s;
+    return 1;
+  }
+  LOG(INFO) << "Replaying " << frames.size() << " frames " << passes
+            << " times.";
+
+  SetConvBiasLeakyReluFusion(fuse_conv_bias_leaky_relu);
+  SetWinogradConv3x3(winograd_conv3x3);
+  if (matmul_weights != "float" && matmul_weights != "bfloat16" &&
+      matmul_weights != "int8") {
+    LOG(ERROR) << "Unknown MatMul weight format " << matmul_weights;
+    return 1;
+  }
+  SetPackedMatMul(packed_matmul, matmul_weights == "int8"
+                                     ? kMatMulWeightsInt8
+                                     : matmul_weights == "bfloat16"
+                                           ? kMatMulWeightsBfloat16
+                                           : kMatMulWeightsFloat);
+  SetStaticMemoryPlanning(static_memory_plan);
+  SetCriticalPathScheduling(critical_path_schedule);
+  SetThreadCachingAllocator(thread_caching_allocator);
+  SetAdaptiveSharding(adaptive_sharding);
+  if (static_executor) {
+    // So that the memory plan is reported next to the peak of the CPU
+    // allocator, where the platform can measure it.
+    EnableCPUAllocatorStats(true);
+  }
+  std::unique_ptr<DetectorEngine> engine;
+  const int64 load_start_time = CurrentTimeUs();
+  const int64 load_start_rss_kb = ReadResidentSetKb();
+  s = LoadEngine(graph, config, &engine);
+  if (!s.ok()) {
+    LOG(ERROR) << "Could not load " << graph << ": " << s;
+    return 1;
+  }
+  s = AddVariants(variant_graphs, variant_input_sizes, engine.get());
+  if (!s.ok()) {
+    LOG(ERROR) << "Could not load model variants: " << s;
+    return 1;
+  }
+  // The controller settles on a variant during warmup.
+  engine->SetLatencyTarget(static_cast<int64>(latency_target_ms) * 1000);
+  LOG(INFO) << "Loaded " << graph << " in "
+            << (CurrentTimeUs() - load_start_time) / 1000 << "ms, "
+            << (ReadResidentSetKb() - load_start_rss_kb) / 1024
+            << "MB resident";
+
+  // Resident memory also grows on the first runs, as the sessions allocate
+  // their activations, so it is reported again after the run.
+  std::unique_ptr<DetectorEngine> reference_engine;
+  if (!reference_graph.empty()) {
+    const int64 reference_start_rss_kb = ReadResidentSetKb();
+    s = LoadEngine(reference_graph, config, &reference_engine);
+    if (!s.ok()) {
+      LOG(ERROR) << "Could not load " << reference_graph << ": " << s;
+      return 1;
+    }
+    LOG(INFO) << "Loaded reference " << reference_graph << ", "
+              << (ReadResidentSetKb() - reference_start_rss_kb) / 1024
+              << "MB resident";
+  }
+
+  // Profiling is left disabled during warmup; traced runs are slower, so
+  // they show up in the run percentiles.
+  const int64 num_profiled_runs =
+      profile_sample_interval > 0
+          ? (static_cast<int64>(frames.size()) * passes +
+             profile_sample_interval - 1) /
+                profile_sample_interval
+          : 0;
+
+  // Gated frames skip every stage and pull the percentiles down, so the
+  // number skipped is reported along with them.
+  SceneChangeConfig scene_change;
+  scene_change.enabled = scene_change_gating;
+  scene_change.block_threshold =
+      strtof(scene_change_block_threshold.c_str(), nullptr);
+  scene_change.changed_block_fraction =
+      strtof(scene_change_block_fraction.c_str(), nullptr);
+  scene_change.refresh_interval = scene_change_refresh_interval;
+
+  const float score = strtof(score_threshold.c_str(), nullptr);
+  const float iou = strtof(iou_threshold.c_str(), nullptr);
+  std::vector<float> detections(max_detections * kDetectionStride);
+  std::vector<float> reference_detections(detections.size());
+  std::vector<uint32> argb(static_cast<size_t>(width) * height);
+
+  StageStats yuv2rgb_stats("yuv2rgb");
+  StageStats preprocess_stats("preprocess");
+  StageStats run_stats("run");
+  StageStats decode_stats("decode");
+  StageStats suppress_stats("suppress");
+  StageStats total_stats("detect");
+  StageStats reference_run_stats("reference run");
+  StageStats reference_total_stats("reference detect");
+  DetectionAgreement agreement;
+  // Frames run at each input size.
+  std::map<int, int64> frames_per_input_size;
+  // Heap allocations of the detector per measured frame, leaving out those
+  // of Session::Run.
+  int64 total_allocations = 0;
+  int64 max_allocations = 0;
+
+  const int64 num_frames = static_cast<int64>(frames.size()) * passes;
+  for (int64 i = -warmup_frames; i < num_frames; ++i) {
+    if (i == 0) {
+      if (profile_sample_interval > 0) {
+        engine->profiler()->Configure(profile_sample_interval,
+                                      num_profiled_runs);
+      }
+      engine->SetSceneChangeConfig(scene_change);
+      if (!record_dir.empty()) {
+        FrameRecorderConfig recorder;
+        recorder.directory = record_dir;
+        recorder.sample_interval = record_sample_interval;
+        s = engine->StartRecording(recorder);
+        if (!s.ok()) {
+          LOG(ERROR) << "Could not record to " << record_dir << ": " << s;
+          return 1;
+        }
+      }
+    }
+    const YUV420Frame& frame =
+        frames[(i + warmup_frames) % frames.size()].frame;
+
+    // The full-frame conversion the Java side uses for previews and debug
+    // frames, through ImageUtils.
+    const int64 convert_start_time = CurrentTimeUs();
+    ConvertYUV420ToARGB8888(frame.y, frame.u, frame.v, argb.data(),
+                            frame.width, frame.height, frame.y_row_stride,
+                            frame.uv_row_stride, frame.uv_pixel_stride);
+    const int64 detect_start_time = CurrentTimeUs();
+
+    const int active_input_size = engine->ActiveInputSize();
+    FrameTiming timing;
+    const int64 allocation_count = GetThreadAllocationCount();
+    int count;
+    s = engine->DetectYuv(frame, rotation, max_detections, score, iou,
+                          detections.data(), &count, &timing);
+    const int64 end_time = CurrentTimeUs();
+    if (!s.ok()) {
+      LOG(ERROR) << "Error running the detector: " << s;
+      return 1;
+    }
+    const int64 frame_allocations =
+        GetThreadAllocationCount() - allocation_count;
+
+    if (reference_engine != nullptr) {
+      FrameTiming reference_timing;
+      int reference_count;
+      s = reference_engine->DetectYuv(frame, rotation, max_detections, score,
+                                      iou, reference_detections.data(),
+                                      &reference_count, &reference_timing);
+      if (!s.ok()) {
+        LOG(ERROR) << "Error running the reference detector: " << s;
+        return 1;
+      }
+      if (i >= 0) {
+        reference_run_stats.Add(reference_timing.run_us);
+        reference_total_stats.Add(CurrentTimeUs() - end_time);
+        agreement.Add(detections.data(), count, reference_detections.data(),
+                      reference_count);
+      }
+    }
+    if (i < 0) {
+      continue;
+    }
+    ++frames_per_input_size[active_input_size];
+    yuv2rgb_stats.Add(detect_start_time - convert_start_time);
+    preprocess_stats.Add(timing.preprocess_us);
+    run_stats.Add(timing.run_us);
+    decode_stats.Add(timing.decode_us);
+    suppress_stats.Add(timing.suppress_us);
+    total_stats.Add(end_time - detect_start_time);
+    total_allocations += frame_allocations;
+    max_allocations = std::max(max_allocations, frame_allocations);
+  }
+
+  yuv2rgb_stats.Log();
+  preprocess_stats.Log();
+  run_stats.Log();
+  decode_stats.Log();
+  suppress_stats.Log();
+  total_stats.Log();
+  LOG(INFO) << "Throughput: "
+            << num_frames * 1000000.0 / std::max<int64>(total_stats.total(), 1)
+            << " fps over " << num_frames << " frames";
+  LOG(INFO) << "Resident memory after the run: "
+            << ReadResidentSetKb() / 1024 << "MB";
+  LOG(INFO) << "Heap allocations per frame outside of Session::Run: avg "
+            << static_cast<double>(total_allocations) /
+                   std::max<int64>(num_frames, 1)
+            << ", max " << max_allocations;
+  if (reference_engine != nullptr) {
+    reference_run_stats.Log();
+    reference_total_stats.Log();
+    agreement.Log();
+  }
+  if (latency_target_ms > 0) {
+    for (const auto& entry : frames_per_input_size) {
+      LOG(INFO) << entry.second << " frames run at " << entry.first << "x"
+                << entry.first;
+    }
+  }
+  if (thread_caching_allocator) {
+    ThreadCacheStats stats;
+    ThreadCachingCpuAllocator()->GetCacheStats(&stats);
+    LOG(INFO) << "Thread caching allocator: " << stats.DebugString();
+  }
+  if (adaptive_sharding) {
+    for (const ShardSiteStats& stats : GetShardSiteStats()) {
+      LOG(INFO) << "Shard site " << stats.DebugString();
+    }
+  }
+  if (scene_change_gating) {
+    const SceneChangeDetector::Stats stats = engine->GetSceneChangeStats();
+    LOG(INFO) << "Scene change gating skipped " << stats.frames_skipped
+              << " of " << stats.frames_checked << " runs, "
+              << stats.forced_refreshes << " forced refreshes.";
+  }
+
+  if (!record_dir.empty()) {
+    // Logs what was recorded once the queued frames are written.
+    engine->StopRecording();
+  }
+
+  if (profile_sample_interval > 0) {
+    LOG(INFO) << engine->profiler()->GetSummary();
+    if (!profile_dir.empty()) {
+      engine->profiler()->Flush(profile_dir);
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace android
+}  // namespace tensorflow
+
+int main(int argc, char** argv) {
+  tensorflow::port::InitMain(argv[0], &argc, &argv);
+  return tensorflow::android::Main(argc, argv);
+}
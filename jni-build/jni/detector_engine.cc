@@ -0,0 +1,612 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/detector_engine.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/examples/android/jni/allocation_counter.h"
+#include "tensorflow/examples/android/jni/static_executor.h"
+
+namespace tensorflow {
+namespace android {
+
+const int64 DetectorEngine::kUnchangedFrame;
+
+namespace {
+
+// Improve benchmarking by limiting runs to predefined amount.
+// 0 (default) denotes infinite runs.
+#ifndef MAX_NUM_RUNS
+#define MAX_NUM_RUNS 0
+#endif
+
+const bool kBenchmarkMode = MAX_NUM_RUNS > 0;
+
+inline int64 CurrentThreadTimeUs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Reads the current frequency of the first core.
+int64 GetCpuSpeed() {
+  const int kMaxLength = 32;
+  char contents[kMaxLength];
+  const int fd =
+      open("/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq", O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  const ssize_t length = read(fd, contents, kMaxLength - 1);
+  close(fd);
+  if (length <= 0) {
+    return 0;
+  }
+  contents[length] = '\0';
+  return strtoll(contents, nullptr, 10);
+}
+
+// Selects the static executor in options if config asks for it and graph_def
+// has no control flow.
+void SelectExecutor(const DetectorConfig& config, const GraphDef& graph_def,
+                    SessionOptions* const options) {
+  if (!config.static_executor) {
+    return;
+  }
+  const Status s = CheckStaticGraph(graph_def);
+  if (!s.ok()) {
+    LOG(WARNING) << "Using the local executor: " << s;
+    return;
+  }
+  options->target = kStaticSessionTarget;
+}
+
+}  // namespace
+
+Status DetectorEngine::Create(const GraphDef& graph_def,
+                              const DetectorConfig& config,
+                              std::unique_ptr<MemmappedPackage> package,
+                              std::unique_ptr<DetectorEngine>* engine) {
+  if (config.input_size <= 0) {
+    return errors::InvalidArgument("Invalid model input size ",
+                                   config.input_size);
+  }
+  std::unique_ptr<DetectorEngine> new_engine(
+      new DetectorEngine(config, graph_def));
+
+  LOG(INFO) << "Creating session.";
+  SessionOptions options;
+  ConfigureSessionThreading(config.threading, &options);
+  SelectExecutor(config, graph_def, &options);
+  new_engine->env_ = options.env;
+  TF_RETURN_IF_ERROR(CreateSession(graph_def, options, std::move(package),
+                                   new_engine->variants_[0].get()));
+
+  *engine = std::move(new_engine);
+  return Status::OK();
+}
+
+Status DetectorEngine::CreateSession(const GraphDef& graph_def,
+                                     SessionOptions options,
+                                     std::unique_ptr<MemmappedPackage> package,
+                                     ModelVariant* const variant) {
+  if (package != nullptr) {
+    variant->package = std::move(package);
+    variant->package_env = variant->package->NewEnv(options.env);
+    options.env = variant->package_env.get();
+  }
+  variant->session.reset(NewSession(options));
+  if (variant->session == nullptr) {
+    return errors::Internal("Could not create a TensorFlow session.");
+  }
+  return variant->session->Create(graph_def);
+}
+
+DetectorEngine::ModelVariant::ModelVariant(const DetectorConfig& config,
+                                           const int input_size,
+                                           const YoloGridConfig& grid)
+    : index(0),
+      input_size(input_size),
+      grid(grid),
+      input_tensor(DT_FLOAT, TensorShape({1, input_size, input_size, 3})),
+      preprocessor(input_size, config.image_mean, config.image_std),
+      candidates(grid.NumCandidates() * grid.CandidateStride()),
+      suppressor(grid) {
+  // The feed shares its buffer with input_tensor.
+  input_feed.emplace_back(config.input_name, input_tensor);
+}
+
+DetectorEngine::ModelVariant::~ModelVariant() {
+  if (session != nullptr) {
+    const Status s = session->Close();
+    if (!s.ok()) {
+      LOG(ERROR) << "Error closing session: " << s;
+    }
+  }
+}
+
+DetectorEngine::DetectorEngine(const DetectorConfig& config,
+                               const GraphDef& graph_def)
+    : config_(config),
+      env_(Env::Default()),
+      recorder_(config.image_mean, config.image_std),
+      num_last_yuv_detections_(0),
+      num_runs_(0),
+      timing_total_us_(0),
+      last_allocation_count_(0),
+      profiler_(graph_def),
+      next_frame_id_(0) {
+  const YoloGridConfig& grid = config_.grid;
+  variants_.emplace_back(
+      new ModelVariant(config_, config_.input_size, config_.grid));
+  detections_.resize(grid.NumCandidates() * grid.num_classes);
+  last_yuv_detections_.resize(detections_.size());
+
+  // output_tensors_ keeps its capacity across runs.
+  output_names_.assign(1, config_.output_name);
+  output_tensors_.reserve(output_names_.size());
+  run_options_.set_trace_level(RunOptions::FULL_TRACE);
+}
+
+DetectorEngine::~DetectorEngine() {
+  StopPipeline();
+  if (latency_.num_switches() > 0) {
+    LOG(INFO) << "Switched model variants " << latency_.num_switches()
+              << " times to meet the latency target.";
+  }
+}
+
+void DetectorEngine::FillInput(const RGBA* const pixels) {
+  const int size = config_.input_size;
+  const float mean = config_.image_mean;
+  const float std = config_.image_std;
+  auto input_tensor_mapped = variants_[0]->input_tensor.tensor<float, 4>();
+
+  VLOG(1) << "TensorFlow: Copying Data.";
+  for (int i = 0; i < size; ++i) {
+    const RGBA* src = pixels + i * size;
+    for (int j = 0; j < size; ++j) {
+      // Copy 3 values
+      input_tensor_mapped(0, i, j, 0) =
+          (static_cast<float>(src->red) - mean) / std;
+      input_tensor_mapped(0, i, j, 1) =
+          (static_cast<float>(src->green) - mean) / std;
+      input_tensor_mapped(0, i, j, 2) =
+          (static_cast<float>(src->blue) - mean) / std;
+      ++src;
+    }
+  }
+}
+
+Status DetectorEngine::RunModel(ModelVariant* const variant,
+                                const Feed& inputs, int* const num_candidates,
+                                FrameTiming* const timing) {
+  // Force the app to quit if we've reached our run quota, to make
+  // benchmarks more reproducible.
+  if (MAX_NUM_RUNS > 0 && num_runs_ >= MAX_NUM_RUNS) {
+    LOG(INFO) << "Benchmark complete. "
+              << (timing_total_us_ / num_runs_ / 1000) << "ms/run avg over "
+              << num_runs_ << " runs.";
+    LOG(INFO) << "Heap allocations per frame outside of Session::Run: "
+              << frame_allocations_;
+    LOG(INFO) << "";
+    exit(0);
+  }
+
+  if (kBenchmarkMode) {
+    // Everything this thread allocated since the previous run belongs to the
+    // previous frame: its postprocessing and this frame's preprocessing.
+    const int64 allocation_count = GetThreadAllocationCount();
+    if (num_runs_ > 0) {
+      frame_allocations_.UpdateStat(allocation_count - last_allocation_count_);
+    }
+    last_allocation_count_ = allocation_count;
+  }
+
+  ++num_runs_;
+
+  VLOG(1) << "Start computing.";
+
+  Status s;
+  int64 start_time, end_time;
+
+  Session* const session = variant->session.get();
+  // The profiler aggregates per node of the first variant's graph.
+  if (variant->index == 0 && profiler_.ShouldTrace()) {
+    run_metadata_.Clear();
+    const int64 frequency_start = GetCpuSpeed();
+    start_time = CurrentThreadTimeUs();
+    {
+      ScopedAllocationCountingPause pause;
+      s = session->Run(run_options_, inputs, output_names_, {},
+                       &output_tensors_, &run_metadata_);
+    }
+    end_time = CurrentThreadTimeUs();
+    const int64 frequency_end = GetCpuSpeed();
+    if (s.ok()) {
+      profiler_.Record(run_metadata_.mutable_step_stats(), frequency_start,
+                       frequency_end);
+    }
+  } else {
+    start_time = CurrentThreadTimeUs();
+    {
+      ScopedAllocationCountingPause pause;
+      s = session->Run(inputs, output_names_, {}, &output_tensors_);
+    }
+    end_time = CurrentThreadTimeUs();
+  }
+  const int64 elapsed_time_inf = end_time - start_time;
+  timing_total_us_ += elapsed_time_inf;
+  VLOG(1) << "End computing. Ran in " << elapsed_time_inf / 1000 << "ms ("
+          << (timing_total_us_ / num_runs_ / 1000) << "ms avg over "
+          << num_runs_ << " runs)";
+
+  if (!s.ok()) {
+    return s;
+  }
+  latency_.Update(variant->index, elapsed_time_inf);
+
+  const YoloGridConfig& grid = variant->grid;
+  const Tensor& output = output_tensors_[0];
+  const int output_size = output.NumElements();
+  if (output_size != grid.OutputSize()) {
+    return errors::InvalidArgument("Output layer ", output_names_[0], " has ",
+                                   output_size, " values, expected ",
+                                   grid.OutputSize());
+  }
+
+  DecodeYoloOutput(grid, output.flat<float>().data(),
+                   variant->candidates.data());
+  if (timing != nullptr) {
+    timing->run_us = elapsed_time_inf;
+    timing->decode_us = CurrentThreadTimeUs() - end_time;
+  }
+  *num_candidates = grid.NumCandidates();
+  return Status::OK();
+}
+
+int DetectorEngine::Suppress(ModelVariant* const variant,
+                             const int num_candidates, const int max_results,
+                             const float score_threshold,
+                             const float iou_threshold, float* const output) {
+  if (num_candidates == 0) {
+    return 0;
+  }
+
+  // Boxes are normalized to the crop the model saw, so they need no scaling
+  // whatever the input size of the variant.
+  const int num_detections = variant->suppressor.Run(
+      variant->candidates.data(), score_threshold, iou_threshold,
+      std::min<int>(max_results, detections_.size()), detections_.data());
+  WriteDetections(detections_.data(), num_detections, output);
+  return num_detections;
+}
+
+Status DetectorEngine::Classify(const RGBA* const pixels,
+                                float* const candidates,
+                                int* const num_candidates) {
+  mutex_lock l(mu_);
+  ModelVariant* const variant = variants_[0].get();
+  FillInput(pixels);
+  TF_RETURN_IF_ERROR(RunModel(variant, variant->input_feed, num_candidates));
+  std::copy_n(variant->candidates.data(),
+              *num_candidates * variant->grid.CandidateStride(), candidates);
+  return Status::OK();
+}
+
+Status DetectorEngine::Detect(const RGBA* const pixels,
+                              const int max_detections,
+                              const float score_threshold,
+                              const float iou_threshold,
+                              float* const detections,
+                              int* const num_detections) {
+  mutex_lock l(mu_);
+  ModelVariant* const variant = variants_[0].get();
+  FillInput(pixels);
+  int num_candidates;
+  TF_RETURN_IF_ERROR(RunModel(variant, variant->input_feed, &num_candidates));
+  *num_detections = Suppress(variant, num_candidates, max_detections,
+                             score_threshold, iou_threshold, detections);
+  return Status::OK();
+}
+
+Status DetectorEngine::DetectYuv(const YUV420Frame& frame, const int rotation,
+                                 const int max_detections,
+                                 const float score_threshold,
+                                 const float iou_threshold,
+                                 float* const detections,
+                                 int* const num_detections,
+                                 FrameTiming* const timing) {
+  const int64 frame_time_us = Env::Default()->NowMicros();
+  mutex_lock l(mu_);
+  if (!scene_change_.ShouldRun(frame)) {
+    *num_detections =
+        std::max(0, std::min(num_last_yuv_detections_, max_detections));
+    WriteDetections(last_yuv_detections_.data(), *num_detections, detections);
+    if (timing != nullptr) {
+      *timing = FrameTiming();
+    }
+    return Status::OK();
+  }
+
+  ModelVariant* const variant = variants_[latency_.active()].get();
+  const int64 start_time = CurrentThreadTimeUs();
+  variant->preprocessor.Process(frame, rotation,
+                                variant->input_tensor.flat<float>().data());
+  const int64 preprocess_end_time = CurrentThreadTimeUs();
+  int num_candidates;
+  TF_RETURN_IF_ERROR(
+      RunModel(variant, variant->input_feed, &num_candidates, timing));
+  const int64 suppress_start_time = CurrentThreadTimeUs();
+  *num_detections = Suppress(variant, num_candidates, max_detections,
+                             score_threshold, iou_threshold, detections);
+  if (timing != nullptr) {
+    timing->preprocess_us = preprocess_end_time - start_time;
+    timing->suppress_us = CurrentThreadTimeUs() - suppress_start_time;
+  }
+  // Suppress leaves the detections in detections_.
+  std::copy_n(detections_.begin(), *num_detections,
+              last_yuv_detections_.begin());
+  num_last_yuv_detections_ = *num_detections;
+  tracker_.Update(detections_.data(), *num_detections, frame_time_us);
+  if (recorder_.ShouldRecord()) {
+    recorder_.Record(variant->input_tensor, detections_.data(),
+                     *num_detections, frame_time_us);
+  }
+  return Status::OK();
+}
+
+void DetectorEngine::RunPipelineFrame(const int buffer, const int64 frame_id) {
+  int num_detections;
+  {
+    mutex_lock l(mu_);
+    const int index = worker_.variants[buffer];
+    ModelVariant* const variant = variants_[index].get();
+    int num_candidates;
+    const Status s =
+        RunModel(variant, worker_.feeds[buffer][index], &num_candidates);
+    if (!s.ok()) {
+      // The frame is still delivered, without detections, so that results
+      // stay in submission order.
+      LOG(ERROR) << "Error during inference: " << s;
+      num_detections = 0;
+    } else {
+      num_detections = Suppress(variant, num_candidates,
+                                worker_.max_detections,
+                                worker_.score_threshold,
+                                worker_.iou_threshold,
+                                worker_.detections.data());
+      tracker_.Update(detections_.data(), num_detections,
+                      worker_.submit_times_us[buffer]);
+      if (recorder_.ShouldRecord()) {
+        recorder_.Record(worker_.feeds[buffer][index][0].second,
+                         detections_.data(), num_detections,
+                         worker_.submit_times_us[buffer]);
+      }
+    }
+  }
+  // Other runs of the model may proceed while the result is delivered.
+  worker_.result_fn(frame_id, worker_.detections.data(), num_detections);
+}
+
+void DetectorEngine::StartPipeline(
+    const int queue_depth, const int max_detections,
+    const float score_threshold, const float iou_threshold,
+    const PipelineResultFn& result_fn,
+    const InferencePipeline::WorkerExitFn& worker_exit_fn) {
+  StopPipeline();
+
+  mutex_lock l(pipeline_mu_);
+  worker_.result_fn = result_fn;
+  worker_.max_detections = std::max(0, max_detections);
+  worker_.score_threshold = score_threshold;
+  worker_.iou_threshold = iou_threshold;
+  worker_.detections.resize(worker_.max_detections * kDetectionStride);
+
+  std::vector<TensorShape> input_shapes;
+  pipeline_preprocessors_.clear();
+  for (const auto& variant : variants_) {
+    input_shapes.push_back(variant->input_tensor.shape());
+    pipeline_preprocessors_.emplace_back(new YUVPreprocessor(
+        variant->input_size, config_.image_mean, config_.image_std));
+  }
+  // The new result callback has not seen any results yet.
+  pipeline_scene_change_.Reset();
+  pipeline_.reset(new InferencePipeline(
+      env_, input_shapes, queue_depth,
+      [this](const int buffer, const int64 frame_id) {
+        RunPipelineFrame(buffer, frame_id);
+      },
+      worker_exit_fn));
+
+  // The feeds share their buffers with the pipeline, so they are built once.
+  worker_.feeds.resize(pipeline_->num_buffers());
+  worker_.variants.assign(pipeline_->num_buffers(), 0);
+  worker_.submit_times_us.assign(pipeline_->num_buffers(), 0);
+  for (int i = 0; i < pipeline_->num_buffers(); ++i) {
+    worker_.feeds[i].resize(variants_.size());
+    for (int j = 0; j < static_cast<int>(variants_.size()); ++j) {
+      worker_.feeds[i][j].assign(
+          1, std::make_pair(config_.input_name, *pipeline_->buffer(i, j)));
+    }
+  }
+  LOG(INFO) << "Started pipeline with queue depth " << queue_depth;
+}
+
+void DetectorEngine::StopPipeline() {
+  mutex_lock l(pipeline_mu_);
+  if (pipeline_ == nullptr) {
+    return;
+  }
+  const InferencePipeline::Stats stats = pipeline_->GetStats();
+  LOG(INFO) << "Stopping pipeline: " << stats.frames_submitted
+            << " frames submitted, " << stats.frames_completed
+            << " completed, " << stats.frames_dropped << " dropped.";
+  if (pipeline_scene_change_.config().enabled) {
+    LOG(INFO) << "Scene change gating skipped "
+              << pipeline_scene_change_.stats().frames_skipped << " of "
+              << pipeline_scene_change_.stats().frames_checked << " frames.";
+  }
+
+  pipeline_.reset();
+  pipeline_preprocessors_.clear();
+  worker_ = PipelineWorkerState();
+}
+
+int64 DetectorEngine::SubmitYuvFrame(const YUV420Frame& frame,
+                                     const int rotation) {
+  mutex_lock l(pipeline_mu_);
+  if (pipeline_ == nullptr) {
+    return -1;
+  }
+  if (!pipeline_scene_change_.ShouldRun(frame)) {
+    return kUnchangedFrame;
+  }
+
+  // Preprocessing runs here, on the caller's thread, while the worker runs
+  // the model on an earlier frame.
+  // The variant is picked here rather than by the worker, so that the frame
+  // is scaled for it.
+  const int variant = latency_.active();
+  const int buffer = pipeline_->AcquireInputBuffer();
+  worker_.variants[buffer] = variant;
+  worker_.submit_times_us[buffer] = Env::Default()->NowMicros();
+  pipeline_preprocessors_[variant]->Process(
+      frame, rotation,
+      pipeline_->buffer(buffer, variant)->flat<float>().data());
+
+  const int64 frame_id = next_frame_id_++;
+  pipeline_->Submit(buffer, frame_id);
+  return frame_id;
+}
+
+void DetectorEngine::SetSceneChangeConfig(const SceneChangeConfig& config) {
+  // mu_ is never held while taking pipeline_mu_; StopPipeline holds
+  // pipeline_mu_ while the worker waits for mu_.
+  {
+    mutex_lock l(mu_);
+    scene_change_.Configure(config);
+  }
+  {
+    mutex_lock l(pipeline_mu_);
+    pipeline_scene_change_.Configure(config);
+  }
+  LOG(INFO) << "Scene change gating "
+            << (config.enabled ? "enabled" : "disabled") << ", block threshold "
+            << config.block_threshold << ", changed block fraction "
+            << config.changed_block_fraction << ", refresh interval "
+            << config.refresh_interval;
+}
+
+SceneChangeDetector::Stats DetectorEngine::GetSceneChangeStats() {
+  SceneChangeDetector::Stats stats;
+  {
+    mutex_lock l(mu_);
+    stats = scene_change_.stats();
+  }
+  mutex_lock l(pipeline_mu_);
+  const SceneChangeDetector::Stats& pipeline_stats =
+      pipeline_scene_change_.stats();
+  stats.frames_checked += pipeline_stats.frames_checked;
+  stats.frames_skipped += pipeline_stats.frames_skipped;
+  stats.forced_refreshes += pipeline_stats.forced_refreshes;
+  return stats;
+}
+
+Status DetectorEngine::StartRecording(const FrameRecorderConfig& config) {
+  mutex_lock l(mu_);
+  int max_input_size = 0;
+  for (const auto& variant : variants_) {
+    max_input_size = std::max(max_input_size, variant->input_size);
+  }
+  return recorder_.Start(config, max_input_size);
+}
+
+void DetectorEngine::StopRecording() {
+  mutex_lock l(mu_);
+  recorder_.Stop();
+}
+
+FrameRecorder::Stats DetectorEngine::GetRecordingStats() {
+  // The counters are atomic, so this does not wait for a run.
+  return recorder_.GetStats();
+}
+
+Status DetectorEngine::AddVariant(const GraphDef& graph_def,
+                                  const int input_size,
+                                  const YoloGridConfig& grid,
+                                  std::unique_ptr<MemmappedPackage> package) {
+  if (input_size <= 0) {
+    return errors::InvalidArgument("Invalid model input size ", input_size);
+  }
+  if (grid.num_classes != config_.grid.num_classes) {
+    return errors::InvalidArgument("Model variant detects ", grid.num_classes,
+                                   " classes, expected ",
+                                   config_.grid.num_classes);
+  }
+
+  // The session is created before taking any lock, so that runs of the
+  // model go on meanwhile.
+  std::unique_ptr<ModelVariant> variant(
+      new ModelVariant(config_, input_size, grid));
+  LOG(INFO) << "Creating session for " << input_size << "x" << input_size
+            << " model variant.";
+  SessionOptions options;
+  ConfigureSessionThreading(config_.threading, &options);
+  SelectExecutor(config_, graph_def, &options);
+  TF_RETURN_IF_ERROR(
+      CreateSession(graph_def, options, std::move(package), variant.get()));
+
+  mutex_lock pipeline_lock(pipeline_mu_);
+  if (pipeline_ != nullptr) {
+    return errors::FailedPrecondition(
+        "Model variants cannot be added while the pipeline is running.");
+  }
+  mutex_lock l(mu_);
+  variant->index = variants_.size();
+  const float scale = static_cast<float>(input_size) / config_.input_size;
+  latency_.AddVariant(scale * scale);
+  const int max_detections = grid.NumCandidates() * grid.num_classes;
+  if (max_detections > static_cast<int>(detections_.size())) {
+    detections_.resize(max_detections);
+    last_yuv_detections_.resize(max_detections);
+  }
+  variants_.push_back(std::move(variant));
+  return Status::OK();
+}
+
+void DetectorEngine::SetLatencyTarget(const int64 target_us) {
+  mutex_lock l(mu_);
+  latency_.SetTarget(target_us);
+  LOG(INFO) << "Latency target " << target_us / 1000 << "ms over "
+            << variants_.size() << " model variants.";
+}
+
+int DetectorEngine::ActiveInputSize() {
+  mutex_lock l(mu_);
+  return variants_[latency_.active()]->input_size;
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,360 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// A YOLO detector with its own TensorFlow session and all the state needed to
+// run it. Several engines can live side by side, e.g. a small model deciding
+// whether anything is in front of the camera next to the full detector, and a
+// new engine can be created before the one it replaces is destroyed. An
+// engine may also hold cheaper variants of its model, with sessions created
+// up front, which camera frames are switched to when runs exceed a latency
+// target. The Java bindings live in tensorflow_jni.cc.
+
+#ifndef ORG_TENSORFLOW_JNI_DETECTOR_ENGINE_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_DETECTOR_ENGINE_H_  // NOLINT
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/protobuf/config.pb.h"
+#include "tensorflow/core/public/session.h"
+#include "tensorflow/core/util/stat_summarizer.h"
+#include "tensorflow/examples/android/jni/frame_recorder.h"
+#include "tensorflow/examples/android/jni/inference_pipeline.h"
+#include "tensorflow/examples/android/jni/latency_controller.h"
+#include "tensorflow/examples/android/jni/memmapped_package.h"
+#include "tensorflow/examples/android/jni/non_max_suppression.h"
+#include "tensorflow/examples/android/jni/object_tracker.h"
+#include "tensorflow/examples/android/jni/scene_change_detector.h"
+#include "tensorflow/examples/android/jni/session_threading.h"
+#include "tensorflow/examples/android/jni/step_stats_profiler.h"
+#include "tensorflow/examples/android/jni/yolo_decoder.h"
+#include "tensorflow/examples/android/jni/yuv_preprocessor.h"
+
+namespace tensorflow {
+namespace android {
+
+// Everything about a model the engine needs besides its graph.
+struct DetectorConfig {
+  // The model takes a 1 x input_size x input_size x 3 float image, normalized
+  // as (value - image_mean) / image_std.
+  int input_size = 448;
+  int image_mean = 128;
+  float image_std = 128.0f;
+  string input_name;
+  string output_name;
+  YoloGridConfig grid;
+  SessionThreadingConfig threading;
+  // Runs the graph with the static executor instead of the local one, unless
+  // it has control flow.
+  bool static_executor = false;
+};
+
+// The memory layout of an Android ARGB_8888 bitmap pixel.
+struct RGBA {
+  uint8 red;
+  uint8 green;
+  uint8 blue;
+  uint8 alpha;
+};
+
+// Wall time spent in each stage of a frame, in microseconds.
+struct FrameTiming {
+  int64 preprocess_us = 0;
+  int64 run_us = 0;
+  int64 decode_us = 0;
+  int64 suppress_us = 0;
+};
+
+class DetectorEngine {
+ public:
+  // Called on the pipeline worker thread with the detections of a frame, as
+  // kDetectionStride floats each. The detections are only valid until the
+  // callback returns.
+  typedef std::function<void(int64 frame_id, const float* detections,
+                             int count)>
+      PipelineResultFn;
+
+  // Creates a session for graph_def. If the graph was read from a memmapped
+  // package, the package must be passed along to serve its weights; it is
+  // kept for the lifetime of the engine. Errors are returned rather than
+  // fatal, so that a failed model swap leaves the engine being replaced
+  // untouched.
+  static Status Create(const GraphDef& graph_def, const DetectorConfig& config,
+                       std::unique_ptr<MemmappedPackage> package,
+                       std::unique_ptr<DetectorEngine>* engine);
+
+  // Stops the pipeline, if any, and closes the session.
+  ~DetectorEngine();
+
+  const DetectorConfig& config() const { return config_; }
+
+  // The methods below are thread-safe. Runs of the model on one engine are
+  // serialized; different engines run independently.
+
+  // Runs the model on an input_size x input_size image and writes the decoded
+  // candidates to candidates, which must hold grid.NumCandidates() rows of
+  // grid.CandidateStride() floats, and their number to num_candidates. If
+  // the run fails, its error is returned and nothing is written.
+  Status Classify(const RGBA* const pixels, float* const candidates,
+                  int* const num_candidates);
+
+  // Runs the model on an input_size x input_size image, applies per-class
+  // non-max suppression and writes up to max_detections detections to
+  // detections, kDetectionStride floats each, and their number to
+  // num_detections. If the run fails, its error is returned and nothing is
+  // written.
+  Status Detect(const RGBA* const pixels, const int max_detections,
+                const float score_threshold, const float iou_threshold,
+                float* const detections, int* const num_detections);
+
+  // Same as above, but converts the center square of a YUV 4:2:0 frame,
+  // rotated clockwise by rotation degrees, on the fly. If timing is set, the
+  // time spent in each stage is written to it. When scene change gating is
+  // enabled and the frame looks like the last one the model ran on, the
+  // detections of that frame are returned instead, without running the
+  // model.
+  Status DetectYuv(const YUV420Frame& frame, const int rotation,
+                   const int max_detections, const float score_threshold,
+                   const float iou_threshold, float* const detections,
+                   int* const num_detections,
+                   FrameTiming* const timing = nullptr);
+
+  // Starts running the detector asynchronously on the frames passed to
+  // SubmitYuvFrame; see InferencePipeline. Restarts the pipeline if it is
+  // running. result_fn and worker_exit_fn are called on the worker thread.
+  void StartPipeline(const int queue_depth, const int max_detections,
+                     const float score_threshold, const float iou_threshold,
+                     const PipelineResultFn& result_fn,
+                     const InferencePipeline::WorkerExitFn& worker_exit_fn);
+
+  // Drops the frames still waiting and waits for the one being run. Does
+  // nothing if the pipeline is not running.
+  void StopPipeline();
+
+  // Returned by SubmitYuvFrame for frames that are not run because the scene
+  // has not changed; the last results delivered still apply.
+  static const int64 kUnchangedFrame = -2;
+
+  // Converts a frame as for DetectYuv on the calling thread and queues it for
+  // the pipeline. The frame is no longer needed once this returns. Returns the
+  // id passed to the result callback, -1 if the pipeline is not running, or
+  // kUnchangedFrame if scene change gating skipped the frame.
+  int64 SubmitYuvFrame(const YUV420Frame& frame, const int rotation);
+
+  // Replaces the scene change gating settings of DetectYuv and the pipeline,
+  // and resets their counters.
+  void SetSceneChangeConfig(const SceneChangeConfig& config);
+
+  // The scene change counters of DetectYuv and the pipeline, added up.
+  SceneChangeDetector::Stats GetSceneChangeStats();
+
+  // Follows the detections of DetectYuv and the pipeline between runs of the
+  // model. Camera frames are passed to its TrackFrame, with timestamps from
+  // Env::Default()->NowMicros(), which the detections are stamped with too.
+  ObjectTracker* tracker() { return &tracker_; }
+
+  // Profiling of runs of the model; see StepStatsProfiler. May be called at
+  // any time, including while runs are in progress. Only runs of the model
+  // the engine was created with are traced.
+  StepStatsProfiler* profiler() { return &profiler_; }
+
+  // Starts recording a sample of the frames DetectYuv and the pipeline run
+  // the model on, with their detections; see FrameRecorder. Recording
+  // replaces any earlier recording and stops when the engine is destroyed.
+  Status StartRecording(const FrameRecorderConfig& config);
+
+  // Waits for the frames being encoded and closes the file.
+  void StopRecording();
+
+  FrameRecorder::Stats GetRecordingStats();
+
+  // Adds a variant of the model that DetectYuv and the pipeline may switch
+  // to in order to meet the latency target, e.g. the same detector exported
+  // for a smaller input_size. Its session is created here, so switching to it
+  // later never touches a graph. Variants must be added from the most
+  // accurate to the cheapest, must detect the same classes as the model, and
+  // cannot be added while the pipeline is running. The package is handled as
+  // in Create.
+  Status AddVariant(const GraphDef& graph_def, const int input_size,
+                    const YoloGridConfig& grid,
+                    std::unique_ptr<MemmappedPackage> package);
+
+  // Sets the Session::Run time, in microseconds, that camera frames should
+  // stay within; see LatencyController. 0, the default, always runs the
+  // model the engine was created with. Classify and Detect always do.
+  void SetLatencyTarget(const int64 target_us);
+
+  // The input size of the variant camera frames currently run on.
+  int ActiveInputSize();
+
+ private:
+  typedef std::vector<std::pair<string, Tensor> > Feed;
+
+  // Settings and scratch space of the pipeline worker. They are written under
+  // pipeline_mu_ while no worker is running and only read by the worker
+  // otherwise, which must not take pipeline_mu_: StopPipeline holds it while
+  // waiting for the worker to finish. The exception is the submission time of
+  // the frame in each input buffer, written by the producer while it holds
+  // the buffer.
+  struct PipelineWorkerState {
+    // Indexed by input buffer, then by model variant.
+    std::vector<std::vector<Feed> > feeds;
+    // The variant the frame in each input buffer was prepared for.
+    std::vector<int> variants;
+    std::vector<int64> submit_times_us;
+    std::vector<float> detections;
+    PipelineResultFn result_fn;
+    int max_detections = 0;
+    float score_threshold = 0.0f;
+    float iou_threshold = 0.0f;
+  };
+
+  // A session for one variant of the model, and the buffers sized for its
+  // input and output.
+  struct ModelVariant {
+    ModelVariant(const DetectorConfig& config, const int input_size,
+                 const YoloGridConfig& grid);
+    // Closes the session.
+    ~ModelVariant();
+
+    // Position in variants_, set when the variant is added.
+    int index;
+    const int input_size;
+    const YoloGridConfig grid;
+    // The package the weights are mapped from, if any, and the Env the
+    // session reads them through. Declared before session, which must be
+    // destroyed first.
+    std::unique_ptr<MemmappedPackage> package;
+    std::unique_ptr<Env> package_env;
+    std::unique_ptr<Session> session;
+
+    // The model input, filled in place for every frame, and the feed of
+    // Session::Run built around it once.
+    Tensor input_tensor;
+    Feed input_feed;
+    YUVPreprocessor preprocessor;
+
+    // Decoded candidates and the suppression state, sized once.
+    std::vector<float> candidates;
+    NonMaxSuppressor suppressor;
+  };
+
+  DetectorEngine(const DetectorConfig& config, const GraphDef& graph_def);
+
+  // Creates the session of variant with the given options, which are
+  // changed to read the weights from package if it is set.
+  static Status CreateSession(const GraphDef& graph_def,
+                              SessionOptions options,
+                              std::unique_ptr<MemmappedPackage> package,
+                              ModelVariant* const variant);
+
+  // Normalizes an RGBA image into the input of the first variant.
+  void FillInput(const RGBA* const pixels) EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Runs variant on the given feed and decodes the output layer into its
+  // candidates, writing their number to num_candidates. If timing is set,
+  // the time spent running and decoding is written to it. Errors of the run
+  // are returned rather than fatal, so that the app survives them.
+  Status RunModel(ModelVariant* const variant, const Feed& inputs,
+                  int* const num_candidates,
+                  FrameTiming* const timing = nullptr)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Suppresses the candidates of the last run of variant and writes up to
+  // max_results detections to output. Returns the number written.
+  int Suppress(ModelVariant* const variant, const int num_candidates,
+               const int max_results, const float score_threshold,
+               const float iou_threshold, float* const output)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Runs on the pipeline worker for every frame that is not dropped.
+  void RunPipelineFrame(const int buffer, const int64 frame_id);
+
+  const DetectorConfig config_;
+  // Starts the threads of the sessions and the pipeline; see
+  // ConfigureSessionThreading.
+  Env* env_;
+
+  // Serializes runs of the model, which share the state below. When both are
+  // needed, pipeline_mu_ is taken first.
+  mutex mu_;
+
+  // The model the engine was created with, followed by the variants added
+  // since. Only appended to, with both mu_ and pipeline_mu_ held, so holding
+  // either is enough to read it.
+  std::vector<std::unique_ptr<ModelVariant> > variants_;
+  // Picks the variant camera frames run on. Updated under mu_; its active()
+  // is also read by the pipeline producer without it.
+  LatencyController latency_;
+
+  // The remaining arguments of Session::Run, shared by all variants.
+  std::vector<string> output_names_ GUARDED_BY(mu_);
+  std::vector<Tensor> output_tensors_ GUARDED_BY(mu_);
+  RunOptions run_options_ GUARDED_BY(mu_);
+  RunMetadata run_metadata_ GUARDED_BY(mu_);
+
+  // Suppressed detections, sized for the variant with the most candidates.
+  std::vector<Detection> detections_ GUARDED_BY(mu_);
+
+  // Keeps a sample of the camera frames run, off the calling thread.
+  FrameRecorder recorder_ GUARDED_BY(mu_);
+
+  // Gates DetectYuv, with the detections of the last frame it ran on.
+  SceneChangeDetector scene_change_ GUARDED_BY(mu_);
+  std::vector<Detection> last_yuv_detections_ GUARDED_BY(mu_);
+  int num_last_yuv_detections_ GUARDED_BY(mu_);
+
+  // For basic benchmarking.
+  int num_runs_ GUARDED_BY(mu_);
+  int64 timing_total_us_ GUARDED_BY(mu_);
+
+  // Heap allocations made between consecutive runs in benchmark mode,
+  // leaving out those TensorFlow makes inside Session::Run.
+  Stat<int64> frame_allocations_ GUARDED_BY(mu_);
+  int64 last_allocation_count_ GUARDED_BY(mu_);
+
+  // Traces sampled runs. Thread-safe, so that profiles can be read and
+  // flushed without waiting for a run.
+  StepStatsProfiler profiler_;
+
+  ObjectTracker tracker_;
+
+  // Serializes starting, stopping and feeding the pipeline.
+  mutex pipeline_mu_;
+  std::unique_ptr<InferencePipeline> pipeline_ GUARDED_BY(pipeline_mu_);
+  // One per variant.
+  std::vector<std::unique_ptr<YUVPreprocessor> > pipeline_preprocessors_
+      GUARDED_BY(pipeline_mu_);
+  int64 next_frame_id_ GUARDED_BY(pipeline_mu_);
+  SceneChangeDetector pipeline_scene_change_ GUARDED_BY(pipeline_mu_);
+  PipelineWorkerState worker_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(DetectorEngine);
+};
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_DETECTOR_ENGINE_H_  // NOLINT
@@ -0,0 +1,315 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/frame_recorder.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/io/path.h"
+#ifdef ENABLE_FRAME_RECORDER
+#include "tensorflow/core/lib/jpeg/jpeg_mem.h"
+#endif  // ENABLE_FRAME_RECORDER
+#include "tensorflow/core/lib/strings/stringprintf.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// How long the encoder sleeps when the ring is empty. The producer wakes it
+// up without taking a lock, so a wakeup may be missed; this bounds the delay.
+const int64 kIdleWaitMs = 50;
+
+void SetBytes(Example* const example, const string& key,
+              const string& value) {
+  (*example->mutable_features()->mutable_feature())[key]
+      .mutable_bytes_list()
+      ->add_value(value);
+}
+
+void SetInt64(Example* const example, const string& key, const int64 value) {
+  (*example->mutable_features()->mutable_feature())[key]
+      .mutable_int64_list()
+      ->add_value(value);
+}
+
+// Returns the float list of the feature, cleared but keeping its capacity.
+protobuf::RepeatedField<float>* FloatList(Example* const example,
+                                          const string& key) {
+  protobuf::RepeatedField<float>* const values =
+      (*example->mutable_features()->mutable_feature())[key]
+          .mutable_float_list()
+          ->mutable_value();
+  values->Clear();
+  return values;
+}
+
+}  // namespace
+
+FrameRecorder::FrameRecorder(const int image_mean, const float image_std)
+    : image_mean_(image_mean),
+      image_std_(image_std),
+      recording_(false),
+      runs_until_record_(0),
+      head_(0),
+      tail_(0),
+      stopping_(false),
+      frames_recorded_(0),
+      frames_dropped_(0),
+      bytes_written_(0),
+      records_in_file_(0),
+      file_prefix_(0),
+      next_file_number_(0) {}
+
+FrameRecorder::~FrameRecorder() { Stop(); }
+
+Status FrameRecorder::Start(const FrameRecorderConfig& config,
+                            const int max_input_size) {
+  Stop();
+#ifndef ENABLE_FRAME_RECORDER
+  return errors::Unimplemented(
+      "Built without the frame recorder; see ENABLE_FRAME_RECORDER in "
+      "Android.mk.");
+#endif  // ENABLE_FRAME_RECORDER
+  if (config.directory.empty() || config.sample_interval <= 0 ||
+      config.queue_capacity <= 0 || config.records_per_file <= 0 ||
+      config.max_files <= 0) {
+    return errors::InvalidArgument("Invalid frame recorder configuration.");
+  }
+  Env* const env = Env::Default();
+  if (!env->FileExists(config.directory)) {
+    TF_RETURN_IF_ERROR(env->CreateDir(config.directory));
+  }
+
+  config_ = config;
+  config_.jpeg_quality = std::min(100, std::max(0, config.jpeg_quality));
+  slots_.resize(config_.queue_capacity + 1);
+  const size_t num_values = static_cast<size_t>(max_input_size) *
+                            max_input_size * 3;
+  for (Slot& slot : slots_) {
+    slot.pixels.resize(num_values);
+  }
+  rgb_.resize(num_values);
+  head_ = 0;
+  tail_ = 0;
+  stopping_ = false;
+  frames_recorded_ = 0;
+  frames_dropped_ = 0;
+  bytes_written_ = 0;
+  runs_until_record_ = 0;
+
+  // Files of earlier sessions are left alone, both when naming and when
+  // deleting.
+  file_prefix_ = env->NowMicros() / 1000000;
+  next_file_number_ = 0;
+  records_in_file_ = 0;
+  files_.clear();
+
+  encoder_.reset(env->StartThread(ThreadOptions(), "frame_recorder",
+                                  [this]() { EncoderLoop(); }));
+  recording_ = true;
+  LOG(INFO) << "Recording one in " << config_.sample_interval
+            << " frames to " << config_.directory;
+  return Status::OK();
+}
+
+void FrameRecorder::Stop() {
+  if (!recording_) {
+    return;
+  }
+  recording_ = false;
+  stopping_ = true;
+  wake_.notify_one();
+  encoder_.reset();
+  const Stats stats = GetStats();
+  LOG(INFO) << "Recorded " << stats.frames_recorded << " frames, "
+            << (stats.bytes_written >> 10) << "KB, dropped "
+            << stats.frames_dropped;
+}
+
+bool FrameRecorder::ShouldRecord() {
+  if (!recording_) {
+    return false;
+  }
+  if (runs_until_record_ > 0) {
+    --runs_until_record_;
+    return false;
+  }
+  runs_until_record_ = config_.sample_interval - 1;
+  return true;
+}
+
+void FrameRecorder::Record(const Tensor& input,
+                           const Detection* const detections,
+                           const int num_detections,
+                           const int64 timestamp_us) {
+  const int tail = tail_.load(std::memory_order_relaxed);
+  const int next = (tail + 1) % slots_.size();
+  if (next == head_.load(std::memory_order_acquire)) {
+    ++frames_dropped_;
+    return;
+  }
+
+  Slot& slot = slots_[tail];
+  const int size = input.dim_size(1);
+  const int64 num_values = input.NumElements();
+  if (num_values > static_cast<int64>(slot.pixels.size())) {
+    LOG(ERROR) << "Model input of " << size << "x" << size
+               << " is too large to record.";
+    return;
+  }
+  memcpy(slot.pixels.data(), input.flat<float>().data(),
+         num_values * sizeof(float));
+  slot.size = size;
+  // Keeps its capacity, so this only allocates for the first frames.
+  slot.detections.assign(detections, detections + num_detections);
+  slot.timestamp_us = timestamp_us;
+
+  tail_.store(next, std::memory_order_release);
+  wake_.notify_one();
+}
+
+FrameRecorder::Stats FrameRecorder::GetStats() const {
+  Stats stats;
+  stats.frames_recorded = frames_recorded_;
+  stats.frames_dropped = frames_dropped_;
+  stats.bytes_written = bytes_written_;
+  return stats;
+}
+
+void FrameRecorder::EncoderLoop() {
+  while (true) {
+    const int head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      // The frames queued before Stop are written before exiting.
+      if (stopping_) {
+        break;
+      }
+      mutex_lock l(wake_mu_);
+      WaitForMilliseconds(&l, &wake_, kIdleWaitMs);
+      continue;
+    }
+
+    const Status s = WriteSlot(slots_[head]);
+    if (!s.ok()) {
+      LOG(ERROR) << "Could not record frame: " << s;
+    }
+    head_.store((head + 1) % slots_.size(), std::memory_order_release);
+  }
+  CloseFile();
+}
+
+Status FrameRecorder::WriteSlot(const Slot& slot) {
+  const int num_values = slot.size * slot.size * 3;
+  for (int i = 0; i < num_values; ++i) {
+    const float value = slot.pixels[i] * image_std_ + image_mean_ + 0.5f;
+    rgb_[i] = static_cast<uint8>(std::min(255.0f, std::max(0.0f, value)));
+  }
+
+#ifdef ENABLE_FRAME_RECORDER
+  jpeg::CompressFlags flags;
+  flags.format = jpeg::FORMAT_RGB;
+  flags.quality = config_.jpeg_quality;
+  if (!jpeg::Compress(rgb_.data(), slot.size, slot.size, flags, &jpeg_)) {
+    return errors::Internal("JPEG encoding failed.");
+  }
+#else
+  return errors::Unimplemented("Built without JPEG encoding.");
+#endif  // ENABLE_FRAME_RECORDER
+
+  // The Example is reused, so that its fields keep their capacity.
+  example_.Clear();
+  SetBytes(&example_, "image/encoded", jpeg_);
+  SetBytes(&example_, "image/format", "jpeg");
+  SetInt64(&example_, "image/width", slot.size);
+  SetInt64(&example_, "image/height", slot.size);
+  SetInt64(&example_, "image/timestamp_us", slot.timestamp_us);
+  protobuf::RepeatedField<float>* const xmin =
+      FloatList(&example_, "image/object/bbox/xmin");
+  protobuf::RepeatedField<float>* const ymin =
+      FloatList(&example_, "image/object/bbox/ymin");
+  protobuf::RepeatedField<float>* const xmax =
+      FloatList(&example_, "image/object/bbox/xmax");
+  protobuf::RepeatedField<float>* const ymax =
+      FloatList(&example_, "image/object/bbox/ymax");
+  protobuf::RepeatedField<float>* const score =
+      FloatList(&example_, "image/object/score");
+  protobuf::RepeatedField<int64>* const label =
+      (*example_.mutable_features()
+            ->mutable_feature())["image/object/class/label"]
+          .mutable_int64_list()
+          ->mutable_value();
+  for (const Detection& detection : slot.detections) {
+    xmin->Add(detection.x - detection.width * 0.5f);
+    ymin->Add(detection.y - detection.height * 0.5f);
+    xmax->Add(detection.x + detection.width * 0.5f);
+    ymax->Add(detection.y + detection.height * 0.5f);
+    score->Add(detection.score);
+    label->Add(detection.class_index);
+  }
+  example_.SerializeToString(&record_);
+
+  if (writer_ == nullptr || records_in_file_ >= config_.records_per_file) {
+    TF_RETURN_IF_ERROR(OpenNextFile());
+  }
+  TF_RETURN_IF_ERROR(writer_->WriteRecord(record_));
+  // Flushed every record, so that little is lost if the app is killed.
+  TF_RETURN_IF_ERROR(file_->Flush());
+  ++records_in_file_;
+  ++frames_recorded_;
+  bytes_written_ += record_.size();
+  return Status::OK();
+}
+
+Status FrameRecorder::OpenNextFile() {
+  CloseFile();
+  Env* const env = Env::Default();
+  const string path = io::JoinPath(
+      config_.directory,
+      strings::Printf("frames-%lld-%05d.tfrecord",
+                      static_cast<long long>(file_prefix_),
+                      next_file_number_++));
+  TF_RETURN_IF_ERROR(env->NewWritableFile(path, &file_));
+  writer_.reset(new io::RecordWriter(file_.get()));
+  records_in_file_ = 0;
+
+  files_.push_back(path);
+  while (files_.size() > static_cast<size_t>(config_.max_files)) {
+    const Status s = env->DeleteFile(files_.front());
+    if (!s.ok()) {
+      LOG(WARNING) << "Could not delete " << files_.front() << ": " << s;
+    }
+    files_.pop_front();
+  }
+  return Status::OK();
+}
+
+void FrameRecorder::CloseFile() {
+  if (file_ == nullptr) {
+    return;
+  }
+  writer_.reset();
+  const Status s = file_->Close();
+  if (!s.ok()) {
+    LOG(ERROR) << "Could not close " << files_.back() << ": " << s;
+  }
+  file_.reset();
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,282 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Compares the scalar and vector paths of the YUV/RGB converters. Every
+// converter with a vector path is first run on both over random images of
+// odd and even widths and heights, and the outputs are checked to be
+// identical byte for byte. Then both are timed on a 640x480 preview frame;
+// the argument is 0 for the scalar path and 1 for the vector path the CPU
+// supports, which is the label. Items processed are pixels.
+//
+// Usage:
+//   make -C jni-build kernel-benchmark
+//   jni-build/image_utils_benchmark [regex]
+
+#include <string.h>
+#include <random>
+#include <vector>
+
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/examples/android/jni/rgb2yuv.h"
+#include "tensorflow/examples/android/jni/yuv2rgb.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+const int kBenchmarkWidth = 640;
+const int kBenchmarkHeight = 480;
+
+// Padding added to the row strides of the planar inputs, so that the
+// converters are also run on rows that are not packed.
+const int kRowPadding = 3;
+
+enum Converter {
+  kYUV420ToARGB8888Planar,
+  kYUV420ToARGB8888Interleaved,
+  kYUV420SPToARGB8888,
+  kYUV420SPToRGB565,
+  kARGB8888ToYUV420SP,
+  kRGB565ToYUV420SP,
+  kNumConverters,
+};
+
+const char* const kConverterNames[kNumConverters] = {
+    "ConvertYUV420ToARGB8888 (planar)",
+    "ConvertYUV420ToARGB8888 (interleaved)",
+    "ConvertYUV420SPToARGB8888",
+    "ConvertYUV420SPToRGB565",
+    "ConvertARGB8888ToYUV420SP",
+    "ConvertRGB565ToYUV420SP",
+};
+
+const char* PathName(const int path) {
+  switch (path) {
+    case kImageUtilsSse2:
+      return "sse2";
+    case kImageUtilsNeon:
+      return "neon";
+    default:
+      return "scalar";
+  }
+}
+
+// The random inputs of every converter for one image size.
+struct Frame {
+  int width = 0;
+  int height = 0;
+  int y_row_stride = 0;
+  int uv_row_stride = 0;
+  // A Y plane with padded rows, separate U and V planes with padded rows,
+  // and the same chroma interleaved as V, U pairs.
+  std::vector<uint8> y;
+  std::vector<uint8> u;
+  std::vector<uint8> v;
+  std::vector<uint8> vu;
+  // A packed NV21 image: Y, then interleaved V and U rows of width bytes.
+  std::vector<uint8> nv21;
+  std::vector<uint32> argb;
+  std::vector<uint16> rgb565;
+};
+
+void MakeFrame(const int width, const int height, std::mt19937* const random,
+               Frame* const frame) {
+  const int chroma_width = (width + 1) / 2;
+  const int chroma_height = (height + 1) / 2;
+  frame->width = width;
+  frame->height = height;
+  frame->y_row_stride = width + kRowPadding;
+  frame->uv_row_stride = chroma_width + kRowPadding;
+  frame->y.resize(frame->y_row_stride * height);
+  frame->u.resize(frame->uv_row_stride * chroma_height);
+  frame->v.resize(frame->uv_row_stride * chroma_height);
+  frame->vu.resize(2 * frame->uv_row_stride * chroma_height);
+  // Odd widths read one byte past the last chroma row, as the camera
+  // buffers allow.
+  frame->nv21.resize(width * height + width * chroma_height + 1);
+  frame->argb.resize(width * height);
+  frame->rgb565.resize(width * height);
+
+  std::uniform_int_distribution<int> byte(0, 255);
+  for (std::vector<uint8>* const plane :
+       {&frame->y, &frame->u, &frame->v, &frame->vu, &frame->nv21}) {
+    for (uint8& value : *plane) {
+      value = byte(*random);
+    }
+  }
+  std::uniform_int_distribution<uint32> pixel;
+  for (uint32& value : frame->argb) {
+    value = pixel(*random);
+  }
+  for (uint16& value : frame->rgb565) {
+    value = pixel(*random);
+  }
+}
+
+// Returns the number of bytes converter writes for frame.
+size_t OutputBytes(const Converter converter, const Frame& frame) {
+  const int pixels = frame.width * frame.height;
+  switch (converter) {
+    case kYUV420SPToRGB565:
+      return pixels * sizeof(uint16);
+    case kARGB8888ToYUV420SP:
+    case kRGB565ToYUV420SP:
+      return pixels +
+             2 * ((frame.width + 1) / 2) * ((frame.height + 1) / 2);
+    default:
+      return pixels * sizeof(uint32);
+  }
+}
+
+// Runs converter on frame, writing OutputBytes(converter, frame) bytes to
+// output.
+void Convert(const Converter converter, const Frame& frame,
+             uint8* const output) {
+  const int width = frame.width;
+  const int height = frame.height;
+  switch (converter) {
+    case kYUV420ToARGB8888Planar:
+      ConvertYUV420ToARGB8888(frame.y.data(), frame.u.data(), frame.v.data(),
+                              reinterpret_cast<uint32*>(output), width,
+                              height, frame.y_row_stride, frame.uv_row_stride,
+                              1);
+      break;
+    case kYUV420ToARGB8888Interleaved:
+      ConvertYUV420ToARGB8888(frame.y.data(), frame.vu.data() + 1,
+                              frame.vu.data(),
+                              reinterpret_cast<uint32*>(output), width,
+                              height, frame.y_row_stride,
+                              2 * frame.uv_row_stride, 2);
+      break;
+    case kYUV420SPToARGB8888:
+      ConvertYUV420SPToARGB8888(frame.nv21.data(),
+                                frame.nv21.data() + width * height,
+                                reinterpret_cast<uint32*>(output), width,
+                                height);
+      break;
+    case kYUV420SPToRGB565:
+      ConvertYUV420SPToRGB565(frame.nv21.data(),
+                              reinterpret_cast<uint16*>(output), width,
+                              height);
+      break;
+    case kARGB8888ToYUV420SP:
+      ConvertARGB8888ToYUV420SP(frame.argb.data(), output, width, height);
+      break;
+    case kRGB565ToYUV420SP:
+      ConvertRGB565ToYUV420SP(frame.rgb565.data(), output, width, height);
+      break;
+    default:
+      LOG(FATAL) << "Unknown converter " << converter;
+  }
+}
+
+// Checks that the vector path writes the same bytes as the scalar path for
+// every converter, over sizes that leave tails of every length.
+void VerifyImageUtils() {
+  const int path = GetSupportedImageUtilsSimdPath();
+  LOG(INFO) << "Comparing the " << PathName(path)
+            << " path with the scalar path";
+  if (path == kImageUtilsScalar) {
+    LOG(WARNING) << "No vector path on this CPU, nothing to compare";
+  }
+  const int kWidths[] = {1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 641};
+  const int kHeights[] = {1, 2, 3, 4, 5, 17};
+  std::mt19937 random(1);
+  Frame frame;
+  std::vector<uint8> expected;
+  std::vector<uint8> actual;
+  for (const int width : kWidths) {
+    for (const int height : kHeights) {
+      MakeFrame(width, height, &random, &frame);
+      for (int i = 0; i < kNumConverters; ++i) {
+        const Converter converter = static_cast<Converter>(i);
+        // Filled differently, so that bytes written by one path only are
+        // caught too.
+        expected.assign(OutputBytes(converter, frame), 0x00);
+        actual.assign(expected.size(), 0xff);
+        SetImageUtilsSimdPath(kImageUtilsScalar);
+        Convert(converter, frame, expected.data());
+        SetImageUtilsSimdPath(-1);
+        Convert(converter, frame, actual.data());
+        for (size_t j = 0; j < expected.size(); ++j) {
+          CHECK_EQ(expected[j], actual[j])
+              << kConverterNames[converter] << " of " << width << "x"
+              << height << ": byte " << j << " differs on the "
+              << PathName(path) << " path";
+        }
+      }
+    }
+  }
+  SetImageUtilsSimdPath(-1);
+}
+
+void BenchmarkConverter(const int iters, const Converter converter,
+                        const bool vectorized) {
+  testing::StopTiming();
+  std::mt19937 random(1);
+  Frame frame;
+  MakeFrame(kBenchmarkWidth, kBenchmarkHeight, &random, &frame);
+  std::vector<uint8> output(OutputBytes(converter, frame));
+  SetImageUtilsSimdPath(vectorized ? -1 : kImageUtilsScalar);
+  testing::ItemsProcessed(static_cast<int64>(iters) * kBenchmarkWidth *
+                          kBenchmarkHeight);
+  testing::SetLabel(PathName(GetImageUtilsSimdPath()));
+  testing::StartTiming();
+  for (int i = 0; i < iters; ++i) {
+    Convert(converter, frame, output.data());
+  }
+  testing::StopTiming();
+  SetImageUtilsSimdPath(-1);
+}
+
+}  // namespace
+
+static void BM_YUV420ToARGB8888Planar(int iters, int vectorized) {
+  BenchmarkConverter(iters, kYUV420ToARGB8888Planar, vectorized);
+}
+static void BM_YUV420ToARGB8888Interleaved(int iters, int vectorized) {
+  BenchmarkConverter(iters, kYUV420ToARGB8888Interleaved, vectorized);
+}
+static void BM_YUV420SPToARGB8888(int iters, int vectorized) {
+  BenchmarkConverter(iters, kYUV420SPToARGB8888, vectorized);
+}
+static void BM_YUV420SPToRGB565(int iters, int vectorized) {
+  BenchmarkConverter(iters, kYUV420SPToRGB565, vectorized);
+}
+static void BM_ARGB8888ToYUV420SP(int iters, int vectorized) {
+  BenchmarkConverter(iters, kARGB8888ToYUV420SP, vectorized);
+}
+static void BM_RGB565ToYUV420SP(int iters, int vectorized) {
+  BenchmarkConverter(iters, kRGB565ToYUV420SP, vectorized);
+}
+BENCHMARK(BM_YUV420ToARGB8888Planar)->Arg(0)->Arg(1);
+BENCHMARK(BM_YUV420ToARGB8888Interleaved)->Arg(0)->Arg(1);
+BENCHMARK(BM_YUV420SPToARGB8888)->Arg(0)->Arg(1);
+BENCHMARK(BM_YUV420SPToRGB565)->Arg(0)->Arg(1);
+BENCHMARK(BM_ARGB8888ToYUV420SP)->Arg(0)->Arg(1);
+BENCHMARK(BM_RGB565ToYUV420SP)->Arg(0)->Arg(1);
+
+}  // namespace android
+}  // namespace tensorflow
+
+int main(int argc, char** argv) {
+  tensorflow::port::InitMain(argv[0], &argc, &argv);
+  tensorflow::android::VerifyImageUtils();
+  tensorflow::testing::Benchmark::Run(argc > 1 ? argv[1] : "all");
+  return 0;
+}
@@ -21,6 +21,7 @@ limitations under the License.
 #include <stdlib.h>
 
 #include "tensorflow/core/platform/types.h"
+#include "tensorflow/examples/android/jni/jni_utils.h"
 #include "tensorflow/examples/android/jni/rgb2yuv.h"
 #include "tensorflow/examples/android/jni/yuv2rgb.h"
 
@@ -57,6 +58,27 @@ IMAGEUTILS_METHOD(convertRGB565ToYUV420SP)(
     JNIEnv* env, jclass clazz, jbyteArray input, jbyteArray output,
     jint width, jint height);
 
+JNIEXPORT void JNICALL IMAGEUTILS_METHOD(convertYUV420SPToARGB8888Direct)(
+    JNIEnv* env, jclass clazz, jobject input, jobject output, jint width,
+    jint height, jboolean halfSize);
+
+JNIEXPORT void JNICALL IMAGEUTILS_METHOD(convertYUV420ToARGB8888Direct)(
+    JNIEnv* env, jclass clazz, jobject y, jobject u, jobject v, jobject output,
+    jint width, jint height, jint y_row_stride, jint uv_row_stride,
+    jint uv_pixel_stride);
+
+JNIEXPORT void JNICALL IMAGEUTILS_METHOD(convertYUV420SPToRGB565Direct)(
+    JNIEnv* env, jclass clazz, jobject input, jobject output, jint width,
+    jint height);
+
+JNIEXPORT void JNICALL IMAGEUTILS_METHOD(convertARGB8888ToYUV420SPDirect)(
+    JNIEnv* env, jclass clazz, jobject input, jobject output, jint width,
+    jint height);
+
+JNIEXPORT void JNICALL IMAGEUTILS_METHOD(convertRGB565ToYUV420SPDirect)(
+    JNIEnv* env, jclass clazz, jobject input, jobject output, jint width,
+    jint height);
+
 #ifdef __cplusplus
 }
 #endif
@@ -168,3 +190,96 @@ IMAGEUTILS_METHOD(convertRGB565ToYUV420SP)(
   env->ReleaseByteArrayElements(input, i, JNI_ABORT);
   env->ReleaseByteArrayElements(output, o, 0);
 }
+
+// The Direct variants below operate on direct java.nio buffers in place, so
+// that a camera frame is never copied onto or off the Java heap. The buffers
+// are checked to be large enough for the given dimensions.
+
+// Number of bytes of a YUV420SP image, matching ImageUtils.getYUVByteSize.
+static jlong YUV420SPByteSize(const int width, const int height) {
+  return static_cast<jlong>(width) * height +
+         2 * static_cast<jlong>((width + 1) / 2) * ((height + 1) / 2);
+}
+
+// Number of bytes a plane with the given sampled size and strides spans. The
+// last row of an android.media.Image plane is not padded to the row stride.
+static jlong PlaneByteSize(const int width, const int height,
+                           const int row_stride, const int pixel_stride) {
+  if (width <= 0 || height <= 0) {
+    return 0;
+  }
+  return static_cast<jlong>(height - 1) * row_stride +
+         static_cast<jlong>(width - 1) * pixel_stride + 1;
+}
+
+JNIEXPORT void JNICALL IMAGEUTILS_METHOD(convertYUV420SPToARGB8888Direct)(
+    JNIEnv* env, jclass clazz, jobject input, jobject output, jint width,
+    jint height, jboolean halfSize) {
+  const uint8* const i = static_cast<const uint8*>(GetDirectBufferAddressChecked(
+      env, input, YUV420SPByteSize(width, height)));
+
+  if (halfSize) {
+    uint32* const o = static_cast<uint32*>(GetDirectBufferAddressChecked(
+        env, output, static_cast<jlong>(width / 2) * (height / 2)));
+    ConvertYUV420SPToARGB8888HalfSize(i, o, width, height);
+  } else {
+    uint32* const o = static_cast<uint32*>(GetDirectBufferAddressChecked(
+        env, output, static_cast<jlong>(width) * height));
+    ConvertYUV420SPToARGB8888(i, i + width * height, o, width, height);
+  }
+}
+
+JNIEXPORT void JNICALL IMAGEUTILS_METHOD(convertYUV420ToARGB8888Direct)(
+    JNIEnv* env, jclass clazz, jobject y, jobject u, jobject v, jobject output,
+    jint width, jint height, jint y_row_stride, jint uv_row_stride,
+    jint uv_pixel_stride) {
+  const jlong uv_size = PlaneByteSize((width + 1) / 2, (height + 1) / 2,
+                                      uv_row_stride, uv_pixel_stride);
+  const uint8* const y_buff = static_cast<const uint8*>(
+      GetDirectBufferAddressChecked(
+          env, y, PlaneByteSize(width, height, y_row_stride, 1)));
+  const uint8* const u_buff =
+      static_cast<const uint8*>(GetDirectBufferAddressChecked(env, u, uv_size));
+  const uint8* const v_buff =
+      static_cast<const uint8*>(GetDirectBufferAddressChecked(env, v, uv_size));
+  uint32* const o = static_cast<uint32*>(GetDirectBufferAddressChecked(
+      env, output, static_cast<jlong>(width) * height));
+
+  ConvertYUV420ToARGB8888(y_buff, u_buff, v_buff, o, width, height,
+                          y_row_stride, uv_row_stride, uv_pixel_stride);
+}
+
+JNIEXPORT void JNICALL IMAGEUTILS_METHOD(convertYUV420SPToRGB565Direct)(
+    JNIEnv* env, jclass clazz, jobject input, jobject output, jint width,
+    jint height) {
+  const uint8* const i = static_cast<const uint8*>(GetDirectBufferAddressChecked(
+      env, input, YUV420SPByteSize(width, height)));
+  uint16* const o = static_cast<uint16*>(GetDirectBufferAddressChecked(
+      env, output, static_cast<jlong>(width) * height * 2));
+
+  ConvertYUV420SPToRGB565(i, o, width, height);
+}
+
+JNIEXPORT void JNICALL IMAGEUTILS_METHOD(convertARGB8888ToYUV420SPDirect)(
+    JNIEnv* env, jclass clazz, jobject input, jobject output, jint width,
+    jint height) {
+  const uint32* const i = static_cast<const uint32*>(
+      GetDirectBufferAddressChecked(env, input,
+                                    static_cast<jlong>(width) * height));
+  uint8* const o = static_cast<uint8*>(GetDirectBufferAddressChecked(
+      env, output, YUV420SPByteSize(width, height)));
+
+  ConvertARGB8888ToYUV420SP(i, o, width, height);
+}
+
+JNIEXPORT void JNICALL IMAGEUTILS_METHOD(convertRGB565ToYUV420SPDirect)(
+    JNIEnv* env, jclass clazz, jobject input, jobject output, jint width,
+    jint height) {
+  const uint16* const i = static_cast<const uint16*>(
+      GetDirectBufferAddressChecked(env, input,
+                                    static_cast<jlong>(width) * height * 2));
+  uint8* const o = static_cast<uint8*>(GetDirectBufferAddressChecked(
+      env, output, YUV420SPByteSize(width, height)));
+
+  ConvertRGB565ToYUV420SP(i, o, width, height);
+}
@@ -0,0 +1,118 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// A replacement for Shard that learns what the work of each call site costs.
+// Shard takes the cost_per_unit a kernel guesses to be nanoseconds, splits
+// the work into one equal block per thread once it exceeds 10us, and runs
+// the first block on the calling thread. The guesses are often off by an
+// order of magnitude either way, so small tensors wake every thread for a
+// few microseconds of work and large ones go to a single thread, and one
+// slow block, e.g. on a little core, holds up the whole call.
+//
+// AdaptiveShard times every call and keeps, per ShardSite, the nanoseconds
+// one unit of the guessed cost actually takes, so that the guesses of a call
+// site are corrected whatever the shapes of the call. From that estimate it
+// runs work under 10us on the calling thread and gives larger work one
+// thread per 10us, up to max_parallelism. The threads, the calling one
+// among them, then take chunks of the remaining units off a shared counter:
+// each chunk a fraction of what is left, so that they shrink towards the
+// end and the threads finish together, but never under 2us of work.
+//
+// GetShardSiteStats reports what each call site has done, to find the
+// kernels whose guesses are furthest off.
+
+#ifndef ORG_TENSORFLOW_JNI_ADAPTIVE_SHARDER_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_ADAPTIVE_SHARDER_H_  // NOLINT
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace android {
+
+// What the calls of one ShardSite have done so far.
+struct ShardSiteStats {
+  string name;
+  int64 calls = 0;
+  // Calls run on the calling thread alone.
+  int64 inline_calls = 0;
+  // Threads the calls ran on, the calling ones included.
+  int64 threads = 0;
+  int64 units = 0;
+  int64 chunks = 0;
+  // Time spent in the work, summed over threads.
+  int64 busy_ns = 0;
+  // Time from the start to the end of each call.
+  int64 wall_ns = 0;
+  // The current estimate of the time one unit of the guessed cost takes; 1
+  // if the guesses are right.
+  double ns_per_cost = 1.0;
+
+  string DebugString() const;
+};
+
+// A call site of AdaptiveShard, such as one loop of a kernel. Sites are
+// created once, as function-local statics, and never destroyed.
+class ShardSite {
+ public:
+  explicit ShardSite(const string& name);
+
+  // The estimated time of total units of cost_per_unit each.
+  double EstimateNs(const int64 total, const int64 cost_per_unit) const;
+  // Records a call and corrects the estimate with its busy time.
+  void RecordCall(const int64 total, const int64 cost_per_unit,
+                  const int num_threads, const int64 num_chunks,
+                  const int64 busy_ns, const int64 wall_ns);
+
+  ShardSiteStats GetStats() const;
+
+ private:
+  const string name_;
+  // The estimate in 1/1024 ns, so that cheap units keep their precision.
+  std::atomic<int64> scaled_ns_per_cost_;
+  std::atomic<int64> calls_;
+  std::atomic<int64> inline_calls_;
+  std::atomic<int64> threads_;
+  std::atomic<int64> units_;
+  std::atomic<int64> chunks_;
+  std::atomic<int64> busy_ns_;
+  std::atomic<int64> wall_ns_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ShardSite);
+};
+
+// Calls work(start, limit) for ranges covering [0, total), as Shard does,
+// on the calling thread and those of workers. cost_per_unit is the guess
+// Shard would be given, which site corrects.
+void AdaptiveShard(ShardSite* site, int max_parallelism,
+                   thread::ThreadPool* workers, int64 total,
+                   int64 cost_per_unit, std::function<void(int64, int64)> work);
+
+// Returns the stats of every ShardSite created so far.
+std::vector<ShardSiteStats> GetShardSiteStats();
+
+// Enables or disables adaptive sharding. While disabled, AdaptiveShard calls
+// Shard and records nothing. It is enabled by default.
+void SetAdaptiveSharding(const bool enabled);
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_ADAPTIVE_SHARDER_H_  // NOLINT
@@ -0,0 +1,56 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Counts the heap allocations made through operator new by each thread, so
+// that benchmarks can check that the per-frame path of the native code does
+// not allocate in the steady state.
+//
+// Counting replaces the global operator new, so it is only compiled into
+// benchmark builds: the app built with MAX_NUM_RUNS > 0, as in
+//   ndk-build APP_CFLAGS=-DMAX_NUM_RUNS=50
+// and the host benchmark, which defines COUNT_ALLOCATIONS. Other builds keep
+// the default allocation functions, and the count stays 0.
+
+#ifndef ORG_TENSORFLOW_JNI_ALLOCATION_COUNTER_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_ALLOCATION_COUNTER_H_  // NOLINT
+
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace android {
+
+// Returns the number of allocations the calling thread has made through
+// operator new since it started, not counting those made while a
+// ScopedAllocationCountingPause was active. Always 0 outside of benchmark
+// builds.
+int64 GetThreadAllocationCount();
+
+// Stops counting the allocations of the calling thread for as long as it is
+// in scope, e.g. to leave out the allocations TensorFlow itself makes inside
+// Session::Run. Pauses nest.
+class ScopedAllocationCountingPause {
+ public:
+  ScopedAllocationCountingPause();
+  ~ScopedAllocationCountingPause();
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(ScopedAllocationCountingPause);
+};
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_ALLOCATION_COUNTER_H_  // NOLINT
@@ -0,0 +1,61 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Fuses the convolution, bias and leaky ReLU of each YOLO layer into a single
+// FusedConv2DBiasLeakyRelu op. Unfused, every layer writes its convolution
+// output, reads it back to add the bias, and reads and writes it twice more
+// for Mul(alpha, x) and Maximum; the fused CPU kernel applies the bias and
+// activation to each output tile while the convolution has just left it in
+// cache.
+//
+// The rewrite is a GraphOptimizationPass registered for PRE_PLACEMENT, so it
+// applies to every session the process creates. It matches
+//
+//   Maximum(Mul(alpha, x), x), x = BiasAdd(Conv2D(input, filter), bias)
+//
+// in either operand order, where alpha is a scalar Const and the bias may also
+// be added with Add of a rank 1 Const as the YOLO_tensorflow export does.
+// Intermediate outputs must have no other consumers; the fused node takes the
+// name of the Maximum, so the activation can still be fed or fetched by name
+// but the convolution and bias outputs cannot.
+//
+// Large enough 3x3 stride 1 layers are convolved with the Winograd transform
+// in winograd_conv.h instead of Eigen's SpatialConvolution.
+
+#ifndef ORG_TENSORFLOW_JNI_CONV_BIAS_LEAKY_RELU_FUSION_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_CONV_BIAS_LEAKY_RELU_FUSION_H_  // NOLINT
+
+namespace tensorflow {
+
+class Graph;
+
+namespace android {
+
+// Replaces every matching pattern in graph with a FusedConv2DBiasLeakyRelu
+// node. Returns the number of layers fused.
+int FuseConvBiasLeakyRelu(Graph* graph);
+
+// Enables or disables the registered pass for sessions created afterwards.
+// It is enabled by default.
+void SetConvBiasLeakyReluFusion(const bool enabled);
+
+// Enables or disables the Winograd convolution for fused kernels created
+// afterwards. It is enabled by default.
+void SetWinogradConv3x3(const bool enabled);
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_CONV_BIAS_LEAKY_RELU_FUSION_H_  // NOLINT
@@ -0,0 +1,172 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Records a sample of the frames the model runs on, with their detections,
+// for debugging in the field. Recording a frame only copies the model input
+// into a slot of a bounded single-producer single-consumer ring, which never
+// blocks or allocates; when the ring is full the frame is dropped. A
+// background thread turns the input back into eight bit RGB, encodes it with
+// jpeg::Compress and appends it as a tf.Example to a TFRecord file, starting
+// a new file every so many records and deleting the oldest ones.
+//
+// The Example features follow the usual object detection layout:
+// image/encoded, image/format, image/width, image/height, image/timestamp_us,
+// image/object/bbox/{xmin,ymin,xmax,ymax} normalized to the image,
+// image/object/class/label and image/object/score.
+//
+// The JPEG encoder needs libjpeg, which the Android TensorFlow libraries leave
+// out, so the recorder only works when built with ENABLE_FRAME_RECORDER;
+// otherwise Start returns Unimplemented.
+
+#ifndef ORG_TENSORFLOW_JNI_FRAME_RECORDER_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_FRAME_RECORDER_H_  // NOLINT
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/example/example.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/examples/android/jni/non_max_suppression.h"
+
+namespace tensorflow {
+namespace android {
+
+struct FrameRecorderConfig {
+  // Where the TFRecord files are written. Created if missing, but not its
+  // parents.
+  string directory;
+  // One in every sample_interval runs of the model is recorded.
+  int sample_interval = 30;
+  // Frames copied but not encoded yet. Frames recorded while this many are
+  // waiting are dropped.
+  int queue_capacity = 2;
+  int jpeg_quality = 90;
+  // A new file is started after this many records, and the oldest file
+  // written since Start is deleted once there are more than max_files.
+  int records_per_file = 100;
+  int max_files = 10;
+};
+
+class FrameRecorder {
+ public:
+  struct Stats {
+    int64 frames_recorded = 0;
+    // Frames dropped because the encoder was behind.
+    int64 frames_dropped = 0;
+    int64 bytes_written = 0;
+  };
+
+  // Model inputs are turned back into pixels as value * image_std +
+  // image_mean.
+  FrameRecorder(const int image_mean, const float image_std);
+
+  // Stops recording.
+  ~FrameRecorder();
+
+  // The methods below must be serialized by the caller, except for
+  // GetStats.
+
+  // Starts recording model inputs of up to max_input_size x max_input_size,
+  // stopping first if recording. Allocates the ring and starts the encoder.
+  Status Start(const FrameRecorderConfig& config, const int max_input_size);
+
+  // Lets the encoder finish the frames queued so far, then closes the file.
+  // Does nothing if not recording.
+  void Stop();
+
+  // Counts a run of the model and returns whether its input should be
+  // passed to Record. Always false when not recording.
+  bool ShouldRecord();
+
+  // Queues a copy of a 1 x size x size x 3 float model input, with the
+  // detections of the run, for the encoder. Never blocks.
+  void Record(const Tensor& input, const Detection* const detections,
+              const int num_detections, const int64 timestamp_us);
+
+  Stats GetStats() const;
+
+ private:
+  struct Slot {
+    std::vector<float> pixels;
+    int size = 0;
+    std::vector<Detection> detections;
+    int64 timestamp_us = 0;
+  };
+
+  void EncoderLoop();
+
+  // Encodes slot and appends it to the current file.
+  Status WriteSlot(const Slot& slot);
+
+  // Closes the current file, if any, opens the next one and deletes the
+  // oldest ones beyond max_files.
+  Status OpenNextFile();
+
+  void CloseFile();
+
+  const int image_mean_;
+  const float image_std_;
+
+  FrameRecorderConfig config_;
+  bool recording_;
+  int64 runs_until_record_;
+
+  // The ring holds one more slot than queue_capacity, so that a full ring
+  // can be told from an empty one. The producer fills the slot at tail_ and
+  // then advances it; the encoder reads the slot at head_ and then advances
+  // it, handing the slot back.
+  std::vector<Slot> slots_;
+  std::atomic<int> head_;
+  std::atomic<int> tail_;
+  std::atomic<bool> stopping_;
+
+  // Wakes up the encoder when a frame is queued.
+  mutex wake_mu_;
+  condition_variable wake_;
+
+  std::atomic<int64> frames_recorded_;
+  std::atomic<int64> frames_dropped_;
+  std::atomic<int64> bytes_written_;
+
+  // Only used by the encoder thread while it runs.
+  std::unique_ptr<WritableFile> file_;
+  std::unique_ptr<io::RecordWriter> writer_;
+  int records_in_file_;
+  int64 file_prefix_;
+  int next_file_number_;
+  std::deque<string> files_;
+  std::vector<uint8> rgb_;
+  string jpeg_;
+  Example example_;
+  string record_;
+
+  std::unique_ptr<Thread> encoder_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(FrameRecorder);
+};
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_FRAME_RECORDER_H_  // NOLINT
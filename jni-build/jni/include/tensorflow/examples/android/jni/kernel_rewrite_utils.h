@@ -0,0 +1,83 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Helpers shared by the graph passes that replace stock ops with the CPU
+// kernels of this library, i.e. the Conv2D, bias and leaky ReLU fusion and
+// the packed MatMul, and by those kernels.
+
+#ifndef ORG_TENSORFLOW_JNI_KERNEL_REWRITE_UTILS_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_KERNEL_REWRITE_UTILS_H_  // NOLINT
+
+#include <functional>
+#include <memory>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace android {
+
+// Returns the edge feeding data input index of node, or null.
+const Edge* DataInput(const Node* node, const int index);
+
+// Whether a node requested for device may be placed on a CPU, i.e. device is
+// empty, names no device type or names the CPU.
+bool IsCpuDevice(const string& device);
+
+// Keeps a value a kernel derives from one of its inputs, such as transformed
+// or packed weights, for as long as the input stays the same. The weights of
+// a frozen graph are constants that hand the kernel the same buffer on every
+// run, so the value is only derived again when the buffer changes.
+template <typename T>
+class DerivedInputCache {
+ public:
+  DerivedInputCache() {}
+
+  // Returns the value derived from input, calling derive(input, value) on a
+  // new value if input is not the tensor the last one was derived from.
+  std::shared_ptr<const T> Get(
+      const Tensor& input,
+      const std::function<void(const Tensor&, T*)>& derive) {
+    mutex_lock l(mu_);
+    if (!input_.IsInitialized() || !input.SharesBufferWith(input_) ||
+        !input.IsSameSize(input_)) {
+      // A new value rather than an update in place, as concurrent runs may
+      // still be reading the old one.
+      std::shared_ptr<T> value(new T);
+      derive(input, value.get());
+      // Holding on to the input keeps its buffer from being reused for a
+      // different one.
+      input_ = input;
+      value_ = value;
+    }
+    return value_;
+  }
+
+ private:
+  mutex mu_;
+  Tensor input_ GUARDED_BY(mu_);
+  std::shared_ptr<const T> value_ GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(DerivedInputCache);
+};
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_KERNEL_REWRITE_UTILS_H_  // NOLINT
@@ -0,0 +1,167 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Keeps objects found by the detector on screen between its runs. Each
+// detection is associated with a track by IoU; a track follows the center of
+// its box with a constant velocity Kalman filter per axis, so boxes can be
+// predicted for every camera frame while the model is still busy. Optionally,
+// every frame also refines the tracks by matching a small luma patch around
+// each box center against the previous frame. Tracks keep their id for as
+// long as they are matched.
+//
+// Boxes are in the normalized coordinates of the model input, i.e. of the
+// rotated center square of the frame, as in the detections.
+
+#ifndef ORG_TENSORFLOW_JNI_OBJECT_TRACKER_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_OBJECT_TRACKER_H_  // NOLINT
+
+#include <vector>
+
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/examples/android/jni/non_max_suppression.h"
+#include "tensorflow/examples/android/jni/yuv_preprocessor.h"
+
+namespace tensorflow {
+namespace android {
+
+struct TrackerConfig {
+  // A detection continues a track of the same class when their boxes overlap
+  // by more than this.
+  float match_iou = 0.3f;
+  // A track is dropped once this many detector runs in a row did not match
+  // it.
+  int max_missed_detections = 3;
+  // Whether camera frames refine the tracks by patch matching, rather than
+  // only advancing them by their velocity.
+  bool optical_flow = true;
+};
+
+// A track as reported for a frame.
+struct TrackedObject {
+  int64 id;
+  Detection detection;
+};
+
+// Number of floats used per tracked object by WriteTrackedObjects:
+// [track id, class index, score, center x, center y, width, height].
+static const int kTrackedObjectStride = 7;
+
+// Thread-safe.
+class ObjectTracker {
+ public:
+  ObjectTracker();
+
+  // Replaces the settings and drops all tracks.
+  void Configure(const TrackerConfig& config);
+
+  // Feeds the result of a detector run at timestamp_us. Detections are
+  // associated with the tracks predicted for that time, updating them, and
+  // the rest start new tracks.
+  void Update(const Detection* const detections, const int count,
+              const int64 timestamp_us);
+
+  // Advances the tracks to a camera frame taken at timestamp_us, refining
+  // them from its Y plane if optical flow is enabled, and writes up to
+  // max_objects of them to objects. rotation is as for
+  // YUVPreprocessor::Process. Returns the number written.
+  int TrackFrame(const YUV420Frame& frame, const int rotation,
+                 const int64 timestamp_us, const int max_objects,
+                 TrackedObject* const objects);
+
+ private:
+  // Position and velocity along one axis, with their covariance.
+  struct AxisFilter {
+    float position;
+    float velocity;
+    float p00, p01, p11;
+
+    void Reset(const float initial_position);
+    void Predict(const float dt);
+    void Correct(const float measurement, const float variance);
+  };
+
+  struct Track {
+    int64 id;
+    int class_index;
+    float score;
+    AxisFilter x;
+    AxisFilter y;
+    float width;
+    float height;
+    int missed_detections;
+    int64 timestamp_us;
+  };
+
+  // Moves all tracks forward to timestamp_us.
+  void PredictTracks(const int64 timestamp_us) EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Samples the luma of the model input region of frame into thumbnail_.
+  void SampleThumbnail(const YUV420Frame& frame, const int rotation)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Estimates how far the patch around (x, y) in previous_thumbnail_ moved in
+  // thumbnail_, in thumbnail pixels. Returns false if the patch is too flat
+  // or no good match is found.
+  bool MatchPatch(const float x, const float y, int* const dx,
+                  int* const dy) const EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  mutex mu_;
+  TrackerConfig config_ GUARDED_BY(mu_);
+  std::vector<Track> tracks_ GUARDED_BY(mu_);
+  int64 next_track_id_ GUARDED_BY(mu_);
+
+  // Scratch space of Update, kept across calls.
+  struct Match {
+    float iou;
+    int track;
+    int detection;
+  };
+  std::vector<Match> matches_ GUARDED_BY(mu_);
+  std::vector<char> track_matched_ GUARDED_BY(mu_);
+  std::vector<char> detection_matched_ GUARDED_BY(mu_);
+  // Scratch space of TrackFrame: the center of each track as measured by
+  // patch matching, as x and y, and whether it could be.
+  std::vector<float> measured_centers_ GUARDED_BY(mu_);
+  std::vector<char> has_measured_center_ GUARDED_BY(mu_);
+  // Order in which the tracks are reported.
+  std::vector<int> report_order_ GUARDED_BY(mu_);
+
+  // Geometry the thumbnail sampling table was computed for, and the Y plane
+  // offset of every thumbnail pixel.
+  int frame_width_ GUARDED_BY(mu_);
+  int frame_height_ GUARDED_BY(mu_);
+  int y_row_stride_ GUARDED_BY(mu_);
+  int rotation_ GUARDED_BY(mu_);
+  std::vector<int> thumbnail_offsets_ GUARDED_BY(mu_);
+
+  // Luma thumbnails of the current and the previous frame.
+  std::vector<uint8> thumbnail_ GUARDED_BY(mu_);
+  std::vector<uint8> previous_thumbnail_ GUARDED_BY(mu_);
+  bool has_previous_thumbnail_ GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ObjectTracker);
+};
+
+// Flattens tracked objects into kTrackedObjectStride floats each.
+void WriteTrackedObjects(const TrackedObject* const objects, const int count,
+                         float* const output);
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_OBJECT_TRACKER_H_  // NOLINT
@@ -0,0 +1,109 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Sampled profiling of Session::Run. Tracing every run with FULL_TRACE and
+// writing its StepStats to storage on the inference thread distorts the very
+// latency being measured, so only one in every sample_interval runs is traced,
+// the traces are kept in a bounded in-memory ring and aggregated through a
+// StatSummarizer, and they only reach storage when a flush is requested, on a
+// background thread.
+
+#ifndef ORG_TENSORFLOW_JNI_STEP_STATS_PROFILER_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_STEP_STATS_PROFILER_H_  // NOLINT
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/step_stats.pb.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/stat_summarizer.h"
+
+namespace tensorflow {
+namespace android {
+
+class StepStatsProfiler {
+ public:
+  // Profiling starts disabled.
+  explicit StepStatsProfiler(const GraphDef& graph_def);
+
+  // Waits for a flush in progress to finish.
+  ~StepStatsProfiler();
+
+  // Traces one in every sample_interval runs, or none if sample_interval is 0
+  // or less, keeping the last ring_capacity traces. Changing the settings
+  // discards the traces and statistics collected so far.
+  void Configure(const int sample_interval, const int ring_capacity);
+
+  // Called once before every run. Returns whether the run should be traced
+  // and its StepStats passed to Record.
+  bool ShouldTrace();
+
+  // Adds the StepStats of a traced run to the ring and the aggregate
+  // statistics, along with the core frequency in kHz before and after it. The
+  // contents of stats are swapped into the ring, so stats is left holding an
+  // old trace.
+  void Record(StepStats* const stats, const int64 frequency_start_khz,
+              const int64 frequency_end_khz);
+
+  // Starts writing the traces in the ring to directory as
+  // stepstats<number>.pb, together with the aggregate statistics as
+  // summary.txt, on a background thread. Waits for the previous flush, if
+  // any, to finish first. Returns the number of traces being written.
+  int Flush(const string& directory);
+
+  // The aggregate statistics of the traced runs, as for StatSummarizer.
+  string GetSummary();
+
+ private:
+  struct FlushJob;
+
+  static void WriteFlushJob(const FlushJob& job);
+
+  string GetSummaryLocked() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const GraphDef graph_def_;
+
+  mutex mu_;
+  int sample_interval_ GUARDED_BY(mu_);
+  int64 num_runs_ GUARDED_BY(mu_);
+  // The last traces, oldest first starting at ring_start_. Entries are reused
+  // as the ring wraps around.
+  std::vector<StepStats> ring_ GUARDED_BY(mu_);
+  int ring_size_ GUARDED_BY(mu_);
+  int ring_start_ GUARDED_BY(mu_);
+  // Number of the next trace, used to name the files it is flushed to.
+  int64 next_trace_number_ GUARDED_BY(mu_);
+  std::unique_ptr<StatSummarizer> summarizer_ GUARDED_BY(mu_);
+  Stat<int64> frequency_start_ GUARDED_BY(mu_);
+  Stat<int64> frequency_end_ GUARDED_BY(mu_);
+
+  // Serializes flushes. Joining flush_thread_ waits for the last one.
+  mutex flush_mu_;
+  std::unique_ptr<Thread> flush_thread_ GUARDED_BY(flush_mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(StepStatsProfiler);
+};
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_STEP_STATS_PROFILER_H_  // NOLINT
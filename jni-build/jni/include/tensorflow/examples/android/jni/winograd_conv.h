@@ -0,0 +1,68 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Winograd F(2x2, 3x3) convolution for the 3x3 stride 1 layers that make up
+// most of the detector's work. Each 2x2 block of outputs is computed from a
+// 4x4 block of inputs with 16 multiplications per channel pair instead of the
+// 36 a direct convolution needs; the multiplications become 16 matrix
+// products over all the tiles of a block, which Eigen runs at full speed.
+//
+// F(4x4, 3x3) would save more multiplications, but its larger transform
+// coefficients cost several bits of float precision per layer, which add up
+// over the 24 layers of YOLO.
+
+#ifndef ORG_TENSORFLOW_JNI_WINOGRAD_CONV_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_WINOGRAD_CONV_H_  // NOLINT
+
+#include "tensorflow/core/framework/device_base.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace android {
+
+// Number of transformed filter values per input and output channel pair.
+static const int kWinogradPoints = 16;
+
+// Whether a 3x3 stride 1 convolution with the given output is large enough
+// for the transforms to pay off, and its transformed filter small enough to
+// keep around.
+bool UseWinogradConv3x3(const int64 out_rows, const int64 out_cols,
+                        const int64 in_depth, const int64 out_depth);
+
+// Transforms a [3, 3, in_depth, out_depth] filter into the
+// [kWinogradPoints, in_depth, out_depth] form WinogradConv3x3BiasLeakyRelu
+// takes, sharding the work over workers.
+void TransformWinogradFilter(const float* const filter, const int64 in_depth,
+                             const int64 out_depth,
+                             const DeviceBase::CpuWorkerThreads& workers,
+                             float* const transformed);
+
+// Convolves an NHWC input of [batch, in_rows, in_cols, in_depth] with a
+// transformed 3x3 filter, stride 1 and no padding, into an output of
+// [batch, in_rows - 2, in_cols - 2, out_depth]. The bias is added and
+// max(alpha * x, x) applied to each output tile as it is produced.
+void WinogradConv3x3BiasLeakyRelu(const float* const input, const int64 batch,
+                                  const int64 in_rows, const int64 in_cols,
+                                  const int64 in_depth,
+                                  const float* const transformed_filter,
+                                  const float* const bias, const float alpha,
+                                  const int64 out_depth,
+                                  const DeviceBase::CpuWorkerThreads& workers,
+                                  float* const output);
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_WINOGRAD_CONV_H_  // NOLINT
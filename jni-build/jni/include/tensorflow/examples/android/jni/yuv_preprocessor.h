@@ -0,0 +1,112 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Turns a camera YUV 4:2:0 frame directly into the normalized float input of
+// the model, without converting the full frame to RGB first.
+
+#ifndef ORG_TENSORFLOW_JNI_YUV_PREPROCESSOR_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_YUV_PREPROCESSOR_H_  // NOLINT
+
+#include <vector>
+
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace android {
+
+// A YUV 4:2:0 image with a plane of 8 bit Y samples and separate U and V
+// planes with arbitrary row and pixel strides, as delivered by the camera2
+// ImageReader.
+struct YUV420Frame {
+  const uint8* y;
+  const uint8* u;
+  const uint8* v;
+  int width;
+  int height;
+  int y_row_stride;
+  int uv_row_stride;
+  int uv_pixel_stride;
+
+  // Number of bytes the Y plane and each chroma plane span. The last row of
+  // an android.media.Image plane is not padded to the row stride.
+  int64 YPlaneSize() const {
+    return PlaneSize(width, height, y_row_stride, 1);
+  }
+  int64 UVPlaneSize() const {
+    return PlaneSize((width + 1) / 2, (height + 1) / 2, uv_row_stride,
+                     uv_pixel_stride);
+  }
+
+ private:
+  static int64 PlaneSize(const int plane_width, const int plane_height,
+                         const int row_stride, const int pixel_stride) {
+    if (plane_width <= 0 || plane_height <= 0) {
+      return 0;
+    }
+    return static_cast<int64>(plane_height - 1) * row_stride +
+           static_cast<int64>(plane_width - 1) * pixel_stride + 1;
+  }
+};
+
+class YUVPreprocessor {
+ public:
+  // Output pixels are normalized as (value - image_mean) / image_std.
+  YUVPreprocessor(const int output_size, const int image_mean,
+                  const float image_std);
+
+  // Takes the largest centered square out of the frame, rotates it clockwise
+  // by rotation degrees (a multiple of 90) and scales it to
+  // output_size x output_size with nearest neighbor sampling. Only the sampled
+  // pixels are converted to RGB; they are written as normalized floats in
+  // row-major HWC order to output, which must hold output_size^2 * 3 values.
+  //
+  // This matches what drawing the full ARGB frame onto the cropped bitmap in
+  // TensorFlowImageListener.drawResizedBitmap produced.
+  void Process(const YUV420Frame& frame, const int rotation,
+               float* const output);
+
+  int output_size() const { return output_size_; }
+
+ private:
+  // Recomputes the sampling tables when the frame geometry changes.
+  void UpdateSampling(const YUV420Frame& frame);
+
+  template <int kRotation>
+  void ProcessRotated(const YUV420Frame& frame, float* const output) const;
+
+  const int output_size_;
+
+  // Lookup table from eight bit channel value to normalized float.
+  float normalized_[256];
+
+  // Geometry the sampling tables were computed for.
+  int frame_width_;
+  int frame_height_;
+  int y_row_stride_;
+  int uv_row_stride_;
+  int uv_pixel_stride_;
+
+  // For each of the output_size sample positions along an axis of the crop,
+  // the byte offsets of the sampled column or row in the Y and UV planes.
+  std::vector<int> y_col_offsets_;
+  std::vector<int> uv_col_offsets_;
+  std::vector<int> y_row_offsets_;
+  std::vector<int> uv_row_offsets_;
+};
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_YUV_PREPROCESSOR_H_  // NOLINT
@@ -0,0 +1,131 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/inference_pipeline.h"
+
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace android {
+
+InferencePipeline::InferencePipeline(
+    Env* env, const std::vector<TensorShape>& input_shapes,
+    const int queue_depth, const InferenceFn& inference_fn,
+    const WorkerExitFn& worker_exit_fn)
+    : queue_depth_(queue_depth),
+      inference_fn_(inference_fn),
+      worker_exit_fn_(worker_exit_fn),
+      queue_(queue_depth),
+      queue_head_(0),
+      queue_size_(0),
+      stopping_(false) {
+  CHECK_GE(queue_depth_, 1);
+  CHECK(!input_shapes.empty());
+  const int num_buffers = queue_depth_ + 2;
+  buffers_.reserve(num_buffers);
+  free_buffers_.reserve(num_buffers);
+  for (int i = 0; i < num_buffers; ++i) {
+    buffers_.emplace_back();
+    for (const TensorShape& shape : input_shapes) {
+      buffers_.back().emplace_back(DT_FLOAT, shape);
+    }
+    free_buffers_.push_back(i);
+  }
+  worker_.reset(env->StartThread(ThreadOptions(), "inference_pipeline",
+                                 [this]() { WorkerLoop(); }));
+}
+
+InferencePipeline::~InferencePipeline() {
+  {
+    mutex_lock l(mu_);
+    stopping_ = true;
+    stats_.frames_dropped += queue_size_;
+    queue_size_ = 0;
+  }
+  frame_queued_.notify_all();
+  worker_.reset();
+}
+
+int InferencePipeline::AcquireInputBuffer() {
+  mutex_lock l(mu_);
+  // There is always a free buffer: the queue holds at most queue_depth_, and
+  // the producer and the worker at most one each.
+  CHECK(!free_buffers_.empty());
+  const int buffer = free_buffers_.back();
+  free_buffers_.pop_back();
+  return buffer;
+}
+
+void InferencePipeline::Submit(const int buffer, const int64 frame_id) {
+  {
+    mutex_lock l(mu_);
+    ++stats_.frames_submitted;
+    if (queue_size_ == queue_depth_) {
+      free_buffers_.push_back(PopFrame().buffer);
+      ++stats_.frames_dropped;
+    }
+    QueuedFrame& frame = queue_[(queue_head_ + queue_size_) % queue_depth_];
+    frame.buffer = buffer;
+    frame.frame_id = frame_id;
+    ++queue_size_;
+  }
+  frame_queued_.notify_one();
+}
+
+void InferencePipeline::Release(const int buffer) {
+  mutex_lock l(mu_);
+  free_buffers_.push_back(buffer);
+}
+
+InferencePipeline::Stats InferencePipeline::GetStats() {
+  mutex_lock l(mu_);
+  return stats_;
+}
+
+InferencePipeline::QueuedFrame InferencePipeline::PopFrame() {
+  const QueuedFrame frame = queue_[queue_head_];
+  queue_head_ = (queue_head_ + 1) % queue_depth_;
+  --queue_size_;
+  return frame;
+}
+
+void InferencePipeline::WorkerLoop() {
+  while (true) {
+    QueuedFrame frame;
+    {
+      mutex_lock l(mu_);
+      while (!stopping_ && queue_size_ == 0) {
+        frame_queued_.wait(l);
+      }
+      if (stopping_) {
+        break;
+      }
+      frame = PopFrame();
+    }
+
+    inference_fn_(frame.buffer, frame.frame_id);
+
+    mutex_lock l(mu_);
+    free_buffers_.push_back(frame.buffer);
+    ++stats_.frames_completed;
+  }
+
+  if (worker_exit_fn_) {
+    worker_exit_fn_();
+  }
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,129 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// A two stage pipeline that overlaps preparing the input of the next frame
+// with running the model on the current one. The producer thread fills a free
+// input buffer and submits it; a worker thread consumes submitted buffers in
+// order. At most queue_depth buffers wait between the stages. When the queue
+// is full, the oldest waiting frame is dropped, so the latency between a frame
+// being submitted and its result stays bounded however slow the model is.
+
+#ifndef ORG_TENSORFLOW_JNI_INFERENCE_PIPELINE_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_INFERENCE_PIPELINE_H_  // NOLINT
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace android {
+
+class InferencePipeline {
+ public:
+  // Called on the worker thread for every frame that is not dropped, with the
+  // index of the input buffer holding it.
+  typedef std::function<void(int buffer, int64 frame_id)> InferenceFn;
+
+  // Called on the worker thread right before it exits, e.g. to detach it from
+  // the Java VM.
+  typedef std::function<void()> WorkerExitFn;
+
+  // Counters since the pipeline was started.
+  struct Stats {
+    int64 frames_submitted = 0;
+    int64 frames_dropped = 0;
+    int64 frames_completed = 0;
+  };
+
+  // Allocates queue_depth + 2 input buffers, so that the producer and the
+  // worker each hold one while the queue is full, and starts the worker
+  // thread. Every buffer holds a float tensor of each of input_shapes, e.g.
+  // one per model variant, of which the producer fills the one the frame
+  // runs on.
+  InferencePipeline(Env* env, const std::vector<TensorShape>& input_shapes,
+                    const int queue_depth, const InferenceFn& inference_fn,
+                    const WorkerExitFn& worker_exit_fn);
+
+  // Drops the frames still waiting, lets the frame being run finish and joins
+  // the worker thread.
+  ~InferencePipeline();
+
+  int num_buffers() const { return buffers_.size(); }
+
+  // The tensor of the given shape in the input buffer with the given index.
+  // Buffers are allocated once, so this can be used to set up per-buffer
+  // state such as Session::Run feeds.
+  Tensor* buffer(const int index, const int shape_index = 0) {
+    return &buffers_[index][shape_index];
+  }
+
+  // Returns the index of a free input buffer for the producer to fill. The
+  // producer may hold only one buffer at a time. This never blocks.
+  int AcquireInputBuffer();
+
+  // Queues a buffer obtained from AcquireInputBuffer for the worker, dropping
+  // the oldest waiting frame if the queue is full.
+  void Submit(const int buffer, const int64 frame_id);
+
+  // Returns a buffer obtained from AcquireInputBuffer without running it.
+  void Release(const int buffer);
+
+  Stats GetStats();
+
+ private:
+  struct QueuedFrame {
+    int buffer;
+    int64 frame_id;
+  };
+
+  QueuedFrame PopFrame() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  void WorkerLoop();
+
+  const int queue_depth_;
+  const InferenceFn inference_fn_;
+  const WorkerExitFn worker_exit_fn_;
+  std::vector<std::vector<Tensor> > buffers_;
+
+  mutex mu_;
+  condition_variable frame_queued_;
+  std::vector<int> free_buffers_ GUARDED_BY(mu_);
+  // Ring of the frames waiting for the worker, oldest first. Fixed in size so
+  // that queueing never allocates.
+  std::vector<QueuedFrame> queue_ GUARDED_BY(mu_);
+  int queue_head_ GUARDED_BY(mu_);
+  int queue_size_ GUARDED_BY(mu_);
+  bool stopping_ GUARDED_BY(mu_);
+  Stats stats_ GUARDED_BY(mu_);
+
+  // Declared last so that the worker is joined before anything it uses is
+  // destroyed.
+  std::unique_ptr<Thread> worker_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(InferencePipeline);
+};
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_INFERENCE_PIPELINE_H_  // NOLINT
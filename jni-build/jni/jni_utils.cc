@@ -75,6 +75,22 @@ bool IsAsset(const char* const filename) {
   return strstr(filename, ASSET_PREFIX) == filename;
 }
 
+bool FileExists(AAssetManager* const asset_manager,
+                const char* const filename) {
+  if (!IsAsset(filename)) {
+    return std::ifstream(filename).good();
+  }
+
+  CHECK_NOTNULL(asset_manager);
+  AAsset* const asset = AAssetManager_open(
+      asset_manager, filename + strlen(ASSET_PREFIX), AASSET_MODE_STREAMING);
+  if (asset == nullptr) {
+    return false;
+  }
+  AAsset_close(asset);
+  return true;
+}
+
 void ReadFileToProto(AAssetManager* const asset_manager,
                      const char* const filename,
                      google::protobuf::MessageLite* message) {
@@ -179,3 +195,12 @@ void WriteProtoToFile(const char* const filename,
   }
   VLOG(0) << "Wrote proto to " << filename;
 }
+
+void* GetDirectBufferAddressChecked(JNIEnv* env, jobject buffer,
+                                    const jlong min_capacity) {
+  void* const address = env->GetDirectBufferAddress(buffer);
+  CHECK(address != nullptr) << "Buffer is not a direct buffer.";
+  const jlong capacity = env->GetDirectBufferCapacity(buffer);
+  CHECK_GE(capacity, min_capacity) << "Direct buffer is too small.";
+  return address;
+}
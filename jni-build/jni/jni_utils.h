@@ -33,6 +33,10 @@ class AAssetManager;
 bool PortableReadFileToProto(const std::string& file_name,
                              ::google::protobuf::MessageLite* proto);
 
+// Whether filename, which may be an asset as for ReadFileToProto, exists.
+bool FileExists(AAssetManager* const asset_manager,
+                const char* const filename);
+
 void ReadFileToProto(AAssetManager* const asset_manager,
     const char* const filename, google::protobuf::MessageLite* message);
 
@@ -45,4 +49,10 @@ void ReadFileToVector(AAssetManager* const asset_manager,
 void WriteProtoToFile(const char* const filename,
                       const google::protobuf::MessageLite& message);
 
+// Returns the address of a direct java.nio buffer, such as the ByteBuffer of
+// an android.media.Image.Plane, without copying it. The buffer must be direct
+// and hold at least min_capacity elements of its own type.
+void* GetDirectBufferAddressChecked(JNIEnv* env, jobject buffer,
+                                    const jlong min_capacity);
+
 #endif  // ORG_TENSORFLOW_JNI_JNI_UTILS_H_
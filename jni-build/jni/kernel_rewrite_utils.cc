@@ -0,0 +1,40 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/kernel_rewrite_utils.h"
+
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/util/device_name_utils.h"
+
+namespace tensorflow {
+namespace android {
+
+const Edge* DataInput(const Node* node, const int index) {
+  for (const Edge* edge : node->in_edges()) {
+    if (!edge->IsControlEdge() && edge->dst_input() == index) {
+      return edge;
+    }
+  }
+  return nullptr;
+}
+
+bool IsCpuDevice(const string& device) {
+  DeviceNameUtils::ParsedName parsed;
+  return DeviceNameUtils::ParseFullName(device, &parsed) &&
+         (!parsed.has_type || parsed.type == DEVICE_CPU);
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,109 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/latency_controller.h"
+
+#include <algorithm>
+
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace android {
+
+const int LatencyController::kSettleRuns;
+constexpr float LatencyController::kUpgradeHeadroom;
+const int LatencyController::kRemeasureRuns;
+
+namespace {
+
+// Weight of the newest run in the moving averages.
+const float kAverageWeight = 0.25f;
+
+}  // namespace
+
+LatencyController::LatencyController()
+    : variants_(1),
+      target_us_(0),
+      active_(0),
+      runs_since_switch_(0),
+      num_switches_(0) {}
+
+int LatencyController::AddVariant(const float relative_cost) {
+  CHECK_GT(relative_cost, 0.0f);
+  variants_.emplace_back();
+  variants_.back().relative_cost = relative_cost;
+  return variants_.size() - 1;
+}
+
+void LatencyController::SetTarget(const int64 target_us) {
+  target_us_ = std::max<int64>(0, target_us);
+  if (target_us_ == 0 && active() != 0) {
+    SwitchTo(0);
+  }
+}
+
+float LatencyController::Estimate(const int variant) const {
+  const Variant& active_variant = variants_[active()];
+  const Variant& other = variants_[variant];
+  if (other.num_runs > 1 && runs_since_switch_ < kRemeasureRuns) {
+    return other.average_run_us;
+  }
+  return active_variant.average_run_us * other.relative_cost /
+         active_variant.relative_cost;
+}
+
+void LatencyController::SwitchTo(const int variant) {
+  LOG(INFO) << "Latency target " << target_us_ / 1000
+            << "ms: switching from model variant " << active() << " ("
+            << static_cast<int64>(variants_[active()].average_run_us / 1000)
+            << "ms/run) to " << variant;
+  active_.store(variant, std::memory_order_relaxed);
+  runs_since_switch_ = 0;
+  ++num_switches_;
+}
+
+void LatencyController::Update(const int variant, const int64 run_us) {
+  Variant& measured = variants_[variant];
+  // The first run of a session initializes it and is much slower than the
+  // rest, so it is left out.
+  if (measured.num_runs++ == 0) {
+    return;
+  }
+  measured.average_run_us =
+      measured.num_runs == 2
+          ? run_us
+          : measured.average_run_us +
+                kAverageWeight * (run_us - measured.average_run_us);
+
+  const int current = active();
+  if (variant != current || target_us_ == 0) {
+    return;
+  }
+  runs_since_switch_ = std::min(runs_since_switch_ + 1, kRemeasureRuns);
+  if (runs_since_switch_ < kSettleRuns) {
+    return;
+  }
+  if (measured.average_run_us > target_us_) {
+    if (current + 1 < num_variants()) {
+      SwitchTo(current + 1);
+    }
+  } else if (current > 0 &&
+             Estimate(current - 1) < kUpgradeHeadroom * target_us_) {
+    SwitchTo(current - 1);
+  }
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,100 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Keeps the time spent in Session::Run within a latency target by switching
+// between variants of a model, e.g. the same detector exported for 448, 320
+// and 224 pixel inputs. The run time of each variant is tracked with an
+// exponential moving average; the controller steps to the next cheaper
+// variant when the active one runs over the target, and back to a more
+// accurate one once that is expected to fit with some headroom to spare.
+// After every switch a few runs are measured before deciding again, so that
+// a single slow frame does not make it oscillate.
+
+#ifndef ORG_TENSORFLOW_JNI_LATENCY_CONTROLLER_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_LATENCY_CONTROLLER_H_  // NOLINT
+
+#include <atomic>
+#include <vector>
+
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace android {
+
+class LatencyController {
+ public:
+  // Runs measured on a variant after switching to it before the next switch
+  // is considered.
+  static const int kSettleRuns = 5;
+  // A more accurate variant is only switched to if it is expected to take at
+  // most this fraction of the target.
+  static constexpr float kUpgradeHeadroom = 0.8f;
+  // After this many runs on a cheaper variant, the measured time of the more
+  // accurate one is no longer trusted, e.g. because the device has cooled
+  // down since, and its cost is estimated from the active variant instead.
+  static const int kRemeasureRuns = 150;
+
+  // Starts with a single variant of relative cost 1 and no target.
+  LatencyController();
+
+  // Appends a variant, expected to cost relative_cost times the first one,
+  // e.g. the ratio of their input pixel counts. Variants must be added from
+  // the most accurate to the cheapest. Returns the index of the variant.
+  int AddVariant(const float relative_cost);
+
+  // Sets the Session::Run time to stay within, in microseconds. 0 disables
+  // the controller and switches back to the first variant.
+  void SetTarget(const int64 target_us);
+
+  // Records how long a run of variant took, and switches the active variant
+  // if needed. Runs of other than the active variant, e.g. pipeline frames
+  // queued before a switch, only update its average.
+  void Update(const int variant, const int64 run_us);
+
+  // The variant the next frame should run on. Unlike the methods above,
+  // which the caller must serialize, this may be read from any thread.
+  int active() const { return active_.load(std::memory_order_relaxed); }
+
+  int num_variants() const { return variants_.size(); }
+  int64 target_us() const { return target_us_; }
+  int64 num_switches() const { return num_switches_; }
+
+ private:
+  struct Variant {
+    float relative_cost = 1.0f;
+    int64 num_runs = 0;
+    float average_run_us = 0.0f;
+  };
+
+  // The expected run time of variant, based on measurements of the active
+  // one.
+  float Estimate(const int variant) const;
+
+  void SwitchTo(const int variant);
+
+  std::vector<Variant> variants_;
+  int64 target_us_;
+  std::atomic<int> active_;
+  int runs_since_switch_;
+  int64 num_switches_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(LatencyController);
+};
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_LATENCY_CONTROLLER_H_  // NOLINT
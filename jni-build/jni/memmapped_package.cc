@@ -0,0 +1,355 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/memmapped_package.h"
+
+#ifdef __ANDROID__
+#include <android/asset_manager.h>
+#endif  // __ANDROID__
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mem.h"
+#include "tensorflow/core/platform/protobuf.h"
+#include "tensorflow/core/util/memmapped_file_system.pb.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// Names used by MemmappedFileSystem for the regions of a package and for the
+// graph stored in it.
+const char kPackagePrefix[] = "memmapped_package://";
+const char kPackageGraphDef[] = "memmapped_package://.";
+
+const char kAssetPrefix[] = "file:///android_asset/";
+
+// The writer aligns every tensor to this relative to the package start, and
+// ImmutableConst checks the same alignment in memory.
+const uint64 kTensorAlignment = Allocator::kAllocatorAlignment;
+
+uint64 DecodeUint64LittleEndian(const uint8* buffer) {
+  uint64 result = 0;
+  for (int i = 0; i < static_cast<int>(sizeof(uint64)); ++i) {
+    result |= static_cast<uint64>(buffer[i]) << (8 * i);
+  }
+  return result;
+}
+
+// A read-only mapping of part of a file.
+class MappedRegion : public ReadOnlyMemoryRegion {
+ public:
+  MappedRegion(void* mapping, const size_t mapping_length,
+               const void* data, const uint64 length)
+      : mapping_(mapping),
+        mapping_length_(mapping_length),
+        data_(data),
+        length_(length) {}
+  ~MappedRegion() override { munmap(mapping_, mapping_length_); }
+
+  const void* data() override { return data_; }
+  uint64 length() override { return length_; }
+
+ private:
+  void* const mapping_;
+  const size_t mapping_length_;
+  const void* const data_;
+  const uint64 length_;
+};
+
+// A copy of a package that could not be mapped with the alignment it needs.
+class AlignedCopyRegion : public ReadOnlyMemoryRegion {
+ public:
+  AlignedCopyRegion(const void* data, const uint64 length)
+      : data_(port::aligned_malloc(length, kTensorAlignment)),
+        length_(length) {
+    CHECK(data_ != nullptr);
+    memcpy(data_, data, length);
+  }
+  ~AlignedCopyRegion() override { port::aligned_free(data_); }
+
+  const void* data() override { return data_; }
+  uint64 length() override { return length_; }
+
+ private:
+  void* const data_;
+  const uint64 length_;
+};
+
+// A region of the package, valid for as long as the package.
+class PackageRegion : public ReadOnlyMemoryRegion {
+ public:
+  PackageRegion(const void* data, const uint64 length)
+      : data_(data), length_(length) {}
+
+  const void* data() override { return data_; }
+  uint64 length() override { return length_; }
+
+ private:
+  const void* const data_;
+  const uint64 length_;
+};
+
+// Maps length bytes of fd starting at offset.
+Status MapFileRange(const int fd, const off_t offset, const uint64 length,
+                    std::unique_ptr<ReadOnlyMemoryRegion>* memory) {
+  // mmap takes page aligned offsets only.
+  const off_t page_size = sysconf(_SC_PAGESIZE);
+  const off_t mapping_offset = offset - offset % page_size;
+  const size_t mapping_length = length + (offset - mapping_offset);
+  void* const mapping = mmap(nullptr, mapping_length, PROT_READ, MAP_SHARED,
+                             fd, mapping_offset);
+  if (mapping == MAP_FAILED) {
+    return errors::Internal("mmap failed: ", strerror(errno));
+  }
+  memory->reset(new MappedRegion(
+      mapping, mapping_length,
+      static_cast<const uint8*>(mapping) + (offset - mapping_offset), length));
+  return Status::OK();
+}
+
+// Makes sure the tensors of the package will be aligned in memory, copying it
+// if they would not be.
+void EnsureAligned(const char* const filename,
+                   std::unique_ptr<ReadOnlyMemoryRegion>* memory) {
+  if (reinterpret_cast<uintptr_t>((*memory)->data()) % kTensorAlignment == 0) {
+    return;
+  }
+  LOG(WARNING) << filename << " is not stored at a multiple of "
+               << kTensorAlignment << " bytes, so it is copied to the heap "
+               << "instead of being mapped. Align it in the APK to avoid this.";
+  memory->reset(new AlignedCopyRegion((*memory)->data(), (*memory)->length()));
+}
+
+// Serves the regions of a package under the memmapped_package:// scheme.
+class PackageFileSystem : public NullFileSystem {
+ public:
+  explicit PackageFileSystem(const MemmappedPackage* package)
+      : package_(package) {}
+
+  Status NewReadOnlyMemoryRegionFromFile(
+      const string& fname,
+      std::unique_ptr<ReadOnlyMemoryRegion>* result) override {
+    const void* data;
+    uint64 length;
+    TF_RETURN_IF_ERROR(package_->GetRegion(fname, &data, &length));
+    result->reset(new PackageRegion(data, length));
+    return Status::OK();
+  }
+
+  bool FileExists(const string& fname) override {
+    const void* data;
+    uint64 length;
+    return package_->GetRegion(fname, &data, &length).ok();
+  }
+
+  Status GetFileSize(const string& fname, uint64* file_size) override {
+    const void* data;
+    return package_->GetRegion(fname, &data, file_size);
+  }
+
+  Status Stat(const string& fname, FileStatistics* stat) override {
+    uint64 length;
+    TF_RETURN_IF_ERROR(GetFileSize(fname, &length));
+    stat->length = length;
+    return Status::OK();
+  }
+
+ private:
+  const MemmappedPackage* const package_;
+};
+
+class PackageEnv : public EnvWrapper {
+ public:
+  PackageEnv(Env* const target, const MemmappedPackage* package)
+      : EnvWrapper(target), file_system_(package) {}
+
+  Status GetFileSystemForFile(const string& fname,
+                              FileSystem** result) override {
+    if (fname.compare(0, strlen(kPackagePrefix), kPackagePrefix) == 0) {
+      *result = &file_system_;
+      return Status::OK();
+    }
+    return EnvWrapper::GetFileSystemForFile(fname, result);
+  }
+
+  Status GetRegisteredFileSystemSchemes(
+      std::vector<string>* schemes) override {
+    TF_RETURN_IF_ERROR(EnvWrapper::GetRegisteredFileSystemSchemes(schemes));
+    schemes->emplace_back(kPackagePrefix);
+    return Status::OK();
+  }
+
+ private:
+  PackageFileSystem file_system_;
+};
+
+}  // namespace
+
+Status MemmappedPackage::Map(AAssetManager* const asset_manager,
+                             const char* const filename,
+                             std::unique_ptr<MemmappedPackage>* package) {
+  // The directory is read before anything is copied, so that a plain GraphDef
+  // costs no more than mapping it.
+  std::unique_ptr<ReadOnlyMemoryRegion> memory;
+  std::unordered_map<string, Region> directory;
+  if (strstr(filename, kAssetPrefix) == filename) {
+#ifdef __ANDROID__
+    CHECK_NOTNULL(asset_manager);
+    const char* const asset_filename = filename + strlen(kAssetPrefix);
+    AAsset* const asset =
+        AAssetManager_open(asset_manager, asset_filename, AASSET_MODE_RANDOM);
+    if (asset == nullptr) {
+      return errors::NotFound("Asset not found: ", asset_filename);
+    }
+    off_t start;
+    off_t length;
+    const int fd = AAsset_openFileDescriptor(asset, &start, &length);
+    Status s;
+    if (fd >= 0) {
+      s = MapFileRange(fd, start, length, &memory);
+      close(fd);
+    } else {
+      // Compressed assets have to be inflated into memory anyway.
+      const void* const buffer = AAsset_getBuffer(asset);
+      const uint64 buffer_length = AAsset_getLength(asset);
+      if (buffer == nullptr) {
+        s = errors::Internal("Could not read asset ", asset_filename);
+      } else {
+        s = ReadDirectory(filename, static_cast<const uint8*>(buffer),
+                          buffer_length, &directory);
+      }
+      if (s.ok()) {
+        LOG(WARNING) << "Asset " << asset_filename
+                     << " is compressed and cannot be mapped.";
+        memory.reset(new AlignedCopyRegion(buffer, buffer_length));
+      }
+    }
+    AAsset_close(asset);
+    TF_RETURN_IF_ERROR(s);
+#else
+    return errors::Unimplemented("Assets can only be read on Android: ",
+                                 filename);
+#endif  // __ANDROID__
+  } else {
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+      return errors::NotFound("Could not open ", filename, ": ",
+                              strerror(errno));
+    }
+    struct stat st;
+    Status s;
+    if (fstat(fd, &st) != 0) {
+      s = errors::Internal("fstat failed: ", strerror(errno));
+    } else {
+      s = MapFileRange(fd, 0, st.st_size, &memory);
+    }
+    close(fd);
+    TF_RETURN_IF_ERROR(s);
+  }
+  // A directory always lists the graph, so it is only empty if the package
+  // has been mapped but not read yet.
+  if (directory.empty()) {
+    TF_RETURN_IF_ERROR(ReadDirectory(
+        filename, static_cast<const uint8*>(memory->data()), memory->length(),
+        &directory));
+  }
+  EnsureAligned(filename, &memory);
+
+  package->reset(new MemmappedPackage(std::move(memory), std::move(directory)));
+  return Status::OK();
+}
+
+Status MemmappedPackage::ReadDirectory(
+    const char* const filename, const uint8* const start, const uint64 size,
+    std::unordered_map<string, Region>* const directory) {
+  // The package ends with the offset of its directory, which lists the
+  // regions in increasing order of offset. The same checks as in
+  // MemmappedFileSystem::InitializeFromFile reject files in other formats.
+  // Offsets are relative to the start, so this does not need the alignment
+  // the tensors do.
+  if (size <= sizeof(uint64)) {
+    return errors::NotFound(filename, " is not a memmapped package");
+  }
+  const uint64 directory_offset =
+      DecodeUint64LittleEndian(start + size - sizeof(uint64));
+  if (directory_offset > size - sizeof(uint64)) {
+    return errors::NotFound(filename, " is not a memmapped package");
+  }
+  MemmappedFileSystemDirectory proto_directory;
+  if (!ParseProtoUnlimited(&proto_directory, start + directory_offset,
+                           size - directory_offset - sizeof(uint64))) {
+    return errors::NotFound(filename, " is not a memmapped package");
+  }
+
+  directory->clear();
+  uint64 next_offset = directory_offset;
+  for (auto element = proto_directory.element().rbegin();
+       element != proto_directory.element().rend(); ++element) {
+    if (element->offset() >= next_offset) {
+      return errors::DataLoss("Corrupted memmapped package ", filename,
+                              ": invalid offset of ", element->name());
+    }
+    Region region;
+    region.offset = element->offset();
+    region.length = next_offset - element->offset();
+    if (!directory->insert(std::make_pair(element->name(), region)).second) {
+      return errors::DataLoss("Corrupted memmapped package ", filename,
+                              ": duplicate region ", element->name());
+    }
+    next_offset = element->offset();
+  }
+  if (directory->count(kPackageGraphDef) == 0) {
+    directory->clear();
+    return errors::NotFound(filename, " is not a memmapped package");
+  }
+  return Status::OK();
+}
+
+Status MemmappedPackage::GetRegion(const string& name, const void** data,
+                                   uint64* length) const {
+  const auto region = directory_.find(name);
+  if (region == directory_.end()) {
+    return errors::NotFound("Region ", name, " is not in the package");
+  }
+  *data = static_cast<const uint8*>(memory_->data()) + region->second.offset;
+  *length = region->second.length;
+  return Status::OK();
+}
+
+Status MemmappedPackage::ReadGraphDef(GraphDef* const graph_def) const {
+  const void* data;
+  uint64 length;
+  TF_RETURN_IF_ERROR(GetRegion(kPackageGraphDef, &data, &length));
+  if (!ParseProtoUnlimited(graph_def, data, length)) {
+    return errors::DataLoss("Could not parse the graph of the package");
+  }
+  return Status::OK();
+}
+
+std::unique_ptr<Env> MemmappedPackage::NewEnv(Env* const target) {
+  return std::unique_ptr<Env>(new PackageEnv(target, this));
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,92 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Serves a model package written by core/util/memmapped_file_system_writer.h
+// (see contrib/util/convert_graphdef_memmapped_format) straight out of memory
+// mapped from the model file or APK asset. The weights of such a graph are
+// ImmutableConst ops reading regions of the package, so they are paged in on
+// demand and shared between processes instead of being parsed onto the heap
+// and then copied into tensors by Session::Create.
+
+#ifndef ORG_TENSORFLOW_JNI_MEMMAPPED_PACKAGE_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_MEMMAPPED_PACKAGE_H_  // NOLINT
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+
+class AAssetManager;
+
+namespace tensorflow {
+namespace android {
+
+class MemmappedPackage {
+ public:
+  // Maps filename, which may be a file:///android_asset/ URI as for
+  // ReadFileToProto, in which case asset_manager must be set. Assets must be
+  // stored uncompressed; see aaptOptions in app/build.gradle. Returns NotFound
+  // if the file is missing or is not a memmapped package, having copied
+  // nothing, and DataLoss if it is a corrupted one.
+  static Status Map(AAssetManager* const asset_manager,
+                    const char* const filename,
+                    std::unique_ptr<MemmappedPackage>* package);
+
+  // Parses the graph stored in the package. It only holds the structure of
+  // the model; its weights stay in the package.
+  Status ReadGraphDef(GraphDef* const graph_def) const;
+
+  // Returns an Env to run a session of the graph with. It serves the regions
+  // of the package to the ImmutableConst ops and forwards everything else to
+  // target. The package must outlive the Env and every session using it.
+  std::unique_ptr<Env> NewEnv(Env* const target);
+
+  // Returns the region with the given memmapped_package:// name.
+  Status GetRegion(const string& name, const void** data,
+                   uint64* length) const;
+
+  uint64 size() const { return memory_->length(); }
+
+ private:
+  struct Region {
+    uint64 offset;
+    uint64 length;
+  };
+
+  MemmappedPackage(std::unique_ptr<ReadOnlyMemoryRegion> memory,
+                   std::unordered_map<string, Region> directory)
+      : memory_(std::move(memory)), directory_(std::move(directory)) {}
+
+  // Reads the directory at the end of the size bytes of the package at start.
+  static Status ReadDirectory(const char* const filename,
+                              const uint8* const start, const uint64 size,
+                              std::unordered_map<string, Region>* directory);
+
+  std::unique_ptr<ReadOnlyMemoryRegion> memory_;
+  std::unordered_map<string, Region> directory_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(MemmappedPackage);
+};
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_MEMMAPPED_PACKAGE_H_  // NOLINT
@@ -0,0 +1,139 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/non_max_suppression.h"
+
+#include <algorithm>
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// Compute intersection-over-union overlap between two candidate rows, whose
+// boxes are stored as center x, center y, width and height.
+inline float ComputeIOU(const float* const box_i, const float* const box_j) {
+  const float area_i = box_i[2] * box_i[3];
+  const float area_j = box_j[2] * box_j[3];
+  if (area_i <= 0 || area_j <= 0) return 0.0;
+
+  const float xmin_i = box_i[0] - box_i[2] * 0.5f;
+  const float xmax_i = box_i[0] + box_i[2] * 0.5f;
+  const float ymin_i = box_i[1] - box_i[3] * 0.5f;
+  const float ymax_i = box_i[1] + box_i[3] * 0.5f;
+  const float xmin_j = box_j[0] - box_j[2] * 0.5f;
+  const float xmax_j = box_j[0] + box_j[2] * 0.5f;
+  const float ymin_j = box_j[1] - box_j[3] * 0.5f;
+  const float ymax_j = box_j[1] + box_j[3] * 0.5f;
+
+  const float intersection_area =
+      std::max<float>(std::min(ymax_i, ymax_j) - std::max(ymin_i, ymin_j),
+                      0.0) *
+      std::max<float>(std::min(xmax_i, xmax_j) - std::max(xmin_i, xmin_j),
+                      0.0);
+  return intersection_area / (area_i + area_j - intersection_area);
+}
+
+}  // namespace
+
+NonMaxSuppressor::NonMaxSuppressor(const YoloGridConfig& config)
+    : config_(config) {
+  const int num_candidates = config_.NumCandidates();
+  sorted_indices_.resize(num_candidates);
+  active_.resize(num_candidates);
+  selected_.resize(num_candidates * config_.num_classes);
+}
+
+int NonMaxSuppressor::Run(const float* const candidates,
+                          const float score_threshold,
+                          const float iou_threshold, const int max_detections,
+                          Detection* const detections) {
+  const int num_candidates = config_.NumCandidates();
+  const int stride = config_.CandidateStride();
+  int num_selected = 0;
+
+  for (int c = 0; c < config_.num_classes; ++c) {
+    const int score_offset = YoloGridConfig::kCandidateHeaderSize + c;
+
+    // Gather the candidates that beat the threshold for this class.
+    int num_boxes = 0;
+    for (int i = 0; i < num_candidates; ++i) {
+      if (candidates[i * stride + score_offset] > score_threshold) {
+        sorted_indices_[num_boxes++] = i;
+      }
+    }
+    if (num_boxes == 0) {
+      continue;
+    }
+
+    std::sort(sorted_indices_.begin(), sorted_indices_.begin() + num_boxes,
+              [candidates, stride, score_offset](const int i, const int j) {
+                return candidates[i * stride + score_offset] >
+                       candidates[j * stride + score_offset];
+              });
+    std::fill(active_.begin(), active_.begin() + num_boxes, 1);
+
+    for (int i = 0; i < num_boxes; ++i) {
+      if (!active_[i]) {
+        continue;
+      }
+      const float* const box_i = candidates + sorted_indices_[i] * stride;
+
+      Detection* const detection = &selected_[num_selected++];
+      detection->class_index = c;
+      detection->score = box_i[score_offset];
+      detection->x = box_i[0];
+      detection->y = box_i[1];
+      detection->width = box_i[2];
+      detection->height = box_i[3];
+
+      for (int j = i + 1; j < num_boxes; ++j) {
+        if (active_[j] &&
+            ComputeIOU(box_i, candidates + sorted_indices_[j] * stride) >
+                iou_threshold) {
+          active_[j] = 0;
+        }
+      }
+    }
+  }
+
+  // Keep the best max_detections over all classes.
+  const int num_results = std::max(0, std::min(num_selected, max_detections));
+  std::partial_sort(selected_.begin(), selected_.begin() + num_results,
+                    selected_.begin() + num_selected,
+                    [](const Detection& a, const Detection& b) {
+                      return a.score > b.score;
+                    });
+  std::copy_n(selected_.begin(), num_results, detections);
+  return num_results;
+}
+
+void WriteDetections(const Detection* const detections, const int count,
+                     float* const output) {
+  float* out = output;
+  for (int i = 0; i < count; ++i) {
+    const Detection& detection = detections[i];
+    out[0] = detection.class_index;
+    out[1] = detection.score;
+    out[2] = detection.x;
+    out[3] = detection.y;
+    out[4] = detection.width;
+    out[5] = detection.height;
+    out += kDetectionStride;
+  }
+}
+
+}  // namespace android
+}  // namespace tensorflow
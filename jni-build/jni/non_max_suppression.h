@@ -0,0 +1,78 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Per-class non-max suppression over the candidate boxes produced by
+// DecodeYoloOutput. This follows the greedy sort-and-suppress algorithm of
+// tensorflow/core/kernels/non_max_suppression_op.cc, but keeps all of its
+// scratch space across frames so that steady-state calls do not allocate.
+
+#ifndef ORG_TENSORFLOW_JNI_NON_MAX_SUPPRESSION_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_NON_MAX_SUPPRESSION_H_  // NOLINT
+
+#include <vector>
+
+#include "tensorflow/examples/android/jni/yolo_decoder.h"
+
+namespace tensorflow {
+namespace android {
+
+// A detection that survived suppression. The box is normalized to [0, 1] with
+// (x, y) being its center, as in the decoded candidates.
+struct Detection {
+  int class_index;
+  float score;
+  float x;
+  float y;
+  float width;
+  float height;
+};
+
+// Number of floats used per detection by WriteDetections:
+// [class index, score, center x, center y, width, height].
+static const int kDetectionStride = 6;
+
+class NonMaxSuppressor {
+ public:
+  // Sizes the candidate buffers for the given grid once.
+  explicit NonMaxSuppressor(const YoloGridConfig& config);
+
+  // Scores every candidate against every class, drops those below
+  // score_threshold, and greedily suppresses boxes of the same class that
+  // overlap a higher scoring one by more than iou_threshold. Up to
+  // max_detections survivors over all classes are written to detections in
+  // decreasing order of score. Returns the number written.
+  int Run(const float* const candidates, const float score_threshold,
+          const float iou_threshold, const int max_detections,
+          Detection* const detections);
+
+ private:
+  const YoloGridConfig config_;
+
+  // Indices of the candidates above threshold for the class being processed.
+  std::vector<int> sorted_indices_;
+  // Whether each entry of sorted_indices_ is still a valid detection.
+  std::vector<char> active_;
+  // Survivors of all classes before the final top-K selection.
+  std::vector<Detection> selected_;
+};
+
+// Flattens detections into kDetectionStride floats each.
+void WriteDetections(const Detection* const detections, const int count,
+                     float* const output);
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_NON_MAX_SUPPRESSION_H_  // NOLINT
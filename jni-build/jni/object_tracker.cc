@@ -0,0 +1,414 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/object_tracker.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// Side of the luma thumbnail patches are matched in. One thumbnail pixel is
+// about a hundredth of the model input.
+const int kThumbnailSize = 96;
+// Patches are (2 * kPatchRadius + 1) pixels square and searched for up to
+// kSearchRadius pixels away.
+const int kPatchRadius = 4;
+const int kSearchRadius = 6;
+const int kPatchArea = (2 * kPatchRadius + 1) * (2 * kPatchRadius + 1);
+// Patches whose mean absolute deviation from their mean is below this carry
+// too little texture to be matched.
+const int kMinPatchContrast = 4;
+// Matches whose mean absolute difference is above this are rejected.
+const int kMaxMatchError = 12;
+
+// Variance of the acceleration of a box center, in normalized units per
+// second squared. Objects cross the screen in about a second.
+const float kAccelerationVariance = 1.0f;
+// Measurement variances of a detected and a patch matched box center.
+const float kDetectionVariance = 0.02f * 0.02f;
+const float kFlowVariance = 0.03f * 0.03f;
+// Variance of the velocity of a new track.
+const float kInitialVelocityVariance = 0.25f;
+// Velocities decay with this time constant when not measured, so that boxes
+// coast to a halt rather than off the screen.
+const float kVelocityDecaySeconds = 1.0f;
+// Weight of a new detection in the smoothed box size.
+const float kSizeSmoothing = 0.5f;
+
+inline float Clamp01(const float value) {
+  return std::min(1.0f, std::max(0.0f, value));
+}
+
+float ComputeIOU(const float x_i, const float y_i, const float w_i,
+                 const float h_i, const Detection& detection) {
+  const float area_i = w_i * h_i;
+  const float area_j = detection.width * detection.height;
+  if (area_i <= 0 || area_j <= 0) return 0.0;
+
+  const float intersection_width = std::max<float>(
+      std::min(x_i + w_i * 0.5f, detection.x + detection.width * 0.5f) -
+          std::max(x_i - w_i * 0.5f, detection.x - detection.width * 0.5f),
+      0.0);
+  const float intersection_height = std::max<float>(
+      std::min(y_i + h_i * 0.5f, detection.y + detection.height * 0.5f) -
+          std::max(y_i - h_i * 0.5f, detection.y - detection.height * 0.5f),
+      0.0);
+  const float intersection_area = intersection_width * intersection_height;
+  return intersection_area / (area_i + area_j - intersection_area);
+}
+
+}  // namespace
+
+void ObjectTracker::AxisFilter::Reset(const float initial_position) {
+  position = initial_position;
+  velocity = 0.0f;
+  p00 = kDetectionVariance;
+  p01 = 0.0f;
+  p11 = kInitialVelocityVariance;
+}
+
+void ObjectTracker::AxisFilter::Predict(const float dt) {
+  // x' = F x with F = [1 dt; 0 1], P' = F P F^T + Q for white noise
+  // acceleration.
+  position += velocity * dt;
+  const float dt2 = dt * dt;
+  p00 += dt * (2.0f * p01 + dt * p11) +
+         kAccelerationVariance * dt2 * dt2 / 4.0f;
+  p01 += dt * p11 + kAccelerationVariance * dt2 * dt / 2.0f;
+  p11 += kAccelerationVariance * dt2;
+
+  const float decay = 1.0f / (1.0f + dt / kVelocityDecaySeconds);
+  velocity *= decay;
+  p01 *= decay;
+  p11 *= decay * decay;
+}
+
+void ObjectTracker::AxisFilter::Correct(const float measurement,
+                                        const float variance) {
+  // H = [1 0].
+  const float s = p00 + variance;
+  const float k0 = p00 / s;
+  const float k1 = p01 / s;
+  const float residual = measurement - position;
+  position += k0 * residual;
+  velocity += k1 * residual;
+  p11 -= k1 * p01;
+  p01 -= k0 * p01;
+  p00 -= k0 * p00;
+}
+
+ObjectTracker::ObjectTracker()
+    : next_track_id_(1),
+      frame_width_(0),
+      frame_height_(0),
+      y_row_stride_(0),
+      rotation_(0),
+      thumbnail_offsets_(kThumbnailSize * kThumbnailSize),
+      thumbnail_(kThumbnailSize * kThumbnailSize),
+      previous_thumbnail_(kThumbnailSize * kThumbnailSize),
+      has_previous_thumbnail_(false) {}
+
+void ObjectTracker::Configure(const TrackerConfig& config) {
+  mutex_lock l(mu_);
+  config_ = config;
+  tracks_.clear();
+  has_previous_thumbnail_ = false;
+}
+
+void ObjectTracker::PredictTracks(const int64 timestamp_us) {
+  for (Track& track : tracks_) {
+    // Detections can arrive for a frame older than the last one tracked;
+    // those correct the tracks where they are now.
+    if (timestamp_us <= track.timestamp_us) {
+      continue;
+    }
+    const float dt = (timestamp_us - track.timestamp_us) / 1000000.0f;
+    track.x.Predict(dt);
+    track.y.Predict(dt);
+    track.x.position = Clamp01(track.x.position);
+    track.y.position = Clamp01(track.y.position);
+    track.timestamp_us = timestamp_us;
+  }
+}
+
+void ObjectTracker::Update(const Detection* const detections,
+                           const int count, const int64 timestamp_us) {
+  mutex_lock l(mu_);
+  PredictTracks(timestamp_us);
+
+  // Greedily match the most overlapping pairs of the same class first.
+  matches_.clear();
+  for (int i = 0; i < tracks_.size(); ++i) {
+    const Track& track = tracks_[i];
+    for (int j = 0; j < count; ++j) {
+      if (detections[j].class_index != track.class_index) {
+        continue;
+      }
+      const float iou = ComputeIOU(track.x.position, track.y.position,
+                                   track.width, track.height, detections[j]);
+      if (iou > config_.match_iou) {
+        matches_.push_back({iou, i, j});
+      }
+    }
+  }
+  std::sort(matches_.begin(), matches_.end(),
+            [](const Match& a, const Match& b) { return a.iou > b.iou; });
+
+  track_matched_.assign(tracks_.size(), 0);
+  detection_matched_.assign(count, 0);
+  for (const Match& match : matches_) {
+    if (track_matched_[match.track] || detection_matched_[match.detection]) {
+      continue;
+    }
+    track_matched_[match.track] = 1;
+    detection_matched_[match.detection] = 1;
+
+    Track& track = tracks_[match.track];
+    const Detection& detection = detections[match.detection];
+    track.x.Correct(detection.x, kDetectionVariance);
+    track.y.Correct(detection.y, kDetectionVariance);
+    track.width += kSizeSmoothing * (detection.width - track.width);
+    track.height += kSizeSmoothing * (detection.height - track.height);
+    track.score = detection.score;
+    track.missed_detections = 0;
+  }
+
+  // Age the tracks nothing matched, dropping those missed too often.
+  int num_kept = 0;
+  for (int i = 0; i < tracks_.size(); ++i) {
+    if (!track_matched_[i] &&
+        ++tracks_[i].missed_detections >= config_.max_missed_detections) {
+      continue;
+    }
+    tracks_[num_kept++] = tracks_[i];
+  }
+  tracks_.resize(num_kept);
+
+  for (int j = 0; j < count; ++j) {
+    if (detection_matched_[j]) {
+      continue;
+    }
+    const Detection& detection = detections[j];
+    Track track;
+    track.id = next_track_id_++;
+    track.class_index = detection.class_index;
+    track.score = detection.score;
+    track.x.Reset(detection.x);
+    track.y.Reset(detection.y);
+    track.width = detection.width;
+    track.height = detection.height;
+    track.missed_detections = 0;
+    track.timestamp_us = timestamp_us;
+    tracks_.push_back(track);
+  }
+}
+
+void ObjectTracker::SampleThumbnail(const YUV420Frame& frame,
+                                    const int rotation) {
+  const int normalized_rotation = ((rotation % 360) + 360) % 360;
+  if (frame.width != frame_width_ || frame.height != frame_height_ ||
+      frame.y_row_stride != y_row_stride_ ||
+      normalized_rotation != rotation_) {
+    frame_width_ = frame.width;
+    frame_height_ = frame.height;
+    y_row_stride_ = frame.y_row_stride;
+    rotation_ = normalized_rotation;
+    has_previous_thumbnail_ = false;
+
+    // Sample the same rotated center square as YUVPreprocessor.
+    const int min_dim = std::min(frame.width, frame.height);
+    const int crop_x = (frame.width - min_dim) / 2;
+    const int crop_y = (frame.height - min_dim) / 2;
+    const int last = kThumbnailSize - 1;
+    for (int i = 0; i < kThumbnailSize; ++i) {
+      for (int j = 0; j < kThumbnailSize; ++j) {
+        int sx, sy;
+        switch (rotation_) {
+          case 90:
+            sx = i;
+            sy = last - j;
+            break;
+          case 180:
+            sx = last - j;
+            sy = last - i;
+            break;
+          case 270:
+            sx = last - i;
+            sy = j;
+            break;
+          default:
+            sx = j;
+            sy = i;
+            break;
+        }
+        const int x = crop_x + ((2 * sx + 1) * min_dim) / (2 * kThumbnailSize);
+        const int y = crop_y + ((2 * sy + 1) * min_dim) / (2 * kThumbnailSize);
+        thumbnail_offsets_[i * kThumbnailSize + j] = y * y_row_stride_ + x;
+      }
+    }
+  }
+
+  const int* offset = thumbnail_offsets_.data();
+  uint8* out = thumbnail_.data();
+  for (int i = 0; i < kThumbnailSize * kThumbnailSize; ++i) {
+    *out++ = frame.y[*offset++];
+  }
+}
+
+bool ObjectTracker::MatchPatch(const float x, const float y, int* const dx,
+                               int* const dy) const {
+  const int margin = kPatchRadius + kSearchRadius;
+  const int cx = static_cast<int>(x * kThumbnailSize);
+  const int cy = static_cast<int>(y * kThumbnailSize);
+  if (cx < margin || cy < margin || cx >= kThumbnailSize - margin ||
+      cy >= kThumbnailSize - margin) {
+    return false;
+  }
+
+  const uint8* const patch =
+      &previous_thumbnail_[(cy - kPatchRadius) * kThumbnailSize + cx -
+                           kPatchRadius];
+  const int patch_side = 2 * kPatchRadius + 1;
+  int sum = 0;
+  for (int i = 0; i < patch_side; ++i) {
+    for (int j = 0; j < patch_side; ++j) {
+      sum += patch[i * kThumbnailSize + j];
+    }
+  }
+  const int mean = sum / kPatchArea;
+  int deviation = 0;
+  for (int i = 0; i < patch_side; ++i) {
+    for (int j = 0; j < patch_side; ++j) {
+      deviation += abs(patch[i * kThumbnailSize + j] - mean);
+    }
+  }
+  if (deviation < kMinPatchContrast * kPatchArea) {
+    return false;
+  }
+
+  int best_sad = kMaxMatchError * kPatchArea + 1;
+  for (int oy = -kSearchRadius; oy <= kSearchRadius; ++oy) {
+    for (int ox = -kSearchRadius; ox <= kSearchRadius; ++ox) {
+      const uint8* const candidate =
+          &thumbnail_[(cy - kPatchRadius + oy) * kThumbnailSize + cx -
+                      kPatchRadius + ox];
+      int sad = 0;
+      for (int i = 0; i < patch_side && sad <= best_sad; ++i) {
+        for (int j = 0; j < patch_side; ++j) {
+          sad += abs(patch[i * kThumbnailSize + j] -
+                     candidate[i * kThumbnailSize + j]);
+        }
+      }
+      // Prefer the smallest motion among equally good matches.
+      if (sad < best_sad ||
+          (sad == best_sad && abs(ox) + abs(oy) < abs(*dx) + abs(*dy))) {
+        best_sad = sad;
+        *dx = ox;
+        *dy = oy;
+      }
+    }
+  }
+  return best_sad <= kMaxMatchError * kPatchArea;
+}
+
+int ObjectTracker::TrackFrame(const YUV420Frame& frame, const int rotation,
+                              const int64 timestamp_us, const int max_objects,
+                              TrackedObject* const objects) {
+  mutex_lock l(mu_);
+  const int num_tracks = tracks_.size();
+
+  // Match the patches around where the tracks were in the previous frame
+  // before moving them to this one.
+  has_measured_center_.assign(num_tracks, 0);
+  if (config_.optical_flow) {
+    SampleThumbnail(frame, rotation);
+    measured_centers_.resize(2 * num_tracks);
+    for (int i = 0; has_previous_thumbnail_ && i < num_tracks; ++i) {
+      const Track& track = tracks_[i];
+      int dx = 0;
+      int dy = 0;
+      if (MatchPatch(track.x.position, track.y.position, &dx, &dy)) {
+        has_measured_center_[i] = 1;
+        measured_centers_[2 * i] =
+            track.x.position + static_cast<float>(dx) / kThumbnailSize;
+        measured_centers_[2 * i + 1] =
+            track.y.position + static_cast<float>(dy) / kThumbnailSize;
+      }
+    }
+    thumbnail_.swap(previous_thumbnail_);
+    has_previous_thumbnail_ = true;
+  }
+
+  PredictTracks(timestamp_us);
+  for (int i = 0; i < num_tracks; ++i) {
+    if (has_measured_center_[i]) {
+      Track& track = tracks_[i];
+      track.x.Correct(measured_centers_[2 * i], kFlowVariance);
+      track.y.Correct(measured_centers_[2 * i + 1], kFlowVariance);
+      track.x.position = Clamp01(track.x.position);
+      track.y.position = Clamp01(track.y.position);
+    }
+  }
+
+  // Report the highest scoring tracks first, as detections are.
+  report_order_.resize(num_tracks);
+  for (int i = 0; i < num_tracks; ++i) {
+    report_order_[i] = i;
+  }
+  const int num_objects = std::min(std::max(0, max_objects), num_tracks);
+  std::partial_sort(report_order_.begin(),
+                    report_order_.begin() + num_objects, report_order_.end(),
+                    [this](const int a, const int b) {
+                      return tracks_[a].score > tracks_[b].score;
+                    });
+  for (int i = 0; i < num_objects; ++i) {
+    const Track& track = tracks_[report_order_[i]];
+    TrackedObject* const object = &objects[i];
+    object->id = track.id;
+    object->detection.class_index = track.class_index;
+    object->detection.score = track.score;
+    object->detection.x = track.x.position;
+    object->detection.y = track.y.position;
+    object->detection.width = track.width;
+    object->detection.height = track.height;
+  }
+  return num_objects;
+}
+
+void WriteTrackedObjects(const TrackedObject* const objects, const int count,
+                         float* const output) {
+  float* out = output;
+  for (int i = 0; i < count; ++i) {
+    const TrackedObject& object = objects[i];
+    out[0] = object.id;
+    out[1] = object.detection.class_index;
+    out[2] = object.detection.score;
+    out[3] = object.detection.x;
+    out[4] = object.detection.y;
+    out[5] = object.detection.width;
+    out[6] = object.detection.height;
+    out += kTrackedObjectStride;
+  }
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,568 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define EIGEN_USE_THREADS
+
+#include "tensorflow/examples/android/jni/packed_matmul.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define PACKED_MATMUL_USE_NEON
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define PACKED_MATMUL_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "tensorflow/core/common_runtime/optimization_registry.h"
+#include "tensorflow/core/framework/common_shape_fns.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/examples/android/jni/adaptive_sharder.h"
+#include "tensorflow/examples/android/jni/kernel_rewrite_utils.h"
+
+namespace tensorflow {
+
+REGISTER_OP("PackedMatMul")
+    .Input("a: T")
+    .Input("b: T")
+    .Output("product: T")
+    .Attr("transpose_a: bool = false")
+    .Attr("transpose_b: bool = false")
+    .Attr("T: {float}")
+    .Attr("weight_format: {'float', 'bfloat16', 'int8'} = 'float'")
+    .SetShapeFn(shape_inference::MatMulShape)
+    .Doc(R"doc(
+Multiplies a by the constant matrix b, as MatMul does.
+
+Produced by the MatMul weight packing pass rather than built directly. When a
+has a single row, b is read from a copy packed on the first run and stored in
+weight_format.
+
+weight_format: Storage of the packed weights. 'bfloat16' keeps the upper half
+  of each float; 'int8' keeps symmetric eight bit values with a float scale
+  per column of the product.
+)doc");
+
+namespace android {
+
+namespace {
+
+// Columns of the product computed together. Each row of a panel is one cache
+// line of float weights.
+const int kPanelWidth = 16;
+
+// How many panel rows ahead of the one being read to prefetch.
+const int kPrefetchRows = 8;
+
+const char* WeightFormatName(const MatMulWeightFormat format) {
+  switch (format) {
+    case kMatMulWeightsBfloat16:
+      return "bfloat16";
+    case kMatMulWeightsInt8:
+      return "int8";
+    default:
+      return "float";
+  }
+}
+
+// Weights laid out panel by panel: panel p holds columns
+// [p * kPanelWidth, (p + 1) * kPanelWidth) of the product, row by row, with
+// columns past the end zero. Only the vector of the chosen format is filled.
+struct PackedWeights {
+  int64 depth;
+  int64 columns;
+  int64 num_panels;
+  std::vector<float> floats;
+  std::vector<uint16> bfloat16s;
+  std::vector<int8> int8s;
+  // For int8, the value of one step of each column.
+  std::vector<float> scales;
+};
+
+inline uint16 FloatToBfloat16(const float value) {
+  uint32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  // Round to nearest, ties to even.
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return static_cast<uint16>(bits >> 16);
+}
+
+// Packs the depth x columns weights of b, transposed if transpose_b.
+void PackWeights(const Tensor& b, const bool transpose_b,
+                 const MatMulWeightFormat format,
+                 const DeviceBase::CpuWorkerThreads& workers,
+                 PackedWeights* const packed) {
+  auto weights = b.matrix<float>();
+  packed->depth = b.dim_size(transpose_b ? 1 : 0);
+  packed->columns = b.dim_size(transpose_b ? 0 : 1);
+  packed->num_panels = (packed->columns + kPanelWidth - 1) / kPanelWidth;
+  const int64 size = packed->num_panels * packed->depth * kPanelWidth;
+  switch (format) {
+    case kMatMulWeightsBfloat16:
+      packed->bfloat16s.resize(size);
+      break;
+    case kMatMulWeightsInt8:
+      packed->int8s.resize(size);
+      packed->scales.resize(packed->num_panels * kPanelWidth);
+      break;
+    default:
+      packed->floats.resize(size);
+      break;
+  }
+
+  const int64 depth = packed->depth;
+  const int64 columns = packed->columns;
+  auto work = [&](int64 begin, int64 end) {
+    for (int64 panel = begin; panel < end; ++panel) {
+      for (int j = 0; j < kPanelWidth; ++j) {
+        const int64 n = panel * kPanelWidth + j;
+        float scale = 0.0f;
+        if (format == kMatMulWeightsInt8 && n < columns) {
+          float max_abs = 0.0f;
+          for (int64 k = 0; k < depth; ++k) {
+            max_abs = std::max(
+                max_abs, fabsf(transpose_b ? weights(n, k) : weights(k, n)));
+          }
+          scale = max_abs / 127.0f;
+          packed->scales[n] = scale;
+        }
+        for (int64 k = 0; k < depth; ++k) {
+          const float value =
+              n < columns ? (transpose_b ? weights(n, k) : weights(k, n))
+                          : 0.0f;
+          const int64 index = (panel * depth + k) * kPanelWidth + j;
+          switch (format) {
+            case kMatMulWeightsBfloat16:
+              packed->bfloat16s[index] = FloatToBfloat16(value);
+              break;
+            case kMatMulWeightsInt8:
+              packed->int8s[index] = static_cast<int8>(
+                  scale > 0.0f ? roundf(value / scale) : 0.0f);
+              break;
+            default:
+              packed->floats[index] = value;
+              break;
+          }
+        }
+      }
+    }
+  };
+  static ShardSite* const site = new ShardSite("packed_matmul/pack");
+  AdaptiveShard(site, workers.num_threads, workers.workers, packed->num_panels,
+                depth * kPanelWidth * 4, work);
+}
+
+// Four lanes of floats and the panel row loads for each weight format. A
+// panel row fills four vectors.
+
+#if defined(PACKED_MATMUL_USE_NEON)
+
+typedef float32x4_t FloatVector;
+
+inline FloatVector Broadcast(const float value) { return vdupq_n_f32(value); }
+
+inline FloatVector MultiplyAdd(const FloatVector sum, const FloatVector a,
+                               const FloatVector b) {
+  return vmlaq_f32(sum, a, b);
+}
+
+inline void Store(const FloatVector value, float* const output) {
+  vst1q_f32(output, value);
+}
+
+inline void LoadPanelRow(const float* const row, FloatVector* const values) {
+  for (int i = 0; i < 4; ++i) {
+    values[i] = vld1q_f32(row + i * 4);
+  }
+}
+
+inline void LoadPanelRow(const uint16* const row, FloatVector* const values) {
+  for (int i = 0; i < 2; ++i) {
+    const uint16x8_t halves = vld1q_u16(row + i * 8);
+    values[i * 2] =
+        vreinterpretq_f32_u32(vshll_n_u16(vget_low_u16(halves), 16));
+    values[i * 2 + 1] =
+        vreinterpretq_f32_u32(vshll_n_u16(vget_high_u16(halves), 16));
+  }
+}
+
+inline void LoadPanelRow(const int8* const row, FloatVector* const values) {
+  const int8x16_t bytes = vld1q_s8(row);
+  const int16x8_t low = vmovl_s8(vget_low_s8(bytes));
+  const int16x8_t high = vmovl_s8(vget_high_s8(bytes));
+  values[0] = vcvtq_f32_s32(vmovl_s16(vget_low_s16(low)));
+  values[1] = vcvtq_f32_s32(vmovl_s16(vget_high_s16(low)));
+  values[2] = vcvtq_f32_s32(vmovl_s16(vget_low_s16(high)));
+  values[3] = vcvtq_f32_s32(vmovl_s16(vget_high_s16(high)));
+}
+
+#elif defined(PACKED_MATMUL_USE_SSE2)
+
+typedef __m128 FloatVector;
+
+inline FloatVector Broadcast(const float value) { return _mm_set1_ps(value); }
+
+inline FloatVector MultiplyAdd(const FloatVector sum, const FloatVector a,
+                               const FloatVector b) {
+  return _mm_add_ps(sum, _mm_mul_ps(a, b));
+}
+
+inline void Store(const FloatVector value, float* const output) {
+  _mm_storeu_ps(output, value);
+}
+
+inline void LoadPanelRow(const float* const row, FloatVector* const values) {
+  for (int i = 0; i < 4; ++i) {
+    values[i] = _mm_loadu_ps(row + i * 4);
+  }
+}
+
+inline void LoadPanelRow(const uint16* const row, FloatVector* const values) {
+  const __m128i zero = _mm_setzero_si128();
+  for (int i = 0; i < 2; ++i) {
+    const __m128i halves =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i * 8));
+    values[i * 2] = _mm_castsi128_ps(_mm_unpacklo_epi16(zero, halves));
+    values[i * 2 + 1] = _mm_castsi128_ps(_mm_unpackhi_epi16(zero, halves));
+  }
+}
+
+inline void LoadPanelRow(const int8* const row, FloatVector* const values) {
+  const __m128i bytes =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+  // Each byte goes to the top of its lane, and an arithmetic shift brings it
+  // back down with its sign.
+  const __m128i low = _mm_unpacklo_epi8(bytes, bytes);
+  const __m128i high = _mm_unpackhi_epi8(bytes, bytes);
+  values[0] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(low, low), 24));
+  values[1] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(low, low), 24));
+  values[2] =
+      _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(high, high), 24));
+  values[3] =
+      _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(high, high), 24));
+}
+
+#else
+
+struct FloatVector {
+  float lanes[4];
+};
+
+inline FloatVector Broadcast(const float value) {
+  FloatVector result;
+  for (int i = 0; i < 4; ++i) {
+    result.lanes[i] = value;
+  }
+  return result;
+}
+
+inline FloatVector MultiplyAdd(const FloatVector sum, const FloatVector a,
+                               const FloatVector b) {
+  FloatVector result;
+  for (int i = 0; i < 4; ++i) {
+    result.lanes[i] = sum.lanes[i] + a.lanes[i] * b.lanes[i];
+  }
+  return result;
+}
+
+inline void Store(const FloatVector value, float* const output) {
+  memcpy(output, value.lanes, sizeof(value.lanes));
+}
+
+inline float WidenWeight(const float weight) { return weight; }
+
+inline float WidenWeight(const uint16 weight) {
+  const uint32 bits = static_cast<uint32>(weight) << 16;
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+inline float WidenWeight(const int8 weight) {
+  return static_cast<float>(weight);
+}
+
+template <typename Weight>
+inline void LoadPanelRow(const Weight* const row, FloatVector* const values) {
+  for (int i = 0; i < kPanelWidth; ++i) {
+    values[i / 4].lanes[i % 4] = WidenWeight(row[i]);
+  }
+}
+
+#endif
+
+// Computes the kPanelWidth products of input with one panel of weights.
+template <typename Weight>
+void MultiplyPanel(const float* const input, const Weight* const panel,
+                   const int64 depth, float* const output) {
+  FloatVector sums[4];
+  for (int i = 0; i < 4; ++i) {
+    sums[i] = Broadcast(0.0f);
+  }
+  for (int64 k = 0; k < depth; ++k) {
+    const Weight* const row = panel + k * kPanelWidth;
+    // Panels are read front to back, but the row after a panel is in the
+    // next panel, which another thread may be reading.
+    __builtin_prefetch(row + kPrefetchRows * kPanelWidth);
+    FloatVector weights[4];
+    LoadPanelRow(row, weights);
+    const FloatVector value = Broadcast(input[k]);
+    for (int i = 0; i < 4; ++i) {
+      sums[i] = MultiplyAdd(sums[i], weights[i], value);
+    }
+  }
+  for (int i = 0; i < 4; ++i) {
+    Store(sums[i], output + i * 4);
+  }
+}
+
+// Multiplies the depth values of input by the packed weights, one panel per
+// unit of work.
+void MultiplyPacked(const float* const input, const PackedWeights& packed,
+                    const DeviceBase::CpuWorkerThreads& workers,
+                    float* const output) {
+  auto work = [&](int64 begin, int64 end) {
+    float products[kPanelWidth];
+    for (int64 panel = begin; panel < end; ++panel) {
+      const int64 offset = panel * packed.depth * kPanelWidth;
+      if (!packed.bfloat16s.empty()) {
+        MultiplyPanel(input, packed.bfloat16s.data() + offset, packed.depth,
+                      products);
+      } else if (!packed.int8s.empty()) {
+        MultiplyPanel(input, packed.int8s.data() + offset, packed.depth,
+                      products);
+      } else {
+        MultiplyPanel(input, packed.floats.data() + offset, packed.depth,
+                      products);
+      }
+      const int64 first = panel * kPanelWidth;
+      const int64 count = std::min<int64>(kPanelWidth, packed.columns - first);
+      for (int64 j = 0; j < count; ++j) {
+        output[first + j] = packed.scales.empty()
+                                ? products[j]
+                                : products[j] * packed.scales[first + j];
+      }
+    }
+  };
+  static ShardSite* const site = new ShardSite("packed_matmul/panels");
+  AdaptiveShard(site, workers.num_threads, workers.workers, packed.num_panels,
+                packed.depth * kPanelWidth * 2, work);
+}
+
+class PackedMatMulOp : public OpKernel {
+ public:
+  explicit PackedMatMulOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("transpose_a", &transpose_a_));
+    OP_REQUIRES_OK(context, context->GetAttr("transpose_b", &transpose_b_));
+    string weight_format;
+    OP_REQUIRES_OK(context, context->GetAttr("weight_format", &weight_format));
+    format_ = weight_format == "bfloat16"
+                  ? kMatMulWeightsBfloat16
+                  : weight_format == "int8" ? kMatMulWeightsInt8
+                                            : kMatMulWeightsFloat;
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& a = context->input(0);
+    const Tensor& b = context->input(1);
+    OP_REQUIRES(context, TensorShapeUtils::IsMatrix(a.shape()),
+                errors::InvalidArgument("In[0] is not a matrix"));
+    OP_REQUIRES(context, TensorShapeUtils::IsMatrix(b.shape()),
+                errors::InvalidArgument("In[1] is not a matrix"));
+    Eigen::array<Eigen::IndexPair<Eigen::DenseIndex>, 1> dim_pair;
+    dim_pair[0].first = transpose_a_ ? 0 : 1;
+    dim_pair[0].second = transpose_b_ ? 1 : 0;
+    OP_REQUIRES(
+        context,
+        a.dim_size(dim_pair[0].first) == b.dim_size(dim_pair[0].second),
+        errors::InvalidArgument("Matrix size-compatible: In[0]: ",
+                                a.shape().DebugString(), ", In[1]: ",
+                                b.shape().DebugString()));
+    const int64 rows = a.dim_size(1 - dim_pair[0].first);
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(
+                       0,
+                       TensorShape({rows, b.dim_size(1 - dim_pair[0].second)}),
+                       &output));
+    if (output->NumElements() == 0) {
+      return;
+    }
+    if (a.NumElements() == 0) {
+      output->flat<float>().setZero();
+      return;
+    }
+
+    // A single row is contiguous whether or not it is transposed.
+    if (rows == 1) {
+      MultiplyPacked(a.flat<float>().data(), *PackedWeightsOf(b, context),
+                     *context->device()->tensorflow_cpu_worker_threads(),
+                     output->flat<float>().data());
+      return;
+    }
+    output->matrix<float>().device(
+        context->eigen_device<Eigen::ThreadPoolDevice>()) =
+        a.matrix<float>().contract(b.matrix<float>(), dim_pair);
+  }
+
+ private:
+  // Returns the packed copy of b, packed once per weights tensor.
+  std::shared_ptr<const PackedWeights> PackedWeightsOf(
+      const Tensor& b, OpKernelContext* context) {
+    const DeviceBase::CpuWorkerThreads& workers =
+        *context->device()->tensorflow_cpu_worker_threads();
+    return packed_.Get(b, [this, &workers](const Tensor& weights,
+                                           PackedWeights* packed) {
+      PackWeights(weights, transpose_b_, format_, workers, packed);
+    });
+  }
+
+  bool transpose_a_;
+  bool transpose_b_;
+  MatMulWeightFormat format_;
+
+  DerivedInputCache<PackedWeights> packed_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("PackedMatMul")
+                            .Device(DEVICE_CPU)
+                            .TypeConstraint<float>("T"),
+                        PackedMatMulOp);
+
+bool IsPackable(const Node* node) {
+  DataType dtype;
+  if (!node->IsOp() || node->type_string() != "MatMul" ||
+      !GetNodeAttr(node->def(), "T", &dtype).ok() || dtype != DT_FLOAT) {
+    return false;
+  }
+  const Edge* weights = DataInput(node, 1);
+  if (weights == nullptr) {
+    return false;
+  }
+  const string& source = weights->src()->type_string();
+  if (source != "Const" && source != "ImmutableConst") {
+    return false;
+  }
+  // The packed kernel only exists for the CPU.
+  return IsCpuDevice(node->def().device());
+}
+
+Status ReplaceMatMul(Graph* graph, Node* matmul,
+                     const MatMulWeightFormat format) {
+  const Edge* a = DataInput(matmul, 0);
+  const Edge* b = DataInput(matmul, 1);
+  if (a == nullptr) {
+    return errors::InvalidArgument("Missing input of ", matmul->name());
+  }
+  bool transpose_a;
+  bool transpose_b;
+  TF_RETURN_IF_ERROR(GetNodeAttr(matmul->def(), "transpose_a", &transpose_a));
+  TF_RETURN_IF_ERROR(GetNodeAttr(matmul->def(), "transpose_b", &transpose_b));
+  std::vector<Node*> control_inputs;
+  for (const Edge* edge : matmul->in_edges()) {
+    if (edge->IsControlEdge()) {
+      control_inputs.push_back(edge->src());
+    }
+  }
+
+  Node* packed;
+  TF_RETURN_IF_ERROR(NodeBuilder(matmul->name(), "PackedMatMul",
+                                 graph->op_registry())
+                         .Input(a->src(), a->src_output())
+                         .Input(b->src(), b->src_output())
+                         .Attr("T", DT_FLOAT)
+                         .Attr("transpose_a", transpose_a)
+                         .Attr("transpose_b", transpose_b)
+                         .Attr("weight_format", WeightFormatName(format))
+                         .ControlInputs(control_inputs)
+                         .Device(matmul->def().device())
+                         .Finalize(graph, &packed));
+
+  const std::vector<const Edge*> out_edges(matmul->out_edges().begin(),
+                                           matmul->out_edges().end());
+  for (const Edge* edge : out_edges) {
+    graph->AddEdge(packed, edge->src_output(), edge->dst(), edge->dst_input());
+  }
+  graph->RemoveNode(matmul);
+  return Status::OK();
+}
+
+std::atomic<bool> packing_enabled(true);
+std::atomic<int> packing_format(kMatMulWeightsFloat);
+
+class PackedMatMulPass : public GraphOptimizationPass {
+ public:
+  Status Run(const GraphOptimizationPassOptions& options) override {
+    if (!packing_enabled.load(std::memory_order_relaxed) ||
+        options.graph == nullptr) {
+      return Status::OK();
+    }
+    const MatMulWeightFormat format = static_cast<MatMulWeightFormat>(
+        packing_format.load(std::memory_order_relaxed));
+    const int packed = PackMatMulWeights(options.graph->get(), format);
+    if (packed > 0) {
+      VLOG(1) << "Packed the weights of " << packed << " MatMuls";
+    }
+    return Status::OK();
+  }
+};
+
+REGISTER_OPTIMIZATION(OptimizationPassRegistry::PRE_PLACEMENT, 0,
+                      PackedMatMulPass);
+
+}  // namespace
+
+int PackMatMulWeights(Graph* graph, const MatMulWeightFormat format) {
+  // Collected first, as replacing a node removes it from the graph.
+  std::vector<Node*> matmuls;
+  for (Node* node : graph->nodes()) {
+    if (IsPackable(node)) {
+      matmuls.push_back(node);
+    }
+  }
+
+  int packed = 0;
+  for (Node* matmul : matmuls) {
+    const string name = matmul->name();
+    const Status s = ReplaceMatMul(graph, matmul, format);
+    if (!s.ok()) {
+      LOG(WARNING) << "Could not pack " << name << ": " << s;
+      continue;
+    }
+    ++packed;
+  }
+  return packed;
+}
+
+void SetPackedMatMul(const bool enabled, const MatMulWeightFormat format) {
+  packing_format.store(format, std::memory_order_relaxed);
+  packing_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,61 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// A MatMul for the fully connected layers of YOLO, which hold most of its
+// weights and at batch 1 are bound by how fast those weights stream from
+// memory. A GraphOptimizationPass registered for PRE_PLACEMENT turns every
+// float MatMul with constant weights into a PackedMatMul. Its CPU kernel
+// packs the weights once into panels of one cache line of columns, laid out
+// in the order a single input row reads them, and computes each panel with
+// SIMD multiply-accumulates on its own thread. Larger batches fall back to
+// the Eigen contraction MatMul uses.
+//
+// The packed weights can also be stored as bfloat16 or as eight bit integers
+// with a scale per column, halving or quartering the bytes read per frame.
+// Accumulation is in float either way.
+
+#ifndef ORG_TENSORFLOW_JNI_PACKED_MATMUL_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_PACKED_MATMUL_H_  // NOLINT
+
+namespace tensorflow {
+
+class Graph;
+
+namespace android {
+
+enum MatMulWeightFormat {
+  kMatMulWeightsFloat = 0,
+  // The upper half of each float, rounded to nearest. Unlike IEEE half
+  // precision, it widens back with a shift, which ARMv7 NEON can do without
+  // the optional half precision conversions.
+  kMatMulWeightsBfloat16 = 1,
+  // Symmetric eight bit values with one float scale per output column.
+  kMatMulWeightsInt8 = 2,
+};
+
+// Replaces every float MatMul in graph whose weights come from a Const or
+// ImmutableConst with a PackedMatMul storing them in format. Returns the
+// number of nodes replaced.
+int PackMatMulWeights(Graph* graph, const MatMulWeightFormat format);
+
+// Enables or disables the registered pass for sessions created afterwards,
+// and sets the format it stores weights in. It is enabled with float weights
+// by default.
+void SetPackedMatMul(const bool enabled, const MatMulWeightFormat format);
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_PACKED_MATMUL_H_  // NOLINT
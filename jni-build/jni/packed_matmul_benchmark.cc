@@ -0,0 +1,166 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Compares the fully connected layers of YOLO at batch 1 run as MatMul
+// against PackedMatMul with each weight format, with the kernel benchmark
+// harness. Bytes processed are the weight bytes streamed, so the reported
+// rate is the memory bandwidth each achieves. Every format is first checked
+// against MatMul through a session, which also exercises the registered pass.
+//
+// Usage:
+//   make -C jni-build kernel-benchmark
+//   jni-build/packed_matmul_benchmark [regex]
+
+#include <math.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/public/session.h"
+#include "tensorflow/examples/android/jni/packed_matmul.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+Tensor RandomTensor(const TensorShape& shape) {
+  Tensor tensor(DT_FLOAT, shape);
+  tensor.flat<float>() = tensor.flat<float>().random() - 0.5f;
+  return tensor;
+}
+
+int WeightBytes(const MatMulWeightFormat format) {
+  switch (format) {
+    case kMatMulWeightsBfloat16:
+      return 2;
+    case kMatMulWeightsInt8:
+      return 1;
+    default:
+      return 4;
+  }
+}
+
+// Largest difference from MatMul allowed, relative to the largest output.
+float Tolerance(const MatMulWeightFormat format) {
+  switch (format) {
+    case kMatMulWeightsBfloat16:
+      return 1e-2f;
+    case kMatMulWeightsInt8:
+      return 2e-2f;
+    default:
+      return 1e-5f;
+  }
+}
+
+// One fully connected layer without its bias, as MatMul of a single input
+// row by constant weights.
+Graph* FullyConnected(const int depth, const int columns, const bool packed,
+                      const MatMulWeightFormat format) {
+  Graph* g = new Graph(OpRegistry::Global());
+  test::graph::Matmul(g, test::graph::Constant(g, RandomTensor({1, depth})),
+                      test::graph::Constant(g, RandomTensor({depth, columns})),
+                      false, false);
+  if (packed) {
+    CHECK_EQ(1, PackMatMulWeights(g, format));
+  }
+  return g;
+}
+
+Tensor RunMatMul(const GraphDef& graph_def, const string& output) {
+  std::unique_ptr<Session> session(NewSession(SessionOptions()));
+  TF_CHECK_OK(session->Create(graph_def));
+  std::vector<Tensor> outputs;
+  TF_CHECK_OK(session->Run({}, {output}, {}, &outputs));
+  TF_CHECK_OK(session->Close());
+  return outputs[0];
+}
+
+// Checks PackedMatMul storing its weights in format against MatMul.
+void VerifyPackedMatMul(const int depth, const int columns,
+                        const MatMulWeightFormat format) {
+  Graph g(OpRegistry::Global());
+  Node* matmul = test::graph::Matmul(
+      &g, test::graph::Constant(&g, RandomTensor({1, depth})),
+      test::graph::Constant(&g, RandomTensor({depth, columns})), false, false);
+  GraphDef graph_def;
+  g.ToGraphDef(&graph_def);
+
+  SetPackedMatMul(false, format);
+  const Tensor expected = RunMatMul(graph_def, matmul->name());
+  SetPackedMatMul(true, format);
+  const Tensor actual = RunMatMul(graph_def, matmul->name());
+
+  float max_error = 0.0f;
+  float max_value = 0.0f;
+  for (int64 i = 0; i < expected.NumElements(); ++i) {
+    max_error = std::max(
+        max_error, fabsf(actual.flat<float>()(i) - expected.flat<float>()(i)));
+    max_value = std::max(max_value, fabsf(expected.flat<float>()(i)));
+  }
+  CHECK_LE(max_error, Tolerance(format) * max_value)
+      << "PackedMatMul of " << depth << " to " << columns << " with format "
+      << format << " differs from MatMul";
+  LOG(INFO) << "PackedMatMul " << depth << " to " << columns << " with format "
+            << format << ": max error " << max_error << " of " << max_value;
+}
+
+}  // namespace
+
+#define BM_FullyConnected(DEPTH, COLUMNS, PACKED, FORMAT, LABEL)               \
+  static void BM_FullyConnected_##DEPTH##_##COLUMNS##_##LABEL(int iters) {     \
+    testing::BytesProcessed(static_cast<int64>(iters) * DEPTH * COLUMNS *      \
+                            WeightBytes(FORMAT));                              \
+    test::Benchmark("cpu", FullyConnected(DEPTH, COLUMNS, PACKED, FORMAT))     \
+        .Run(iters);                                                           \
+  }                                                                            \
+  BENCHMARK(BM_FullyConnected_##DEPTH##_##COLUMNS##_##LABEL);
+
+#define BM_YoloFullyConnected(DEPTH, COLUMNS)                                  \
+  BM_FullyConnected(DEPTH, COLUMNS, false, kMatMulWeightsFloat, MatMul);       \
+  BM_FullyConnected(DEPTH, COLUMNS, true, kMatMulWeightsFloat, Float);         \
+  BM_FullyConnected(DEPTH, COLUMNS, true, kMatMulWeightsBfloat16, Bfloat16);   \
+  BM_FullyConnected(DEPTH, COLUMNS, true, kMatMulWeightsInt8, Int8);
+
+// The fully connected layers of YOLO small at 448x448.
+BM_YoloFullyConnected(50176, 512);
+BM_YoloFullyConnected(512, 4096);
+BM_YoloFullyConnected(4096, 1470);
+
+}  // namespace android
+}  // namespace tensorflow
+
+int main(int argc, char** argv) {
+  tensorflow::port::InitMain(argv[0], &argc, &argv);
+  using tensorflow::android::VerifyPackedMatMul;
+  // The last YOLO layer, and a width that leaves a partial panel.
+  for (const auto format :
+       {tensorflow::android::kMatMulWeightsFloat,
+        tensorflow::android::kMatMulWeightsBfloat16,
+        tensorflow::android::kMatMulWeightsInt8}) {
+    VerifyPackedMatMul(4096, 1470, format);
+    VerifyPackedMatMul(100, 37, format);
+  }
+  tensorflow::testing::Benchmark::Run(argc > 1 ? argv[1] : "all");
+  return 0;
+}
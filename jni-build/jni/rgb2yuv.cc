@@ -18,6 +18,15 @@ limitations under the License.
 #include "tensorflow/examples/android/jni/rgb2yuv.h"
 
 #include "tensorflow/core/platform/types.h"
+#include "tensorflow/examples/android/jni/yuv2rgb.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define IMAGEUTILS_USE_NEON
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define IMAGEUTILS_USE_SSE2
+#include <emmintrin.h>
+#endif
 
 using namespace tensorflow;
 
@@ -55,50 +64,284 @@ static inline void WriteYUV(const int x, const int y, const int width,
   pUV[offset + u_offset] += ((-38 * r8 - 74 * g8 + 112 * b8 + 128) >> 10) + 32;
 }
 
-void ConvertARGB8888ToYUV420SP(const uint32* const input, uint8* const output,
-                               int width, int height) {
-  uint8* pY = output;
-  uint8* pUV = output + (width * height);
-  const uint32* in = input;
+// The vector converters below handle a pair of rows at a time, so that each
+// 2x2 chroma block is summed in registers and written once instead of being
+// accumulated pixel by pixel. They convert the longest prefix of the row pair
+// they can and return its length; the caller finishes the rows with WriteYUV.
+// The per-pixel terms are computed exactly as in WriteYUV, so the output is
+// bit-identical.
+
+#if defined(IMAGEUTILS_USE_NEON)
 
-  for (int y = 0; y < height; y++) {
-    for (int x = 0; x < width; x++) {
-      const uint32 rgb = *in++;
+// Splits 8 ARGB pixels into eight bit channels.
+static inline void LoadRGB8Neon(const uint32* const in, uint8x8_t* const r,
+                                uint8x8_t* const g, uint8x8_t* const b) {
+  const uint8x8x4_t channels = vld4_u8(reinterpret_cast<const uint8*>(in));
 #ifdef __APPLE__
-      const int nB = (rgb >> 8) & 0xFF;
-      const int nG = (rgb >> 16) & 0xFF;
-      const int nR = (rgb >> 24) & 0xFF;
+  *b = channels.val[1];
+  *g = channels.val[2];
+  *r = channels.val[3];
 #else
-      const int nR = (rgb >> 16) & 0xFF;
-      const int nG = (rgb >> 8) & 0xFF;
-      const int nB = rgb & 0xFF;
+  *b = channels.val[0];
+  *g = channels.val[1];
+  *r = channels.val[2];
 #endif
-      WriteYUV(x, y, width, nR, nG, nB, pY++, pUV);
-    }
+}
+
+// Splits 8 RGB 565 pixels into eight bit channels, stretched like in
+// ConvertRGB565ToYUV420SP.
+static inline void LoadRGB8Neon(const uint16* const in, uint8x8_t* const r,
+                                uint8x8_t* const g, uint8x8_t* const b) {
+  const uint16x8_t rgb = vld1q_u16(in);
+  const uint8x8_t r5 = vmovn_u16(vshrq_n_u16(rgb, 11));
+  const uint8x8_t g6 = vmovn_u16(vandq_u16(vshrq_n_u16(rgb, 5),
+                                           vdupq_n_u16(0x3f)));
+  const uint8x8_t b5 = vmovn_u16(vandq_u16(rgb, vdupq_n_u16(0x1f)));
+  *r = vorr_u8(vshl_n_u8(r5, 3), vshr_n_u8(r5, 2));
+  *g = vorr_u8(vshl_n_u8(g6, 2), vshr_n_u8(g6, 4));
+  *b = vorr_u8(vshl_n_u8(b5, 3), vshr_n_u8(b5, 2));
+}
+
+// Writes the Y samples of 8 pixels and returns their V and U terms summed
+// over horizontally adjacent pairs.
+static inline void ConvertRGB8Neon(const uint8x8_t r, const uint8x8_t g,
+                                   const uint8x8_t b, uint8* const pY,
+                                   int32x4_t* const v_sums,
+                                   int32x4_t* const u_sums) {
+  uint16x8_t y = vmull_u8(r, vdup_n_u8(66));
+  y = vmlal_u8(y, g, vdup_n_u8(129));
+  y = vmlal_u8(y, b, vdup_n_u8(25));
+  y = vaddq_u16(vshrq_n_u16(vaddq_u16(y, vdupq_n_u16(128)), 8),
+                vdupq_n_u16(16));
+  vst1_u8(pY, vmovn_u16(y));
+
+  const int16x8_t r16 = vreinterpretq_s16_u16(vmovl_u8(r));
+  const int16x8_t g16 = vreinterpretq_s16_u16(vmovl_u8(g));
+  const int16x8_t b16 = vreinterpretq_s16_u16(vmovl_u8(b));
+  const int16x8_t rounding = vdupq_n_s16(128);
+  const int16x8_t bias = vdupq_n_s16(32);
+
+  int16x8_t v = vmulq_n_s16(r16, 112);
+  v = vmlsq_n_s16(v, g16, 94);
+  v = vmlsq_n_s16(v, b16, 18);
+  v = vaddq_s16(vshrq_n_s16(vaddq_s16(v, rounding), 10), bias);
+
+  int16x8_t u = vmulq_n_s16(b16, 112);
+  u = vmlsq_n_s16(u, r16, 38);
+  u = vmlsq_n_s16(u, g16, 74);
+  u = vaddq_s16(vshrq_n_s16(vaddq_s16(u, rounding), 10), bias);
+
+  *v_sums = vpaddlq_s16(v);
+  *u_sums = vpaddlq_s16(u);
+}
+
+template <typename Pixel>
+static int ConvertRowPairToYUV420SPNeon(const Pixel* const in0,
+                                        const Pixel* const in1,
+                                        const int width, uint8* const pY0,
+                                        uint8* const pY1, uint8* const pUV) {
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    uint8x8_t r, g, b;
+    int32x4_t v0, u0, v1, u1;
+    LoadRGB8Neon(in0 + x, &r, &g, &b);
+    ConvertRGB8Neon(r, g, b, pY0 + x, &v0, &u0);
+    LoadRGB8Neon(in1 + x, &r, &g, &b);
+    ConvertRGB8Neon(r, g, b, pY1 + x, &v1, &u1);
+
+    // Each block sum is at most 4 * 60, so it fits in a byte.
+    const int16x4_t v = vmovn_s32(vaddq_s32(v0, v1));
+    const int16x4_t u = vmovn_s32(vaddq_s32(u0, u1));
+#ifdef __APPLE__
+    const int16x4_t uv = vorr_s16(u, vshl_n_s16(v, 8));
+#else
+    const int16x4_t uv = vorr_s16(v, vshl_n_s16(u, 8));
+#endif
+    vst1_u8(pUV + x, vreinterpret_u8_s16(uv));
   }
+  return x;
 }
 
-void ConvertRGB565ToYUV420SP(const uint16* const input, uint8* const output,
-                             const int width, const int height) {
-  uint8* pY = output;
-  uint8* pUV = output + (width * height);
-  const uint16* in = input;
+#elif defined(IMAGEUTILS_USE_SSE2)
 
-  for (int y = 0; y < height; y++) {
-    for (int x = 0; x < width; x++) {
-      const uint32 rgb = *in++;
+// Splits 8 ARGB pixels into 16 bit channel lanes.
+static inline void LoadRGB8Sse2(const uint32* const in, __m128i* const r,
+                                __m128i* const g, __m128i* const b) {
+  const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+  const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4));
+  const __m128i mask = _mm_set1_epi32(0xff);
+#ifdef __APPLE__
+  *b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask),
+                       _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+  *g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask),
+                       _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+  *r = _mm_packs_epi32(_mm_srli_epi32(lo, 24), _mm_srli_epi32(hi, 24));
+#else
+  *b = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+  *g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask),
+                       _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+  *r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask),
+                       _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+#endif
+}
 
-      const int r5 = ((rgb >> 11) & 0x1F);
-      const int g6 = ((rgb >> 5) & 0x3F);
-      const int b5 = (rgb & 0x1F);
+// Splits 8 RGB 565 pixels into 16 bit channel lanes, stretched like in
+// ConvertRGB565ToYUV420SP.
+static inline void LoadRGB8Sse2(const uint16* const in, __m128i* const r,
+                                __m128i* const g, __m128i* const b) {
+  const __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+  const __m128i r5 = _mm_srli_epi16(rgb, 11);
+  const __m128i g6 = _mm_and_si128(_mm_srli_epi16(rgb, 5), _mm_set1_epi16(0x3f));
+  const __m128i b5 = _mm_and_si128(rgb, _mm_set1_epi16(0x1f));
+  *r = _mm_or_si128(_mm_slli_epi16(r5, 3), _mm_srli_epi16(r5, 2));
+  *g = _mm_or_si128(_mm_slli_epi16(g6, 2), _mm_srli_epi16(g6, 4));
+  *b = _mm_or_si128(_mm_slli_epi16(b5, 3), _mm_srli_epi16(b5, 2));
+}
+
+// Writes the Y samples of 8 pixels and returns their V and U terms summed
+// over horizontally adjacent pairs.
+static inline void ConvertRGB8Sse2(const __m128i r, const __m128i g,
+                                   const __m128i b, uint8* const pY,
+                                   __m128i* const v_sums,
+                                   __m128i* const u_sums) {
+  // The weighted sum reaches 56228, so the Y shift has to be unsigned.
+  __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+                            _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+  y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+  y = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(128)), 8),
+                    _mm_set1_epi16(16));
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(pY), _mm_packus_epi16(y, y));
+
+  const __m128i rounding = _mm_set1_epi16(128);
+  const __m128i bias = _mm_set1_epi16(32);
+
+  __m128i v = _mm_sub_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)),
+                            _mm_mullo_epi16(g, _mm_set1_epi16(94)));
+  v = _mm_sub_epi16(v, _mm_mullo_epi16(b, _mm_set1_epi16(18)));
+  v = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(v, rounding), 10), bias);
 
-      // Shift left, then fill in the empty low bits with a copy of the high
-      // bits so we can stretch across the entire 0 - 255 range.
-      const int r8 = r5 << 3 | r5 >> 2;
-      const int g8 = g6 << 2 | g6 >> 4;
-      const int b8 = b5 << 3 | b5 >> 2;
+  __m128i u = _mm_sub_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)),
+                            _mm_mullo_epi16(r, _mm_set1_epi16(38)));
+  u = _mm_sub_epi16(u, _mm_mullo_epi16(g, _mm_set1_epi16(74)));
+  u = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(u, rounding), 10), bias);
 
-      WriteYUV(x, y, width, r8, g8, b8, pY++, pUV);
+  const __m128i ones = _mm_set1_epi16(1);
+  *v_sums = _mm_madd_epi16(v, ones);
+  *u_sums = _mm_madd_epi16(u, ones);
+}
+
+template <typename Pixel>
+static int ConvertRowPairToYUV420SPSse2(const Pixel* const in0,
+                                        const Pixel* const in1,
+                                        const int width, uint8* const pY0,
+                                        uint8* const pY1, uint8* const pUV) {
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i r, g, b, v0, u0, v1, u1;
+    LoadRGB8Sse2(in0 + x, &r, &g, &b);
+    ConvertRGB8Sse2(r, g, b, pY0 + x, &v0, &u0);
+    LoadRGB8Sse2(in1 + x, &r, &g, &b);
+    ConvertRGB8Sse2(r, g, b, pY1 + x, &v1, &u1);
+
+    // Each block sum is at most 4 * 60, so it fits in a byte.
+    const __m128i v = _mm_add_epi32(v0, v1);
+    const __m128i u = _mm_add_epi32(u0, u1);
+    const __m128i v16 = _mm_packs_epi32(v, v);
+    const __m128i u16 = _mm_packs_epi32(u, u);
+#ifdef __APPLE__
+    const __m128i uv = _mm_or_si128(u16, _mm_slli_epi16(v16, 8));
+#else
+    const __m128i uv = _mm_or_si128(v16, _mm_slli_epi16(u16, 8));
+#endif
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(pUV + x), uv);
+  }
+  return x;
+}
+
+#endif
+
+// Converts the longest prefix of a row pair the selected vector path can
+// handle.
+template <typename Pixel>
+static inline int ConvertRowPairToYUV420SPSimd(const Pixel* const in0,
+                                               const Pixel* const in1,
+                                               const int width,
+                                               uint8* const pY0,
+                                               uint8* const pY1,
+                                               uint8* const pUV) {
+  const int path = GetImageUtilsSimdPath();
+#if defined(IMAGEUTILS_USE_NEON)
+  if (path == kImageUtilsNeon) {
+    return ConvertRowPairToYUV420SPNeon(in0, in1, width, pY0, pY1, pUV);
+  }
+#elif defined(IMAGEUTILS_USE_SSE2)
+  if (path == kImageUtilsSse2) {
+    return ConvertRowPairToYUV420SPSse2(in0, in1, width, pY0, pY1, pUV);
+  }
+#endif
+  return 0;
+}
+
+// Reads one pixel as eight bit channels.
+static inline void ReadRGB8(const uint32 rgb, int* const r8, int* const g8,
+                            int* const b8) {
+#ifdef __APPLE__
+  *b8 = (rgb >> 8) & 0xFF;
+  *g8 = (rgb >> 16) & 0xFF;
+  *r8 = (rgb >> 24) & 0xFF;
+#else
+  *r8 = (rgb >> 16) & 0xFF;
+  *g8 = (rgb >> 8) & 0xFF;
+  *b8 = rgb & 0xFF;
+#endif
+}
+
+static inline void ReadRGB8(const uint16 rgb, int* const r8, int* const g8,
+                            int* const b8) {
+  const int r5 = ((rgb >> 11) & 0x1F);
+  const int g6 = ((rgb >> 5) & 0x3F);
+  const int b5 = (rgb & 0x1F);
+
+  // Shift left, then fill in the empty low bits with a copy of the high
+  // bits so we can stretch across the entire 0 - 255 range.
+  *r8 = r5 << 3 | r5 >> 2;
+  *g8 = g6 << 2 | g6 >> 4;
+  *b8 = b5 << 3 | b5 >> 2;
+}
+
+template <typename Pixel>
+static void ConvertToYUV420SP(const Pixel* const input, uint8* const output,
+                              const int width, const int height) {
+  uint8* const pY = output;
+  uint8* const pUV = output + (width * height);
+  const int blocks_per_row = (width + 1) / 2;
+
+  for (int y = 0; y < height; y += 2) {
+    const int rows = y + 1 < height ? 2 : 1;
+
+    int x_start = 0;
+    if (rows == 2) {
+      x_start = ConvertRowPairToYUV420SPSimd(
+          input + y * width, input + (y + 1) * width, width, pY + y * width,
+          pY + (y + 1) * width, pUV + 2 * (y / 2) * blocks_per_row);
+    }
+
+    for (int row = y; row < y + rows; ++row) {
+      for (int x = x_start; x < width; x++) {
+        int r8, g8, b8;
+        ReadRGB8(input[row * width + x], &r8, &g8, &b8);
+        WriteYUV(x, row, width, r8, g8, b8, pY + row * width + x, pUV);
+      }
     }
   }
 }
+
+void ConvertARGB8888ToYUV420SP(const uint32* const input, uint8* const output,
+                               int width, int height) {
+  ConvertToYUV420SP(input, output, width, height);
+}
+
+void ConvertRGB565ToYUV420SP(const uint16* const input, uint8* const output,
+                             const int width, const int height) {
+  ConvertToYUV420SP(input, output, width, height);
+}
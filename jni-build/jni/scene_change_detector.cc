@@ -0,0 +1,138 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/scene_change_detector.h"
+
+#include <stdlib.h>
+#include <algorithm>
+
+namespace tensorflow {
+namespace android {
+
+const int SceneChangeDetector::kGridSize;
+const int SceneChangeDetector::kBlockSize;
+const int SceneChangeDetector::kThumbnailSize;
+
+SceneChangeDetector::SceneChangeDetector()
+    : frame_width_(0),
+      frame_height_(0),
+      y_row_stride_(0),
+      col_offsets_(kThumbnailSize),
+      row_offsets_(kThumbnailSize),
+      thumbnail_(kThumbnailSize * kThumbnailSize),
+      reference_(kThumbnailSize * kThumbnailSize),
+      has_reference_(false),
+      frames_since_run_(0) {}
+
+void SceneChangeDetector::Configure(const SceneChangeConfig& config) {
+  config_ = config;
+  stats_ = Stats();
+  Reset();
+}
+
+void SceneChangeDetector::Reset() {
+  has_reference_ = false;
+  frames_since_run_ = 0;
+}
+
+bool SceneChangeDetector::UpdateSampling(const YUV420Frame& frame) {
+  if (frame.width == frame_width_ && frame.height == frame_height_ &&
+      frame.y_row_stride == y_row_stride_) {
+    return false;
+  }
+  frame_width_ = frame.width;
+  frame_height_ = frame.height;
+  y_row_stride_ = frame.y_row_stride;
+
+  // The same center square the model input is cropped from.
+  const int min_dim = std::min(frame.width, frame.height);
+  const int crop_x = (frame.width - min_dim) / 2;
+  const int crop_y = (frame.height - min_dim) / 2;
+  for (int i = 0; i < kThumbnailSize; ++i) {
+    const int offset = ((2 * i + 1) * min_dim) / (2 * kThumbnailSize);
+    col_offsets_[i] = crop_x + offset;
+    row_offsets_[i] = (crop_y + offset) * y_row_stride_;
+  }
+  return true;
+}
+
+int SceneChangeDetector::CountChangedBlocks() const {
+  // Compare sums rather than means, to stay in integers.
+  const int sad_threshold =
+      static_cast<int>(config_.block_threshold * kBlockSize * kBlockSize);
+  int num_changed = 0;
+  for (int block_row = 0; block_row < kGridSize; ++block_row) {
+    for (int block_col = 0; block_col < kGridSize; ++block_col) {
+      const int start =
+          (block_row * kThumbnailSize + block_col) * kBlockSize;
+      int sad = 0;
+      for (int i = 0; i < kBlockSize; ++i) {
+        const uint8* const current = &thumbnail_[start + i * kThumbnailSize];
+        const uint8* const reference =
+            &reference_[start + i * kThumbnailSize];
+        for (int j = 0; j < kBlockSize; ++j) {
+          sad += abs(static_cast<int>(current[j]) - reference[j]);
+        }
+      }
+      if (sad > sad_threshold) {
+        ++num_changed;
+      }
+    }
+  }
+  return num_changed;
+}
+
+bool SceneChangeDetector::ShouldRun(const YUV420Frame& frame) {
+  if (!config_.enabled) {
+    return true;
+  }
+  ++stats_.frames_checked;
+  if (UpdateSampling(frame)) {
+    has_reference_ = false;
+  }
+
+  uint8* out = thumbnail_.data();
+  for (int i = 0; i < kThumbnailSize; ++i) {
+    const uint8* const row = frame.y + row_offsets_[i];
+    for (int j = 0; j < kThumbnailSize; ++j) {
+      *out++ = row[col_offsets_[j]];
+    }
+  }
+
+  bool run = !has_reference_;
+  if (!run) {
+    const int tolerated_blocks = static_cast<int>(
+        config_.changed_block_fraction * kGridSize * kGridSize);
+    run = CountChangedBlocks() > tolerated_blocks;
+  }
+  if (!run && config_.refresh_interval > 0 &&
+      frames_since_run_ + 1 >= config_.refresh_interval) {
+    run = true;
+    ++stats_.forced_refreshes;
+  }
+
+  if (!run) {
+    ++frames_since_run_;
+    ++stats_.frames_skipped;
+    return false;
+  }
+  thumbnail_.swap(reference_);
+  has_reference_ = true;
+  frames_since_run_ = 0;
+  return true;
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,113 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Decides whether a camera frame differs enough from the last one the model
+// ran on to be worth running the model again. The center square of the Y
+// plane, which is all the model sees, is point sampled into a small thumbnail,
+// and the thumbnail is compared block by block with that of the reference
+// frame by the sum of absolute differences. This costs a few thousand byte
+// reads per frame against a full Session::Run.
+
+#ifndef ORG_TENSORFLOW_JNI_SCENE_CHANGE_DETECTOR_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_SCENE_CHANGE_DETECTOR_H_  // NOLINT
+
+#include <vector>
+
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/examples/android/jni/yuv_preprocessor.h"
+
+namespace tensorflow {
+namespace android {
+
+struct SceneChangeConfig {
+  // Every frame is run when disabled.
+  bool enabled = false;
+  // A block has changed when the mean absolute difference of its luma
+  // samples from the reference frame exceeds this, out of 255.
+  float block_threshold = 10.0f;
+  // The scene has changed when more than this fraction of the blocks have.
+  float changed_block_fraction = 0.02f;
+  // The model is run at least once every this many frames even if nothing
+  // changed, so that slow drift and missed detections are caught up on. 0
+  // never forces a run.
+  int refresh_interval = 15;
+};
+
+class SceneChangeDetector {
+ public:
+  // Number of blocks along each side of the thumbnail, and of luma samples
+  // along each side of a block.
+  static const int kGridSize = 16;
+  static const int kBlockSize = 4;
+
+  // Counters since the detector was last configured.
+  struct Stats {
+    int64 frames_checked = 0;
+    // Frames for which the model was not run.
+    int64 frames_skipped = 0;
+    // Frames run only because of refresh_interval.
+    int64 forced_refreshes = 0;
+  };
+
+  SceneChangeDetector();
+
+  // Replaces the settings, resets the counters and forgets the reference
+  // frame.
+  void Configure(const SceneChangeConfig& config);
+
+  // Forgets the reference frame, so that the model runs on the next frame.
+  void Reset();
+
+  // Returns whether the model should run on frame. If so, frame becomes the
+  // reference the following frames are compared with; the reference is not
+  // updated by skipped frames, so that gradual changes add up.
+  bool ShouldRun(const YUV420Frame& frame);
+
+  const SceneChangeConfig& config() const { return config_; }
+  const Stats& stats() const { return stats_; }
+
+ private:
+  static const int kThumbnailSize = kGridSize * kBlockSize;
+
+  // Recomputes the sampling tables when the frame geometry changes. Returns
+  // whether it changed.
+  bool UpdateSampling(const YUV420Frame& frame);
+
+  // Returns the number of blocks of thumbnail_ that differ from reference_.
+  int CountChangedBlocks() const;
+
+  SceneChangeConfig config_;
+  Stats stats_;
+
+  // Geometry the sampling tables were computed for.
+  int frame_width_;
+  int frame_height_;
+  int y_row_stride_;
+  // Byte offsets of the sampled columns and rows in the Y plane.
+  std::vector<int> col_offsets_;
+  std::vector<int> row_offsets_;
+
+  // Luma thumbnails of the current and the reference frame, row-major.
+  std::vector<uint8> thumbnail_;
+  std::vector<uint8> reference_;
+  bool has_reference_;
+  // Frames skipped in a row since the model last ran.
+  int frames_since_run_;
+};
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_SCENE_CHANGE_DETECTOR_H_  // NOLINT
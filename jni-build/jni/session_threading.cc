@@ -0,0 +1,185 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/session_threading.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif  // __ANDROID__
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// Cores beyond this are ignored; phones have at most ten.
+const int kMaxCpus = 64;
+
+// Reads an integer out of a sysfs file, returning -1 if it does not exist.
+int64 ReadSysfsInt(const char* const path) {
+  char contents[32];
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  const ssize_t length = read(fd, contents, sizeof(contents) - 1);
+  close(fd);
+  if (length <= 0) {
+    return -1;
+  }
+  contents[length] = '\0';
+  return strtoll(contents, nullptr, 10);
+}
+
+#ifdef __ANDROID__
+// Returns false if the property is not set.
+bool GetProperty(const char* const name, char* const value) {
+  return __system_property_get(name, value) > 0;
+}
+#else
+// There are no system properties outside of Android; host binaries take the
+// settings as flags instead.
+const int PROP_VALUE_MAX = 92;
+bool GetProperty(const char* const name, char* const value) { return false; }
+#endif  // __ANDROID__
+
+// Starts every thread on a fixed set of cores.
+class AffinityEnv : public EnvWrapper {
+ public:
+  AffinityEnv(Env* const target, const uint64 cpu_mask)
+      : EnvWrapper(target), cpu_mask_(cpu_mask) {}
+
+  Thread* StartThread(const ThreadOptions& thread_options, const string& name,
+                      std::function<void()> fn) override {
+    const uint64 cpu_mask = cpu_mask_;
+    return EnvWrapper::StartThread(
+        thread_options, name, [cpu_mask, name, fn]() {
+          const Status s = SetCurrentThreadAffinity(cpu_mask);
+          if (!s.ok()) {
+            LOG(WARNING) << "Could not pin thread " << name << ": " << s;
+          }
+          fn();
+        });
+  }
+
+ private:
+  const uint64 cpu_mask_;
+};
+
+}  // namespace
+
+void ApplyThreadingOverrides(SessionThreadingConfig* const config) {
+  char value[PROP_VALUE_MAX];
+  if (GetProperty("debug.tensorflow.intra_op_threads", value)) {
+    config->intra_op_threads = atoi(value);
+  }
+  if (GetProperty("debug.tensorflow.inter_op_threads", value)) {
+    config->inter_op_threads = atoi(value);
+  }
+  if (GetProperty("debug.tensorflow.use_per_session_threads", value)) {
+    config->use_per_session_threads = atoi(value) != 0;
+  }
+  if (GetProperty("debug.tensorflow.cpu_affinity_mask", value)) {
+    config->cpu_affinity_mask = strcmp(value, "fastest") == 0
+                                    ? kFastestCpus
+                                    : strtoull(value, nullptr, 16);
+  }
+}
+
+void ConfigureSessionThreading(const SessionThreadingConfig& config,
+                               SessionOptions* const options) {
+  ConfigProto& proto = options->config;
+  proto.set_intra_op_parallelism_threads(config.intra_op_threads);
+  proto.set_inter_op_parallelism_threads(config.inter_op_threads);
+  proto.set_use_per_session_threads(config.use_per_session_threads);
+
+  uint64 cpu_mask = config.cpu_affinity_mask;
+  if (cpu_mask == kFastestCpus) {
+    cpu_mask = GetFastestCpuMask();
+  }
+  if (cpu_mask != 0) {
+    options->env = GetAffinityEnv(cpu_mask);
+  }
+  LOG(INFO) << "Session threads: intra-op " << config.intra_op_threads
+            << ", inter-op " << config.inter_op_threads
+            << (config.use_per_session_threads ? " (per session)" : "")
+            << ", affinity mask 0x" << std::hex << cpu_mask << std::dec;
+}
+
+uint64 GetFastestCpuMask() {
+  int64 max_frequency = 0;
+  uint64 mask = 0;
+  for (int cpu = 0; cpu < kMaxCpus; ++cpu) {
+    char path[96];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+    const int64 frequency = ReadSysfsInt(path);
+    if (frequency < 0) {
+      // Cores are numbered consecutively, but the cpufreq directory of an
+      // offline core may be missing, so keep looking.
+      continue;
+    }
+    if (frequency > max_frequency) {
+      max_frequency = frequency;
+      mask = 0;
+    }
+    if (frequency == max_frequency) {
+      mask |= 1ULL << cpu;
+    }
+  }
+  return mask;
+}
+
+Status SetCurrentThreadAffinity(const uint64 cpu_mask) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int cpu = 0; cpu < kMaxCpus; ++cpu) {
+    if (cpu_mask & (1ULL << cpu)) {
+      CPU_SET(cpu, &cpu_set);
+    }
+  }
+  // A pid of 0 is the calling thread.
+  if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+    return errors::Internal("sched_setaffinity failed: ", strerror(errno));
+  }
+  return Status::OK();
+}
+
+Env* GetAffinityEnv(const uint64 cpu_mask) {
+  static mutex envs_mutex(LINKER_INITIALIZED);
+  static std::map<uint64, Env*>* const envs = new std::map<uint64, Env*>;
+  mutex_lock l(envs_mutex);
+  Env*& env = (*envs)[cpu_mask];
+  if (env == nullptr) {
+    env = new AffinityEnv(Env::Default(), cpu_mask);
+  }
+  return env;
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,82 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Thread pool sizing and CPU affinity for the TensorFlow session. By default
+// DirectSession sizes its pools from port::NumSchedulableCPUs(), which is a
+// fixed guess of 4 on Android, and lets the scheduler put the threads on any
+// core; on big.LITTLE phones that spreads convolutions over the slow cores and
+// stretches the tail of the frame latency.
+
+#ifndef ORG_TENSORFLOW_JNI_SESSION_THREADING_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_SESSION_THREADING_H_  // NOLINT
+
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/public/session_options.h"
+
+namespace tensorflow {
+namespace android {
+
+// Affinity mask selecting the cores with the highest maximum frequency.
+static const uint64 kFastestCpus = ~0ULL;
+
+// How the threads of a session are set up. Zero values keep the TensorFlow
+// defaults.
+//
+// TensorFlow creates the intra-op (Eigen) pool once per process, with the
+// settings of the first session; the inter-op pool is shared the same way
+// unless use_per_session_threads is set. Sweeping intra_op_threads therefore
+// takes one process per setting; see jni-build/sweep_threading.sh.
+struct SessionThreadingConfig {
+  // Threads used to parallelize a single op, such as a convolution.
+  int intra_op_threads = 0;
+  // Threads used to run independent ops of the graph.
+  int inter_op_threads = 0;
+  // Gives the session its own inter-op pool instead of the process-wide one.
+  bool use_per_session_threads = false;
+  // Bit i allows the session threads on CPU i. 0 leaves them unpinned, and
+  // kFastestCpus picks the big cores of a big.LITTLE system.
+  uint64 cpu_affinity_mask = 0;
+};
+
+// Replaces the fields of config for which a debug.tensorflow.* system property
+// is set: intra_op_threads, inter_op_threads, use_per_session_threads and
+// cpu_affinity_mask (hexadecimal, or "fastest"). This lets benchmarks change
+// the settings with adb without rebuilding the app.
+void ApplyThreadingOverrides(SessionThreadingConfig* const config);
+
+// Sets the pool sizes of options, and its Env to one that pins every thread
+// the session starts to the configured cores.
+void ConfigureSessionThreading(const SessionThreadingConfig& config,
+                               SessionOptions* const options);
+
+// Returns a mask of the cores with the highest maximum frequency, or 0 if the
+// frequencies cannot be read.
+uint64 GetFastestCpuMask();
+
+// Restricts the calling thread to the cores in cpu_mask.
+Status SetCurrentThreadAffinity(const uint64 cpu_mask);
+
+// Returns an Env that runs every thread started through it on the cores in
+// cpu_mask and forwards everything else to Env::Default(). Thread pools keep
+// their Env for as long as the process lives, so these are never destroyed;
+// one is created per distinct mask.
+Env* GetAffinityEnv(const uint64 cpu_mask);
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_SESSION_THREADING_H_  // NOLINT
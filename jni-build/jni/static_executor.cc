@@ -0,0 +1,1246 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/static_executor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/costmodel_manager.h"
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/device_factory.h"
+#include "tensorflow/core/common_runtime/device_mgr.h"
+#include "tensorflow/core/common_runtime/device_set.h"
+#include "tensorflow/core/common_runtime/function.h"
+#include "tensorflow/core/common_runtime/graph_optimizer.h"
+#include "tensorflow/core/common_runtime/memory_types.h"
+#include "tensorflow/core/common_runtime/rendezvous_mgr.h"
+#include "tensorflow/core/common_runtime/session_factory.h"
+#include "tensorflow/core/common_runtime/simple_graph_execution_state.h"
+#include "tensorflow/core/common_runtime/step_stats_collector.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/cancellation.h"
+#include "tensorflow/core/framework/function.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/rendezvous.h"
+#include "tensorflow/core/framework/resource_mgr.h"
+#include "tensorflow/core/framework/session_state.h"
+#include "tensorflow/core/framework/step_stats.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/graph/algorithm.h"
+#include "tensorflow/core/graph/costmodel.h"
+#include "tensorflow/core/graph/graph_constructor.h"
+#include "tensorflow/core/graph/graph_partition.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/notification.h"
+#include "tensorflow/core/lib/core/refcount.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/gtl/inlined_vector.h"
+#include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/host_info.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/public/session.h"
+#include "tensorflow/core/util/tensor_slice_reader_cache.h"
+#include "tensorflow/examples/android/jni/static_memory_planner.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+typedef gtl::InlinedVector<TensorValue, 4> TensorValueVec;
+typedef gtl::InlinedVector<DeviceContext*, 4> DeviceContextVec;
+typedef gtl::InlinedVector<AllocatorAttributes, 4> AllocatorAttributeVec;
+
+// The steps of each executor of a critical path scheduled session whose node
+// times are measured, unless GraphOptions::build_cost_model sets another
+// number.
+const int64 kCriticalPathCostSteps = 4;
+
+std::atomic<bool> critical_path_enabled(false);
+
+// One output of a node during a step.
+struct Entry {
+  Tensor val;
+  // Set instead of val for ref outputs, such as those of a Variable.
+  Tensor* ref = nullptr;
+  mutex* ref_mu = nullptr;
+  AllocatorAttributes alloc_attr;
+  DeviceContext* device_context = nullptr;
+};
+
+// A node of the schedule, with where its inputs and outputs are among the
+// entries of a step.
+struct ScheduledNode {
+  const Node* node = nullptr;
+  OpKernel* kernel = nullptr;
+  bool is_async = false;
+  int num_inputs = 0;
+  int num_outputs = 0;
+  // Index in input_entries_ of the entry input 0 is read from.
+  int input_start = 0;
+  // Entry of output 0; the other outputs follow it.
+  int output_start = 0;
+  // Range in release_entries_ of the entries nothing later in the schedule
+  // reads, which are cleared once the node has run.
+  int release_start = 0;
+  int num_releases = 0;
+  // Range in successors_ of the positions of the nodes this one has edges
+  // to, and the number of edges into it from other nodes of the schedule,
+  // for steps run by priority.
+  int successor_start = 0;
+  int num_successors = 0;
+  int num_predecessors = 0;
+};
+
+void ReleaseEntry(Entry* const entry) {
+  entry->val = Tensor();
+  entry->ref = nullptr;
+  entry->ref_mu = nullptr;
+}
+
+// The inputs of the node a thread runs.
+struct NodeInputs {
+  TensorValueVec values;
+  DeviceContextVec device_contexts;
+  AllocatorAttributeVec alloc_attrs;
+  // Ref inputs read as values, when several threads may read their entries
+  // at once and so they are not dereferenced in place.
+  gtl::InlinedVector<Tensor, 4> ref_values;
+};
+
+// What the nodes of a step share besides their entries.
+struct StepResources {
+  explicit StepResources(const Executor::Args::Runner& runner)
+      : runner(runner) {}
+
+  ResourceMgr step_resource_manager;
+  checkpoint::TensorSliceReaderCacheWrapper slice_reader_cache;
+  Executor::Args::Runner runner;
+};
+
+// A step run by priority. Nodes whose inputs are all ready wait in a queue,
+// from which every thread running nodes of the step takes the one with the
+// longest path to the sink next.
+struct PriorityStep {
+  const Executor::Args* args = nullptr;
+  StepResources* resources = nullptr;
+  Entry* entries = nullptr;
+  // The longest path from each node to the sink, by position.
+  const std::vector<int64>* path_costs = nullptr;
+  // The inputs still to read each entry.
+  std::unique_ptr<std::atomic<int>[]> readers;
+
+  mutex mu;
+  // Notified when the last thread running nodes of the step is done.
+  condition_variable done;
+  // The edges each node still waits for, by position.
+  std::vector<int> pending GUARDED_BY(mu);
+  // The path cost and negated position of each ready node, so that ties go
+  // to the earlier node of the schedule.
+  std::priority_queue<std::pair<int64, int>> ready GUARDED_BY(mu);
+  int num_threads GUARDED_BY(mu) = 0;
+  Status status GUARDED_BY(mu);
+};
+
+// The device kernels of a planned schedule see, which hands them the
+// planner for their outputs and temporaries and forwards everything else.
+class PlannedDevice : public DeviceBase {
+ public:
+  PlannedDevice(Device* device, Allocator* planner)
+      : DeviceBase(device->env()), device_(device), planner_(planner) {
+    set_tensorflow_cpu_worker_threads(const_cast<CpuWorkerThreads*>(
+        device->tensorflow_cpu_worker_threads()));
+    set_eigen_cpu_device(
+        const_cast<Eigen::ThreadPoolDevice*>(device->eigen_cpu_device()));
+  }
+
+  bool RequiresRecordingAccessedTensors() const override {
+    return device_->RequiresRecordingAccessedTensors();
+  }
+  Allocator* GetAllocator(AllocatorAttributes attr) override {
+    return device_->GetAllocator(attr);
+  }
+  // Only allocations with default attributes are planned.
+  Allocator* GetStepAllocator(AllocatorAttributes attr,
+                              ResourceMgr* step_resource_manager) override {
+    return attr.value == 0
+               ? planner_
+               : device_->GetStepAllocator(attr, step_resource_manager);
+  }
+  const DeviceAttributes& attributes() const override {
+    return device_->attributes();
+  }
+  Status MakeTensorFromProto(const TensorProto& tensor_proto,
+                             const AllocatorAttributes alloc_attrs,
+                             Tensor* tensor) override {
+    return device_->MakeTensorFromProto(tensor_proto, alloc_attrs, tensor);
+  }
+
+ private:
+  Device* const device_;
+  Allocator* const planner_;
+};
+
+class StaticExecutor : public Executor {
+ public:
+  // A step runs up to max_parallelism nodes at once, on the threads of
+  // Args::runner and the calling one, in order of their longest path to the
+  // sink. At 1 it runs the schedule in order on the calling thread.
+  StaticExecutor(const LocalExecutorParams& params, const Graph* graph,
+                 const int max_parallelism)
+      : params_(params),
+        graph_(graph),
+        max_parallelism_(max_parallelism),
+        num_entries_(0),
+        path_costs_(nullptr),
+        memory_planner_(nullptr) {}
+  ~StaticExecutor() override;
+
+  Status Initialize();
+
+  // The whole step runs before done is called.
+  void RunAsync(const Args& args, DoneCallback done) override {
+    done(RunSchedule(args));
+  }
+
+  // Takes the measured execution times of cost_model as the costs of the
+  // nodes when ordering ready nodes by their longest path to the sink. Until
+  // then each node costs one. Only the first call has any effect.
+  void SetNodeCosts(const CostModel& cost_model);
+
+ private:
+  Status RunSchedule(const Args& args);
+  Status RunByPriority(const Args& args, StepResources* resources,
+                       Entry* const entries) const;
+  // Runs ready nodes of step until there are none, or one fails.
+  void RunReadyNodes(PriorityStep* step) const;
+  void InitParams(const Args& args, StepResources* resources,
+                  NodeInputs* inputs, OpKernelContext::Params* params) const;
+  // Set concurrent if other threads may read the entries at the same time.
+  Status RunNode(const Args& args, const ScheduledNode& item,
+                 const bool concurrent, OpKernelContext::Params* params,
+                 NodeInputs* inputs, Entry* const entries) const;
+  Status PrepareInputs(const ScheduledNode& item, const bool concurrent,
+                       Entry* const entries, NodeInputs* inputs) const;
+  Status ProcessOutputs(const ScheduledNode& item, OpKernelContext* ctx,
+                        NodeExecStats* stats, Entry* const entries) const;
+
+  // Returns the longest path from each node to the sink, by position, given
+  // the cost of each node.
+  std::vector<int64> GetPathCosts(const std::vector<int64>& node_costs) const;
+
+  const LocalExecutorParams params_;
+  const std::unique_ptr<const Graph> graph_;
+  const int max_parallelism_;
+
+  // The op nodes of the graph in topological order.
+  std::vector<ScheduledNode> schedule_;
+  int num_entries_;
+  std::vector<int> input_entries_;
+  std::vector<int> release_entries_;
+  // The allocator attributes of every entry.
+  std::vector<AllocatorAttributes> output_attrs_;
+  std::vector<int> successors_;
+  // The number of inputs reading each entry.
+  std::vector<int> num_readers_;
+  // The path costs steps run by priority start with: unit_path_costs_, until
+  // SetNodeCosts replaces them with measured_path_costs_.
+  std::atomic<const std::vector<int64>*> path_costs_;
+  std::vector<int64> unit_path_costs_;
+  mutex costs_mu_;
+  std::unique_ptr<const std::vector<int64>> measured_path_costs_
+      GUARDED_BY(costs_mu_);
+  DeviceContextMap device_context_map_;
+  // Null unless memory planning was enabled when the executor was created.
+  StaticMemoryPlanner* memory_planner_;
+  std::unique_ptr<PlannedDevice> planned_device_;
+};
+
+StaticExecutor::~StaticExecutor() {
+  if (memory_planner_ != nullptr) {
+    memory_planner_->Unref();
+  }
+  for (const ScheduledNode& item : schedule_) {
+    params_.delete_kernel(item.kernel);
+  }
+  for (DeviceContext* context : device_context_map_) {
+    if (context != nullptr) {
+      context->Unref();
+    }
+  }
+}
+
+Status StaticExecutor::Initialize() {
+  std::vector<Node*> order;
+  GetReversePostOrder(*graph_, &order);
+
+  // The entry of output 0 and the position of each node, by id.
+  std::vector<int> output_starts(graph_->num_node_ids(), -1);
+  std::vector<int> positions(graph_->num_node_ids(), -1);
+  for (const Node* node : order) {
+    // The source and sink nodes only order the others.
+    if (!node->IsOp()) {
+      continue;
+    }
+    if (node->IsControlFlow()) {
+      return errors::InvalidArgument(
+          "The static executor cannot run control flow node ", node->name());
+    }
+    ScheduledNode item;
+    item.node = node;
+    item.num_inputs = node->num_inputs();
+    item.num_outputs = node->num_outputs();
+    item.input_start = input_entries_.size();
+    item.output_start = num_entries_;
+    output_starts[node->id()] = num_entries_;
+    positions[node->id()] = schedule_.size();
+    num_entries_ += item.num_outputs;
+    input_entries_.resize(input_entries_.size() + item.num_inputs, -1);
+    const Status s = params_.create_kernel(node->def(), &item.kernel);
+    if (!s.ok()) {
+      return AttachDef(s, node->def());
+    }
+    item.is_async = item.kernel->AsAsync() != nullptr;
+    schedule_.push_back(item);
+  }
+
+  // The position in the schedule of the last node reading each entry, or of
+  // its producer if nothing reads it.
+  std::vector<int> last_reads(num_entries_);
+  for (int position = 0; position < schedule_.size(); ++position) {
+    const ScheduledNode& item = schedule_[position];
+    for (int i = 0; i < item.num_outputs; ++i) {
+      last_reads[item.output_start + i] = position;
+    }
+    for (const Edge* edge : item.node->in_edges()) {
+      if (edge->IsControlEdge()) {
+        continue;
+      }
+      const int entry = output_starts[edge->src()->id()] + edge->src_output();
+      input_entries_[item.input_start + edge->dst_input()] = entry;
+      last_reads[entry] = position;
+    }
+    for (int i = 0; i < item.num_inputs; ++i) {
+      if (input_entries_[item.input_start + i] < 0) {
+        return errors::InvalidArgument("Input ", i, " of ", item.node->name(),
+                                       " is not connected");
+      }
+    }
+  }
+  std::vector<std::vector<int>> releases(schedule_.size());
+  for (int entry = 0; entry < num_entries_; ++entry) {
+    releases[last_reads[entry]].push_back(entry);
+  }
+  for (int position = 0; position < schedule_.size(); ++position) {
+    ScheduledNode& item = schedule_[position];
+    item.release_start = release_entries_.size();
+    item.num_releases = releases[position].size();
+    release_entries_.insert(release_entries_.end(), releases[position].begin(),
+                            releases[position].end());
+  }
+
+  // Steps run by priority wait for every edge between scheduled nodes, and
+  // release an entry once all its readers have run.
+  num_readers_.resize(num_entries_);
+  for (const int entry : input_entries_) {
+    ++num_readers_[entry];
+  }
+  for (ScheduledNode& item : schedule_) {
+    item.successor_start = successors_.size();
+    for (const Edge* edge : item.node->out_edges()) {
+      const int successor = positions[edge->dst()->id()];
+      if (successor >= 0) {
+        successors_.push_back(successor);
+        ++schedule_[successor].num_predecessors;
+      }
+    }
+    item.num_successors = successors_.size() - item.successor_start;
+  }
+  unit_path_costs_ = GetPathCosts(std::vector<int64>(schedule_.size(), 1));
+  path_costs_ = &unit_path_costs_;
+
+  // A single device has no transfers that need special memory, so only the
+  // memory types of the kernels matter.
+  output_attrs_.resize(num_entries_);
+  for (const ScheduledNode& item : schedule_) {
+    for (int i = 0; i < item.num_outputs; ++i) {
+      output_attrs_[item.output_start + i].set_on_host(
+          item.kernel->output_memory_types()[i] == HOST_MEMORY);
+    }
+  }
+  // The plan follows the order of the schedule, which steps run by priority
+  // do not.
+  if (max_parallelism_ == 1 && StaticMemoryPlanningEnabled()) {
+    memory_planner_ = new StaticMemoryPlanner(
+        params_.device->GetAllocator(AllocatorAttributes()), schedule_.size());
+    planned_device_.reset(new PlannedDevice(params_.device, memory_planner_));
+  }
+  return params_.device->FillContextMap(graph_.get(), &device_context_map_);
+}
+
+void StaticExecutor::SetNodeCosts(const CostModel& cost_model) {
+  std::vector<int64> node_costs(schedule_.size());
+  int64 total_cost = 0;
+  for (int position = 0; position < schedule_.size(); ++position) {
+    node_costs[position] = std::max<int64>(
+        cost_model.MaxExecutionTime(schedule_[position].node).value(), 1);
+    total_cost += node_costs[position];
+  }
+  mutex_lock l(costs_mu_);
+  if (measured_path_costs_ != nullptr) {
+    return;
+  }
+  measured_path_costs_.reset(
+      new std::vector<int64>(GetPathCosts(node_costs)));
+  path_costs_.store(measured_path_costs_.get(), std::memory_order_release);
+  int64 critical_path = 0;
+  for (const int64 path_cost : *measured_path_costs_) {
+    critical_path = std::max(critical_path, path_cost);
+  }
+  LOG(INFO) << "Scheduling " << schedule_.size() << " nodes of "
+            << total_cost << "us by a critical path of " << critical_path
+            << "us";
+}
+
+std::vector<int64> StaticExecutor::GetPathCosts(
+    const std::vector<int64>& node_costs) const {
+  // Successors come later in the schedule, so their paths are known first.
+  std::vector<int64> path_costs(schedule_.size());
+  for (int position = schedule_.size() - 1; position >= 0; --position) {
+    const ScheduledNode& item = schedule_[position];
+    int64 longest_successor = 0;
+    for (int i = 0; i < item.num_successors; ++i) {
+      longest_successor = std::max(
+          longest_successor, path_costs[successors_[item.successor_start + i]]);
+    }
+    path_costs[position] = node_costs[position] + longest_successor;
+  }
+  return path_costs;
+}
+
+Status StaticExecutor::RunSchedule(const Args& args) {
+  Device* const device = params_.device;
+  // Declared first, so that it is in scope until the last tensor of the step
+  // is released.
+  StaticMemoryPlanner::ScopedStep memory_step(memory_planner_);
+  std::unique_ptr<Entry[]> entries(new Entry[num_entries_]);
+  StepResources resources(args.runner);
+  if (max_parallelism_ > 1) {
+    TF_RETURN_IF_ERROR(RunByPriority(args, &resources, entries.get()));
+    return device->Sync();
+  }
+
+  NodeInputs inputs;
+  OpKernelContext::Params params;
+  InitParams(args, &resources, &inputs, &params);
+  for (int position = 0; position < schedule_.size(); ++position) {
+    const ScheduledNode& item = schedule_[position];
+    memory_step.StartNode(position);
+    const Status s =
+        RunNode(args, item, false, &params, &inputs, entries.get());
+    for (int i = 0; i < item.num_releases; ++i) {
+      ReleaseEntry(&entries[release_entries_[item.release_start + i]]);
+    }
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return device->Sync();
+}
+
+Status StaticExecutor::RunByPriority(const Args& args,
+                                     StepResources* resources,
+                                     Entry* const entries) const {
+  PriorityStep step;
+  step.args = &args;
+  step.resources = resources;
+  step.entries = entries;
+  step.path_costs = path_costs_.load(std::memory_order_acquire);
+  step.readers.reset(new std::atomic<int>[num_entries_]);
+  for (int entry = 0; entry < num_entries_; ++entry) {
+    step.readers[entry].store(num_readers_[entry], std::memory_order_relaxed);
+  }
+  {
+    mutex_lock l(step.mu);
+    step.pending.resize(schedule_.size());
+    for (int position = 0; position < schedule_.size(); ++position) {
+      step.pending[position] = schedule_[position].num_predecessors;
+      if (step.pending[position] == 0) {
+        step.ready.emplace((*step.path_costs)[position], -position);
+      }
+    }
+    step.num_threads = 1;
+  }
+
+  // The calling thread runs nodes too, then waits for the others.
+  RunReadyNodes(&step);
+  mutex_lock l(step.mu);
+  while (step.num_threads > 0) {
+    step.done.wait(l);
+  }
+  return step.status;
+}
+
+void StaticExecutor::RunReadyNodes(PriorityStep* step) const {
+  NodeInputs inputs;
+  OpKernelContext::Params params;
+  InitParams(*step->args, step->resources, &inputs, &params);
+  // The node this thread last ran, if any, and how that went.
+  int position = -1;
+  Status s;
+  while (true) {
+    int num_new_threads = 0;
+    {
+      mutex_lock l(step->mu);
+      if (!s.ok()) {
+        step->status.Update(s);
+      } else if (position >= 0) {
+        const ScheduledNode& item = schedule_[position];
+        for (int i = 0; i < item.num_successors; ++i) {
+          const int successor = successors_[item.successor_start + i];
+          if (--step->pending[successor] == 0) {
+            step->ready.emplace((*step->path_costs)[successor], -successor);
+          }
+        }
+      }
+      if (!step->status.ok() || step->ready.empty()) {
+        // Notified under the lock, as the step is gone once it is released.
+        if (--step->num_threads == 0) {
+          step->done.notify_all();
+        }
+        return;
+      }
+      position = -step->ready.top().second;
+      step->ready.pop();
+      // Every other ready node gets a thread, up to max_parallelism_.
+      num_new_threads = std::min(static_cast<int>(step->ready.size()),
+                                 max_parallelism_ - step->num_threads);
+      step->num_threads += num_new_threads;
+    }
+    for (int i = 0; i < num_new_threads; ++i) {
+      step->resources->runner([this, step]() { RunReadyNodes(step); });
+    }
+
+    const ScheduledNode& item = schedule_[position];
+    s = RunNode(*step->args, item, true, &params, &inputs, step->entries);
+    for (int i = 0; i < item.num_inputs; ++i) {
+      const int entry = input_entries_[item.input_start + i];
+      if (step->readers[entry].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        ReleaseEntry(&step->entries[entry]);
+      }
+    }
+    for (int i = 0; i < item.num_outputs; ++i) {
+      if (num_readers_[item.output_start + i] == 0) {
+        ReleaseEntry(&step->entries[item.output_start + i]);
+      }
+    }
+  }
+}
+
+void StaticExecutor::InitParams(const Args& args, StepResources* resources,
+                                NodeInputs* inputs,
+                                OpKernelContext::Params* params) const {
+  params->step_id = args.step_id;
+  params->device = planned_device_ != nullptr
+                       ? static_cast<DeviceBase*>(planned_device_.get())
+                       : params_.device;
+  params->track_allocations = args.stats_collector != nullptr;
+  params->rendezvous = args.rendezvous;
+  params->session_state = args.session_state;
+  params->tensor_store = args.tensor_store;
+  params->cancellation_manager = args.cancellation_manager;
+  params->call_frame = args.call_frame;
+  params->function_library = params_.function_library;
+  params->resource_manager = params_.device->resource_manager();
+  params->step_resource_manager = &resources->step_resource_manager;
+  params->slice_reader_cache = &resources->slice_reader_cache;
+  params->inputs = &inputs->values;
+  params->input_device_contexts = &inputs->device_contexts;
+  params->input_alloc_attrs = &inputs->alloc_attrs;
+  params->runner = &resources->runner;
+}
+
+Status StaticExecutor::RunNode(const Args& args, const ScheduledNode& item,
+                               const bool concurrent,
+                               OpKernelContext::Params* params,
+                               NodeInputs* inputs,
+                               Entry* const entries) const {
+  Device* const device = params_.device;
+  NodeExecStats* stats = nullptr;
+  if (args.stats_collector != nullptr) {
+    stats = new NodeExecStats;
+    stats->set_node_name(item.node->name());
+    stats->set_all_start_micros(Env::Default()->NowMicros());
+  }
+
+  Status s = PrepareInputs(item, concurrent, entries, inputs);
+  if (s.ok()) {
+    const int id = item.node->id();
+    params->op_kernel = item.kernel;
+    params->output_attr_array = output_attrs_.data() + item.output_start;
+    params->op_device_context =
+        id < device_context_map_.size() ? device_context_map_[id] : nullptr;
+    OpKernelContext ctx(params, item.num_outputs);
+    if (stats != nullptr) {
+      stats->set_op_start_rel_micros(Env::Default()->NowMicros() -
+                                     stats->all_start_micros());
+    }
+    if (item.is_async) {
+      // In an inference graph these are the _Recv nodes of the feeds,
+      // whose values were sent before the step started.
+      Notification done;
+      device->ComputeAsync(item.kernel->AsAsync(), &ctx,
+                           [&done]() { done.Notify(); });
+      done.WaitForNotification();
+    } else {
+      device->Compute(item.kernel, &ctx);
+    }
+    if (stats != nullptr) {
+      stats->set_op_end_rel_micros(Env::Default()->NowMicros() -
+                                   stats->all_start_micros());
+    }
+    s = ProcessOutputs(item, &ctx, stats, entries);
+  }
+
+  if (stats != nullptr) {
+    stats->set_all_end_rel_micros(Env::Default()->NowMicros() -
+                                  stats->all_start_micros());
+    args.stats_collector->UpdateCostModelNode(stats, graph_.get(), item.node);
+    args.stats_collector->Save(device->name(), stats);
+  }
+  return s;
+}
+
+Status StaticExecutor::PrepareInputs(const ScheduledNode& item,
+                                     const bool concurrent,
+                                     Entry* const entries,
+                                     NodeInputs* inputs) const {
+  inputs->values.clear();
+  inputs->values.resize(item.num_inputs);
+  inputs->device_contexts.clear();
+  inputs->device_contexts.resize(item.num_inputs);
+  inputs->alloc_attrs.clear();
+  inputs->alloc_attrs.resize(item.num_inputs);
+  inputs->ref_values.clear();
+  if (concurrent) {
+    inputs->ref_values.resize(item.num_inputs);
+  }
+
+  for (int i = 0; i < item.num_inputs; ++i) {
+    Entry* const entry = &entries[input_entries_[item.input_start + i]];
+    inputs->device_contexts[i] = entry->device_context;
+    inputs->alloc_attrs[i] = entry->alloc_attr;
+    TensorValue* const input = &inputs->values[i];
+    const bool expect_ref = IsRefType(item.node->input_type(i));
+    if (entry->ref == nullptr) {
+      if (expect_ref) {
+        return AttachDef(
+            errors::InvalidArgument(i, "-th input expects a ref type"),
+            item.kernel->def());
+      }
+      input->tensor = &entry->val;
+    } else if (expect_ref) {
+      input->mutex_if_ref = entry->ref_mu;
+      input->tensor = entry->ref;
+    } else {
+      if (!entry->ref->IsInitialized()) {
+        return AttachDef(
+            errors::FailedPrecondition("Attempting to use uninitialized value ",
+                                       item.kernel->def().input(i)),
+            item.kernel->def());
+      }
+      if (concurrent) {
+        // Dereferenced under its mutex for this reader only.
+        mutex_lock l(*entry->ref_mu);
+        inputs->ref_values[i] = *entry->ref;
+        input->tensor = &inputs->ref_values[i];
+        continue;
+      }
+      // Dereferenced under its mutex once, for this and later readers.
+      {
+        mutex_lock l(*entry->ref_mu);
+        entry->val = *entry->ref;
+      }
+      entry->ref = nullptr;
+      entry->ref_mu = nullptr;
+      input->tensor = &entry->val;
+    }
+  }
+  return Status::OK();
+}
+
+Status StaticExecutor::ProcessOutputs(const ScheduledNode& item,
+                                      OpKernelContext* ctx,
+                                      NodeExecStats* stats,
+                                      Entry* const entries) const {
+  Status s = ctx->status();
+  if (!s.ok()) {
+    return AttachDef(s, item.kernel->def());
+  }
+  if (stats != nullptr) {
+    for (const auto& allocator_pair : ctx->wrapped_allocators()) {
+      AllocatorMemoryUsed* const memory = stats->add_memory();
+      const auto sizes = allocator_pair.second->GetSizesAndUnRef();
+      memory->set_allocator_name(allocator_pair.first->Name());
+      memory->set_total_bytes(sizes.first);
+      if (allocator_pair.first->TracksAllocationSizes()) {
+        memory->set_peak_bytes(sizes.second);
+      }
+    }
+  }
+  if (item.num_outputs == 0 && params_.node_outputs_cb != nullptr) {
+    s.Update(params_.node_outputs_cb(item.node->name(), -1, nullptr, false,
+                                     ctx));
+  }
+
+  const int id = item.node->id();
+  DeviceContext* const device_context =
+      id < device_context_map_.size() ? device_context_map_[id] : nullptr;
+  for (int i = 0; i < item.num_outputs; ++i) {
+    const TensorValue val = ctx->release_output(i);
+    if (val.tensor == nullptr) {
+      s.Update(errors::Internal("Missing ", i, "-th output from ",
+                                SummarizeNodeDef(item.node->def())));
+      continue;
+    }
+    DataType dtype = val->dtype();
+    if (val.is_ref()) {
+      dtype = MakeRefType(dtype);
+    }
+    if (dtype != item.node->output_type(i)) {
+      s.Update(errors::Internal("Output ", i, " of type ",
+                                DataTypeString(dtype),
+                                " does not match declared output type ",
+                                DataTypeString(item.node->output_type(i)),
+                                " for node ",
+                                SummarizeNodeDef(item.node->def())));
+    } else {
+      Entry* const entry = &entries[item.output_start + i];
+      entry->device_context = device_context;
+      entry->alloc_attr = ctx->output_alloc_attr(i);
+      if (stats != nullptr && val.tensor->IsInitialized()) {
+        NodeOutput* const output = stats->add_output();
+        output->set_slot(i);
+        val.tensor->FillDescription(output->mutable_tensor_description());
+      }
+      if (val.is_ref()) {
+        entry->ref = val.tensor;
+        entry->ref_mu = val.mutex_if_ref;
+      } else {
+        entry->val = std::move(*val.tensor);
+      }
+      if (params_.node_outputs_cb != nullptr) {
+        s.Update(params_.node_outputs_cb(
+            item.node->name(), i, val.is_ref() ? entry->ref : &entry->val,
+            val.is_ref(), ctx));
+      }
+    }
+    if (!val.is_ref()) {
+      delete val.tensor;
+    }
+  }
+  return s;
+}
+
+Status CreateStaticExecutor(const LocalExecutorParams& params,
+                            const Graph* graph, const int max_parallelism,
+                            StaticExecutor** executor) {
+  StaticExecutor* const impl =
+      new StaticExecutor(params, graph, max_parallelism);
+  const Status s = impl->Initialize();
+  if (!s.ok()) {
+    delete impl;
+    return s;
+  }
+  *executor = impl;
+  return Status::OK();
+}
+
+// Feeds and fetches go through a rendezvous, as with DirectSession, under
+// keys that name the CPU device as both ends.
+string GetRendezvousKey(const string& tensor_name,
+                        const DeviceAttributes& device_info) {
+  return strings::StrCat(device_info.name(), ";",
+                         strings::FpToString(device_info.incarnation()), ";",
+                         device_info.name(), ";", tensor_name, ";0:0");
+}
+
+const char kSessionHandle[] = "static";
+
+std::atomic<int64> next_step_id(1);
+
+class StaticSession : public Session {
+ public:
+  StaticSession(const SessionOptions& options, const DeviceMgr* device_mgr);
+  ~StaticSession() override;
+
+  Status Create(const GraphDef& graph) override;
+  Status Extend(const GraphDef& graph) override;
+  Status Run(const std::vector<std::pair<string, Tensor>>& inputs,
+             const std::vector<string>& output_names,
+             const std::vector<string>& target_nodes,
+             std::vector<Tensor>* outputs) override;
+  Status Run(const RunOptions& run_options,
+             const std::vector<std::pair<string, Tensor>>& inputs,
+             const std::vector<string>& output_names,
+             const std::vector<string>& target_nodes,
+             std::vector<Tensor>* outputs,
+             RunMetadata* run_metadata) override;
+  Status PRunSetup(const std::vector<string>& input_names,
+                   const std::vector<string>& output_names,
+                   const std::vector<string>& target_nodes,
+                   string* handle) override {
+    return errors::Unimplemented("The static executor has no partial runs");
+  }
+  Status PRun(const string& handle,
+              const std::vector<std::pair<string, Tensor>>& inputs,
+              const std::vector<string>& output_names,
+              std::vector<Tensor>* outputs) override {
+    return errors::Unimplemented("The static executor has no partial runs");
+  }
+  Status Close() override;
+
+ private:
+  // The executor and rendezvous keys for one set of feeds, fetches and
+  // targets. Members are destroyed in reverse order, so the executor goes
+  // before the library its kernels came from.
+  struct Step {
+    std::unique_ptr<FunctionLibraryDefinition> flib_def;
+    std::unique_ptr<FunctionLibraryRuntime> flib;
+    // Owned by executor.
+    const Graph* graph = nullptr;
+    std::unique_ptr<StaticExecutor> executor;
+    std::unordered_map<string, Rendezvous::ParsedKey> input_keys;
+    std::unordered_map<string, Rendezvous::ParsedKey> output_keys;
+    int64 step_count = 0;
+  };
+
+  Status ExtendLocked(const GraphDef& graph)
+      EXCLUSIVE_LOCKS_REQUIRED(graph_mu_);
+  Status GetOrCreateStep(std::vector<string> inputs,
+                         std::vector<string> outputs,
+                         std::vector<string> targets, Step** step);
+  Status CreateGraph(const BuildGraphOptions& options,
+                     std::unique_ptr<Graph>* graph,
+                     std::unique_ptr<FunctionLibraryDefinition>* flib_def);
+
+  const SessionOptions options_;
+  const std::unique_ptr<const DeviceMgr> device_mgr_;
+  // The CPU device, owned by device_mgr_.
+  Device* device_;
+  DeviceSet device_set_;
+  CancellationManager cancellation_manager_;
+  SessionState session_state_;
+  CostModelManager cost_model_manager_;
+  // Runs the nodes of steps scheduled by priority besides the calling
+  // thread; null if the steps run in schedule order.
+  std::unique_ptr<thread::ThreadPool> inter_op_pool_;
+
+  mutex graph_mu_;
+  bool graph_created_ GUARDED_BY(graph_mu_);
+  std::unique_ptr<SimpleGraphExecutionState> execution_state_
+      GUARDED_BY(graph_mu_);
+  int64 name_counter_ GUARDED_BY(graph_mu_);
+
+  mutex steps_mu_;
+  std::unordered_map<string, std::unique_ptr<Step>> steps_
+      GUARDED_BY(steps_mu_);
+};
+
+StaticSession::StaticSession(const SessionOptions& options,
+                             const DeviceMgr* device_mgr)
+    : options_(options),
+      device_mgr_(device_mgr),
+      device_(device_mgr->ListDevices()[0]),
+      graph_created_(false),
+      name_counter_(0) {
+  device_set_.AddDevice(device_);
+  device_set_.set_client_device(device_);
+  device_->op_segment()->AddHold(kSessionHandle);
+  if (critical_path_enabled.load(std::memory_order_relaxed)) {
+    int num_threads = options.config.inter_op_parallelism_threads();
+    if (num_threads <= 0) {
+      num_threads = port::NumSchedulableCPUs();
+    }
+    inter_op_pool_.reset(new thread::ThreadPool(
+        options.env, "static_inter_op", std::max(num_threads, 1)));
+  }
+}
+
+StaticSession::~StaticSession() {
+  {
+    mutex_lock l(steps_mu_);
+    steps_.clear();
+  }
+  device_->op_segment()->RemoveHold(kSessionHandle);
+}
+
+Status StaticSession::Create(const GraphDef& graph) {
+  mutex_lock l(graph_mu_);
+  if (graph_created_) {
+    return errors::AlreadyExists(
+        "A Graph has already been created for this session.");
+  }
+  return ExtendLocked(graph);
+}
+
+Status StaticSession::Extend(const GraphDef& graph) {
+  mutex_lock l(graph_mu_);
+  return ExtendLocked(graph);
+}
+
+Status StaticSession::ExtendLocked(const GraphDef& graph) {
+  TF_RETURN_IF_ERROR(CheckStaticGraph(graph));
+  if (execution_state_ == nullptr) {
+    SimpleGraphExecutionStateOptions options;
+    options.device_set = &device_set_;
+    options.session_options = &options_;
+    execution_state_.reset(
+        new SimpleGraphExecutionState(graph.library(), options));
+  }
+  std::unique_ptr<SimpleGraphExecutionState> state;
+  TF_RETURN_IF_ERROR(execution_state_->Extend(graph, &state));
+  execution_state_.swap(state);
+  graph_created_ = true;
+  return Status::OK();
+}
+
+Status StaticSession::Run(const std::vector<std::pair<string, Tensor>>& inputs,
+                          const std::vector<string>& output_names,
+                          const std::vector<string>& target_nodes,
+                          std::vector<Tensor>* outputs) {
+  RunMetadata run_metadata;
+  return Run(RunOptions(), inputs, output_names, target_nodes, outputs,
+             &run_metadata);
+}
+
+Status StaticSession::Run(const RunOptions& run_options,
+                          const std::vector<std::pair<string, Tensor>>& inputs,
+                          const std::vector<string>& output_names,
+                          const std::vector<string>& target_nodes,
+                          std::vector<Tensor>* outputs,
+                          RunMetadata* run_metadata) {
+  std::vector<string> input_names;
+  input_names.reserve(inputs.size());
+  for (const auto& input : inputs) {
+    input_names.push_back(input.first);
+  }
+  Step* step;
+  TF_RETURN_IF_ERROR(
+      GetOrCreateStep(input_names, output_names, target_nodes, &step));
+
+  IntraProcessRendezvous* const rendezvous =
+      new IntraProcessRendezvous(device_mgr_.get());
+  core::ScopedUnref unref_rendezvous(rendezvous);
+  for (const auto& input : inputs) {
+    const Status s = rendezvous->Send(step->input_keys.at(input.first),
+                                      Rendezvous::Args(), input.second, false);
+    if (!s.ok()) {
+      rendezvous->StartAbort(s);
+      return s;
+    }
+  }
+
+  TensorStore tensor_store;
+  Executor::Args args;
+  args.step_id = next_step_id.fetch_add(1);
+  args.rendezvous = rendezvous;
+  args.cancellation_manager = &cancellation_manager_;
+  args.session_state = &session_state_;
+  args.tensor_store = &tensor_store;
+  if (inter_op_pool_ != nullptr) {
+    thread::ThreadPool* const pool = inter_op_pool_.get();
+    args.runner = [pool](Executor::Args::Closure c) {
+      pool->Schedule(std::move(c));
+    };
+  } else {
+    // Closures run inline, as DirectSession runs them on Android.
+    args.runner = [](Executor::Args::Closure c) { c(); };
+  }
+  const int64 build_cost_model =
+      options_.config.graph_options().build_cost_model();
+  // Scheduling by priority measures the nodes of the first steps even if no
+  // cost model was asked for.
+  const int64 cost_model_steps =
+      build_cost_model > 0
+          ? build_cost_model
+          : inter_op_pool_ != nullptr ? kCriticalPathCostSteps : 0;
+  bool measure_costs = build_cost_model > 0;
+  if (!measure_costs && cost_model_steps > 0) {
+    mutex_lock l(steps_mu_);
+    measure_costs = step->step_count < cost_model_steps;
+  }
+  const bool return_stats =
+      run_options.trace_level() > RunOptions::NO_TRACE || build_cost_model > 0;
+  std::unique_ptr<StepStatsCollector> collector;
+  // The stats of steps measured only for scheduling.
+  StepStats scheduling_stats;
+  if (return_stats || measure_costs) {
+    collector.reset(new StepStatsCollector(
+        return_stats ? run_metadata->mutable_step_stats() : &scheduling_stats,
+        measure_costs ? &cost_model_manager_ : nullptr));
+    args.stats_collector = collector.get();
+  }
+
+  Status s = step->executor->Run(args);
+  if (!s.ok()) {
+    rendezvous->StartAbort(s);
+    return s;
+  }
+
+  outputs->clear();
+  outputs->resize(output_names.size());
+  for (int i = 0; i < output_names.size(); ++i) {
+    bool is_dead;
+    s = rendezvous->Recv(step->output_keys.at(output_names[i]),
+                         Rendezvous::Args(), &(*outputs)[i], &is_dead);
+    if (s.ok() && is_dead) {
+      s = errors::InvalidArgument("The tensor returned for ", output_names[i],
+                                  " was not valid.");
+    }
+    if (!s.ok()) {
+      rendezvous->StartAbort(s);
+      outputs->clear();
+      return s;
+    }
+  }
+  TF_RETURN_IF_ERROR(tensor_store.SaveTensors(output_names, &session_state_));
+
+  if (cost_model_steps > 0) {
+    mutex_lock l(steps_mu_);
+    if (++step->step_count == cost_model_steps) {
+      if (inter_op_pool_ != nullptr) {
+        step->executor->SetNodeCosts(
+            *cost_model_manager_.FindOrCreateCostModel(step->graph));
+      }
+      if (build_cost_model > 0) {
+        TF_RETURN_IF_ERROR(cost_model_manager_.AddToCostGraphDef(
+            step->graph, run_metadata->mutable_cost_graph()));
+      }
+    }
+  }
+  return Status::OK();
+}
+
+Status StaticSession::GetOrCreateStep(std::vector<string> inputs,
+                                      std::vector<string> outputs,
+                                      std::vector<string> targets,
+                                      Step** step) {
+  // Sorted, so that the same feeds and fetches in a different order share
+  // an executor.
+  std::sort(inputs.begin(), inputs.end());
+  std::sort(outputs.begin(), outputs.end());
+  std::sort(targets.begin(), targets.end());
+  const string key = strings::StrCat(
+      str_util::Join(inputs, ","), "->", str_util::Join(outputs, ","), "/",
+      str_util::Join(targets, ","));
+  {
+    mutex_lock l(steps_mu_);
+    auto it = steps_.find(key);
+    if (it != steps_.end()) {
+      *step = it->second.get();
+      return Status::OK();
+    }
+  }
+
+  // Created without holding steps_mu_, as DirectSession creates executors.
+  BuildGraphOptions options;
+  options.feed_endpoints = inputs;
+  options.fetch_endpoints = outputs;
+  options.target_nodes = targets;
+  std::unique_ptr<Step> new_step(new Step);
+  std::unique_ptr<Graph> graph;
+  TF_RETURN_IF_ERROR(CreateGraph(options, &graph, &new_step->flib_def));
+
+  const OptimizerOptions& optimizer_options =
+      options_.config.graph_options().optimizer_options();
+  new_step->flib.reset(NewFunctionLibraryRuntime(
+      device_mgr_.get(), device_, graph->versions().producer(),
+      new_step->flib_def.get(), optimizer_options));
+  FunctionLibraryRuntime* const lib = new_step->flib.get();
+  OpSegment* const opseg = device_->op_segment();
+
+  LocalExecutorParams params;
+  params.device = device_;
+  params.function_library = lib;
+  params.create_kernel = [lib, opseg](const NodeDef& ndef, OpKernel** kernel) {
+    // Stateful kernels, such as those of Variables, are shared by every
+    // executor of the session.
+    if (!lib->IsStateful(ndef.op())) {
+      return lib->CreateKernel(ndef, kernel);
+    }
+    auto create_fn = [lib, &ndef](OpKernel** kernel) {
+      return lib->CreateKernel(ndef, kernel);
+    };
+    return opseg->FindOrCreate(kSessionHandle, ndef.name(), kernel, create_fn);
+  };
+  params.delete_kernel = [lib](OpKernel* kernel) {
+    if (kernel != nullptr && !lib->IsStateful(kernel->type_string())) {
+      delete kernel;
+    }
+  };
+
+  Graph* optimized_graph = graph.release();
+  GraphOptimizer(optimizer_options).Optimize(lib, device_, &optimized_graph);
+  graph.reset(optimized_graph);
+  TF_RETURN_IF_ERROR(EnsureMemoryTypes(DeviceType(device_->device_type()),
+                                       device_->name(), graph.get()));
+  new_step->graph = graph.get();
+  // The calling thread runs nodes too.
+  const int max_parallelism =
+      inter_op_pool_ != nullptr ? inter_op_pool_->NumThreads() + 1 : 1;
+  StaticExecutor* executor;
+  TF_RETURN_IF_ERROR(CreateStaticExecutor(params, graph.release(),
+                                          max_parallelism, &executor));
+  new_step->executor.reset(executor);
+
+  for (const string& input : inputs) {
+    TF_RETURN_IF_ERROR(Rendezvous::ParseKey(
+        GetRendezvousKey(input, device_->attributes()),
+        &new_step->input_keys[input]));
+  }
+  for (const string& output : outputs) {
+    TF_RETURN_IF_ERROR(Rendezvous::ParseKey(
+        GetRendezvousKey(output, device_->attributes()),
+        &new_step->output_keys[output]));
+  }
+
+  // Another thread may have created the same step meanwhile, in which case
+  // this one is dropped.
+  mutex_lock l(steps_mu_);
+  *step = steps_.emplace(key, std::move(new_step)).first->second.get();
+  return Status::OK();
+}
+
+Status StaticSession::CreateGraph(
+    const BuildGraphOptions& options, std::unique_ptr<Graph>* graph,
+    std::unique_ptr<FunctionLibraryDefinition>* flib_def) {
+  mutex_lock l(graph_mu_);
+  if (!graph_created_) {
+    return errors::InvalidArgument(
+        "Session was not created with a graph before Run()!");
+  }
+  std::unique_ptr<SimpleClientGraph> client_graph;
+  TF_RETURN_IF_ERROR(execution_state_->BuildGraph(options, &client_graph));
+
+  // Everything is on the one device, so partitioning only turns the client
+  // graph into a GraphDef with the assigned device of every node filled in.
+  PartitionOptions partition_options;
+  partition_options.node_to_loc = [](const Node* node) {
+    return node->assigned_device_name();
+  };
+  partition_options.new_name = [this](const string& prefix) {
+    return strings::StrCat(prefix, "/_", name_counter_++);
+  };
+  partition_options.get_incarnation = [](const string& name) { return 1; };
+  partition_options.control_flow_added = false;
+  std::unordered_map<string, GraphDef> partitions;
+  TF_RETURN_IF_ERROR(
+      Partition(partition_options, &client_graph->graph, &partitions));
+  if (partitions.size() != 1) {
+    return errors::InvalidArgument("Expected the graph on one device, got ",
+                                   partitions.size(), " partitions");
+  }
+
+  GraphDef* const graph_def = &partitions.begin()->second;
+  TF_RETURN_IF_ERROR(
+      device_->MaybeRewriteGraph(client_graph->flib_def->ToProto(), graph_def));
+  graph->reset(new Graph(client_graph->flib_def.get()));
+  GraphConstructorOptions graph_options;
+  graph_options.allow_internal_ops = true;
+  graph_options.expect_device_spec = true;
+  TF_RETURN_IF_ERROR(
+      ConvertGraphDefToGraph(graph_options, *graph_def, graph->get()));
+  *flib_def = std::move(client_graph->flib_def);
+  return Status::OK();
+}
+
+Status StaticSession::Close() {
+  cancellation_manager_.StartCancel();
+  return Status::OK();
+}
+
+class StaticSessionFactory : public SessionFactory {
+ public:
+  bool AcceptsOptions(const SessionOptions& options) override {
+    return options.target == kStaticSessionTarget;
+  }
+
+  Session* NewSession(const SessionOptions& options) override {
+    // Must be done before the CPU allocator is created.
+    if (options.config.graph_options().build_cost_model() > 0) {
+      EnableCPUAllocatorFullStats(true);
+    }
+    Device* const device = DeviceFactory::NewDevice(
+        "CPU", options, "/job:localhost/replica:0/task:0");
+    if (device == nullptr) {
+      return nullptr;
+    }
+    return new StaticSession(options, new DeviceMgr({device}));
+  }
+};
+
+class StaticSessionRegistrar {
+ public:
+  StaticSessionRegistrar() {
+    SessionFactory::Register("STATIC_SESSION", new StaticSessionFactory());
+  }
+};
+static StaticSessionRegistrar registrar;
+
+}  // namespace
+
+Status CheckStaticGraph(const GraphDef& graph_def) {
+  static const std::unordered_set<string>* const control_flow_ops =
+      new std::unordered_set<string>(
+          {"Switch", "RefSwitch", "Merge", "RefMerge", "Enter", "RefEnter",
+           "Exit", "RefExit", "NextIteration", "RefNextIteration"});
+  for (const NodeDef& node : graph_def.node()) {
+    if (control_flow_ops->count(node.op()) > 0) {
+      return errors::InvalidArgument(
+          "The static executor cannot run control flow node ", node.name(),
+          " (", node.op(), ")");
+    }
+  }
+  return Status::OK();
+}
+
+Status NewStaticExecutor(const LocalExecutorParams& params, const Graph* graph,
+                         Executor** executor) {
+  StaticExecutor* impl;
+  TF_RETURN_IF_ERROR(CreateStaticExecutor(params, graph, 1, &impl));
+  *executor = impl;
+  return Status::OK();
+}
+
+void SetCriticalPathScheduling(const bool enabled) {
+  critical_path_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+}  // namespace android
+}  // namespace tensorflow
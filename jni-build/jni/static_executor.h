@@ -0,0 +1,75 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// An Executor for inference graphs without control flow. Every step of the
+// local executor initializes a pending count per node, sets up the root frame
+// and its iteration state, and pushes each node through a ready queue once
+// its inputs arrive; for a detector graph, which is a chain of a few dozen
+// kernels, that bookkeeping is all it does besides run them. The static
+// executor orders the graph topologically once, when it is created, and each
+// step runs the kernels in that order on the calling thread. Parallelism
+// comes from the sharding inside kernels; on Android DirectSession runs
+// inter-op closures inline anyway. Unless SetStaticMemoryPlanning disables
+// it, the intermediates of the steps are placed in a preallocated slab by a
+// StaticMemoryPlanner.
+//
+// Graphs with parallel branches, such as the towers of Inception, can run
+// them at once instead. With SetCriticalPathScheduling, a step runs the
+// nodes whose inputs are ready on a thread pool of the session, taking the
+// one with the longest path to the sink first, so that the branches the
+// step waits on longest start earliest. The path lengths count every node
+// as one until the execution times of the first steps have been measured;
+// they are kept in the cost model of the session, over
+// GraphOptions::build_cost_model steps if it is set. Such steps are not
+// memory planned.
+//
+// DirectSession always creates local executors, so the static executor comes
+// with a Session of its own, created by NewSession when SessionOptions::target
+// is kStaticSessionTarget. It places the whole graph on the CPU and runs the
+// registered optimization passes and graph optimizations as DirectSession
+// does, but has no partial runs.
+
+#ifndef ORG_TENSORFLOW_JNI_STATIC_EXECUTOR_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_STATIC_EXECUTOR_H_  // NOLINT
+
+#include "tensorflow/core/common_runtime/executor.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/lib/core/status.h"
+
+namespace tensorflow {
+namespace android {
+
+// The SessionOptions::target that selects the static executor.
+static const char kStaticSessionTarget[] = "static";
+
+// Returns an error naming the first control flow node of graph_def, which the
+// static executor cannot run, or OK if there is none.
+Status CheckStaticGraph(const GraphDef& graph_def);
+
+// Creates an executor running graph from a fixed schedule, with the contract
+// of NewLocalExecutor: it takes ownership of graph, even on error, and
+// several threads may run it at once. Fails if graph has control flow.
+Status NewStaticExecutor(const LocalExecutorParams& params, const Graph* graph,
+                         Executor** executor);
+
+// Enables or disables critical path scheduling for static sessions created
+// afterwards. It is disabled by default.
+void SetCriticalPathScheduling(const bool enabled);
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_STATIC_EXECUTOR_H_  // NOLINT
@@ -0,0 +1,274 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Measures the per-step overhead of DirectSession with the local executor
+// against the static executor, on graphs of 100 scalar Adds whose kernels
+// take next to no time: a chain, where each Add reads the previous one, and
+// a fan of independent Adds summed by one AddN. Items processed are the
+// nodes run, so the reported rate is the nodes each executor gets through
+// per second. The static executor is timed with and without its memory
+// planner.
+//
+// Critical path scheduling is measured on three towers of 128x128 MatMuls
+// and Adds, summed by one AddN: one of six MatMuls and two of three MatMuls
+// and three Adds each. Every tower has as many nodes, so only the measured
+// costs tell that the first is the longest. With two nodes running at once
+// and kernels on one thread each, a step takes about six MatMuls if the
+// first tower starts first and nine if it starts last. The static executor
+// runs the towers in schedule order, and by priority once it has measured
+// their costs; DirectSession runs them with one inter-op thread.
+//
+// The sessions are first checked to compute the same outputs, over enough
+// steps for the static one to run from its memory plan, or from measured
+// node costs.
+//
+// Usage:
+//   make -C jni-build kernel-benchmark
+//   jni-build/static_executor_benchmark [regex]
+
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/protobuf/config.pb.h"
+#include "tensorflow/core/public/session.h"
+#include "tensorflow/examples/android/jni/static_executor.h"
+#include "tensorflow/examples/android/jni/static_memory_planner.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+const int kNumNodes = 100;
+const int kTowerSize = 128;
+const int kTowerLength = 6;
+
+enum class Shape { kChain, kFan, kTowers };
+
+Node* Placeholder(Graph* g) {
+  Node* node;
+  TF_CHECK_OK(NodeBuilder(g->NewName("input"), "Placeholder")
+                  .Attr("dtype", DT_FLOAT)
+                  .Finalize(g, &node));
+  return node;
+}
+
+// Returns the last of kNumNodes Adds, each adding the input to the one
+// before.
+Node* Chain(Graph* g, Node* input) {
+  Node* node = input;
+  for (int i = 0; i < kNumNodes; ++i) {
+    node = test::graph::Add(g, node, input);
+  }
+  return node;
+}
+
+// Returns the AddN of kNumNodes - 1 independent Adds of the input to itself.
+Node* Fan(Graph* g, Node* input) {
+  std::vector<Node*> branches;
+  for (int i = 0; i < kNumNodes - 1; ++i) {
+    branches.push_back(test::graph::Add(g, input, input));
+  }
+  return test::graph::Multi(g, "AddN", branches);
+}
+
+// Returns a tower of kTowerLength nodes on the input, the first
+// num_matmuls of which multiply by the input and the rest add it.
+Node* Tower(Graph* g, Node* input, const int num_matmuls) {
+  Node* node = input;
+  for (int i = 0; i < kTowerLength; ++i) {
+    node = i < num_matmuls ? test::graph::Matmul(g, node, input, false, false)
+                           : test::graph::Add(g, node, input);
+  }
+  return node;
+}
+
+// Returns the AddN of a tower of MatMuls and two towers half of MatMuls.
+Node* Towers(Graph* g, Node* input) {
+  return test::graph::Multi(
+      g, "AddN", {Tower(g, input, kTowerLength),
+                  Tower(g, input, kTowerLength / 2),
+                  Tower(g, input, kTowerLength / 2)});
+}
+
+struct BenchmarkGraph {
+  GraphDef graph_def;
+  string input;
+  string output;
+  Tensor input_value;
+  int num_nodes = 0;
+};
+
+Tensor Scalar(const float value) {
+  Tensor tensor(DT_FLOAT, TensorShape({}));
+  tensor.scalar<float>()() = value;
+  return tensor;
+}
+
+BenchmarkGraph MakeGraph(const Shape shape) {
+  Graph g(OpRegistry::Global());
+  Node* input = Placeholder(&g);
+  BenchmarkGraph graph;
+  Node* output;
+  if (shape == Shape::kTowers) {
+    output = Towers(&g, input);
+    graph.input_value = Tensor(DT_FLOAT, TensorShape({kTowerSize, kTowerSize}));
+    // Small enough for six MatMuls not to overflow.
+    graph.input_value.flat<float>().setConstant(1.0f / kTowerSize);
+    graph.num_nodes = 3 * kTowerLength + 1;
+  } else {
+    output = shape == Shape::kFan ? Fan(&g, input) : Chain(&g, input);
+    graph.input_value = Scalar(1.0f);
+    graph.num_nodes = kNumNodes;
+  }
+  g.ToGraphDef(&graph.graph_def);
+  graph.input = input->name();
+  graph.output = output->name();
+  return graph;
+}
+
+std::unique_ptr<Session> CreateSession(const BenchmarkGraph& graph,
+                                       const string& target) {
+  SessionOptions options;
+  options.target = target;
+  // Common subexpression elimination would merge the Adds of the fan.
+  options.config.mutable_graph_options()
+      ->mutable_optimizer_options()
+      ->set_opt_level(OptimizerOptions::L0);
+  // Kernels on one thread each, so that the towers only run in parallel
+  // with each other, two at a time. The intra-op pool is created with the
+  // options of the first session of the process.
+  options.config.set_intra_op_parallelism_threads(1);
+  options.config.set_inter_op_parallelism_threads(1);
+  std::unique_ptr<Session> session(NewSession(options));
+  CHECK(session != nullptr) << "No session for target " << target;
+  TF_CHECK_OK(session->Create(graph.graph_def));
+  return session;
+}
+
+void RunSteps(const int iters, const Shape shape, const string& target,
+              const bool planned, const bool critical_path) {
+  testing::StopTiming();
+  SetStaticMemoryPlanning(planned);
+  SetCriticalPathScheduling(critical_path);
+  const BenchmarkGraph graph = MakeGraph(shape);
+  std::unique_ptr<Session> session = CreateSession(graph, target);
+  const std::vector<std::pair<string, Tensor>> inputs = {
+      {graph.input, graph.input_value}};
+  std::vector<Tensor> outputs;
+  // The first steps create the executor and its memory plan, or measure the
+  // costs of the nodes.
+  for (int i = 0; i < 5; ++i) {
+    TF_CHECK_OK(session->Run(inputs, {graph.output}, {}, &outputs));
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * graph.num_nodes);
+  testing::UseRealTime();
+  testing::StartTiming();
+  for (int i = 0; i < iters; ++i) {
+    TF_CHECK_OK(session->Run(inputs, {graph.output}, {}, &outputs));
+  }
+  testing::StopTiming();
+  TF_CHECK_OK(session->Close());
+  SetCriticalPathScheduling(false);
+}
+
+// Checks that the static executor computes what DirectSession does.
+void VerifyStaticExecutor(const Shape shape, const bool critical_path) {
+  const BenchmarkGraph graph = MakeGraph(shape);
+  TF_CHECK_OK(CheckStaticGraph(graph.graph_def));
+  const std::vector<std::pair<string, Tensor>> inputs = {
+      {graph.input, graph.input_value}};
+  std::vector<Tensor> expected;
+  TF_CHECK_OK(CreateSession(graph, "")->Run(inputs, {graph.output}, {},
+                                            &expected));
+  SetStaticMemoryPlanning(true);
+  SetCriticalPathScheduling(critical_path);
+  std::unique_ptr<Session> session = CreateSession(graph, kStaticSessionTarget);
+  SetCriticalPathScheduling(false);
+  for (int step = 0; step < 6; ++step) {
+    std::vector<Tensor> actual;
+    TF_CHECK_OK(session->Run(inputs, {graph.output}, {}, &actual));
+    CHECK_EQ(expected[0].NumElements(), actual[0].NumElements());
+    const auto expected_values = expected[0].flat<float>();
+    const auto actual_values = actual[0].flat<float>();
+    for (int i = 0; i < expected_values.size(); ++i) {
+      // The same kernels sum in the same order, whatever runs first.
+      CHECK_EQ(expected_values(i), actual_values(i))
+          << "Output " << i << " differs with the static executor at step "
+          << step << (critical_path ? ", scheduled by critical path" : "");
+    }
+  }
+}
+
+}  // namespace
+
+static void BM_ChainLocal(int iters) {
+  RunSteps(iters, Shape::kChain, "", false, false);
+}
+static void BM_ChainStatic(int iters) {
+  RunSteps(iters, Shape::kChain, kStaticSessionTarget, false, false);
+}
+static void BM_ChainStaticPlanned(int iters) {
+  RunSteps(iters, Shape::kChain, kStaticSessionTarget, true, false);
+}
+static void BM_FanLocal(int iters) {
+  RunSteps(iters, Shape::kFan, "", false, false);
+}
+static void BM_FanStatic(int iters) {
+  RunSteps(iters, Shape::kFan, kStaticSessionTarget, false, false);
+}
+static void BM_FanStaticPlanned(int iters) {
+  RunSteps(iters, Shape::kFan, kStaticSessionTarget, true, false);
+}
+static void BM_TowersLocal(int iters) {
+  RunSteps(iters, Shape::kTowers, "", false, false);
+}
+static void BM_TowersStatic(int iters) {
+  RunSteps(iters, Shape::kTowers, kStaticSessionTarget, false, false);
+}
+static void BM_TowersStaticCriticalPath(int iters) {
+  RunSteps(iters, Shape::kTowers, kStaticSessionTarget, false, true);
+}
+BENCHMARK(BM_ChainLocal);
+BENCHMARK(BM_ChainStatic);
+BENCHMARK(BM_ChainStaticPlanned);
+BENCHMARK(BM_FanLocal);
+BENCHMARK(BM_FanStatic);
+BENCHMARK(BM_FanStaticPlanned);
+BENCHMARK(BM_TowersLocal);
+BENCHMARK(BM_TowersStatic);
+BENCHMARK(BM_TowersStaticCriticalPath);
+
+}  // namespace android
+}  // namespace tensorflow
+
+int main(int argc, char** argv) {
+  tensorflow::port::InitMain(argv[0], &argc, &argv);
+  using tensorflow::android::Shape;
+  tensorflow::android::VerifyStaticExecutor(Shape::kChain, false);
+  tensorflow::android::VerifyStaticExecutor(Shape::kFan, false);
+  tensorflow::android::VerifyStaticExecutor(Shape::kTowers, false);
+  tensorflow::android::VerifyStaticExecutor(Shape::kTowers, true);
+  tensorflow::testing::Benchmark::Run(argc > 1 ? argv[1] : "all");
+  return 0;
+}
@@ -0,0 +1,448 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/static_memory_planner.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace android {
+
+// One allocation a kernel made on the thread running a recorded step.
+struct RecordedAllocation {
+  size_t num_bytes;
+  size_t alignment;
+  // The position of the kernel that ran last before it was freed, or -1 if
+  // it was still live at the end of the step.
+  int free_position;
+};
+
+struct StepMemoryRecording {
+  explicit StepMemoryRecording(const int num_positions)
+      : allocations(num_positions), off_thread(num_positions, false) {}
+
+  // The allocations of each kernel, in the order it made them.
+  std::vector<std::vector<RecordedAllocation>> allocations;
+  // Whether each kernel also allocated on other threads, in which case its
+  // allocations may come in a different order every step.
+  std::vector<bool> off_thread;
+};
+
+struct PlannedAllocation {
+  size_t num_bytes;
+  // Where the allocation is in the slab, or -1 if it is not planned.
+  int64 offset;
+};
+
+struct StepMemoryPlan {
+  // The allocations of each kernel, in the order it makes them.
+  std::vector<std::vector<PlannedAllocation>> allocations;
+  size_t slab_bytes = 0;
+};
+
+namespace {
+
+// Planned buffers start on a cache line.
+const size_t kSlabAlignment = 64;
+
+std::atomic<bool> planning_enabled(true);
+
+// The step running on this thread, if any.
+__thread StaticMemoryPlanner::ScopedStep* current_step = nullptr;
+
+size_t RoundUpToSlabAlignment(const size_t num_bytes) {
+  return (num_bytes + kSlabAlignment - 1) / kSlabAlignment * kSlabAlignment;
+}
+
+// An allocation to place, live from the kernel at start to the one at end.
+struct Lifetime {
+  int start;
+  int end;
+  size_t num_bytes;
+  PlannedAllocation* planned;
+};
+
+bool Overlap(const Lifetime& a, const Lifetime& b) {
+  return a.start <= b.end && b.start <= a.end;
+}
+
+// Assigns the offset of every lifetime, largest first, at the start of the
+// smallest gap between the overlapping lifetimes already placed that fits
+// it, or after the last of them. Returns the bytes of the slab.
+size_t PlaceGreedyBySize(std::vector<Lifetime>* lifetimes) {
+  std::sort(lifetimes->begin(), lifetimes->end(),
+            [](const Lifetime& a, const Lifetime& b) {
+              return a.num_bytes != b.num_bytes ? a.num_bytes > b.num_bytes
+                                                : a.start < b.start;
+            });
+  size_t slab_bytes = 0;
+  // The lifetimes placed so far, by offset.
+  std::vector<const Lifetime*> placed;
+  for (Lifetime& lifetime : *lifetimes) {
+    size_t best_offset = 0;
+    size_t best_gap = std::numeric_limits<size_t>::max();
+    size_t gap_start = 0;
+    for (const Lifetime* other : placed) {
+      if (!Overlap(lifetime, *other)) {
+        continue;
+      }
+      const size_t other_offset = other->planned->offset;
+      if (other_offset >= gap_start) {
+        const size_t gap = other_offset - gap_start;
+        if (gap >= lifetime.num_bytes && gap < best_gap) {
+          best_offset = gap_start;
+          best_gap = gap;
+        }
+      }
+      gap_start = std::max(gap_start, other_offset + other->num_bytes);
+    }
+    if (best_gap == std::numeric_limits<size_t>::max()) {
+      best_offset = gap_start;
+    }
+    lifetime.planned->offset = best_offset;
+    slab_bytes = std::max(slab_bytes, best_offset + lifetime.num_bytes);
+    placed.insert(std::upper_bound(placed.begin(), placed.end(), &lifetime,
+                                   [](const Lifetime* a, const Lifetime* b) {
+                                     return a->planned->offset <
+                                            b->planned->offset;
+                                   }),
+                  &lifetime);
+  }
+  return slab_bytes;
+}
+
+// Returns the most bytes live at once among lifetimes.
+int64 PeakBytes(const std::vector<Lifetime>& lifetimes,
+                const int num_positions) {
+  std::vector<int64> live(num_positions + 1, 0);
+  for (const Lifetime& lifetime : lifetimes) {
+    live[lifetime.start] += lifetime.num_bytes;
+    live[lifetime.end + 1] -= lifetime.num_bytes;
+  }
+  int64 bytes = 0;
+  int64 peak = 0;
+  for (int position = 0; position < num_positions; ++position) {
+    bytes += live[position];
+    peak = std::max(peak, bytes);
+  }
+  return peak;
+}
+
+}  // namespace
+
+StaticMemoryPlanner::StaticMemoryPlanner(Allocator* base,
+                                         const int num_positions)
+    : base_(base),
+      num_positions_(num_positions),
+      plan_(nullptr),
+      num_steps_(0),
+      recording_step_(false),
+      recording_position_(-1) {
+  for (Slab& slab : slabs_) {
+    slab.buffer = nullptr;
+    slab.users = 0;
+    slab.in_use = false;
+  }
+}
+
+StaticMemoryPlanner::~StaticMemoryPlanner() {
+  for (Slab& slab : slabs_) {
+    if (slab.buffer != nullptr) {
+      base_->DeallocateRaw(slab.buffer);
+    }
+  }
+  delete plan_.load();
+}
+
+StaticMemoryPlanner::ScopedStep::ScopedStep(StaticMemoryPlanner* planner)
+    : planner_(planner),
+      previous_(current_step),
+      plan_(nullptr),
+      slab_(-1),
+      recording_(false),
+      position_(-1),
+      sequence_(0),
+      mismatch_(false) {
+  current_step = this;
+  if (planner == nullptr) {
+    return;
+  }
+  const StepMemoryPlan* plan = planner->plan_.load(std::memory_order_acquire);
+  if (plan == nullptr) {
+    // The first step lets kernels build whatever they cache, so that the
+    // recorded ones allocate as every later step will.
+    bool expected = false;
+    if (planner->num_steps_.fetch_add(1) > 0 &&
+        planner->recording_step_.compare_exchange_strong(expected, true)) {
+      mutex_lock l(planner->mu_);
+      planner->recording_.reset(
+          new StepMemoryRecording(planner->num_positions_));
+      recording_ = true;
+    }
+    return;
+  }
+  if (plan->slab_bytes == 0) {
+    return;
+  }
+  for (int i = 0; i < kMaxSlabs; ++i) {
+    Slab* const slab = &planner->slabs_[i];
+    bool expected = false;
+    if (!slab->in_use.compare_exchange_strong(expected, true)) {
+      continue;
+    }
+    slab->users = 1;
+    if (slab->buffer.load(std::memory_order_relaxed) == nullptr) {
+      char* const buffer = static_cast<char*>(
+          planner->base_->AllocateRaw(kSlabAlignment, plan->slab_bytes));
+      if (buffer == nullptr) {
+        planner->ReleaseSlab(i);
+        return;
+      }
+      slab->buffer.store(buffer, std::memory_order_release);
+    }
+    slab_ = i;
+    plan_ = plan;
+    return;
+  }
+}
+
+StaticMemoryPlanner::ScopedStep::~ScopedStep() {
+  current_step = previous_;
+  if (slab_ >= 0) {
+    planner_->ReleaseSlab(slab_);
+  }
+  if (recording_) {
+    planner_->FinishRecording(position_ == planner_->num_positions_ - 1);
+  }
+}
+
+void StaticMemoryPlanner::ScopedStep::StartNode(const int position) {
+  position_ = position;
+  sequence_ = 0;
+  mismatch_ = false;
+  if (recording_) {
+    planner_->recording_position_.store(position, std::memory_order_relaxed);
+  }
+}
+
+void* StaticMemoryPlanner::AllocateRaw(size_t alignment, size_t num_bytes) {
+  ScopedStep* const step = current_step;
+  void* ptr = nullptr;
+  if (step != nullptr && step->planner_ == this && step->position_ >= 0) {
+    if (step->plan_ != nullptr) {
+      ptr = AllocatePlanned(step, alignment, num_bytes);
+    } else if (step->recording_) {
+      ptr = AllocateRecorded(step, alignment, num_bytes);
+    }
+  } else if (recording_position_.load(std::memory_order_relaxed) >= 0) {
+    RecordOffThreadAllocation();
+  }
+  if (ptr == nullptr) {
+    ptr = base_->AllocateRaw(alignment, num_bytes);
+  }
+  if (ptr != nullptr) {
+    Ref();
+  }
+  return ptr;
+}
+
+void StaticMemoryPlanner::DeallocateRaw(void* ptr) {
+  const StepMemoryPlan* const plan = plan_.load(std::memory_order_acquire);
+  if (plan != nullptr) {
+    const char* const p = static_cast<const char*>(ptr);
+    for (int i = 0; i < kMaxSlabs; ++i) {
+      const char* const buffer =
+          slabs_[i].buffer.load(std::memory_order_acquire);
+      if (buffer != nullptr && p >= buffer && p < buffer + plan->slab_bytes) {
+        ReleaseSlab(i);
+        Unref();
+        return;
+      }
+    }
+  }
+  if (recording_position_.load(std::memory_order_relaxed) >= 0) {
+    RecordDeallocation(ptr);
+  }
+  base_->DeallocateRaw(ptr);
+  Unref();
+}
+
+void* StaticMemoryPlanner::AllocatePlanned(ScopedStep* step, size_t alignment,
+                                           size_t num_bytes) {
+  const int sequence = step->sequence_++;
+  if (step->mismatch_) {
+    return nullptr;
+  }
+  const std::vector<PlannedAllocation>& allocations =
+      step->plan_->allocations[step->position_];
+  if (sequence >= allocations.size() ||
+      allocations[sequence].num_bytes != num_bytes ||
+      alignment > kSlabAlignment) {
+    step->mismatch_ = true;
+    return nullptr;
+  }
+  if (allocations[sequence].offset < 0) {
+    return nullptr;
+  }
+  Slab* const slab = &slabs_[step->slab_];
+  slab->users.fetch_add(1, std::memory_order_relaxed);
+  return slab->buffer.load(std::memory_order_relaxed) +
+         allocations[sequence].offset;
+}
+
+void StaticMemoryPlanner::ReleaseSlab(const int slab) {
+  if (slabs_[slab].users.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    slabs_[slab].in_use.store(false, std::memory_order_release);
+  }
+}
+
+void* StaticMemoryPlanner::AllocateRecorded(ScopedStep* step, size_t alignment,
+                                            size_t num_bytes) {
+  void* const ptr = base_->AllocateRaw(alignment, num_bytes);
+  if (ptr == nullptr) {
+    return nullptr;
+  }
+  mutex_lock l(mu_);
+  std::vector<RecordedAllocation>* const allocations =
+      &recording_->allocations[step->position_];
+  recorded_allocations_[ptr] =
+      std::make_pair(step->position_, static_cast<int>(allocations->size()));
+  allocations->push_back({num_bytes, alignment, -1});
+  return ptr;
+}
+
+void StaticMemoryPlanner::RecordOffThreadAllocation() {
+  mutex_lock l(mu_);
+  const int position = recording_position_.load(std::memory_order_relaxed);
+  if (recording_ != nullptr && position >= 0) {
+    recording_->off_thread[position] = true;
+  }
+}
+
+void StaticMemoryPlanner::RecordDeallocation(void* ptr) {
+  mutex_lock l(mu_);
+  auto it = recorded_allocations_.find(ptr);
+  if (it == recorded_allocations_.end()) {
+    return;
+  }
+  recording_->allocations[it->second.first][it->second.second].free_position =
+      recording_position_.load(std::memory_order_relaxed);
+  recorded_allocations_.erase(it);
+}
+
+void StaticMemoryPlanner::FinishRecording(const bool complete) {
+  mutex_lock l(mu_);
+  // Anything freed from now on outlives the step.
+  recording_position_.store(-1, std::memory_order_relaxed);
+  recorded_allocations_.clear();
+  // A failed step is recorded again.
+  if (complete) {
+    recordings_.push_back(std::move(recording_));
+  }
+  recording_.reset();
+  if (recordings_.size() < 2) {
+    recording_step_ = false;
+    return;
+  }
+  PlanLocked();
+  recordings_.clear();
+}
+
+void StaticMemoryPlanner::PlanLocked() {
+  const StepMemoryRecording& first = *recordings_[0];
+  const StepMemoryRecording& second = *recordings_[1];
+  StepMemoryPlan* const plan = new StepMemoryPlan;
+  plan->allocations.resize(num_positions_);
+
+  std::vector<Lifetime> planned;
+  std::vector<Lifetime> unplanned;
+  int num_allocations = 0;
+  for (int position = 0; position < num_positions_; ++position) {
+    const std::vector<RecordedAllocation>& a = first.allocations[position];
+    const std::vector<RecordedAllocation>& b = second.allocations[position];
+    bool same = !first.off_thread[position] &&
+                !second.off_thread[position] && a.size() == b.size();
+    for (int i = 0; same && i < a.size(); ++i) {
+      same = a[i].num_bytes == b[i].num_bytes &&
+             a[i].alignment == b[i].alignment;
+    }
+    std::vector<PlannedAllocation>* const allocations =
+        &plan->allocations[position];
+    for (int i = 0; i < b.size(); ++i) {
+      allocations->push_back({b[i].num_bytes, -1});
+    }
+    num_allocations += b.size();
+    for (int i = 0; i < b.size(); ++i) {
+      Lifetime lifetime;
+      lifetime.start = position;
+      lifetime.end = b[i].free_position >= 0
+                         ? std::max(b[i].free_position, position)
+                         : num_positions_ - 1;
+      lifetime.num_bytes = b[i].num_bytes;
+      lifetime.planned = &(*allocations)[i];
+      if (same && a[i].free_position >= 0 && b[i].free_position >= 0 &&
+          b[i].alignment <= kSlabAlignment) {
+        lifetime.end = std::max(lifetime.end, a[i].free_position);
+        lifetime.num_bytes = RoundUpToSlabAlignment(b[i].num_bytes);
+        planned.push_back(lifetime);
+      } else {
+        unplanned.push_back(lifetime);
+      }
+    }
+  }
+
+  const int64 planned_peak = PeakBytes(planned, num_positions_);
+  const int64 unplanned_peak = PeakBytes(unplanned, num_positions_);
+  std::vector<Lifetime> all(planned);
+  all.insert(all.end(), unplanned.begin(), unplanned.end());
+  const int64 observed_peak = PeakBytes(all, num_positions_);
+  plan->slab_bytes = PlaceGreedyBySize(&planned);
+
+  AllocatorStats stats;
+  base_->GetStats(&stats);
+  LOG(INFO) << "Planned " << planned.size() << " of " << num_allocations
+            << " step allocations into a "
+            << strings::HumanReadableNumBytes(plan->slab_bytes)
+            << " slab, against a peak of "
+            << strings::HumanReadableNumBytes(planned_peak)
+            << " live at once. Step peak "
+            << strings::HumanReadableNumBytes(plan->slab_bytes +
+                                              unplanned_peak)
+            << " planned, "
+            << strings::HumanReadableNumBytes(observed_peak)
+            << " observed in schedule order"
+            << (stats.max_bytes_in_use > 0
+                    ? ", CPU allocator peak " +
+                          strings::HumanReadableNumBytes(
+                              stats.max_bytes_in_use)
+                    : "")
+            << ".";
+  plan_.store(plan, std::memory_order_release);
+}
+
+void SetStaticMemoryPlanning(const bool enabled) {
+  planning_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool StaticMemoryPlanningEnabled() {
+  return planning_enabled.load(std::memory_order_relaxed);
+}
+
+}  // namespace android
+}  // namespace tensorflow
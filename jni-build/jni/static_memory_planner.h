@@ -0,0 +1,160 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Places the intermediate tensors of the steps of a static executor in one
+// preallocated slab. Otherwise every output and temporary of every kernel is
+// allocated from the CPU allocator under its lock and freed as the last
+// reference to it drops, and the peak depends on the order those happen in.
+//
+// The schedule of a static executor is fixed, and so for a fixed-shape
+// inference graph is every allocation of a step: which kernel makes it, in
+// what order, of what size, and after which kernel the last reference to it
+// drops. The planner records this over two steps, after a first one that
+// lets kernels build their caches, and keeps the allocations both agree on
+// and that are freed within the step. Their lifetimes are intervals of
+// schedule positions, and they are placed in the slab greedily by size: the
+// largest first, each at the lowest offset in the smallest gap left by the
+// allocations placed so far whose lifetimes overlap its own. Later steps are
+// handed those buffers from a slab of their own, without any lock, and
+// everything else, such as fetched outputs and allocations made off the
+// thread running the step, comes from the CPU allocator as before. An
+// allocation that does not match the plan, e.g. after a feed changes shape,
+// is served from the CPU allocator too.
+
+#ifndef ORG_TENSORFLOW_JNI_STATIC_MEMORY_PLANNER_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_STATIC_MEMORY_PLANNER_H_  // NOLINT
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/lib/core/refcount.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace android {
+
+struct StepMemoryPlan;
+struct StepMemoryRecording;
+
+// The allocator the kernels of a static executor allocate from. Every
+// allocation holds a reference to it, so that tensors outliving the
+// executor can still be freed.
+class StaticMemoryPlanner : public Allocator, public core::RefCounted {
+ public:
+  // Plans a schedule of num_positions kernels, allocating the slabs and
+  // everything left unplanned from base.
+  StaticMemoryPlanner(Allocator* base, const int num_positions);
+
+  // Makes planner serve the allocations of one step made on the calling
+  // thread, for as long as it is in scope. Does nothing if planner is null.
+  class ScopedStep {
+   public:
+    explicit ScopedStep(StaticMemoryPlanner* planner);
+    ~ScopedStep();
+
+    // Called before the kernel at position of the schedule runs.
+    void StartNode(const int position);
+
+   private:
+    friend class StaticMemoryPlanner;
+
+    StaticMemoryPlanner* const planner_;
+    ScopedStep* const previous_;
+    // At most one of these is set.
+    const StepMemoryPlan* plan_;
+    int slab_;
+    bool recording_;
+    int position_;
+    // The allocations made so far by the kernel at position_.
+    int sequence_;
+    // Set once an allocation of the kernel differs from the plan, after
+    // which none of its allocations are served from the slab.
+    bool mismatch_;
+
+    TF_DISALLOW_COPY_AND_ASSIGN(ScopedStep);
+  };
+
+  string Name() override { return "static_memory_planner"; }
+  void* AllocateRaw(size_t alignment, size_t num_bytes) override;
+  void DeallocateRaw(void* ptr) override;
+  void GetStats(AllocatorStats* stats) override { base_->GetStats(stats); }
+
+ private:
+  // Enough for the threads an app runs the same model on at once; further
+  // concurrent steps allocate from base_.
+  static const int kMaxSlabs = 4;
+
+  struct Slab {
+    // Written once, by the first step using the slab.
+    std::atomic<char*> buffer;
+    // One for the step using the slab, plus one per allocation it served
+    // that is still live. The slab is free for another step at zero.
+    std::atomic<int> users;
+    std::atomic<bool> in_use;
+  };
+
+  ~StaticMemoryPlanner() override;
+
+  // Returns the buffer of the plan for the allocation step is making, or
+  // nullptr if the plan has none.
+  void* AllocatePlanned(ScopedStep* step, size_t alignment, size_t num_bytes);
+  void ReleaseSlab(const int slab);
+  void* AllocateRecorded(ScopedStep* step, size_t alignment, size_t num_bytes);
+  void RecordOffThreadAllocation();
+  void RecordDeallocation(void* ptr);
+  void FinishRecording(const bool complete);
+  void PlanLocked() EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  Allocator* const base_;
+  const int num_positions_;
+  // Set once, after the recorded steps.
+  std::atomic<const StepMemoryPlan*> plan_;
+  Slab slabs_[kMaxSlabs];
+
+  // Steps started before the plan was made, the first of which is not
+  // recorded.
+  std::atomic<int64> num_steps_;
+  // Set while a step is recorded, and for good once the plan is made.
+  std::atomic<bool> recording_step_;
+  // The position of the step being recorded, or -1 if none is.
+  std::atomic<int> recording_position_;
+  mutex mu_;
+  std::unique_ptr<StepMemoryRecording> recording_ GUARDED_BY(mu_);
+  std::vector<std::unique_ptr<StepMemoryRecording>> recordings_
+      GUARDED_BY(mu_);
+  // The position and sequence number of each recorded allocation still live.
+  std::unordered_map<void*, std::pair<int, int>> recorded_allocations_
+      GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(StaticMemoryPlanner);
+};
+
+// Enables or disables memory planning for static executors created
+// afterwards. It is enabled by default.
+void SetStaticMemoryPlanning(const bool enabled);
+
+// Returns whether static executors created now plan their memory.
+bool StaticMemoryPlanningEnabled();
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_STATIC_MEMORY_PLANNER_H_  // NOLINT
@@ -0,0 +1,182 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/step_stats_profiler.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <sstream>
+
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// Nodes listed in the summary by decreasing time spent in them.
+const int kSummaryTopNodes = 20;
+
+}  // namespace
+
+// The traces taken out of the ring by a flush, written by the flush thread.
+struct StepStatsProfiler::FlushJob {
+  string directory;
+  std::vector<StepStats> traces;
+  int64 first_trace_number = 0;
+  string summary;
+};
+
+StepStatsProfiler::StepStatsProfiler(const GraphDef& graph_def)
+    : graph_def_(graph_def),
+      sample_interval_(0),
+      num_runs_(0),
+      ring_size_(0),
+      ring_start_(0),
+      next_trace_number_(0),
+      summarizer_(new StatSummarizer(graph_def_)) {}
+
+StepStatsProfiler::~StepStatsProfiler() {
+  mutex_lock l(flush_mu_);
+  flush_thread_.reset();
+}
+
+void StepStatsProfiler::Configure(const int sample_interval,
+                                  const int ring_capacity) {
+  mutex_lock l(mu_);
+  sample_interval_ = std::max(0, sample_interval);
+  num_runs_ = 0;
+  ring_.clear();
+  ring_.resize(sample_interval_ > 0 ? std::max(1, ring_capacity) : 0);
+  ring_size_ = 0;
+  ring_start_ = 0;
+  summarizer_.reset(new StatSummarizer(graph_def_));
+  frequency_start_.Reset();
+  frequency_end_.Reset();
+  LOG(INFO) << "Step stats profiling "
+            << (sample_interval_ > 0 ? "enabled" : "disabled")
+            << ", sample interval " << sample_interval_ << ", ring capacity "
+            << ring_.size();
+}
+
+bool StepStatsProfiler::ShouldTrace() {
+  mutex_lock l(mu_);
+  if (sample_interval_ <= 0) {
+    return false;
+  }
+  return num_runs_++ % sample_interval_ == 0;
+}
+
+void StepStatsProfiler::Record(StepStats* const stats,
+                               const int64 frequency_start_khz,
+                               const int64 frequency_end_khz) {
+  mutex_lock l(mu_);
+  if (ring_.empty()) {
+    // Profiling was disabled while the run was being traced.
+    return;
+  }
+  summarizer_->ProcessStepStats(*stats);
+  frequency_start_.UpdateStat(frequency_start_khz);
+  frequency_end_.UpdateStat(frequency_end_khz);
+
+  const int capacity = ring_.size();
+  if (ring_size_ < capacity) {
+    ring_[(ring_start_ + ring_size_++) % capacity].Swap(stats);
+  } else {
+    // Overwrite the oldest trace.
+    ring_[ring_start_].Swap(stats);
+    ring_start_ = (ring_start_ + 1) % capacity;
+  }
+  ++next_trace_number_;
+}
+
+int StepStatsProfiler::Flush(const string& directory) {
+  std::shared_ptr<FlushJob> job(new FlushJob);
+  job->directory = directory;
+  {
+    mutex_lock l(mu_);
+    // The traces are moved out of the ring rather than copied, so runs are
+    // held up for as short as possible.
+    const int capacity = ring_.size();
+    job->traces.resize(ring_size_);
+    for (int i = 0; i < ring_size_; ++i) {
+      job->traces[i].Swap(&ring_[(ring_start_ + i) % capacity]);
+    }
+    job->first_trace_number = next_trace_number_ - ring_size_;
+    job->summary = GetSummaryLocked();
+    ring_size_ = 0;
+    ring_start_ = 0;
+  }
+
+  mutex_lock l(flush_mu_);
+  // Joins the previous flush thread.
+  flush_thread_.reset();
+  flush_thread_.reset(Env::Default()->StartThread(
+      ThreadOptions(), "step_stats_flush", [job]() { WriteFlushJob(*job); }));
+  return job->traces.size();
+}
+
+void StepStatsProfiler::WriteFlushJob(const FlushJob& job) {
+  Env* const env = Env::Default();
+  const Status dir_status = env->CreateDir(job.directory);
+  if (!dir_status.ok() && !env->IsDirectory(job.directory).ok()) {
+    LOG(ERROR) << "Could not create " << job.directory << ": " << dir_status;
+    return;
+  }
+
+  const int kMaxFilenameLength = 32;
+  char filename[kMaxFilenameLength];
+  for (int i = 0; i < job.traces.size(); ++i) {
+    snprintf(filename, kMaxFilenameLength, "stepstats%05lld.pb",
+             static_cast<long long>(job.first_trace_number + i));
+    const string path = io::JoinPath(job.directory, filename);
+    const Status s =
+        WriteStringToFile(env, path, job.traces[i].SerializeAsString());
+    if (!s.ok()) {
+      LOG(ERROR) << "Could not write " << path << ": " << s;
+      return;
+    }
+  }
+
+  const string summary_path = io::JoinPath(job.directory, "summary.txt");
+  const Status s = WriteStringToFile(env, summary_path, job.summary);
+  if (!s.ok()) {
+    LOG(ERROR) << "Could not write " << summary_path << ": " << s;
+    return;
+  }
+  LOG(INFO) << "Flushed " << job.traces.size() << " step stats to "
+            << job.directory;
+}
+
+string StepStatsProfiler::GetSummary() {
+  mutex_lock l(mu_);
+  return GetSummaryLocked();
+}
+
+string StepStatsProfiler::GetSummaryLocked() {
+  std::stringstream stream;
+  stream << "Traced runs: " << summarizer_->num_runs() << ", one in "
+         << sample_interval_ << std::endl;
+  stream << "Run time (us): " << summarizer_->run_total_us() << std::endl;
+  stream << "CPU frequency start (kHz): " << frequency_start_ << std::endl;
+  stream << "CPU frequency end (kHz):   " << frequency_end_ << std::endl;
+  stream << summarizer_->GetStatsByTopDurations(1.0, kSummaryTopNodes);
+  stream << summarizer_->GetStatsByRunOrder();
+  return stream.str();
+}
+
+}  // namespace android
+}  // namespace tensorflow
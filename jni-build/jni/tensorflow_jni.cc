@@ -20,356 +20,649 @@ limitations under the License.
 #include <android/bitmap.h>
 
 #include <jni.h>
-#include <pthread.h>
-#include <sys/stat.h>
-#include <unistd.h>
-#include <queue>
-#include <sstream>
+#include <sys/time.h>
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <vector>
 
-#include "tensorflow/core/framework/step_stats.pb.h"
-#include "tensorflow/core/framework/tensor.h"
-#include "tensorflow/core/framework/types.pb.h"
-#include "tensorflow/core/lib/strings/stringprintf.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/types.h"
-#include "tensorflow/core/public/session.h"
-#include "tensorflow/core/util/stat_summarizer.h"
+#include "tensorflow/examples/android/jni/detector_engine.h"
+#include "tensorflow/examples/android/jni/frame_recorder.h"
 #include "tensorflow/examples/android/jni/jni_utils.h"
+#include "tensorflow/examples/android/jni/memmapped_package.h"
+#include "tensorflow/examples/android/jni/non_max_suppression.h"
+#include "tensorflow/examples/android/jni/object_tracker.h"
+#include "tensorflow/examples/android/jni/session_threading.h"
+#include "tensorflow/examples/android/jni/yuv_preprocessor.h"
 
 using namespace tensorflow;
 
-// Global variables that holds the TensorFlow classifier.
-static std::unique_ptr<tensorflow::Session> session;
+namespace {
 
-static std::vector<std::string> g_label_strings;
-static bool g_compute_graph_initialized = false;
-// static mutex g_compute_graph_mutex(base::LINKER_INITIALIZED);
+// Most objects trackYuvFrameDirect reports for a frame.
+const int kMaxTrackedObjects = 32;
+
+// A model loaded by initializeTensorFlow. Java holds a pointer to it as an
+// opaque handle.
+struct NativeDetector {
+  std::unique_ptr<android::DetectorEngine> engine;
+  std::vector<std::string> labels;
+
+  // Where the pipeline delivers its results. Set under pipeline_mutex while
+  // the pipeline is stopped, and only read by its worker thread otherwise.
+  mutex pipeline_mutex;
+  JavaVM* java_vm = nullptr;
+  jobject listener = nullptr;
+  jmethodID callback = nullptr;
+  jobject output_buffer = nullptr;
+  float* output = nullptr;
+
+  // The pipeline worker thread, once attached to the Java VM.
+  JNIEnv* worker_env = nullptr;
+};
+
+NativeDetector* FromHandle(const jlong handle) {
+  CHECK_NE(handle, 0) << "TensorFlow has not been initialized.";
+  return reinterpret_cast<NativeDetector*>(handle);
+}
 
-static int g_tensorflow_input_size;  // The image size for the model input.
-static int g_image_mean;             // The image mean.
-static float g_image_std;            // The scale value for the input image.
-static std::unique_ptr<std::string> g_input_name;
-static std::unique_ptr<std::string> g_output_name;
-static std::unique_ptr<StatSummarizer> g_stats;
+android::DetectorEngine* GetEngine(const jlong handle) {
+  return FromHandle(handle)->engine.get();
+}
 
-// For basic benchmarking.
-static int g_num_runs = 0;
-static int64 g_timing_total_us = 0;
-static Stat<int64> g_frequency_start;
-static Stat<int64> g_frequency_end;
+inline int64 CurrentThreadTimeUs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000 + tv.tv_usec;
+}
 
-#ifdef LOG_DETAILED_STATS
-static const bool kLogDetailedStats = true;
-#else
-static const bool kLogDetailedStats = false;
-#endif
+// Fills in the geometry of a YUV 4:2:0 frame whose planes are set by the
+// caller.
+android::YUV420Frame MakeYuvFrame(const int width, const int height,
+                                  const int y_row_stride,
+                                  const int uv_row_stride,
+                                  const int uv_pixel_stride) {
+  android::YUV420Frame frame;
+  frame.y = nullptr;
+  frame.u = nullptr;
+  frame.v = nullptr;
+  frame.width = width;
+  frame.height = height;
+  frame.y_row_stride = y_row_stride;
+  frame.uv_row_stride = uv_row_stride;
+  frame.uv_pixel_stride = uv_pixel_stride;
+  return frame;
+}
 
-// Improve benchmarking by limiting runs to predefined amount.
-// 0 (default) denotes infinite runs.
-#ifndef MAX_NUM_RUNS
-#define MAX_NUM_RUNS 0
-#endif
+// Points frame at the planes of the given direct ByteBuffers.
+void SetDirectPlanes(JNIEnv* env, jobject y, jobject u, jobject v,
+                     android::YUV420Frame* const frame) {
+  frame->y = static_cast<const uint8*>(
+      GetDirectBufferAddressChecked(env, y, frame->YPlaneSize()));
+  frame->u = static_cast<const uint8*>(
+      GetDirectBufferAddressChecked(env, u, frame->UVPlaneSize()));
+  frame->v = static_cast<const uint8*>(
+      GetDirectBufferAddressChecked(env, v, frame->UVPlaneSize()));
+}
 
-#ifdef SAVE_STEP_STATS
-static const bool kSaveStepStats = true;
-#else
-static const bool kSaveStepStats = false;
-#endif
+// Locks the pixels of an RGBA_8888 bitmap for the lifetime of the object.
+class ScopedBitmapPixels {
+ public:
+  ScopedBitmapPixels(JNIEnv* env, jobject bitmap)
+      : env_(env), bitmap_(bitmap) {
+    AndroidBitmapInfo info;
+    CHECK_EQ(AndroidBitmap_getInfo(env_, bitmap_, &info),
+             ANDROID_BITMAP_RESULT_SUCCESS);
+    VLOG(1) << "Image dimensions: " << info.width << "x" << info.height
+            << " stride: " << info.stride;
+    // TODO(andrewharp): deal with other formats if necessary.
+    if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+      LOG(FATAL) << "Only RGBA_8888 Bitmaps are supported.";
+    }
+    CHECK_EQ(AndroidBitmap_lockPixels(env_, bitmap_, &pixels_),
+             ANDROID_BITMAP_RESULT_SUCCESS);
+  }
 
-inline static int64 CurrentThreadTimeUs() {
-  struct timeval tv;
-  gettimeofday(&tv, NULL);
-  return tv.tv_sec * 1000000 + tv.tv_usec;
+  ~ScopedBitmapPixels() {
+    CHECK_EQ(AndroidBitmap_unlockPixels(env_, bitmap_),
+             ANDROID_BITMAP_RESULT_SUCCESS);
+  }
+
+  const android::RGBA* pixels() const {
+    return static_cast<const android::RGBA*>(pixels_);
+  }
+
+ private:
+  JNIEnv* const env_;
+  const jobject bitmap_;
+  void* pixels_;
+};
+
+// Runs fn with the elements of a Java float array and writes them back.
+template <typename Fn>
+int WithFloatArray(JNIEnv* env, jfloatArray array, const Fn& fn) {
+  jfloat* const elements = env->GetFloatArrayElements(array, nullptr);
+  const int result = fn(elements, env->GetArrayLength(array));
+  env->ReleaseFloatArrayElements(array, elements, 0);
+  return result;
 }
 
-JNIEXPORT jint JNICALL TENSORFLOW_METHOD(initializeTensorFlow)(
-    JNIEnv* env, jobject thiz, jobject java_asset_manager, jstring model,
-    jstring labels, jint num_classes, jint model_input_size, jint image_mean,
-    jfloat image_std, jstring input_name, jstring output_name) {
-  g_num_runs = 0;
-  g_timing_total_us = 0;
-  g_frequency_start.Reset();
-  g_frequency_end.Reset();
-
-  // MutexLock input_lock(&g_compute_graph_mutex);
-  if (g_compute_graph_initialized) {
-    LOG(INFO) << "Compute graph already loaded. skipping.";
+// Returns count if a run of the model succeeded. A failed run, e.g. on a
+// model the session cannot execute, is logged and returns an empty result
+// rather than taking down the app.
+int CountOrEmpty(const Status& s, const int count) {
+  if (!s.ok()) {
+    LOG(ERROR) << "Error during inference: " << s;
     return 0;
   }
+  return count;
+}
 
-  const int64 start_time = CurrentThreadTimeUs();
+// Classifies an image into a Java array, which must hold every candidate.
+int ClassifyToJava(JNIEnv* env, android::DetectorEngine* const engine,
+                   const android::RGBA* const pixels, jfloatArray output) {
+  const android::YoloGridConfig& grid = engine->config().grid;
+  return WithFloatArray(
+      env, output, [engine, pixels, &grid](float* const out,
+                                           const int length) {
+        CHECK_GE(length, grid.NumCandidates() * grid.CandidateStride());
+        int num_candidates = 0;
+        const Status s = engine->Classify(pixels, out, &num_candidates);
+        return CountOrEmpty(s, num_candidates);
+      });
+}
 
-  const char* const model_cstr = env->GetStringUTFChars(model, NULL);
-  const char* const labels_cstr = env->GetStringUTFChars(labels, NULL);
+// Stops the pipeline of the detector, waiting for the frame being run, and
+// drops the references it held. Requires detector->pipeline_mutex.
+void StopPipeline(JNIEnv* env, NativeDetector* const detector) {
+  detector->engine->StopPipeline();
+  if (detector->listener != nullptr) {
+    env->DeleteGlobalRef(detector->listener);
+    env->DeleteGlobalRef(detector->output_buffer);
+  }
+  detector->listener = nullptr;
+  detector->output_buffer = nullptr;
+  detector->output = nullptr;
+}
 
-  g_tensorflow_input_size = model_input_size;
-  g_image_mean = image_mean;
-  g_image_std = image_std;
-  g_input_name.reset(new std::string(env->GetStringUTFChars(input_name, NULL)));
-  g_output_name.reset(
-      new std::string(env->GetStringUTFChars(output_name, NULL)));
+// Runs on the pipeline worker thread for every frame that is not dropped.
+void DeliverPipelineResult(NativeDetector* const detector,
+                           const int64 frame_id, const float* const detections,
+                           const int num_detections) {
+  if (detector->worker_env == nullptr) {
+    CHECK_EQ(detector->java_vm->AttachCurrentThread(&detector->worker_env,
+                                                    nullptr),
+             JNI_OK);
+  }
+  std::copy_n(detections, num_detections * android::kDetectionStride,
+              detector->output);
+
+  // The output buffer is only rewritten once the callback has returned.
+  JNIEnv* const env = detector->worker_env;
+  env->CallVoidMethod(detector->listener, detector->callback,
+                      static_cast<jlong>(frame_id),
+                      static_cast<jint>(num_detections));
+  if (env->ExceptionCheck()) {
+    env->ExceptionDescribe();
+    env->ExceptionClear();
+  }
+}
 
-  LOG(INFO) << "Loading TensorFlow.";
+// Reads a model from the assets, either a memmapped package, whose weights
+// are then served from package, or a plain GraphDef with the weights inline.
+// Returns NotFound if there is no such asset.
+Status LoadModel(AAssetManager* const asset_manager, const char* const model,
+                 tensorflow::GraphDef* const graph,
+                 std::unique_ptr<android::MemmappedPackage>* const package) {
+  // Map reports both a missing file and a plain GraphDef as NotFound.
+  if (!FileExists(asset_manager, model)) {
+    return errors::NotFound("Model not found: ", model);
+  }
+  Status s = android::MemmappedPackage::Map(asset_manager, model, package);
+  if (s.ok()) {
+    LOG(INFO) << "Mapped " << ((*package)->size() >> 20)
+              << "MB memmapped package: " << model;
+    return (*package)->ReadGraphDef(graph);
+  }
+  VLOG(1) << s;
+  LOG(INFO) << "Reading file to proto: " << model;
+  ReadFileToProto(asset_manager, model, graph);
+  return Status::OK();
+}
+
+void DetachPipelineWorker(NativeDetector* const detector) {
+  if (detector->worker_env != nullptr) {
+    detector->java_vm->DetachCurrentThread();
+    detector->worker_env = nullptr;
+  }
+}
+
+}  // namespace
+
+JNIEXPORT jboolean JNICALL TENSORFLOW_METHOD(hasQuantizedKernels)(
+    JNIEnv* env, jclass clazz) {
+#ifdef ENABLE_QUANTIZED_OPS
+  return JNI_TRUE;
+#else
+  return JNI_FALSE;
+#endif  // ENABLE_QUANTIZED_OPS
+}
 
-  LOG(INFO) << "Making new SessionOptions.";
-  tensorflow::SessionOptions options;
-  tensorflow::ConfigProto& config = options.config;
-  LOG(INFO) << "Got config, " << config.device_count_size() << " devices";
+JNIEXPORT jlong JNICALL TENSORFLOW_METHOD(initializeTensorFlow)(
+    JNIEnv* env, jobject thiz, jobject java_asset_manager, jstring model,
+    jstring labels, jint num_classes, jint model_input_size, jint image_mean,
+    jfloat image_std, jstring input_name, jstring output_name, jint grid_size,
+    jint boxes_per_cell, jint intra_op_threads, jint inter_op_threads,
+    jboolean use_per_session_threads, jlong cpu_affinity_mask) {
+  const int64 start_time = CurrentThreadTimeUs();
 
-  session.reset(tensorflow::NewSession(options));
-  LOG(INFO) << "Session created.";
+  const char* const model_cstr = env->GetStringUTFChars(model, NULL);
+  const char* const labels_cstr = env->GetStringUTFChars(labels, NULL);
+  const char* const input_name_cstr = env->GetStringUTFChars(input_name, NULL);
+  const char* const output_name_cstr =
+      env->GetStringUTFChars(output_name, NULL);
+
+  android::DetectorConfig config;
+  config.input_size = model_input_size;
+  config.image_mean = image_mean;
+  config.image_std = image_std;
+  config.input_name = input_name_cstr;
+  config.output_name = output_name_cstr;
+  config.grid.grid_size = grid_size;
+  config.grid.boxes_per_cell = boxes_per_cell;
+  config.grid.num_classes = num_classes;
+  config.threading.intra_op_threads = intra_op_threads;
+  config.threading.inter_op_threads = inter_op_threads;
+  config.threading.use_per_session_threads = use_per_session_threads;
+  config.threading.cpu_affinity_mask = static_cast<uint64>(cpu_affinity_mask);
+  android::ApplyThreadingOverrides(&config.threading);
+  env->ReleaseStringUTFChars(input_name, input_name_cstr);
+  env->ReleaseStringUTFChars(output_name, output_name_cstr);
 
-  tensorflow::GraphDef tensorflow_graph;
-  LOG(INFO) << "Graph created.";
+  LOG(INFO) << "Loading TensorFlow.";
 
   AAssetManager* const asset_manager =
       AAssetManager_fromJava(env, java_asset_manager);
   LOG(INFO) << "Acquired AssetManager.";
 
-  LOG(INFO) << "Reading file to proto: " << model_cstr;
-  ReadFileToProto(asset_manager, model_cstr, &tensorflow_graph);
-
-  g_stats.reset(new StatSummarizer(tensorflow_graph));
-
-  LOG(INFO) << "Creating session.";
-  tensorflow::Status s = session->Create(tensorflow_graph);
-  if (!s.ok()) {
-    LOG(FATAL) << "Could not create TensorFlow Graph: " << s;
+  std::unique_ptr<NativeDetector> detector(new NativeDetector);
+  {
+    tensorflow::GraphDef tensorflow_graph;
+    std::unique_ptr<android::MemmappedPackage> package;
+    // If the model is missing, the caller may fall back to another one, e.g.
+    // the float one when an eight bit one has not been generated.
+    Status s = LoadModel(asset_manager, model_cstr, &tensorflow_graph,
+                         &package);
+
+    // The graph goes out of scope once the session holds it, to save memory.
+    if (s.ok()) {
+      s = android::DetectorEngine::Create(tensorflow_graph, config,
+                                          std::move(package),
+                                          &detector->engine);
+    }
+    if (!s.ok()) {
+      LOG(ERROR) << "Could not create TensorFlow Graph from " << model_cstr
+                 << ": " << s;
+      env->ReleaseStringUTFChars(model, model_cstr);
+      env->ReleaseStringUTFChars(labels, labels_cstr);
+      return 0;
+    }
   }
-
-  // Clear the proto to save memory space.
-  tensorflow_graph.Clear();
   LOG(INFO) << "TensorFlow graph loaded from: " << model_cstr;
 
   // Read the label list
-  ReadFileToVector(asset_manager, labels_cstr, &g_label_strings);
-  LOG(INFO) << g_label_strings.size()
+  ReadFileToVector(asset_manager, labels_cstr, &detector->labels);
+  LOG(INFO) << detector->labels.size()
             << " label strings loaded from: " << labels_cstr;
-  g_compute_graph_initialized = true;
+
+  env->ReleaseStringUTFChars(model, model_cstr);
+  env->ReleaseStringUTFChars(labels, labels_cstr);
 
   const int64 end_time = CurrentThreadTimeUs();
   LOG(INFO) << "Initialization done in " << (end_time - start_time) / 1000
             << "ms";
 
-  return 0;
+  return reinterpret_cast<jlong>(detector.release());
 }
 
-namespace {
-typedef struct {
-  uint8 red;
-  uint8 green;
-  uint8 blue;
-  uint8 alpha;
-} RGBA;
-}  // namespace
+JNIEXPORT jboolean JNICALL TENSORFLOW_METHOD(addModelVariant)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject java_asset_manager,
+    jstring model, jint model_input_size, jint grid_size,
+    jint boxes_per_cell) {
+  android::DetectorEngine* const engine = GetEngine(handle);
+  android::YoloGridConfig grid = engine->config().grid;
+  grid.grid_size = grid_size;
+  grid.boxes_per_cell = boxes_per_cell;
 
-// Returns the top N confidence values over threshold in the provided vector,
-// sorted by confidence in descending order.
-static void GetTopN(
-    const Eigen::TensorMap<Eigen::Tensor<float, 1, Eigen::RowMajor>,
-                           Eigen::Aligned>& prediction,
-    const int num_results, const float threshold,
-    std::vector<std::pair<float, int> >* top_results) {
-  // Will contain top N results in ascending order.
-  std::priority_queue<std::pair<float, int>,
-                      std::vector<std::pair<float, int> >,
-                      std::greater<std::pair<float, int> > >
-      top_result_pq;
-
-  const int count = prediction.size();
-  for (int i = 0; i < count; ++i) {
-    const float value = prediction(i);
-
-    // Only add it if it beats the threshold and has a chance at being in
-    // the top N.
-    if (value < threshold) {
-      continue;
+  AAssetManager* const asset_manager =
+      AAssetManager_fromJava(env, java_asset_manager);
+  const char* const model_cstr = env->GetStringUTFChars(model, NULL);
+  Status s;
+  {
+    tensorflow::GraphDef tensorflow_graph;
+    std::unique_ptr<android::MemmappedPackage> package;
+    s = LoadModel(asset_manager, model_cstr, &tensorflow_graph, &package);
+    if (s.ok()) {
+      s = engine->AddVariant(tensorflow_graph, model_input_size, grid,
+                             std::move(package));
     }
+  }
+  if (s.ok()) {
+    LOG(INFO) << "Model variant loaded from: " << model_cstr;
+  } else {
+    LOG(ERROR) << "Could not add model variant " << model_cstr << ": " << s;
+  }
+  env->ReleaseStringUTFChars(model, model_cstr);
+  return s.ok() ? JNI_TRUE : JNI_FALSE;
+}
 
-    top_result_pq.push(std::pair<float, int>(value, i));
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(setLatencyTarget)(
+    JNIEnv* env, jobject thiz, jlong handle, jint target_ms) {
+  GetEngine(handle)->SetLatencyTarget(static_cast<int64>(target_ms) * 1000);
+}
 
-    // If at capacity, kick the smallest value out.
-    if (top_result_pq.size() > num_results) {
-      top_result_pq.pop();
-    }
-  }
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(getActiveInputSize)(JNIEnv* env,
+                                                             jobject thiz,
+                                                             jlong handle) {
+  return GetEngine(handle)->ActiveInputSize();
+}
 
-  // Copy to output vector and reverse into descending order.
-  while (!top_result_pq.empty()) {
-    top_results->push_back(top_result_pq.top());
-    top_result_pq.pop();
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(releaseTensorFlow)(JNIEnv* env,
+                                                             jobject thiz,
+                                                             jlong handle) {
+  NativeDetector* const detector = FromHandle(handle);
+  {
+    mutex_lock l(detector->pipeline_mutex);
+    StopPipeline(env, detector);
   }
-  std::reverse(top_results->begin(), top_results->end());
+  delete detector;
 }
 
-static int64 GetCpuSpeed() {
-  string scaling_contents;
-  ReadFileToString(nullptr,
-                   "/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq",
-                   &scaling_contents);
-  std::stringstream ss(scaling_contents);
-  int64 result;
-  ss >> result;
-  return result;
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(classifyImageRgb)(
+    JNIEnv* env, jobject thiz, jlong handle, jintArray image, jint width,
+    jint height, jfloatArray output) {
+  android::DetectorEngine* const engine = GetEngine(handle);
+
+  // Copy image into currFrame.
+  jboolean iCopied = JNI_FALSE;
+  jint* pixels = env->GetIntArrayElements(image, &iCopied);
+
+  const int num_candidates = ClassifyToJava(
+      env, engine, reinterpret_cast<const android::RGBA*>(pixels), output);
+
+  env->ReleaseIntArrayElements(image, pixels, JNI_ABORT);
+  return num_candidates;
 }
 
-static std::string ClassifyImage(const RGBA* const bitmap_src) {
-  // Force the app to quit if we've reached our run quota, to make
-  // benchmarks more reproducible.
-  if (MAX_NUM_RUNS > 0 && g_num_runs >= MAX_NUM_RUNS) {
-    LOG(INFO) << "Benchmark complete. "
-              << (g_timing_total_us / g_num_runs / 1000) << "ms/run avg over "
-              << g_num_runs << " runs.";
-    LOG(INFO) << "";
-    exit(0);
-  }
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(classifyImageBmp)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject bitmap,
+    jfloatArray output) {
+  android::DetectorEngine* const engine = GetEngine(handle);
+  ScopedBitmapPixels bitmap_pixels(env, bitmap);
+  return ClassifyToJava(env, engine, bitmap_pixels.pixels(), output);
+}
 
-  ++g_num_runs;
-
-  // Create input tensor
-  tensorflow::Tensor input_tensor(
-      tensorflow::DT_FLOAT,
-      tensorflow::TensorShape(
-          {1, g_tensorflow_input_size, g_tensorflow_input_size, 3}));
-
-  auto input_tensor_mapped = input_tensor.tensor<float, 4>();
-
-  LOG(INFO) << "TensorFlow: Copying Data.";
-  for (int i = 0; i < g_tensorflow_input_size; ++i) {
-    const RGBA* src = bitmap_src + i * g_tensorflow_input_size;
-    for (int j = 0; j < g_tensorflow_input_size; ++j) {
-      // Copy 3 values
-      input_tensor_mapped(0, i, j, 0) =
-          (static_cast<float>(src->red) - g_image_mean) / g_image_std;
-      input_tensor_mapped(0, i, j, 1) =
-          (static_cast<float>(src->green) - g_image_mean) / g_image_std;
-      input_tensor_mapped(0, i, j, 2) =
-          (static_cast<float>(src->blue) - g_image_mean) / g_image_std;
-      ++src;
-    }
-  }
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(detectObjects)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject bitmap,
+    jint max_detections, jfloat score_threshold, jfloat iou_threshold,
+    jfloatArray output) {
+  android::DetectorEngine* const engine = GetEngine(handle);
+  ScopedBitmapPixels bitmap_pixels(env, bitmap);
+  return WithFloatArray(
+      env, output, [&](float* const out, const int length) {
+        int num_detections = 0;
+        const Status s = engine->Detect(
+            bitmap_pixels.pixels(),
+            std::min<int>(max_detections, length / android::kDetectionStride),
+            score_threshold, iou_threshold, out, &num_detections);
+        return CountOrEmpty(s, num_detections);
+      });
+}
 
-  std::vector<std::pair<std::string, tensorflow::Tensor> > input_tensors(
-      {{*g_input_name, input_tensor}});
-
-  VLOG(0) << "Start computing.";
-  std::vector<tensorflow::Tensor> output_tensors;
-  std::vector<std::string> output_names({*g_output_name});
-
-  tensorflow::Status s;
-  int64 start_time, end_time;
-
-  if (kLogDetailedStats || kSaveStepStats) {
-    RunOptions run_options;
-    run_options.set_trace_level(RunOptions::FULL_TRACE);
-    RunMetadata run_metadata;
-    g_frequency_start.UpdateStat(GetCpuSpeed());
-    start_time = CurrentThreadTimeUs();
-    s = session->Run(run_options, input_tensors, output_names, {},
-                     &output_tensors, &run_metadata);
-    end_time = CurrentThreadTimeUs();
-    g_frequency_end.UpdateStat(GetCpuSpeed());
-    assert(run_metadata.has_step_stats());
-
-    const StepStats& stats = run_metadata.step_stats();
-
-    if (kLogDetailedStats) {
-      LOG(INFO) << "CPU frequency start: " << g_frequency_start;
-      LOG(INFO) << "CPU frequency end:   " << g_frequency_end;
-      g_stats->ProcessStepStats(stats);
-      g_stats->PrintStepStats();
-    }
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(detectObjectsYuv)(
+    JNIEnv* env, jobject thiz, jlong handle, jbyteArray y, jbyteArray u,
+    jbyteArray v, jint width, jint height, jint y_row_stride,
+    jint uv_row_stride, jint uv_pixel_stride, jint rotation,
+    jint max_detections, jfloat score_threshold, jfloat iou_threshold,
+    jfloatArray output) {
+  android::DetectorEngine* const engine = GetEngine(handle);
+
+  jboolean inputCopy = JNI_FALSE;
+  jbyte* const y_buff = env->GetByteArrayElements(y, &inputCopy);
+  jbyte* const u_buff = env->GetByteArrayElements(u, &inputCopy);
+  jbyte* const v_buff = env->GetByteArrayElements(v, &inputCopy);
+
+  android::YUV420Frame frame = MakeYuvFrame(width, height, y_row_stride,
+                                            uv_row_stride, uv_pixel_stride);
+  frame.y = reinterpret_cast<const uint8*>(y_buff);
+  frame.u = reinterpret_cast<const uint8*>(u_buff);
+  frame.v = reinterpret_cast<const uint8*>(v_buff);
+
+  const int num_detections = WithFloatArray(
+      env, output, [&](float* const out, const int length) {
+        int num_detections = 0;
+        const Status s = engine->DetectYuv(
+            frame, rotation,
+            std::min<int>(max_detections, length / android::kDetectionStride),
+            score_threshold, iou_threshold, out, &num_detections);
+        return CountOrEmpty(s, num_detections);
+      });
+
+  env->ReleaseByteArrayElements(y, y_buff, JNI_ABORT);
+  env->ReleaseByteArrayElements(u, u_buff, JNI_ABORT);
+  env->ReleaseByteArrayElements(v, v_buff, JNI_ABORT);
+  return num_detections;
+}
 
-    if (kSaveStepStats) {
-      mkdir("/sdcard/tf/", 0755);
-      const string filename =
-          strings::Printf("/sdcard/tf/stepstats%05d.pb", g_num_runs);
-      WriteProtoToFile(filename.c_str(), stats);
-    }
-  } else {
-    start_time = CurrentThreadTimeUs();
-    s = session->Run(input_tensors, output_names, {}, &output_tensors);
-    end_time = CurrentThreadTimeUs();
-  }
-  const int64 elapsed_time_inf = end_time - start_time;
-  g_timing_total_us += elapsed_time_inf;
-  VLOG(0) << "End computing. Ran in " << elapsed_time_inf / 1000 << "ms ("
-          << (g_timing_total_us / g_num_runs / 1000) << "ms avg over "
-          << g_num_runs << " runs)";
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(classifyImageRgbDirect)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject image, jint width,
+    jint height, jobject output) {
+  android::DetectorEngine* const engine = GetEngine(handle);
+  const android::DetectorConfig& config = engine->config();
+
+  const android::RGBA* const pixels = static_cast<const android::RGBA*>(
+      GetDirectBufferAddressChecked(
+          env, image, static_cast<jlong>(config.input_size) *
+                          config.input_size));
+  float* const out = static_cast<float*>(GetDirectBufferAddressChecked(
+      env, output, static_cast<jlong>(config.grid.NumCandidates()) *
+                       config.grid.CandidateStride()));
+  int num_candidates = 0;
+  const Status s = engine->Classify(pixels, out, &num_candidates);
+  return CountOrEmpty(s, num_candidates);
+}
 
-  if (!s.ok()) {
-    LOG(FATAL) << "Error during inference: " << s;
-  }
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(detectObjectsYuvDirect)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject y, jobject u, jobject v,
+    jint width, jint height, jint y_row_stride, jint uv_row_stride,
+    jint uv_pixel_stride, jint rotation, jint max_detections,
+    jfloat score_threshold, jfloat iou_threshold, jobject output) {
+  android::DetectorEngine* const engine = GetEngine(handle);
+
+  android::YUV420Frame frame = MakeYuvFrame(width, height, y_row_stride,
+                                            uv_row_stride, uv_pixel_stride);
+  SetDirectPlanes(env, y, u, v, &frame);
+  float* const out = static_cast<float*>(GetDirectBufferAddressChecked(
+      env, output,
+      static_cast<jlong>(max_detections) * android::kDetectionStride));
+  int num_detections = 0;
+  const Status s = engine->DetectYuv(frame, rotation, max_detections,
+                                     score_threshold, iou_threshold, out,
+                                     &num_detections);
+  return CountOrEmpty(s, num_detections);
+}
 
-  VLOG(0) << "Reading from layer " << output_names[0];
-  tensorflow::Tensor* output = &output_tensors[0];
-  
-  // TODO(nataniel): Here we want to modify the output to output the whole vector.
-  // Another idea would be to compute the bounding boxes and classes in c++ directly.
-  // output->flat<float>() has the results. Compute here and send a string to java is better.
-  std::vector<float> top_results;
-
-  // We are creating a vector of floats that have the outputs.
-  const int count = (output->flat<float>()).size();
-  for (int i = 0; i < count; ++i) {
-    const float value = output(i);
-    top_results->push_back(value);
-  }
-  std::reverse(top_results->begin(), top_results->end());
-
-  std::stringstream ss;
-  ss.precision(6);
-  int output_return_count = 1;
-  for (const auto& result : top_results) {
-    ss << result << " ";
-    if (output_return_count % 30 == 0) {
-    ss << "\n";
-    }
-    output_return_count++;
-  }
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(startInferencePipeline)(
+    JNIEnv* env, jobject thiz, jlong handle, jint queue_depth,
+    jint max_detections, jfloat score_threshold, jfloat iou_threshold,
+    jobject output) {
+  NativeDetector* const detector = FromHandle(handle);
+  mutex_lock l(detector->pipeline_mutex);
+  StopPipeline(env, detector);
+
+  CHECK_EQ(env->GetJavaVM(&detector->java_vm), JNI_OK);
+  jclass clazz = env->GetObjectClass(thiz);
+  detector->callback = env->GetMethodID(clazz, "onPipelineResult", "(JI)V");
+  CHECK(detector->callback != nullptr);
+  detector->listener = env->NewGlobalRef(thiz);
+  detector->output_buffer = env->NewGlobalRef(output);
+  detector->output = static_cast<float*>(GetDirectBufferAddressChecked(
+      env, output,
+      static_cast<jlong>(max_detections) * android::kDetectionStride));
+
+  detector->engine->StartPipeline(
+      queue_depth, max_detections, score_threshold, iou_threshold,
+      [detector](const int64 frame_id, const float* const detections,
+                 const int count) {
+        DeliverPipelineResult(detector, frame_id, detections, count);
+      },
+      [detector]() { DetachPipelineWorker(detector); });
+}
 
-  LOG(INFO) << "Predictions: " << ss.str();
-  return ss.str();
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(stopInferencePipeline)(
+    JNIEnv* env, jobject thiz, jlong handle) {
+  NativeDetector* const detector = FromHandle(handle);
+  mutex_lock l(detector->pipeline_mutex);
+  StopPipeline(env, detector);
 }
 
-JNIEXPORT jstring JNICALL TENSORFLOW_METHOD(classifyImageRgb)(
-    JNIEnv* env, jobject thiz, jintArray image, jint width, jint height) {
-  // Copy image into currFrame.
-  jboolean iCopied = JNI_FALSE;
-  jint* pixels = env->GetIntArrayElements(image, &iCopied);
+JNIEXPORT jlong JNICALL TENSORFLOW_METHOD(submitYuvFrameDirect)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject y, jobject u, jobject v,
+    jint width, jint height, jint y_row_stride, jint uv_row_stride,
+    jint uv_pixel_stride, jint rotation) {
+  android::DetectorEngine* const engine = GetEngine(handle);
 
-  std::string result = ClassifyImage(reinterpret_cast<const RGBA*>(pixels));
+  android::YUV420Frame frame = MakeYuvFrame(width, height, y_row_stride,
+                                            uv_row_stride, uv_pixel_stride);
+  SetDirectPlanes(env, y, u, v, &frame);
+  return engine->SubmitYuvFrame(frame, rotation);
+}
 
-  env->ReleaseIntArrayElements(image, pixels, JNI_ABORT);
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(trackYuvFrameDirect)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject y, jobject u, jobject v,
+    jint width, jint height, jint y_row_stride, jint uv_row_stride,
+    jint uv_pixel_stride, jint rotation, jint max_objects, jobject output) {
+  android::DetectorEngine* const engine = GetEngine(handle);
+
+  android::YUV420Frame frame = MakeYuvFrame(width, height, y_row_stride,
+                                            uv_row_stride, uv_pixel_stride);
+  SetDirectPlanes(env, y, u, v, &frame);
+  const int capacity = std::max(0, std::min<int>(max_objects,
+                                                 kMaxTrackedObjects));
+  float* const out = static_cast<float*>(GetDirectBufferAddressChecked(
+      env, output,
+      static_cast<jlong>(capacity) * android::kTrackedObjectStride));
+
+  android::TrackedObject objects[kMaxTrackedObjects];
+  const int count = engine->tracker()->TrackFrame(
+      frame, rotation, Env::Default()->NowMicros(), capacity, objects);
+  android::WriteTrackedObjects(objects, count, out);
+  return count;
+}
 
-  return env->NewStringUTF(result.c_str());
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(setTrackerConfig)(
+    JNIEnv* env, jobject thiz, jlong handle, jfloat match_iou,
+    jint max_missed_detections, jboolean optical_flow) {
+  android::TrackerConfig config;
+  config.match_iou = match_iou;
+  config.max_missed_detections = max_missed_detections;
+  config.optical_flow = optical_flow;
+  GetEngine(handle)->tracker()->Configure(config);
 }
 
-JNIEXPORT jstring JNICALL TENSORFLOW_METHOD(classifyImageBmp)(JNIEnv* env,
-                                                              jobject thiz,
-                                                              jobject bitmap) {
-  // Obtains the bitmap information.
-  AndroidBitmapInfo info;
-  CHECK_EQ(AndroidBitmap_getInfo(env, bitmap, &info),
-           ANDROID_BITMAP_RESULT_SUCCESS);
-  void* pixels;
-  CHECK_EQ(AndroidBitmap_lockPixels(env, bitmap, &pixels),
-           ANDROID_BITMAP_RESULT_SUCCESS);
-  LOG(INFO) << "Image dimensions: " << info.width << "x" << info.height
-            << " stride: " << info.stride;
-  // TODO(andrewharp): deal with other formats if necessary.
-  if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
-    LOG(FATAL) << "Only RGBA_8888 Bitmaps are supported.";
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(setProfiling)(
+    JNIEnv* env, jobject thiz, jlong handle, jint sample_interval,
+    jint ring_capacity) {
+  GetEngine(handle)->profiler()->Configure(sample_interval, ring_capacity);
+}
+
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(flushProfile)(JNIEnv* env,
+                                                      jobject thiz,
+                                                      jlong handle,
+                                                      jstring directory) {
+  const char* const directory_cstr = env->GetStringUTFChars(directory, NULL);
+  const string directory_str = directory_cstr;
+  env->ReleaseStringUTFChars(directory, directory_cstr);
+  return GetEngine(handle)->profiler()->Flush(directory_str);
+}
+
+JNIEXPORT jstring JNICALL TENSORFLOW_METHOD(getProfileSummary)(JNIEnv* env,
+                                                               jobject thiz,
+                                                               jlong handle) {
+  const string summary = GetEngine(handle)->profiler()->GetSummary();
+  return env->NewStringUTF(summary.c_str());
+}
+
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(setSceneChangeGating)(
+    JNIEnv* env, jobject thiz, jlong handle, jboolean enabled,
+    jfloat block_threshold, jfloat changed_block_fraction,
+    jint refresh_interval) {
+  android::SceneChangeConfig config;
+  config.enabled = enabled;
+  config.block_threshold = block_threshold;
+  config.changed_block_fraction = changed_block_fraction;
+  config.refresh_interval = refresh_interval;
+  GetEngine(handle)->SetSceneChangeConfig(config);
+}
+
+JNIEXPORT jlongArray JNICALL TENSORFLOW_METHOD(getSceneChangeStats)(
+    JNIEnv* env, jobject thiz, jlong handle) {
+  const android::SceneChangeDetector::Stats stats =
+      GetEngine(handle)->GetSceneChangeStats();
+  const jlong values[] = {stats.frames_checked, stats.frames_skipped,
+                          stats.forced_refreshes};
+  const jsize num_values = sizeof(values) / sizeof(values[0]);
+  jlongArray result = env->NewLongArray(num_values);
+  if (result != nullptr) {
+    env->SetLongArrayRegion(result, 0, num_values, values);
   }
+  return result;
+}
 
-  std::string result = ClassifyImage(static_cast<const RGBA*>(pixels));
+JNIEXPORT jboolean JNICALL TENSORFLOW_METHOD(startFrameRecorder)(
+    JNIEnv* env, jobject thiz, jlong handle, jstring directory,
+    jint sample_interval, jint queue_capacity, jint jpeg_quality,
+    jint records_per_file, jint max_files) {
+  const char* const directory_cstr = env->GetStringUTFChars(directory, NULL);
+  android::FrameRecorderConfig config;
+  config.directory = directory_cstr;
+  env->ReleaseStringUTFChars(directory, directory_cstr);
+  config.sample_interval = sample_interval;
+  config.queue_capacity = queue_capacity;
+  config.jpeg_quality = jpeg_quality;
+  config.records_per_file = records_per_file;
+  config.max_files = max_files;
+
+  const Status s = GetEngine(handle)->StartRecording(config);
+  if (!s.ok()) {
+    LOG(ERROR) << "Could not start recording to " << config.directory << ": "
+               << s;
+  }
+  return s.ok() ? JNI_TRUE : JNI_FALSE;
+}
 
-  // Finally, unlock the pixels
-  CHECK_EQ(AndroidBitmap_unlockPixels(env, bitmap),
-           ANDROID_BITMAP_RESULT_SUCCESS);
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(stopFrameRecorder)(JNIEnv* env,
+                                                            jobject thiz,
+                                                            jlong handle) {
+  GetEngine(handle)->StopRecording();
+}
 
-  return env->NewStringUTF(result.c_str());
+JNIEXPORT jlongArray JNICALL TENSORFLOW_METHOD(getFrameRecorderStats)(
+    JNIEnv* env, jobject thiz, jlong handle) {
+  const android::FrameRecorder::Stats stats =
+      GetEngine(handle)->GetRecordingStats();
+  const jlong values[] = {stats.frames_recorded, stats.frames_dropped,
+                          stats.bytes_written};
+  const jsize num_values = sizeof(values) / sizeof(values[0]);
+  jlongArray result = env->NewLongArray(num_values);
+  if (result != nullptr) {
+    env->SetLongArrayRegion(result, 0, num_values, values);
+  }
+  return result;
 }
@@ -30,17 +30,200 @@ extern "C" {
 #define TENSORFLOW_METHOD(METHOD_NAME) \
   Java_org_tensorflow_demo_TensorFlowClassifier_##METHOD_NAME  // NOLINT
 
-JNIEXPORT jint JNICALL TENSORFLOW_METHOD(initializeTensorFlow)(
+// Every model lives behind an opaque handle returned by initializeTensorFlow
+// with its own session, configuration and statistics, so several models can
+// be loaded at once and replaced without restarting the process. All methods
+// are thread-safe; runs of one model are serialized, runs of different models
+// are not. A handle must not be used once releaseTensorFlow has been called on
+// it.
+
+// Returns whether the library was built with the eight bit kernels graphs
+// rewritten by quantize_graph.py run on; see ENABLE_QUANTIZED_OPS in
+// Android.mk.
+JNIEXPORT jboolean JNICALL TENSORFLOW_METHOD(hasQuantizedKernels)(
+    JNIEnv* env, jclass clazz);
+
+// Loads the model and labels from the assets and returns a handle to them, or
+// 0 if the model could not be loaded. The threading arguments are described in
+// session_threading.h; a cpu_affinity_mask of -1 selects the fastest cores.
+// debug.tensorflow.* system properties override them.
+JNIEXPORT jlong JNICALL TENSORFLOW_METHOD(initializeTensorFlow)(
     JNIEnv* env, jobject thiz, jobject java_asset_manager, jstring model,
     jstring labels, jint num_classes, jint model_input_size, jint image_mean,
-    jfloat image_std, jstring input_name, jstring output_name);
+    jfloat image_std, jstring input_name, jstring output_name, jint grid_size,
+    jint boxes_per_cell, jint intra_op_threads, jint inter_op_threads,
+    jboolean use_per_session_threads, jlong cpu_affinity_mask);
+
+// Loads a cheaper variant of the model from the assets, e.g. the same
+// detector exported for a smaller input, with its own session. Camera frames
+// are switched to it when runs exceed the latency target; the detections are
+// still normalized to the crop, so they need no rescaling. Variants must be
+// added from the most accurate to the cheapest, and not while the pipeline
+// is running. Returns whether the variant was added.
+JNIEXPORT jboolean JNICALL TENSORFLOW_METHOD(addModelVariant)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject java_asset_manager,
+    jstring model, jint model_input_size, jint grid_size,
+    jint boxes_per_cell);
+
+// Sets the time a run of the model on a camera frame should stay within, in
+// milliseconds, or 0 to always run the model the handle was created with.
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(setLatencyTarget)(
+    JNIEnv* env, jobject thiz, jlong handle, jint target_ms);
+
+// Returns the input size of the variant camera frames are currently run on.
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(getActiveInputSize)(JNIEnv* env,
+                                                             jobject thiz,
+                                                             jlong handle);
+
+// Stops the pipeline of the model, if any, and frees it.
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(releaseTensorFlow)(JNIEnv* env,
+                                                             jobject thiz,
+                                                             jlong handle);
+
+// The classify methods run the detector and write the decoded candidate boxes
+// into output, returning the number of candidates written. See
+// yolo_decoder.h for the layout of each candidate.
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(classifyImageBmp)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject bitmap,
+    jfloatArray output);
+
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(classifyImageRgb)(
+    JNIEnv* env, jobject thiz, jlong handle, jintArray image, jint width,
+    jint height, jfloatArray output);
+
+// Runs the detector and applies per-class non-max suppression to all candidate
+// boxes. Up to max_detections results are written to output as
+// [class index, score, center x, center y, width, height], normalized to
+// [0, 1] and ordered by decreasing score. Returns the number written.
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(detectObjects)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject bitmap,
+    jint max_detections, jfloat score_threshold, jfloat iou_threshold,
+    jfloatArray output);
+
+// Same as detectObjects, but takes a YUV 4:2:0 camera frame directly. The
+// center square of the frame is rotated clockwise by rotation degrees and
+// scaled to the model input size while being converted, so no intermediate
+// RGB frame or bitmap is needed.
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(detectObjectsYuv)(
+    JNIEnv* env, jobject thiz, jlong handle, jbyteArray y, jbyteArray u,
+    jbyteArray v, jint width, jint height, jint y_row_stride,
+    jint uv_row_stride, jint uv_pixel_stride, jint rotation,
+    jint max_detections, jfloat score_threshold, jfloat iou_threshold,
+    jfloatArray output);
+
+// The Direct variants take direct java.nio buffers and use them in place, so
+// a frame is never copied onto or off the Java heap. Pixel buffers are
+// IntBuffers or ByteBuffers as for the array versions, and output is a direct
+// FloatBuffer in native byte order.
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(classifyImageRgbDirect)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject image, jint width,
+    jint height, jobject output);
+
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(detectObjectsYuvDirect)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject y, jobject u, jobject v,
+    jint width, jint height, jint y_row_stride, jint uv_row_stride,
+    jint uv_pixel_stride, jint rotation, jint max_detections,
+    jfloat score_threshold, jfloat iou_threshold, jobject output);
+
+// Starts running the detector asynchronously on frames submitted with
+// submitYuvFrameDirect. Frames are preprocessed on the submitting thread and
+// run on a worker thread, with up to queue_depth frames waiting in between;
+// when the queue is full the oldest waiting frame is dropped. For every frame
+// that is run, the detections are written to the direct FloatBuffer output as
+// in detectObjects, and onPipelineResult(long frameId, int count) is called
+// on thiz from the worker thread. Restarts the pipeline if it is running.
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(startInferencePipeline)(
+    JNIEnv* env, jobject thiz, jlong handle, jint queue_depth,
+    jint max_detections, jfloat score_threshold, jfloat iou_threshold,
+    jobject output);
+
+// Drops the frames still waiting and waits for the one being run.
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(stopInferencePipeline)(
+    JNIEnv* env, jobject thiz, jlong handle);
+
+// Converts a YUV 4:2:0 frame as for detectObjectsYuvDirect and queues it for
+// the pipeline. The planes are no longer needed once this returns. Returns the
+// id passed to onPipelineResult for this frame, -1 if the pipeline of the
+// model is not running, or -2 if scene change gating skipped the frame.
+JNIEXPORT jlong JNICALL TENSORFLOW_METHOD(submitYuvFrameDirect)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject y, jobject u, jobject v,
+    jint width, jint height, jint y_row_stride, jint uv_row_stride,
+    jint uv_pixel_stride, jint rotation);
+
+// Advances the tracks of the objects detected by detectObjectsYuv* and the
+// pipeline to a camera frame, refining them from its Y plane, and writes up
+// to max_objects of them to the direct FloatBuffer output as
+// [track id, class index, score, center x, center y, width, height],
+// normalized as for detectObjects and ordered by decreasing score. Track ids
+// stay the same for as long as an object is followed. Returns the number of
+// objects written. This is much cheaper than running the model, so it can be
+// called for every frame.
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(trackYuvFrameDirect)(
+    JNIEnv* env, jobject thiz, jlong handle, jobject y, jobject u, jobject v,
+    jint width, jint height, jint y_row_stride, jint uv_row_stride,
+    jint uv_pixel_stride, jint rotation, jint max_objects, jobject output);
+
+// Replaces the tracker settings, see object_tracker.h, and drops all tracks.
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(setTrackerConfig)(
+    JNIEnv* env, jobject thiz, jlong handle, jfloat match_iou,
+    jint max_missed_detections, jboolean optical_flow);
+
+// Traces one in every sample_interval runs of the model with FULL_TRACE, or
+// none if sample_interval is 0, keeping the StepStats of the last
+// ring_capacity traced runs in memory. Profiling starts disabled; changing it
+// discards what was collected so far.
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(setProfiling)(
+    JNIEnv* env, jobject thiz, jlong handle, jint sample_interval,
+    jint ring_capacity);
+
+// Writes the StepStats in memory to directory as stepstats<number>.pb, along
+// with summary.txt, on a background thread, and removes them from memory.
+// Returns the number of traces being written.
+JNIEXPORT jint JNICALL TENSORFLOW_METHOD(flushProfile)(JNIEnv* env,
+                                                      jobject thiz,
+                                                      jlong handle,
+                                                      jstring directory);
+
+// Returns the per-node statistics aggregated over all traced runs.
+JNIEXPORT jstring JNICALL TENSORFLOW_METHOD(getProfileSummary)(JNIEnv* env,
+                                                               jobject thiz,
+                                                               jlong handle);
+
+// Skips running the model on camera frames passed to detectObjectsYuv*,
+// which then return the previous detections, and submitYuvFrameDirect while
+// the scene is static; see scene_change_detector.h for the arguments. Gating
+// starts disabled.
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(setSceneChangeGating)(
+    JNIEnv* env, jobject thiz, jlong handle, jboolean enabled,
+    jfloat block_threshold, jfloat changed_block_fraction,
+    jint refresh_interval);
+
+// Returns the number of frames checked for a scene change, the number of
+// them the model was not run on, and the number run only because the refresh
+// interval was reached, since gating was last configured.
+JNIEXPORT jlongArray JNICALL TENSORFLOW_METHOD(getSceneChangeStats)(
+    JNIEnv* env, jobject thiz, jlong handle);
+
+// Records one in every sample_interval frames run by detectObjectsYuv* and
+// the pipeline, with their detections, as JPEG tf.Examples in TFRecord files
+// under directory; see frame_recorder.h for the arguments. Frames are copied
+// on the calling thread and encoded on a background one. Returns whether
+// recording started.
+JNIEXPORT jboolean JNICALL TENSORFLOW_METHOD(startFrameRecorder)(
+    JNIEnv* env, jobject thiz, jlong handle, jstring directory,
+    jint sample_interval, jint queue_capacity, jint jpeg_quality,
+    jint records_per_file, jint max_files);
 
-JNIEXPORT jstring JNICALL TENSORFLOW_METHOD(classifyImageBmp)(JNIEnv* env,
-                                                              jobject thiz,
-                                                              jobject bitmap);
+// Waits for the recorded frames still being encoded and closes the file.
+JNIEXPORT void JNICALL TENSORFLOW_METHOD(stopFrameRecorder)(JNIEnv* env,
+                                                            jobject thiz,
+                                                            jlong handle);
 
-JNIEXPORT jstring JNICALL TENSORFLOW_METHOD(classifyImageRgb)(
-    JNIEnv* env, jobject thiz, jintArray image, jint width, jint height);
+// Returns the number of frames recorded, the number dropped because the
+// encoder was behind, and the number of bytes written since recording
+// started.
+JNIEXPORT jlongArray JNICALL TENSORFLOW_METHOD(getFrameRecorderStats)(
+    JNIEnv* env, jobject thiz, jlong handle);
 
 #ifdef __cplusplus
 }  // extern "C"
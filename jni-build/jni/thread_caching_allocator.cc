@@ -0,0 +1,347 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/thread_caching_allocator.h"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+
+#include "tensorflow/core/common_runtime/device_factory.h"
+#include "tensorflow/core/common_runtime/threadpool_device.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/public/session_options.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// Every chunk is preceded by a header of this size, which is also the
+// alignment of cached chunks and the size of the smallest.
+const size_t kHeaderBytes = 64;
+// Chunks moved between a bin and the central list at once.
+const int kBatchSize = ThreadCachingAllocator::kBinCapacity / 2;
+// Bytes of each size the central list holds at most.
+const size_t kCentralBytes = 256 << 10;
+
+// Stored at the end of the header of every chunk.
+struct ChunkHeader {
+  // The size class of a cached chunk, or -1.
+  int32 size_class;
+  // Bytes from the start of the allocation of the wrapped allocator.
+  uint32 offset;
+};
+
+ChunkHeader* HeaderOf(void* ptr) {
+  return reinterpret_cast<ChunkHeader*>(static_cast<char*>(ptr) -
+                                        sizeof(ChunkHeader));
+}
+
+size_t SizeClassBytes(const int size_class) {
+  return kHeaderBytes << size_class;
+}
+
+int CentralCapacity(const int size_class) {
+  return kCentralBytes / SizeClassBytes(size_class);
+}
+
+// Returns the smallest size class num_bytes fits in, or -1 if it is too large
+// to cache.
+int SizeClass(const size_t num_bytes) {
+  if (num_bytes > ThreadCachingAllocator::kMaxCachedBytes) {
+    return -1;
+  }
+  int size_class = 0;
+  while (SizeClassBytes(size_class) < num_bytes) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+// Counters are only written by the thread owning them, and read by others.
+void Add(std::atomic<int64>* counter, const int64 value) {
+  counter->store(counter->load(std::memory_order_relaxed) + value,
+                 std::memory_order_relaxed);
+}
+
+std::atomic<bool> caching_enabled(true);
+
+}  // namespace
+
+double ThreadCacheStats::HitRate() const {
+  const int64 small_allocs = bin_allocs + central_allocs + uncached_allocs;
+  return small_allocs > 0 ? static_cast<double>(bin_allocs) / small_allocs
+                          : 0.0;
+}
+
+string ThreadCacheStats::DebugString() const {
+  return strings::StrCat(
+      "bin ", bin_allocs, ", central ", central_allocs, ", uncached ",
+      uncached_allocs, ", large ", large_allocs, " allocations, hit rate ",
+      static_cast<int>(HitRate() * 1000) / 10.0, "%, ", batch_transfers,
+      " batch transfers, ", cached_bytes, " bytes cached");
+}
+
+struct ThreadCachingAllocator::ThreadCache {
+  explicit ThreadCache(ThreadCachingAllocator* owner)
+      : owner(owner),
+        bin_allocs(0),
+        central_allocs(0),
+        uncached_allocs(0),
+        large_allocs(0),
+        batch_transfers(0),
+        bin_bytes(0) {
+    memset(counts, 0, sizeof(counts));
+  }
+
+  ThreadCachingAllocator* const owner;
+  int counts[kNumSizeClasses];
+  // The most recently freed chunk of each size is last.
+  void* chunks[kNumSizeClasses][kBinCapacity];
+
+  std::atomic<int64> bin_allocs;
+  std::atomic<int64> central_allocs;
+  std::atomic<int64> uncached_allocs;
+  std::atomic<int64> large_allocs;
+  std::atomic<int64> batch_transfers;
+  std::atomic<int64> bin_bytes;
+};
+
+ThreadCachingAllocator::ThreadCachingAllocator(Allocator* base) : base_(base) {
+  CHECK_EQ(0, pthread_key_create(&key_, &DestroyThreadCache));
+}
+
+ThreadCachingAllocator::~ThreadCachingAllocator() {
+  // No thread exit may release a cache from now on.
+  pthread_key_delete(key_);
+  mutex_lock l(mu_);
+  for (ThreadCache* cache : caches_) {
+    for (int size_class = 0; size_class < kNumSizeClasses; ++size_class) {
+      for (int i = 0; i < cache->counts[size_class]; ++i) {
+        FreeChunk(cache->chunks[size_class][i]);
+      }
+    }
+    delete cache;
+  }
+  for (std::vector<void*>& chunks : central_) {
+    for (void* chunk : chunks) {
+      FreeChunk(chunk);
+    }
+  }
+}
+
+string ThreadCachingAllocator::Name() {
+  return strings::StrCat(base_->Name(), "_thread_caching");
+}
+
+void* ThreadCachingAllocator::AllocateRaw(size_t alignment,
+                                          size_t num_bytes) {
+  ThreadCache* const cache = GetThreadCache();
+  const int size_class = SizeClass(num_bytes);
+  if (size_class < 0 || alignment > kHeaderBytes) {
+    Add(&cache->large_allocs, 1);
+    return AllocateChunk(alignment, num_bytes, -1);
+  }
+  int* const count = &cache->counts[size_class];
+  if (*count > 0) {
+    Add(&cache->bin_allocs, 1);
+  } else if (Refill(cache, size_class)) {
+    Add(&cache->central_allocs, 1);
+  } else {
+    Add(&cache->uncached_allocs, 1);
+    return AllocateChunk(kHeaderBytes, SizeClassBytes(size_class), size_class);
+  }
+  Add(&cache->bin_bytes, -static_cast<int64>(SizeClassBytes(size_class)));
+  return cache->chunks[size_class][--*count];
+}
+
+void ThreadCachingAllocator::DeallocateRaw(void* ptr) {
+  const int size_class = HeaderOf(ptr)->size_class;
+  if (size_class < 0) {
+    FreeChunk(ptr);
+    return;
+  }
+  ThreadCache* const cache = GetThreadCache();
+  if (cache->counts[size_class] == kBinCapacity) {
+    Flush(cache, size_class);
+  }
+  cache->chunks[size_class][cache->counts[size_class]++] = ptr;
+  Add(&cache->bin_bytes, SizeClassBytes(size_class));
+}
+
+void ThreadCachingAllocator::GetCacheStats(ThreadCacheStats* stats) {
+  mutex_lock l(mu_);
+  *stats = retired_stats_;
+  stats->cached_bytes = 0;
+  for (const ThreadCache* cache : caches_) {
+    stats->bin_allocs += cache->bin_allocs.load(std::memory_order_relaxed);
+    stats->central_allocs +=
+        cache->central_allocs.load(std::memory_order_relaxed);
+    stats->uncached_allocs +=
+        cache->uncached_allocs.load(std::memory_order_relaxed);
+    stats->large_allocs += cache->large_allocs.load(std::memory_order_relaxed);
+    stats->batch_transfers +=
+        cache->batch_transfers.load(std::memory_order_relaxed);
+    stats->cached_bytes += cache->bin_bytes.load(std::memory_order_relaxed);
+  }
+  for (int size_class = 0; size_class < kNumSizeClasses; ++size_class) {
+    stats->cached_bytes +=
+        central_[size_class].size() * SizeClassBytes(size_class);
+  }
+}
+
+ThreadCachingAllocator::ThreadCache* ThreadCachingAllocator::GetThreadCache() {
+  ThreadCache* cache = static_cast<ThreadCache*>(pthread_getspecific(key_));
+  if (cache == nullptr) {
+    cache = new ThreadCache(this);
+    {
+      mutex_lock l(mu_);
+      caches_.push_back(cache);
+    }
+    pthread_setspecific(key_, cache);
+  }
+  return cache;
+}
+
+void ThreadCachingAllocator::DestroyThreadCache(void* cache) {
+  ThreadCache* const thread_cache = static_cast<ThreadCache*>(cache);
+  ThreadCachingAllocator* const owner = thread_cache->owner;
+  mutex_lock l(owner->mu_);
+  owner->ReleaseCacheLocked(thread_cache);
+  owner->caches_.erase(std::find(owner->caches_.begin(), owner->caches_.end(),
+                                 thread_cache));
+  delete thread_cache;
+}
+
+bool ThreadCachingAllocator::Refill(ThreadCache* cache, const int size_class) {
+  mutex_lock l(mu_);
+  std::vector<void*>* const central = &central_[size_class];
+  const int num_chunks = std::min<int>(kBatchSize, central->size());
+  if (num_chunks == 0) {
+    return false;
+  }
+  std::copy(central->end() - num_chunks, central->end(),
+            cache->chunks[size_class]);
+  central->resize(central->size() - num_chunks);
+  cache->counts[size_class] = num_chunks;
+  Add(&cache->batch_transfers, 1);
+  Add(&cache->bin_bytes, num_chunks * SizeClassBytes(size_class));
+  return true;
+}
+
+void ThreadCachingAllocator::Flush(ThreadCache* cache, const int size_class) {
+  // The least recently freed chunks leave, and the others move down.
+  void** const chunks = cache->chunks[size_class];
+  void* batch[kBatchSize];
+  std::copy(chunks, chunks + kBatchSize, batch);
+  std::copy(chunks + kBatchSize, chunks + kBinCapacity, chunks);
+  cache->counts[size_class] -= kBatchSize;
+  Add(&cache->batch_transfers, 1);
+  Add(&cache->bin_bytes, -kBatchSize * SizeClassBytes(size_class));
+
+  int num_kept;
+  {
+    mutex_lock l(mu_);
+    std::vector<void*>* const central = &central_[size_class];
+    num_kept = std::min<int>(kBatchSize,
+                              CentralCapacity(size_class) - central->size());
+    central->insert(central->end(), batch, batch + num_kept);
+  }
+  for (int i = num_kept; i < kBatchSize; ++i) {
+    FreeChunk(batch[i]);
+  }
+}
+
+void ThreadCachingAllocator::ReleaseCacheLocked(ThreadCache* cache) {
+  for (int size_class = 0; size_class < kNumSizeClasses; ++size_class) {
+    std::vector<void*>* const central = &central_[size_class];
+    for (int i = 0; i < cache->counts[size_class]; ++i) {
+      if (central->size() < CentralCapacity(size_class)) {
+        central->push_back(cache->chunks[size_class][i]);
+      } else {
+        FreeChunk(cache->chunks[size_class][i]);
+      }
+    }
+    cache->counts[size_class] = 0;
+  }
+  retired_stats_.bin_allocs += cache->bin_allocs;
+  retired_stats_.central_allocs += cache->central_allocs;
+  retired_stats_.uncached_allocs += cache->uncached_allocs;
+  retired_stats_.large_allocs += cache->large_allocs;
+  retired_stats_.batch_transfers += cache->batch_transfers;
+}
+
+void* ThreadCachingAllocator::AllocateChunk(size_t alignment, size_t num_bytes,
+                                            const int size_class) {
+  // Alignments are powers of two, so this one is a multiple of both.
+  const size_t offset = std::max(alignment, kHeaderBytes);
+  char* const allocation =
+      static_cast<char*>(base_->AllocateRaw(offset, num_bytes + offset));
+  if (allocation == nullptr) {
+    return nullptr;
+  }
+  void* const ptr = allocation + offset;
+  ChunkHeader* const header = HeaderOf(ptr);
+  header->size_class = size_class;
+  header->offset = offset;
+  return ptr;
+}
+
+void ThreadCachingAllocator::FreeChunk(void* ptr) {
+  base_->DeallocateRaw(static_cast<char*>(ptr) - HeaderOf(ptr)->offset);
+}
+
+ThreadCachingAllocator* ThreadCachingCpuAllocator() {
+  static ThreadCachingAllocator* allocator =
+      new ThreadCachingAllocator(cpu_allocator());
+  return allocator;
+}
+
+void SetThreadCachingAllocator(const bool enabled) {
+  caching_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+namespace {
+
+// The CPU devices of the default factory, allocating through the thread
+// caching allocator if it is enabled.
+class ThreadCachingDeviceFactory : public DeviceFactory {
+ public:
+  void CreateDevices(const SessionOptions& options, const string& name_prefix,
+                     std::vector<Device*>* devices) override {
+    Allocator* const allocator =
+        caching_enabled.load(std::memory_order_relaxed)
+            ? ThreadCachingCpuAllocator()
+            : cpu_allocator();
+    int n = 1;
+    auto iter = options.config.device_count().find("CPU");
+    if (iter != options.config.device_count().end()) {
+      n = iter->second;
+    }
+    for (int i = 0; i < n; i++) {
+      const string name = strings::StrCat(name_prefix, "/cpu:", i);
+      devices->push_back(new ThreadPoolDevice(options, name, Bytes(256 << 20),
+                                              BUS_ANY, allocator));
+    }
+  }
+};
+REGISTER_LOCAL_DEVICE_FACTORY("CPU", ThreadCachingDeviceFactory, 1);
+
+}  // namespace
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,136 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// An allocator that keeps recently freed small chunks in bins of the thread
+// that freed them and hands them out again without taking any lock. The CPU
+// allocator, and the BFC allocator where one is used, serialize every
+// allocation and deallocation on a single mutex. With several sessions
+// running at once, the small shape and index tensors that most kernels
+// allocate make that mutex the most contended lock of a step.
+//
+// Sizes up to kMaxCachedBytes are rounded up to a power of two, and each
+// thread keeps up to kBinCapacity chunks per size. A full bin returns half of
+// its chunks to a central list, and an empty one takes a batch from there,
+// under the only lock of the allocator; chunks no bin or central list has
+// room for go back to the wrapped allocator. A thread caches at most about a
+// quarter of a megabyte, and the central list as much per size. Larger
+// allocations, and those aligned to more than a cache line, are passed
+// straight to the wrapped allocator.
+//
+// A REGISTER_LOCAL_DEVICE_FACTORY of higher priority than the default one
+// creates the CPU devices of every session with the process-wide instance
+// wrapping cpu_allocator(), unless SetThreadCachingAllocator disables it.
+
+#ifndef ORG_TENSORFLOW_JNI_THREAD_CACHING_ALLOCATOR_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_THREAD_CACHING_ALLOCATOR_H_  // NOLINT
+
+#include <pthread.h>
+
+#include <vector>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace android {
+
+// Counts of how the allocations and deallocations of a
+// ThreadCachingAllocator were served. AllocatorStats has no room for them,
+// so GetStats reports those of the wrapped allocator and GetCacheStats
+// these.
+struct ThreadCacheStats {
+  // Small allocations served from the bin of the thread.
+  int64 bin_allocs = 0;
+  // Small allocations that refilled the bin from the central list.
+  int64 central_allocs = 0;
+  // Small allocations for which neither had a chunk.
+  int64 uncached_allocs = 0;
+  // Allocations too large or too aligned to cache.
+  int64 large_allocs = 0;
+  // Batches moved between bins and the central list, each under the lock.
+  int64 batch_transfers = 0;
+  // Bytes held in bins and the central list.
+  int64 cached_bytes = 0;
+
+  // The fraction of small allocations served without any lock.
+  double HitRate() const;
+  string DebugString() const;
+};
+
+class ThreadCachingAllocator : public Allocator {
+ public:
+  static const size_t kMaxCachedBytes = 4 << 10;
+  static const int kBinCapacity = 32;
+
+  // Caches chunks of base, which must outlive the allocator. No thread may
+  // use the allocator while it is destroyed.
+  explicit ThreadCachingAllocator(Allocator* base);
+  ~ThreadCachingAllocator() override;
+
+  string Name() override;
+  void* AllocateRaw(size_t alignment, size_t num_bytes) override;
+  void DeallocateRaw(void* ptr) override;
+  // The stats of the wrapped allocator, to which cached chunks are in use.
+  void GetStats(AllocatorStats* stats) override { base_->GetStats(stats); }
+
+  void GetCacheStats(ThreadCacheStats* stats);
+
+ private:
+  static const int kNumSizeClasses = 7;
+
+  struct ThreadCache;
+
+  ThreadCache* GetThreadCache();
+  static void DestroyThreadCache(void* cache);
+  // Moves a batch of chunks from the central list into the bin of
+  // size_class. Returns false if there were none.
+  bool Refill(ThreadCache* cache, const int size_class);
+  // Moves a batch of chunks from the full bin of size_class to the central
+  // list.
+  void Flush(ThreadCache* cache, const int size_class);
+  // Returns every chunk of cache to the central list, and its counts to
+  // retired_stats_.
+  void ReleaseCacheLocked(ThreadCache* cache) EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void* AllocateChunk(size_t alignment, size_t num_bytes,
+                      const int size_class);
+  void FreeChunk(void* ptr);
+
+  Allocator* const base_;
+  // Holds the ThreadCache of each thread.
+  pthread_key_t key_;
+
+  mutex mu_;
+  std::vector<void*> central_[kNumSizeClasses] GUARDED_BY(mu_);
+  std::vector<ThreadCache*> caches_ GUARDED_BY(mu_);
+  // The counts of the caches of threads that have exited.
+  ThreadCacheStats retired_stats_ GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ThreadCachingAllocator);
+};
+
+// Returns the process-wide ThreadCachingAllocator wrapping cpu_allocator().
+ThreadCachingAllocator* ThreadCachingCpuAllocator();
+
+// Enables or disables the thread caching allocator for CPU devices created
+// afterwards. It is enabled by default.
+void SetThreadCachingAllocator(const bool enabled);
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_THREAD_CACHING_ALLOCATOR_H_  // NOLINT
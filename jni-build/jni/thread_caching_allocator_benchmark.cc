@@ -0,0 +1,171 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Measures small allocations from 1 to 8 threads at once, as the shape and
+// index tensors of several sessions make them, through the CPU allocator and
+// a BFC allocator, each with and without a ThreadCachingAllocator in front.
+// Every thread keeps a ring of live allocations of shape-tensor sizes and
+// replaces one per iteration. Items processed are allocation and
+// deallocation pairs over all threads, and the label of the cached runs is
+// their hit rate. The caching allocator is first checked under the same
+// load for overlapping chunks.
+//
+// Usage:
+//   make -C jni-build kernel-benchmark
+//   jni-build/thread_caching_allocator_benchmark [regex]
+
+#include <string.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/bfc_allocator.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mem.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/examples/android/jni/thread_caching_allocator.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+const int kRingSize = 16;
+const size_t kSizes[] = {4, 8, 16, 32, 64, 128, 256, 1024};
+const int kNumSizes = sizeof(kSizes) / sizeof(kSizes[0]);
+
+class AlignedSubAllocator : public SubAllocator {
+ public:
+  void* Alloc(size_t alignment, size_t num_bytes) override {
+    return port::aligned_malloc(num_bytes, alignment);
+  }
+  void Free(void* ptr, size_t num_bytes) override { port::aligned_free(ptr); }
+};
+
+Allocator* NewBfcAllocator() {
+  return new BFCAllocator(new AlignedSubAllocator, 1ll << 30, true, "bfc");
+}
+
+// Makes iters replacements in a ring of allocations, filling each with tag
+// and, if verify is set, checking the tag of each before freeing it.
+void ReplaceAllocations(Allocator* allocator, const int iters,
+                        const char tag, const bool verify) {
+  char* ring[kRingSize];
+  size_t sizes[kRingSize];
+  for (int i = 0; i < kRingSize; ++i) {
+    sizes[i] = kSizes[i % kNumSizes];
+    ring[i] = static_cast<char*>(
+        allocator->AllocateRaw(Allocator::kAllocatorAlignment, sizes[i]));
+    memset(ring[i], tag, sizes[i]);
+  }
+  for (int i = 0; i < iters; ++i) {
+    const int slot = i % kRingSize;
+    if (verify) {
+      for (size_t j = 0; j < sizes[slot]; ++j) {
+        CHECK_EQ(tag, ring[slot][j]) << "Chunk overwritten by another thread";
+      }
+    }
+    allocator->DeallocateRaw(ring[slot]);
+    sizes[slot] = kSizes[(i * 7 + slot) % kNumSizes];
+    ring[slot] = static_cast<char*>(
+        allocator->AllocateRaw(Allocator::kAllocatorAlignment, sizes[slot]));
+    if (verify) {
+      memset(ring[slot], tag, sizes[slot]);
+    }
+  }
+  for (int i = 0; i < kRingSize; ++i) {
+    allocator->DeallocateRaw(ring[i]);
+  }
+}
+
+void RunThreads(Allocator* allocator, const int iters, const int num_threads,
+                const bool verify) {
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([allocator, iters, i, verify]() {
+      ReplaceAllocations(allocator, iters, 'a' + i, verify);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+void BenchmarkAllocator(const int iters, const int num_threads,
+                        Allocator* base, const bool cached) {
+  testing::StopTiming();
+  std::unique_ptr<ThreadCachingAllocator> caching;
+  Allocator* allocator = base;
+  if (cached) {
+    caching.reset(new ThreadCachingAllocator(base));
+    allocator = caching.get();
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * num_threads);
+  testing::UseRealTime();
+  testing::StartTiming();
+  RunThreads(allocator, iters, num_threads, false);
+  testing::StopTiming();
+  if (cached) {
+    ThreadCacheStats stats;
+    caching->GetCacheStats(&stats);
+    testing::SetLabel(strings::StrCat(
+        "hit rate ", static_cast<int>(stats.HitRate() * 1000) / 10.0, "%"));
+  }
+}
+
+// Checks that no chunk is handed to two threads at once, with chunks moving
+// between threads through the central list.
+void VerifyThreadCachingAllocator() {
+  std::unique_ptr<Allocator> bfc(NewBfcAllocator());
+  ThreadCachingAllocator caching(bfc.get());
+  RunThreads(&caching, 100000, 8, true);
+  ThreadCacheStats stats;
+  caching.GetCacheStats(&stats);
+  LOG(INFO) << "Thread caching allocator: " << stats.DebugString();
+}
+
+}  // namespace
+
+static void BM_Cpu(int iters, int num_threads) {
+  BenchmarkAllocator(iters, num_threads, cpu_allocator(), false);
+}
+static void BM_CpuCached(int iters, int num_threads) {
+  BenchmarkAllocator(iters, num_threads, cpu_allocator(), true);
+}
+static void BM_Bfc(int iters, int num_threads) {
+  std::unique_ptr<Allocator> bfc(NewBfcAllocator());
+  BenchmarkAllocator(iters, num_threads, bfc.get(), false);
+}
+static void BM_BfcCached(int iters, int num_threads) {
+  std::unique_ptr<Allocator> bfc(NewBfcAllocator());
+  BenchmarkAllocator(iters, num_threads, bfc.get(), true);
+}
+BENCHMARK(BM_Cpu)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+BENCHMARK(BM_CpuCached)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+BENCHMARK(BM_Bfc)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+BENCHMARK(BM_BfcCached)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+}  // namespace android
+}  // namespace tensorflow
+
+int main(int argc, char** argv) {
+  tensorflow::port::InitMain(argv[0], &argc, &argv);
+  tensorflow::android::VerifyThreadCachingAllocator();
+  tensorflow::testing::Benchmark::Run(argc > 1 ? argv[1] : "all");
+  return 0;
+}
@@ -0,0 +1,245 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/winograd_conv.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor_types.h"
+#include "tensorflow/examples/android/jni/adaptive_sharder.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// Below this many output pixels a layer is dominated by the transforms and
+// the small matrix products; the direct convolution is faster.
+const int64 kMinWinogradPixels = 28 * 28;
+
+// Transformed filters take 16/9 the memory of the originals. The deepest
+// YOLO layers are left to the direct convolution rather than double their
+// share of the model's footprint.
+const int64 kMaxWinogradFilterFloats = 4 * 1024 * 1024;
+
+// Tiles are processed in blocks whose transformed inputs and products fit in
+// this many floats, so that they stay in the L2 cache.
+const int64 kBlockScratchFloats = 64 * 1024;
+const int64 kMinBlockTiles = 16;
+const int64 kMaxBlockTiles = 64;
+
+// Computes the kWinogradPoints values of B^T d B for each channel of the 4x4
+// input tile at (row, col), point k going to transformed + k * point_stride.
+// Values outside the input are taken as zero; they only reach outputs past
+// the edge, which are not written.
+void TransformInputTile(const float* const input, const int64 in_rows,
+                        const int64 in_cols, const int64 in_depth,
+                        const int64 row, const int64 col,
+                        const float* const zeros, const int64 point_stride,
+                        float* const transformed) {
+  const float* sources[kWinogradPoints];
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      sources[i * 4 + j] =
+          row + i < in_rows && col + j < in_cols
+              ? input + ((row + i) * in_cols + col + j) * in_depth
+              : zeros;
+    }
+  }
+
+  for (int64 c = 0; c < in_depth; ++c) {
+    float d[kWinogradPoints];
+    for (int k = 0; k < kWinogradPoints; ++k) {
+      d[k] = sources[k][c];
+    }
+    // B^T d.
+    float t[kWinogradPoints];
+    for (int j = 0; j < 4; ++j) {
+      t[j] = d[j] - d[8 + j];
+      t[4 + j] = d[4 + j] + d[8 + j];
+      t[8 + j] = d[8 + j] - d[4 + j];
+      t[12 + j] = d[4 + j] - d[12 + j];
+    }
+    // (B^T d) B.
+    for (int i = 0; i < 4; ++i) {
+      const float* const r = t + i * 4;
+      float* const v = transformed + i * 4 * point_stride + c;
+      v[0] = r[0] - r[2];
+      v[point_stride] = r[1] + r[2];
+      v[2 * point_stride] = r[2] - r[1];
+      v[3 * point_stride] = r[1] - r[3];
+    }
+  }
+}
+
+// Computes the 2x2 outputs A^T m A of one tile from its kWinogradPoints
+// products per output channel, adds the bias and applies the activation.
+// Outputs past out_rows or out_cols are dropped.
+void TransformOutputTile(const float* const products, const int64 point_stride,
+                         const float* const bias, const float alpha,
+                         const int64 out_rows, const int64 out_cols,
+                         const int64 out_depth, const int64 row,
+                         const int64 col, float* const output) {
+  const int rows = std::min<int64>(2, out_rows - row);
+  const int cols = std::min<int64>(2, out_cols - col);
+  for (int64 o = 0; o < out_depth; ++o) {
+    float m[kWinogradPoints];
+    for (int k = 0; k < kWinogradPoints; ++k) {
+      m[k] = products[k * point_stride + o];
+    }
+    // A^T m.
+    float t[8];
+    for (int j = 0; j < 4; ++j) {
+      t[j] = m[j] + m[4 + j] + m[8 + j];
+      t[4 + j] = m[4 + j] - m[8 + j] - m[12 + j];
+    }
+    for (int i = 0; i < rows; ++i) {
+      // (A^T m) A.
+      const float* const r = t + i * 4;
+      const float y[2] = {r[0] + r[1] + r[2], r[1] - r[2] - r[3]};
+      float* const out = output + ((row + i) * out_cols + col) * out_depth + o;
+      for (int j = 0; j < cols; ++j) {
+        const float value = y[j] + bias[o];
+        out[j * out_depth] = std::max(alpha * value, value);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+bool UseWinogradConv3x3(const int64 out_rows, const int64 out_cols,
+                        const int64 in_depth, const int64 out_depth) {
+  return out_rows * out_cols >= kMinWinogradPixels &&
+         kWinogradPoints * in_depth * out_depth <= kMaxWinogradFilterFloats;
+}
+
+void TransformWinogradFilter(const float* const filter, const int64 in_depth,
+                             const int64 out_depth,
+                             const DeviceBase::CpuWorkerThreads& workers,
+                             float* const transformed) {
+  const int64 point_stride = in_depth * out_depth;
+  auto work = [&](int64 begin, int64 end) {
+    for (int64 i = begin; i < end; ++i) {
+      for (int64 o = 0; o < out_depth; ++o) {
+        float g[9];
+        for (int k = 0; k < 9; ++k) {
+          g[k] = filter[(k * in_depth + i) * out_depth + o];
+        }
+        // G g, with G = [1 0 0; 1/2 1/2 1/2; 1/2 -1/2 1/2; 0 0 1].
+        float t[12];
+        for (int j = 0; j < 3; ++j) {
+          t[j] = g[j];
+          t[3 + j] = 0.5f * (g[j] + g[3 + j] + g[6 + j]);
+          t[6 + j] = 0.5f * (g[j] - g[3 + j] + g[6 + j]);
+          t[9 + j] = g[6 + j];
+        }
+        // (G g) G^T.
+        float* const u = transformed + i * out_depth + o;
+        for (int r = 0; r < 4; ++r) {
+          const float* const row = t + r * 3;
+          u[(r * 4) * point_stride] = row[0];
+          u[(r * 4 + 1) * point_stride] = 0.5f * (row[0] + row[1] + row[2]);
+          u[(r * 4 + 2) * point_stride] = 0.5f * (row[0] - row[1] + row[2]);
+          u[(r * 4 + 3) * point_stride] = row[2];
+        }
+      }
+    }
+  };
+  static ShardSite* const site = new ShardSite("winograd/filter_transform");
+  AdaptiveShard(site, workers.num_threads, workers.workers, in_depth,
+                out_depth * kWinogradPoints * 12, work);
+}
+
+void WinogradConv3x3BiasLeakyRelu(const float* const input, const int64 batch,
+                                  const int64 in_rows, const int64 in_cols,
+                                  const int64 in_depth,
+                                  const float* const transformed_filter,
+                                  const float* const bias, const float alpha,
+                                  const int64 out_depth,
+                                  const DeviceBase::CpuWorkerThreads& workers,
+                                  float* const output) {
+  const int64 out_rows = in_rows - 2;
+  const int64 out_cols = in_cols - 2;
+  const int64 tile_rows = (out_rows + 1) / 2;
+  const int64 tile_cols = (out_cols + 1) / 2;
+  const int64 tiles_per_image = tile_rows * tile_cols;
+  const int64 num_tiles = batch * tiles_per_image;
+
+  const int64 block_tiles = std::min(
+      kMaxBlockTiles,
+      std::max(kMinBlockTiles, kBlockScratchFloats /
+                                   (kWinogradPoints * (in_depth + out_depth))));
+  const int64 num_blocks = (num_tiles + block_tiles - 1) / block_tiles;
+
+  Eigen::array<Eigen::IndexPair<Eigen::DenseIndex>, 1> dim_pair;
+  dim_pair[0] = Eigen::IndexPair<Eigen::DenseIndex>(1, 0);
+
+  auto work = [&](int64 begin, int64 end) {
+    // Point k of tile t is at (k * block_tiles + t) * depth, so that each
+    // point's values over the block form one matrix.
+    std::vector<float> transformed_input(kWinogradPoints * block_tiles *
+                                         in_depth);
+    std::vector<float> products(kWinogradPoints * block_tiles * out_depth);
+    const std::vector<float> zeros(in_depth, 0.0f);
+
+    for (int64 block = begin; block < end; ++block) {
+      const int64 first_tile = block * block_tiles;
+      const int64 count = std::min(block_tiles, num_tiles - first_tile);
+
+      for (int64 t = 0; t < count; ++t) {
+        const int64 tile = first_tile + t;
+        const int64 image = tile / tiles_per_image;
+        const int64 tile_index = tile % tiles_per_image;
+        TransformInputTile(input + image * in_rows * in_cols * in_depth,
+                           in_rows, in_cols, in_depth,
+                           (tile_index / tile_cols) * 2,
+                           (tile_index % tile_cols) * 2, zeros.data(),
+                           block_tiles * in_depth,
+                           transformed_input.data() + t * in_depth);
+      }
+
+      for (int k = 0; k < kWinogradPoints; ++k) {
+        TTypes<float, 2>::UnalignedTensor(
+            products.data() + k * block_tiles * out_depth, count, out_depth) =
+            TTypes<float, 2>::UnalignedConstTensor(
+                transformed_input.data() + k * block_tiles * in_depth, count,
+                in_depth)
+                .contract(TTypes<float, 2>::UnalignedConstTensor(
+                              transformed_filter + k * in_depth * out_depth,
+                              in_depth, out_depth),
+                          dim_pair);
+      }
+
+      for (int64 t = 0; t < count; ++t) {
+        const int64 tile = first_tile + t;
+        const int64 image = tile / tiles_per_image;
+        const int64 tile_index = tile % tiles_per_image;
+        TransformOutputTile(products.data() + t * out_depth,
+                            block_tiles * out_depth, bias, alpha, out_rows,
+                            out_cols, out_depth, (tile_index / tile_cols) * 2,
+                            (tile_index % tile_cols) * 2,
+                            output + image * out_rows * out_cols * out_depth);
+      }
+    }
+  };
+  static ShardSite* const site = new ShardSite("winograd/tile_blocks");
+  AdaptiveShard(site, workers.num_threads, workers.workers, num_blocks,
+                block_tiles * kWinogradPoints * in_depth * out_depth, work);
+}
+
+}  // namespace android
+}  // namespace tensorflow
@@ -0,0 +1,63 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/yolo_decoder.h"
+
+namespace tensorflow {
+namespace android {
+
+void DecodeYoloOutput(const YoloGridConfig& config, const float* const output,
+                      float* const candidates) {
+  const int grid_size = config.grid_size;
+  const int boxes_per_cell = config.boxes_per_cell;
+  const int num_classes = config.num_classes;
+  const int num_cells = grid_size * grid_size;
+  const int stride = config.CandidateStride();
+  const float inv_grid_size = 1.0f / grid_size;
+
+  const float* const class_probs = output;
+  const float* const scales = class_probs + num_cells * num_classes;
+  const float* const boxes = scales + num_cells * boxes_per_cell;
+
+  float* out = candidates;
+  for (int row = 0; row < grid_size; ++row) {
+    for (int col = 0; col < grid_size; ++col) {
+      const int cell = row * grid_size + col;
+      const float* const cell_probs = class_probs + cell * num_classes;
+
+      for (int b = 0; b < boxes_per_cell; ++b) {
+        const int candidate = cell * boxes_per_cell + b;
+        const float* const box = boxes + candidate * 4;
+        const float scale = scales[candidate];
+
+        // The network predicts centers relative to the cell and the square
+        // root of the size relative to the whole image.
+        out[0] = (box[0] + col) * inv_grid_size;
+        out[1] = (box[1] + row) * inv_grid_size;
+        out[2] = box[2] * box[2];
+        out[3] = box[3] * box[3];
+
+        float* const scores = out + YoloGridConfig::kCandidateHeaderSize;
+        for (int c = 0; c < num_classes; ++c) {
+          scores[c] = cell_probs[c] * scale;
+        }
+        out += stride;
+      }
+    }
+  }
+}
+
+}  // namespace android
+}  // namespace tensorflow
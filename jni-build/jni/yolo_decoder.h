@@ -0,0 +1,65 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Decodes the raw output layer of a YOLO v1 style detector into candidate
+// boxes without leaving native code.
+
+#ifndef ORG_TENSORFLOW_JNI_YOLO_DECODER_H_  // NOLINT
+#define ORG_TENSORFLOW_JNI_YOLO_DECODER_H_  // NOLINT
+
+namespace tensorflow {
+namespace android {
+
+// Geometry of the detector output: the image is divided into an S x S grid,
+// and each cell predicts B boxes plus one set of C conditional class
+// probabilities. The flattened output holds the S*S*C class probabilities,
+// then the S*S*B objectness scales, then the S*S*B*4 box coordinates.
+struct YoloGridConfig {
+  int grid_size = 7;
+  int boxes_per_cell = 2;
+  int num_classes = 20;
+
+  // Number of floats the output layer must contain.
+  int OutputSize() const {
+    return grid_size * grid_size * (num_classes + boxes_per_cell * 5);
+  }
+
+  // Number of candidate boxes predicted over the whole grid.
+  int NumCandidates() const { return grid_size * grid_size * boxes_per_cell; }
+
+  // Number of floats written per candidate by DecodeYoloOutput.
+  int CandidateStride() const { return kCandidateHeaderSize + num_classes; }
+
+  // Every candidate row starts with the box center x, center y, width and
+  // height, followed by one score per class.
+  static const int kCandidateHeaderSize = 4;
+};
+
+// Decodes the flattened output of the detector into config.NumCandidates()
+// rows of config.CandidateStride() floats each. Box coordinates are
+// normalized to [0, 1] relative to the model input: the cell offsets are
+// added to the predicted centers, and the predicted square roots of width and
+// height are squared. Each class score is the conditional class probability of
+// the cell multiplied by the objectness of the box.
+//
+// Candidate k describes box (k % B) of grid cell (k / B), with cells in
+// row-major order. The caller owns both buffers; no memory is allocated.
+void DecodeYoloOutput(const YoloGridConfig& config, const float* const output,
+                      float* const candidates);
+
+}  // namespace android
+}  // namespace tensorflow
+
+#endif  // ORG_TENSORFLOW_JNI_YOLO_DECODER_H_  // NOLINT
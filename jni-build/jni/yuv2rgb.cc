@@ -18,40 +18,339 @@ limitations under the License.
 
 #include "tensorflow/examples/android/jni/yuv2rgb.h"
 
-#ifndef MAX
-#define MAX(a, b) ({__typeof__(a) _a = (a); __typeof__(b) _b = (b); _a > _b ? _a : _b; })
-#define MIN(a, b) ({__typeof__(a) _a = (a); __typeof__(b) _b = (b); _a < _b ? _a : _b; })
-#endif
+#include <string.h>
+
+#include <atomic>
 
-// This value is 2 ^ 18 - 1, and is used to clamp the RGB values before their ranges
-// are normalized to eight bits.
-static const int kMaxChannelValue = 262143;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define IMAGEUTILS_USE_NEON
+#include <arm_neon.h>
+#if defined(__ANDROID__) && defined(__arm__)
+#include <cpu-features.h>
+#endif
+#elif defined(__SSE2__)
+#define IMAGEUTILS_USE_SSE2
+#include <emmintrin.h>
+#endif
 
 static inline uint32 YUV2RGB(int nY, int nU, int nV) {
-  nY -= 16;
-  nU -= 128;
-  nV -= 128;
-  if (nY < 0) nY = 0;
+  int nR, nG, nB;
+  YUVToRGB(nY, nU, nV, &nR, &nG, &nB);
+  return 0xff000000 | (nR << 16) | (nG << 8) | nB;
+}
+
+static inline uint16 YUV2RGB565(int nY, int nU, int nV) {
+  int nR, nG, nB;
+  YUVToRGB(nY, nU, nV, &nR, &nG, &nB);
+
+  // R is high 5 bits, G is middle 6 bits, and B is low 5 bits.
+  return ((nR >> 3) << 11) | ((nG >> 2) << 5) | (nB >> 3);
+}
+
+static int DetectImageUtilsSimdPath() {
+#if defined(IMAGEUTILS_USE_NEON)
+#if defined(__ANDROID__) && defined(__arm__)
+  // NEON is optional on ARMv7.
+  if (android_getCpuFamily() != ANDROID_CPU_FAMILY_ARM ||
+      !(android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON)) {
+    return kImageUtilsScalar;
+  }
+#endif
+  return kImageUtilsNeon;
+#elif defined(IMAGEUTILS_USE_SSE2)
+  return kImageUtilsSse2;
+#else
+  return kImageUtilsScalar;
+#endif
+}
 
-  // This is the floating point equivalent. We do the conversion in integer
-  // because some Android devices do not have floating point in hardware.
-  // nR = (int)(1.164 * nY + 2.018 * nU);
-  // nG = (int)(1.164 * nY - 0.813 * nV - 0.391 * nU);
-  // nB = (int)(1.164 * nY + 1.596 * nV);
+static std::atomic<int> g_simd_path_override(-1);
 
-  int nR = (int)(1192 * nY + 1634 * nV);
-  int nG = (int)(1192 * nY - 833 * nV - 400 * nU);
-  int nB = (int)(1192 * nY + 2066 * nU);
+int GetSupportedImageUtilsSimdPath() {
+  static const int supported_path = DetectImageUtilsSimdPath();
+  return supported_path;
+}
 
-  nR = MIN(kMaxChannelValue, MAX(0, nR));
-  nG = MIN(kMaxChannelValue, MAX(0, nG));
-  nB = MIN(kMaxChannelValue, MAX(0, nB));
+int GetImageUtilsSimdPath() {
+  const int path = g_simd_path_override.load(std::memory_order_relaxed);
+  return path < 0 ? GetSupportedImageUtilsSimdPath() : path;
+}
 
-  nR = (nR >> 10) & 0xff;
-  nG = (nG >> 10) & 0xff;
-  nB = (nB >> 10) & 0xff;
+void SetImageUtilsSimdPath(int path) {
+  if (path >= 0 && path != GetSupportedImageUtilsSimdPath()) {
+    path = kImageUtilsScalar;
+  }
+  g_simd_path_override.store(path, std::memory_order_relaxed);
+}
 
-  return 0xff000000 | (nR << 16) | (nG << 8) | nB;
+// The vector row converters below convert the longest prefix of a row they
+// can and return its length; the caller finishes the row with the scalar
+// code. They expect chroma samples either packed (uv_step 1) or interleaved
+// with one other byte (uv_step 2), and never read past the last chroma sample
+// the row needs.
+
+#if defined(IMAGEUTILS_USE_NEON)
+
+// Computes the eight bit R, G and B channels of 8 pixels whose chroma has
+// already been upsampled to one sample per pixel.
+static inline void YUVToRGB8Neon(const uint8x8_t y, const uint8x8_t u,
+                                 const uint8x8_t v, uint8x8_t* const r,
+                                 uint8x8_t* const g, uint8x8_t* const b) {
+  // nY = max(Y - 16, 0), nU = U - 128, nV = V - 128.
+  const int16x8_t ny =
+      vreinterpretq_s16_u16(vmovl_u8(vqsub_u8(y, vdup_n_u8(16))));
+  const int16x8_t nu = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u)),
+                                 vdupq_n_s16(128));
+  const int16x8_t nv = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v)),
+                                 vdupq_n_s16(128));
+
+  const int16x4_t ny_lo = vget_low_s16(ny);
+  const int16x4_t ny_hi = vget_high_s16(ny);
+  const int16x4_t nu_lo = vget_low_s16(nu);
+  const int16x4_t nu_hi = vget_high_s16(nu);
+  const int16x4_t nv_lo = vget_low_s16(nv);
+  const int16x4_t nv_hi = vget_high_s16(nv);
+
+  const int32x4_t y_lo = vmull_n_s16(ny_lo, 1192);
+  const int32x4_t y_hi = vmull_n_s16(ny_hi, 1192);
+
+  // Shifting with signed saturation and then narrowing with unsigned
+  // saturation clamps exactly like the scalar path: negative values become 0
+  // and anything above kMaxChannelValue becomes 255.
+  *r = vqmovun_s16(
+      vcombine_s16(vqshrn_n_s32(vmlal_n_s16(y_lo, nv_lo, 1634), 10),
+                   vqshrn_n_s32(vmlal_n_s16(y_hi, nv_hi, 1634), 10)));
+  *g = vqmovun_s16(vcombine_s16(
+      vqshrn_n_s32(vmlsl_n_s16(vmlsl_n_s16(y_lo, nv_lo, 833), nu_lo, 400), 10),
+      vqshrn_n_s32(vmlsl_n_s16(vmlsl_n_s16(y_hi, nv_hi, 833), nu_hi, 400),
+                   10)));
+  *b = vqmovun_s16(
+      vcombine_s16(vqshrn_n_s32(vmlal_n_s16(y_lo, nu_lo, 2066), 10),
+                   vqshrn_n_s32(vmlal_n_s16(y_hi, nu_hi, 2066), 10)));
+}
+
+// Loads the 8 chroma samples covering 16 pixels.
+static inline uint8x8_t LoadChroma8Neon(const uint8* const p,
+                                        const int uv_step) {
+  return uv_step == 1 ? vld1_u8(p) : vld2_u8(p).val[0];
+}
+
+static int YUVRowToARGB8888Neon(const uint8* const pY, const uint8* const pU,
+                                const uint8* const pV, const int uv_step,
+                                uint32* const out, const int width) {
+  if (uv_step != 1 && uv_step != 2) return 0;
+  const int vector_end = uv_step == 1 ? width : width - 1;
+
+  int x = 0;
+  for (; x + 16 <= vector_end; x += 16) {
+    const uint8x16_t y = vld1q_u8(pY + x);
+    const uint8x8_t u = LoadChroma8Neon(pU + (x >> 1) * uv_step, uv_step);
+    const uint8x8_t v = LoadChroma8Neon(pV + (x >> 1) * uv_step, uv_step);
+
+    // Each chroma sample covers two horizontally adjacent pixels.
+    const uint8x8x2_t u_dup = vzip_u8(u, u);
+    const uint8x8x2_t v_dup = vzip_u8(v, v);
+
+    for (int half = 0; half < 2; ++half) {
+      uint8x8x4_t argb;
+      YUVToRGB8Neon(half == 0 ? vget_low_u8(y) : vget_high_u8(y),
+                    u_dup.val[half], v_dup.val[half], &argb.val[2],
+                    &argb.val[1], &argb.val[0]);
+      argb.val[3] = vdup_n_u8(0xff);
+      vst4_u8(reinterpret_cast<uint8*>(out + x + half * 8), argb);
+    }
+  }
+  return x;
+}
+
+static int YUVRowToRGB565Neon(const uint8* const pY, const uint8* const pU,
+                              const uint8* const pV, const int uv_step,
+                              uint16* const out, const int width) {
+  if (uv_step != 1 && uv_step != 2) return 0;
+  const int vector_end = uv_step == 1 ? width : width - 1;
+
+  int x = 0;
+  for (; x + 16 <= vector_end; x += 16) {
+    const uint8x16_t y = vld1q_u8(pY + x);
+    const uint8x8_t u = LoadChroma8Neon(pU + (x >> 1) * uv_step, uv_step);
+    const uint8x8_t v = LoadChroma8Neon(pV + (x >> 1) * uv_step, uv_step);
+    const uint8x8x2_t u_dup = vzip_u8(u, u);
+    const uint8x8x2_t v_dup = vzip_u8(v, v);
+
+    for (int half = 0; half < 2; ++half) {
+      uint8x8_t r, g, b;
+      YUVToRGB8Neon(half == 0 ? vget_low_u8(y) : vget_high_u8(y),
+                    u_dup.val[half], v_dup.val[half], &r, &g, &b);
+      const uint16x8_t rgb565 = vorrq_u16(
+          vorrq_u16(vshlq_n_u16(vmovl_u8(vshr_n_u8(r, 3)), 11),
+                    vshlq_n_u16(vmovl_u8(vshr_n_u8(g, 2)), 5)),
+          vmovl_u8(vshr_n_u8(b, 3)));
+      vst1q_u16(out + x + half * 8, rgb565);
+    }
+  }
+  return x;
+}
+
+#elif defined(IMAGEUTILS_USE_SSE2)
+
+// Packs two int16 coefficients into each 32 bit lane for _mm_madd_epi16.
+static inline __m128i CoefficientPairSse2(const int16 first,
+                                          const int16 second) {
+  return _mm_set1_epi32(static_cast<int>(
+      (static_cast<uint32>(static_cast<uint16>(second)) << 16) |
+      static_cast<uint16>(first)));
+}
+
+// Shifts 8 fixed point channel values down to eight bits, clamping exactly
+// like the scalar path: negative values saturate to 0 and anything above
+// kMaxChannelValue saturates to 255. The result is in the low 8 bytes.
+static inline __m128i NarrowChannelSse2(const __m128i lo, const __m128i hi) {
+  const __m128i narrowed =
+      _mm_packs_epi32(_mm_srai_epi32(lo, 10), _mm_srai_epi32(hi, 10));
+  return _mm_packus_epi16(narrowed, narrowed);
+}
+
+// Computes the eight bit R, G and B channels of 8 pixels given as 16 bit
+// lanes, with chroma already upsampled to one sample per pixel.
+static inline void YUVToRGB8Sse2(const __m128i y, const __m128i u,
+                                 const __m128i v, __m128i* const r,
+                                 __m128i* const g, __m128i* const b) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ny = _mm_subs_epu16(y, _mm_set1_epi16(16));
+  const __m128i nu = _mm_sub_epi16(u, _mm_set1_epi16(128));
+  const __m128i nv = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+  const __m128i yv_lo = _mm_unpacklo_epi16(ny, nv);
+  const __m128i yv_hi = _mm_unpackhi_epi16(ny, nv);
+  const __m128i yu_lo = _mm_unpacklo_epi16(ny, nu);
+  const __m128i yu_hi = _mm_unpackhi_epi16(ny, nu);
+  const __m128i u_lo = _mm_unpacklo_epi16(nu, zero);
+  const __m128i u_hi = _mm_unpackhi_epi16(nu, zero);
+
+  const __m128i r_coeffs = CoefficientPairSse2(1192, 1634);
+  const __m128i g_coeffs = CoefficientPairSse2(1192, -833);
+  const __m128i gu_coeffs = CoefficientPairSse2(-400, 0);
+  const __m128i b_coeffs = CoefficientPairSse2(1192, 2066);
+
+  *r = NarrowChannelSse2(_mm_madd_epi16(yv_lo, r_coeffs),
+                         _mm_madd_epi16(yv_hi, r_coeffs));
+  *g = NarrowChannelSse2(_mm_add_epi32(_mm_madd_epi16(yv_lo, g_coeffs),
+                                       _mm_madd_epi16(u_lo, gu_coeffs)),
+                         _mm_add_epi32(_mm_madd_epi16(yv_hi, g_coeffs),
+                                       _mm_madd_epi16(u_hi, gu_coeffs)));
+  *b = NarrowChannelSse2(_mm_madd_epi16(yu_lo, b_coeffs),
+                         _mm_madd_epi16(yu_hi, b_coeffs));
+}
+
+// Loads the 4 chroma samples covering 8 pixels and upsamples them to one 16
+// bit lane per pixel.
+static inline __m128i LoadChroma8Sse2(const uint8* const p,
+                                      const int uv_step) {
+  __m128i samples;
+  if (uv_step == 1) {
+    int32 packed;
+    memcpy(&packed, p, sizeof(packed));
+    samples = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed),
+                                _mm_setzero_si128());
+  } else {
+    samples = _mm_and_si128(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)),
+                            _mm_set1_epi16(0xff));
+  }
+  return _mm_unpacklo_epi16(samples, samples);
+}
+
+static inline __m128i LoadLuma8Sse2(const uint8* const p) {
+  return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)),
+                           _mm_setzero_si128());
+}
+
+static int YUVRowToARGB8888Sse2(const uint8* const pY, const uint8* const pU,
+                                const uint8* const pV, const int uv_step,
+                                uint32* const out, const int width) {
+  if (uv_step != 1 && uv_step != 2) return 0;
+  const int vector_end = uv_step == 1 ? width : width - 1;
+  const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xff));
+
+  int x = 0;
+  for (; x + 8 <= vector_end; x += 8) {
+    __m128i r, g, b;
+    YUVToRGB8Sse2(LoadLuma8Sse2(pY + x),
+                  LoadChroma8Sse2(pU + (x >> 1) * uv_step, uv_step),
+                  LoadChroma8Sse2(pV + (x >> 1) * uv_step, uv_step), &r, &g,
+                  &b);
+
+    // Interleave to B, G, R, A bytes, which is 0xAARRGGBB in memory.
+    const __m128i bg = _mm_unpacklo_epi8(b, g);
+    const __m128i ra = _mm_unpacklo_epi8(r, alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x),
+                     _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 4),
+                     _mm_unpackhi_epi16(bg, ra));
+  }
+  return x;
+}
+
+static int YUVRowToRGB565Sse2(const uint8* const pY, const uint8* const pU,
+                              const uint8* const pV, const int uv_step,
+                              uint16* const out, const int width) {
+  if (uv_step != 1 && uv_step != 2) return 0;
+  const int vector_end = uv_step == 1 ? width : width - 1;
+  const __m128i zero = _mm_setzero_si128();
+
+  int x = 0;
+  for (; x + 8 <= vector_end; x += 8) {
+    __m128i r, g, b;
+    YUVToRGB8Sse2(LoadLuma8Sse2(pY + x),
+                  LoadChroma8Sse2(pU + (x >> 1) * uv_step, uv_step),
+                  LoadChroma8Sse2(pV + (x >> 1) * uv_step, uv_step), &r, &g,
+                  &b);
+
+    const __m128i r16 = _mm_unpacklo_epi8(r, zero);
+    const __m128i g16 = _mm_unpacklo_epi8(g, zero);
+    const __m128i b16 = _mm_unpacklo_epi8(b, zero);
+    const __m128i rgb565 = _mm_or_si128(
+        _mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(r16, 3), 11),
+                     _mm_slli_epi16(_mm_srli_epi16(g16, 2), 5)),
+        _mm_srli_epi16(b16, 3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), rgb565);
+  }
+  return x;
+}
+
+#endif
+
+// Converts the longest prefix of a row the selected vector path can handle.
+static inline int YUVRowToARGB8888Simd(const int path, const uint8* const pY,
+                                       const uint8* const pU,
+                                       const uint8* const pV,
+                                       const int uv_step, uint32* const out,
+                                       const int width) {
+#if defined(IMAGEUTILS_USE_NEON)
+  if (path == kImageUtilsNeon) {
+    return YUVRowToARGB8888Neon(pY, pU, pV, uv_step, out, width);
+  }
+#elif defined(IMAGEUTILS_USE_SSE2)
+  if (path == kImageUtilsSse2) {
+    return YUVRowToARGB8888Sse2(pY, pU, pV, uv_step, out, width);
+  }
+#endif
+  return 0;
+}
+
+static inline int YUVRowToRGB565Simd(const int path, const uint8* const pY,
+                                     const uint8* const pU,
+                                     const uint8* const pV, const int uv_step,
+                                     uint16* const out, const int width) {
+#if defined(IMAGEUTILS_USE_NEON)
+  if (path == kImageUtilsNeon) {
+    return YUVRowToRGB565Neon(pY, pU, pV, uv_step, out, width);
+  }
+#elif defined(IMAGEUTILS_USE_SSE2)
+  if (path == kImageUtilsSse2) {
+    return YUVRowToRGB565Sse2(pY, pU, pV, uv_step, out, width);
+  }
+#endif
+  return 0;
 }
 
 //  Accepts a YUV 4:2:0 image with a plane of 8 bit Y samples followed by
@@ -63,6 +362,7 @@ void ConvertYUV420ToARGB8888(const uint8* const yData, const uint8* const uData,
                              const int width, const int height,
                              const int y_row_stride, const int uv_row_stride,
                              const int uv_pixel_stride) {
+  const int path = GetImageUtilsSimdPath();
   uint32* out = output;
 
   for (int y = 0; y < height; y++) {
@@ -72,10 +372,13 @@ void ConvertYUV420ToARGB8888(const uint8* const yData, const uint8* const uData,
     const uint8* pU = uData + uv_row_start;
     const uint8* pV = vData + uv_row_start;
 
-    for (int x = 0; x < width; x++) {
+    int x = YUVRowToARGB8888Simd(path, pY, pU, pV, uv_pixel_stride, out,
+                                 width);
+    for (; x < width; x++) {
       const int uv_offset = (x >> 1) * uv_pixel_stride;
-      *out++ = YUV2RGB(pY[x], pU[uv_offset], pV[uv_offset]);
+      out[x] = YUV2RGB(pY[x], pU[uv_offset], pV[uv_offset]);
     }
+    out += width;
   }
 }
 
@@ -87,24 +390,26 @@ void ConvertYUV420SPToARGB8888(const uint8* const yData,
                                const uint8* const uvData,
                                uint32* const output, const int width,
                                const int height) {
-  const uint8* pY = yData;
-  const uint8* pUV = uvData;
+  const int path = GetImageUtilsSimdPath();
   uint32* out = output;
 
   for (int y = 0; y < height; y++) {
-    for (int x = 0; x < width; x++) {
-      int nY = *pY++;
-      int offset = (y >> 1) * width + 2 * (x >> 1);
+    const uint8* pY = yData + y * width;
+    const uint8* pUV = uvData + (y >> 1) * width;
 #ifdef __APPLE__
-      int nU = pUV[offset];
-      int nV = pUV[offset + 1];
+    const uint8* pU = pUV;
+    const uint8* pV = pUV + 1;
 #else
-      int nV = pUV[offset];
-      int nU = pUV[offset + 1];
+    const uint8* pV = pUV;
+    const uint8* pU = pUV + 1;
 #endif
 
-      *out++ = YUV2RGB(nY, nU, nV);
+    int x = YUVRowToARGB8888Simd(path, pY, pU, pV, 2, out, width);
+    for (; x < width; x++) {
+      const int offset = 2 * (x >> 1);
+      out[x] = YUV2RGB(pY[x], pU[offset], pV[offset]);
     }
+    out += width;
   }
 }
 
@@ -143,48 +448,26 @@ void ConvertYUV420SPToARGB8888HalfSize(const uint8* const input,
 //  RGB 565 bit output of the same pixel dimensions.
 void ConvertYUV420SPToRGB565(const uint8* const input, uint16* const output,
                              const int width, const int height) {
-  const uint8* pY = input;
-  const uint8* pUV = input + (width * height);
-  uint16 *out = output;
+  const int path = GetImageUtilsSimdPath();
+  const uint8* const uvData = input + (width * height);
+  uint16* out = output;
 
   for (int y = 0; y < height; y++) {
-    for (int x = 0; x < width; x++) {
-      int nY = *pY++;
-      int offset = (y >> 1) * width + 2 * (x >> 1);
+    const uint8* pY = input + y * width;
+    const uint8* pUV = uvData + (y >> 1) * width;
 #ifdef __APPLE__
-      int nU = pUV[offset];
-      int nV = pUV[offset + 1];
+    const uint8* pU = pUV;
+    const uint8* pV = pUV + 1;
 #else
-      int nV = pUV[offset];
-      int nU = pUV[offset + 1];
+    const uint8* pV = pUV;
+    const uint8* pU = pUV + 1;
 #endif
 
-      nY -= 16;
-      nU -= 128;
-      nV -= 128;
-      if (nY < 0) nY = 0;
-
-      // This is the floating point equivalent. We do the conversion in integer
-      // because some Android devices do not have floating point in hardware.
-      // nR = (int)(1.164 * nY + 2.018 * nU);
-      // nG = (int)(1.164 * nY - 0.813 * nV - 0.391 * nU);
-      // nB = (int)(1.164 * nY + 1.596 * nV);
-
-      int nR = (int)(1192 * nY + 1634 * nV);
-      int nG = (int)(1192 * nY - 833 * nV - 400 * nU);
-      int nB = (int)(1192 * nY + 2066 * nU);
-
-      nR = MIN(kMaxChannelValue, MAX(0, nR));
-      nG = MIN(kMaxChannelValue, MAX(0, nG));
-      nB = MIN(kMaxChannelValue, MAX(0, nB));
-
-      // Shift more than for ARGB8888 and apply appropriate bitmask.
-      nR = (nR >> 13) & 0x1f;
-      nG = (nG >> 12) & 0x3f;
-      nB = (nB >> 13) & 0x1f;
-
-      // R is high 5 bits, G is middle 6 bits, and B is low 5 bits.
-      *out++ = (nR << 11) | (nG << 5) | nB;
+    int x = YUVRowToRGB565Simd(path, pY, pU, pV, 2, out, width);
+    for (; x < width; x++) {
+      const int offset = 2 * (x >> 1);
+      out[x] = YUV2RGB565(pY[x], pU[offset], pV[offset]);
     }
+    out += width;
   }
 }
@@ -27,6 +27,61 @@ using namespace tensorflow;
 extern "C" {
 #endif
 
+// This value is 2 ^ 18 - 1, and is used to clamp the RGB values before their
+// ranges are normalized to eight bits.
+static const int kMaxChannelValue = 262143;
+
+// Converts a single YUV sample to eight bit RGB channels. All of the routines
+// below produce exactly these values.
+static inline void YUVToRGB(int nY, int nU, int nV, int* const r, int* const g,
+                            int* const b) {
+  nY -= 16;
+  nU -= 128;
+  nV -= 128;
+  if (nY < 0) nY = 0;
+
+  // This is the floating point equivalent. We do the conversion in integer
+  // because some Android devices do not have floating point in hardware.
+  // nR = (int)(1.164 * nY + 2.018 * nU);
+  // nG = (int)(1.164 * nY - 0.813 * nV - 0.391 * nU);
+  // nB = (int)(1.164 * nY + 1.596 * nV);
+
+  int nR = (int)(1192 * nY + 1634 * nV);
+  int nG = (int)(1192 * nY - 833 * nV - 400 * nU);
+  int nB = (int)(1192 * nY + 2066 * nU);
+
+  nR = nR < 0 ? 0 : (nR > kMaxChannelValue ? kMaxChannelValue : nR);
+  nG = nG < 0 ? 0 : (nG > kMaxChannelValue ? kMaxChannelValue : nG);
+  nB = nB < 0 ? 0 : (nB > kMaxChannelValue ? kMaxChannelValue : nB);
+
+  *r = (nR >> 10) & 0xff;
+  *g = (nG >> 10) & 0xff;
+  *b = (nB >> 10) & 0xff;
+}
+
+// The implementations available for the conversion routines here and in
+// rgb2yuv.h. Every path produces bit-identical output; the vector paths
+// convert 8 (SSE2) or 16 (NEON) pixels per iteration.
+enum ImageUtilsSimdPath {
+  kImageUtilsScalar = 0,
+  kImageUtilsSse2 = 1,
+  kImageUtilsNeon = 2,
+};
+
+// Returns the fastest path supported by the CPU this is running on. The CPU
+// is only probed once.
+int GetSupportedImageUtilsSimdPath();
+
+// Returns the path currently used by the conversion routines. Unless
+// overridden, this is the supported path.
+int GetImageUtilsSimdPath();
+
+// Forces the conversion routines onto the given path, e.g. to compare the
+// vector and scalar output in tests and benchmarks. Requests for a path the
+// CPU does not support fall back to the scalar path. Pass -1 to restore the
+// default.
+void SetImageUtilsSimdPath(int path);
+
 void ConvertYUV420ToARGB8888(const uint8* const yData, const uint8* const uData,
                              const uint8* const vData, uint32* const output,
                              const int width, const int height,
@@ -0,0 +1,155 @@
+/* Copyright 2016 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/examples/android/jni/yuv_preprocessor.h"
+
+#include <algorithm>
+
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/examples/android/jni/yuv2rgb.h"
+
+namespace tensorflow {
+namespace android {
+
+namespace {
+
+// Output pixels are visited in square tiles so that rotated frames, which
+// read the source planes column-wise, stay within a few cache lines.
+const int kTileSize = 16;
+
+}  // namespace
+
+YUVPreprocessor::YUVPreprocessor(const int output_size, const int image_mean,
+                                 const float image_std)
+    : output_size_(output_size),
+      frame_width_(0),
+      frame_height_(0),
+      y_row_stride_(0),
+      uv_row_stride_(0),
+      uv_pixel_stride_(0) {
+  for (int i = 0; i < 256; ++i) {
+    normalized_[i] = (static_cast<float>(i) - image_mean) / image_std;
+  }
+  y_col_offsets_.resize(output_size_);
+  uv_col_offsets_.resize(output_size_);
+  y_row_offsets_.resize(output_size_);
+  uv_row_offsets_.resize(output_size_);
+}
+
+void YUVPreprocessor::UpdateSampling(const YUV420Frame& frame) {
+  if (frame.width == frame_width_ && frame.height == frame_height_ &&
+      frame.y_row_stride == y_row_stride_ &&
+      frame.uv_row_stride == uv_row_stride_ &&
+      frame.uv_pixel_stride == uv_pixel_stride_) {
+    return;
+  }
+  frame_width_ = frame.width;
+  frame_height_ = frame.height;
+  y_row_stride_ = frame.y_row_stride;
+  uv_row_stride_ = frame.uv_row_stride;
+  uv_pixel_stride_ = frame.uv_pixel_stride;
+
+  // We only want the center square out of the original rectangle.
+  const int min_dim = std::min(frame.width, frame.height);
+  const int crop_x = (frame.width - min_dim) / 2;
+  const int crop_y = (frame.height - min_dim) / 2;
+
+  // Nearest neighbor sampling picks the source pixel under the center of
+  // each output pixel.
+  for (int i = 0; i < output_size_; ++i) {
+    const int offset = ((2 * i + 1) * min_dim) / (2 * output_size_);
+    const int x = crop_x + offset;
+    const int y = crop_y + offset;
+    y_col_offsets_[i] = x;
+    uv_col_offsets_[i] = (x >> 1) * uv_pixel_stride_;
+    y_row_offsets_[i] = y * y_row_stride_;
+    uv_row_offsets_[i] = (y >> 1) * uv_row_stride_;
+  }
+}
+
+template <int kRotation>
+void YUVPreprocessor::ProcessRotated(const YUV420Frame& frame,
+                                     float* const output) const {
+  const int size = output_size_;
+  const int last = size - 1;
+
+  for (int tile_row = 0; tile_row < size; tile_row += kTileSize) {
+    const int row_end = std::min(tile_row + kTileSize, size);
+    for (int tile_col = 0; tile_col < size; tile_col += kTileSize) {
+      const int col_end = std::min(tile_col + kTileSize, size);
+
+      for (int i = tile_row; i < row_end; ++i) {
+        float* out = output + (i * size + tile_col) * 3;
+        for (int j = tile_col; j < col_end; ++j) {
+          // Index of the sample in the unrotated crop which lands on output
+          // pixel (i, j) after a clockwise rotation.
+          int sx, sy;
+          switch (kRotation) {
+            case 90:
+              sx = i;
+              sy = last - j;
+              break;
+            case 180:
+              sx = last - j;
+              sy = last - i;
+              break;
+            case 270:
+              sx = last - i;
+              sy = j;
+              break;
+            default:
+              sx = j;
+              sy = i;
+              break;
+          }
+
+          const int uv_offset = uv_row_offsets_[sy] + uv_col_offsets_[sx];
+          int r, g, b;
+          YUVToRGB(frame.y[y_row_offsets_[sy] + y_col_offsets_[sx]],
+                   frame.u[uv_offset], frame.v[uv_offset], &r, &g, &b);
+          out[0] = normalized_[r];
+          out[1] = normalized_[g];
+          out[2] = normalized_[b];
+          out += 3;
+        }
+      }
+    }
+  }
+}
+
+void YUVPreprocessor::Process(const YUV420Frame& frame, const int rotation,
+                              float* const output) {
+  UpdateSampling(frame);
+
+  switch (((rotation % 360) + 360) % 360) {
+    case 0:
+      ProcessRotated<0>(frame, output);
+      break;
+    case 90:
+      ProcessRotated<90>(frame, output);
+      break;
+    case 180:
+      ProcessRotated<180>(frame, output);
+      break;
+    case 270:
+      ProcessRotated<270>(frame, output);
+      break;
+    default:
+      LOG(FATAL) << "Unsupported rotation: " << rotation;
+  }
+}
+
+}  // namespace android
+}  // namespace tensorflow
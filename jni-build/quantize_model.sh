@@ -0,0 +1,34 @@
+#!/bin/bash
+# Rewrites the float model of the demo into an eight bit one with
+# contrib/quantization/tools/quantize_graph.py. Weights are stored as eight
+# bit values with their ranges, and Conv2D, BiasAdd, Relu and MatMul run on
+# the quantized kernels; other ops are wrapped in Dequantize and QuantizeV2.
+# The kernels are only linked into the demo when it is built with
+#   ndk-build ENABLE_QUANTIZED_OPS=1
+#
+# quantize_graph must have been built in the TensorFlow checkout:
+#   bazel build //tensorflow/contrib/quantization/tools:quantize_graph
+#
+# Usage: ./quantize_model.sh [float graph] [eight bit graph]
+# Compare the two with the host benchmark before switching the app:
+#   ./detector_benchmark --graph=<eight bit graph> \
+#       --reference_graph=<float graph> --frames=<dir>
+
+TENSORFLOW_ROOT=${TENSORFLOW_ROOT:-../../tensorflow}
+ASSETS=../app/src/main/assets
+INPUT=${1:-$ASSETS/android_graph.pb}
+OUTPUT=${2:-$ASSETS/android_graph_quantized.pb}
+OUTPUT_NODE=${OUTPUT_NODE:-19_fc}
+
+QUANTIZE_GRAPH=$TENSORFLOW_ROOT/bazel-bin/tensorflow/contrib/quantization/tools/quantize_graph
+if [ ! -x "$QUANTIZE_GRAPH" ]; then
+  echo "$QUANTIZE_GRAPH not found; build it in $TENSORFLOW_ROOT first." >&2
+  exit 1
+fi
+
+"$QUANTIZE_GRAPH" \
+  --input="$INPUT" \
+  --output="$OUTPUT" \
+  --output_node_names="$OUTPUT_NODE" \
+  --mode=eightbit || exit 1
+echo "Wrote $OUTPUT ($(du -h "$OUTPUT" | cut -f1), float: $(du -h "$INPUT" | cut -f1))"
@@ -0,0 +1,55 @@
+#!/bin/bash
+# Sweeps the session threading settings of the demo on a connected device and
+# prints the average inference time for each.
+#
+# The native library must be built with a run limit, so that the app exits
+# after a fixed number of frames:
+#   ndk-build APP_CFLAGS=-DMAX_NUM_RUNS=50 && make install
+# and the camera activity must be startable from the shell, e.g. after
+# `adb root`. Each setting runs in a fresh process, because TensorFlow sizes
+# its intra-op thread pool once per process.
+#
+# The values swept can be overridden through the environment, e.g.
+#   INTRA="2 4" AFFINITY="0 fastest f0" ./sweep_threading.sh
+
+PACKAGE=org.tensorflow.demo
+ACTIVITY=$PACKAGE/.CameraActivity
+INTRA=${INTRA:-"1 2 4"}
+INTER=${INTER:-"1 2"}
+PER_SESSION=${PER_SESSION:-"0 1"}
+AFFINITY=${AFFINITY:-"0 fastest"}
+TIMEOUT=${TIMEOUT:-300}
+
+printf "%-6s %-6s %-12s %-9s %s\n" intra inter per_session affinity result
+for intra in $INTRA; do
+  for inter in $INTER; do
+    for per_session in $PER_SESSION; do
+      for affinity in $AFFINITY; do
+        adb shell setprop debug.tensorflow.intra_op_threads "$intra"
+        adb shell setprop debug.tensorflow.inter_op_threads "$inter"
+        adb shell setprop debug.tensorflow.use_per_session_threads "$per_session"
+        adb shell setprop debug.tensorflow.cpu_affinity_mask "$affinity"
+        adb shell am force-stop $PACKAGE
+        adb logcat -c
+        adb shell am start -n $ACTIVITY > /dev/null
+
+        # The app exits by itself once the run limit is reached.
+        sleep 2
+        for ((i = 0; i < TIMEOUT; ++i)); do
+          adb shell pidof $PACKAGE > /dev/null || break
+          sleep 1
+        done
+        result=$(adb logcat -d -s native:I | grep -o "Benchmark complete.*" |
+                 tail -n 1)
+        printf "%-6s %-6s %-12s %-9s %s\n" "$intra" "$inter" "$per_session" \
+          "$affinity" "${result:-no result}"
+      done
+    done
+  done
+done
+
+# Leave the device with the settings of the app.
+for property in intra_op_threads inter_op_threads use_per_session_threads \
+    cpu_affinity_mask; do
+  adb shell setprop debug.tensorflow.$property "''"
+done